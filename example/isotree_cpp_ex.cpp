@@ -61,6 +61,7 @@ int main()
     fit_iforest(NULL, &iso,
                 X.data(),  ncol,
                 NULL,    0,    NULL,
+                0,       0,
                 NULL, NULL, NULL,
                 2, 3, Normal, false,
                 NULL, false, false,
@@ -71,7 +72,7 @@ int main()
                 NULL, false,
                 0., 0.,
                 0.,  0.,
-                0., Impute,
+                0., 0, false, Impute,
                 SubSet, Smallest,
                 false, NULL, 0,
                 Higher, Inverse, false,
@@ -82,11 +83,13 @@ int main()
     std::vector<double> outlier_scores(nrow);
     predict_iforest(X.data(), NULL,
                     true, ncol, 0,
+                    0, 0,
                     NULL, NULL, NULL,
                     NULL, NULL, NULL,
                     nrow, 1, true,
                     NULL, &iso,
-                    outlier_scores.data(), NULL);
+                    outlier_scores.data(), NULL,
+                    NULL);
 
     int row_highest = which_max(outlier_scores);
     std::cout << "Point with highest outlier score: [";
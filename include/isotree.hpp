@@ -84,6 +84,9 @@ typedef enum  GainCriterion  {Averaged, Pooled,   NoCrit}      Criterion;      /
 typedef enum  CoefType       {Uniform,  Normal}                CoefType;       /* For extended model */
 typedef enum  UseDepthImp    {Lower,    Higher,   Same}        UseDepthImp;    /* For NA imputation */
 typedef enum  WeighImpRows   {Inverse,  Prop,     Flat}        WeighImpRows;   /* For NA imputation */
+typedef enum  NumericColFormat {ColFloat64, ColFloat32, ColFloat16, ColBFloat16,
+                                ColInt8,    ColUInt8,   ColInt16,   ColUInt16} NumericColFormat; /* For compiled models */
+typedef enum  MappedAccess   {NormalAccess, SequentialAccess, RandomAccess} MappedAccess; /* For memory-mapped data */
 
 /* Notes about new categorical action:
 *  - For single-variable case, if using 'Smallest', can then pass data at prediction time
@@ -293,6 +296,245 @@ typedef struct Imputer {
 
 } Imputer;
 
+/* Read-only version of a single-variable model, meant only for making predictions faster.
+   The nodes from all the trees are laid out in a single flat array, in breadth-first order
+   within each tree and with the two children of a node next to each other, keeping only
+   what's needed for traversal in the node itself, while the range limits (when using
+   'penalize_range') and the categorical splits are kept in separate arrays.
+   Obtained through function 'compile_isoforest'. */
+typedef struct CompiledNode {
+    double    split_point; /* holds the score in terminal nodes, and index in 'cat_splits' for categorical */
+    uint32_t  col_num;     /* holds the terminal node number in terminal nodes, has flags in the upper bits otherwise */
+    uint32_t  child_left;  /* right child is 'child_left + 1', zero for terminal nodes */
+
+    #ifdef _ENABLE_CEREAL
+    template<class Archive>
+    void serialize(Archive &archive)
+    {
+        archive(
+            this->split_point,
+            this->col_num,
+            this->child_left
+            );
+    }
+    #endif
+
+    CompiledNode() = default;
+} CompiledNode;
+
+typedef struct CompiledCategSplit {
+    uint32_t  offset;      /* position in 'cat_bits' where the bitset for this node starts */
+    int       ncat;        /* number of categories in the bitset, zero when splitting by 'chosen_cat' */
+    int       chosen_cat;
+    bool      new_to_left; /* where categories beyond 'ncat' go */
+
+    #ifdef _ENABLE_CEREAL
+    template<class Archive>
+    void serialize(Archive &archive)
+    {
+        archive(
+            this->offset,
+            this->ncat,
+            this->chosen_cat,
+            this->new_to_left
+            );
+    }
+    #endif
+
+    CompiledCategSplit() = default;
+} CompiledCategSplit;
+
+typedef struct CompiledIsoForest {
+    std::vector<CompiledNode>        nodes;
+    std::vector<size_t>              tree_root;
+    std::vector<double>              range_low;  /* empty when the model has no range penalties */
+    std::vector<double>              range_high; /* empty when the model has no range penalties */
+    std::vector<CompiledCategSplit>  cat_splits;
+    std::vector<uint64_t>            cat_bits;
+    std::vector<NumericColFormat>    col_format; /* empty unless quantized through 'quantize_compiled_model' */
+    MissingAction     missing_action;
+    double            exp_avg_depth;
+
+    #ifdef _ENABLE_CEREAL
+    template<class Archive>
+    void serialize(Archive &archive)
+    {
+        archive(
+            this->nodes,
+            this->tree_root,
+            this->range_low,
+            this->range_high,
+            this->cat_splits,
+            this->cat_bits,
+            this->col_format,
+            this->missing_action,
+            this->exp_avg_depth
+            );
+    }
+    #endif
+
+    CompiledIsoForest() = default;
+} CompiledIsoForest;
+
+/* Read-only version of an extended model, meant only for making predictions faster, laid out
+   in the same way as 'CompiledIsoForest'. The column indices and coefficients of each node are
+   contiguous in 'col_num' and 'coef', and the means of the columns are already accounted for in
+   the split points, range limits and imputation values, so that a node only needs a dot product.
+   Only supports models without categorical columns. Obtained through 'compile_ext_isoforest'. */
+typedef struct CompiledHPlane {
+    double    split_point; /* holds the score in terminal nodes */
+    uint32_t  col_st;      /* position of the first column in 'col_num' and 'coef', holds the terminal node number in terminal nodes */
+    uint32_t  ncols;
+    uint32_t  child_left;  /* right child is 'child_left + 1', zero for terminal nodes */
+
+    #ifdef _ENABLE_CEREAL
+    template<class Archive>
+    void serialize(Archive &archive)
+    {
+        archive(
+            this->split_point,
+            this->col_st,
+            this->ncols,
+            this->child_left
+            );
+    }
+    #endif
+
+    CompiledHPlane() = default;
+} CompiledHPlane;
+
+typedef struct CompiledExtIsoForest {
+    std::vector<CompiledHPlane>  hplanes;
+    std::vector<size_t>          tree_root;
+    std::vector<uint32_t>        col_num;
+    std::vector<double>          coef;
+    std::vector<double>          fill_val;   /* empty when the model doesn't impute missing values */
+    std::vector<double>          range_low;  /* empty when the model has no range penalties */
+    std::vector<double>          range_high; /* empty when the model has no range penalties */
+    MissingAction     missing_action;
+    double            exp_avg_depth;
+
+    #ifdef _ENABLE_CEREAL
+    template<class Archive>
+    void serialize(Archive &archive)
+    {
+        archive(
+            this->hplanes,
+            this->tree_root,
+            this->col_num,
+            this->coef,
+            this->fill_val,
+            this->range_low,
+            this->range_high,
+            this->missing_action,
+            this->exp_avg_depth
+            );
+    }
+    #endif
+
+    CompiledExtIsoForest() = default;
+} CompiledExtIsoForest;
+
+/* Mapping from the node indices in the trees of a model to the numbers of their terminal nodes, as output
+   in 'tree_num' by the prediction functions, stored contiguously for all the trees. Terminal node numbers
+   start at zero in each tree, while 'terminal_offset' contains the position at which the terminal nodes of
+   each tree start when numbering them across all the trees (e.g. as columns of a leaf embedding).
+   Obtained through 'build_terminal_mapping', and needs to be rebuilt if the model gets modified. */
+typedef struct TerminalNodeMapping {
+    std::vector<size_t>  terminal_num;    /* terminal number of node 'node' from tree 'tree' is at 'node_offset[tree] + node' */
+    std::vector<size_t>  node_offset;     /* has one entry per tree plus one, last one being the total number of nodes */
+    std::vector<size_t>  terminal_offset; /* has one entry per tree plus one, last one being the total number of terminal nodes */
+
+    #ifdef _ENABLE_CEREAL
+    template<class Archive>
+    void serialize(Archive &archive)
+    {
+        archive(
+            this->terminal_num,
+            this->node_offset,
+            this->terminal_offset
+            );
+    }
+    #endif
+
+    TerminalNodeMapping() = default;
+} TerminalNodeMapping;
+
+/* Object for making predictions repeatedly on small batches of dense data (e.g. one row at a time) with
+   as little overhead as possible. Holds a compiled version of the model when it can be compiled, and
+   otherwise a mapping from tree nodes to terminal node numbers, so that predictions on it do not need to
+   allocate any memory. Batches with fewer than 'min_rows_parallel' rows are scored in the calling thread
+   without starting a parallel region. Keeps a pointer to the model from which it was created, which must
+   outlive it and must not be modified while it is in use. Obtained through 'prepare_predictor'. */
+typedef struct IsoForestPredictor {
+    IsoForest                         *model_outputs;
+    ExtIsoForest                      *model_outputs_ext;
+    bool                              is_compiled;
+    CompiledIsoForest                 compiled_model;
+    CompiledExtIsoForest              compiled_model_ext;
+    TerminalNodeMapping               terminal_mapping; /* empty when the model is compiled */
+    int                               nthreads;
+    size_t                            min_rows_parallel;
+
+    IsoForestPredictor() = default;
+} IsoForestPredictor;
+
+/* Read-only memory mapping of a matrix stored in raw binary files, in either dense column-major format
+   (a single file) or CSC format (one file each for values, row indices and column pointers). The data is
+   shared with every other process that maps the same files, and the pointers can be passed as inputs to
+   the fitting and prediction functions (e.g. 'values' as 'numeric_data' or 'Xc', 'indices' as 'Xc_ind').
+   When fitting to memory-mapped dense data, the OS is told ahead of time which pages contain the rows
+   that were sampled for each tree. Obtained through 'map_dense_matrix' or 'map_csc_matrix', and must
+   be released through 'unmap_matrix'. */
+typedef struct MappedMatrix {
+    void    *values  = NULL;  /* dense data, or non-zero values for CSC matrices */
+    void    *indices = NULL;  /* only for CSC matrices */
+    void    *indptr  = NULL;  /* only for CSC matrices */
+    size_t  values_bytes  = 0;
+    size_t  indices_bytes = 0;
+    size_t  indptr_bytes  = 0;
+    size_t  nrows = 0;
+    size_t  ncols = 0;
+    size_t  nnz   = 0;        /* only for CSC matrices */
+
+    MappedMatrix() = default;
+} MappedMatrix;
+
+/* Function that receives the tiles of distances produced by 'calc_similarity_tiled', as a row-major matrix
+   of 'nrows_tile' query rows (starting at 'row_st') by 'ncols_tile' reference rows (starting at 'col_st') */
+typedef void (*SimilarityTileCallback)(const double *tile, size_t row_st, size_t col_st,
+                                       size_t nrows_tile, size_t ncols_tile, void *callback_data);
+
+/* Terminal node in which each row of the data to which a model was fit falls in each tree, from which the
+   distances between those rows can be calculated without passing them through the trees again. Terminal
+   nodes are numbered as in 'tree_num' in the prediction functions, and are bit-packed using 'bits_per_leaf'
+   bits for each, with the largest number that fits in those bits standing for rows that do not end up in a
+   single terminal node. Obtained through 'build_training_leaf_index', and needs to be rebuilt if the model
+   gets modified. */
+typedef struct TrainingLeafIndex {
+    size_t                nrows = 0;
+    size_t                ntrees = 0;
+    size_t                bits_per_leaf = 0;
+    size_t                words_per_tree = 0;
+    std::vector<uint64_t> leaves;  /* the rows of tree 'tree' start at 'leaves[tree * words_per_tree]' */
+
+    #ifdef _ENABLE_CEREAL
+    template<class Archive>
+    void serialize(Archive &archive)
+    {
+        archive(
+            this->nrows,
+            this->ntrees,
+            this->bits_per_leaf,
+            this->words_per_tree,
+            this->leaves
+            );
+    }
+    #endif
+
+    TrainingLeafIndex() = default;
+} TrainingLeafIndex;
+
 #endif /* ISOTREE_H */
 
 /*  Fit Isolation Forest model, or variant of it such as SCiForest
@@ -329,6 +571,14 @@ typedef struct Imputer {
 * - ncat[ncols_categ]
 *       Number of categories in each categorical column. E.g. if the highest code for a column is '4',
 *       the number of categories for that column is '5' (zero is one category).
+* - ld_numeric
+*       Leading dimension of 'numeric_data', i.e. the distance (in number of entries) between the start
+*       of one column and the start of the next one. Passing a value larger than 'nrows' allows fitting
+*       to a subset of the rows of a larger column-major array without copying it. Pass zero to assume
+*       that it is the same as 'nrows'. Ignored when the numeric data is sparse.
+* - ld_categ
+*       Leading dimension of 'categ_data', with the same meaning as 'ld_numeric'. Pass zero to assume
+*       that it is the same as 'nrows'.
 * - Xc[nnz]
 *       Pointer to numeric data in sparse numeric matrix in CSC format (column-compressed).
 *       Pass NULL if there are no sparse numeric columns.
@@ -406,7 +656,8 @@ typedef struct Imputer {
 *       Array in which to calculate average separation depths or standardized distance metric (see documentation
 *       for 'standardize_dist') as the model is being fit. Pass NULL to avoid doing these calculations alongside
 *       the regular model process. If passing this output argument, the sample size must be the same as the number
-*       of rows, and there cannot be sample weights. If not NULL, must already be initialized to zeros. As the
+*       of rows, and there cannot be sample weights. If not NULL, must already be initialized to zeros. All
+*       threads add into this same array, so its memory usage does not grow with the number of threads. As the
 *       output is a symmetric matrix, this function will only fill in the upper-triangular part, in which
 *       entry 0 <= i < j < n will be located at position
 *           p(i,j) = (i * (n - (i+1)/2) + j - i - 1).
@@ -481,6 +732,22 @@ typedef struct Imputer {
 *       Minimum gain that a split threshold needs to produce in order to proceed with a split. Only used when the splits
 *       are decided by a gain criterion (either pooled or averaged). If the highest possible gain in the evaluated
 *       splits at a node is below this  threshold, that node becomes a terminal node.
+* - max_bins
+*       When splits are decided by a gain criterion in the single-variable model, numeric columns from dense data can be
+*       discretized into at most this many bins (up to 255) before fitting, with roughly the same number of observations
+*       in each bin. Gains are then evaluated only for splits between bins, calculated from statistics of each bin rather
+*       than by sorting the values at each node, which is much faster for large sample sizes. Nodes with few observations
+*       are still evaluated exactly. Pass zero to always evaluate all possible splits. In that case, if there are no missing
+*       values (or if passing "Fail" for 'missing_action'), the numeric columns might be sorted only once per tree and have
+*       their order passed down to each node, which requires additional memory for 'sample_size' indices per numeric column
+*       and per thread.
+* - compensated_sums
+*       In the extended model, whether to calculate the means and standard deviations of dense numeric columns at each
+*       node (used to standardize them in the linear combinations) with sums in 'double' precision spread over multiple
+*       lanes, using compensated (Neumaier) summation for nodes with at least 1e6 observations, instead of the default
+*       running (Welford) calculation, which uses 'long double' for such nodes. This can be computed with SIMD instructions
+*       and is much faster, and its results do not depend on the CPU, but the means and standard deviations will differ in
+*       the last digits from those of the default, and hence so will the fitted model. Not used with sparse data or weights.
 * - missing_action
 *       How to handle missing data at both fitting and prediction time. Options are a) "Divide" (for the single-variable
 *       model only, recommended), which will follow both branches and combine the result with the weight given by the fraction of
@@ -549,6 +816,11 @@ typedef struct Imputer {
 *       'categ_data', and 'Xc', will get overwritten with the imputations produced.
 * - random_seed
 *       Seed that will be used to generate random numbers used by the model.
+*       Note that when 'sample_size' is at least 65536 (and there is no imputer, 'missing_action' is not
+*       'Divide', and weights are not used as densities), the larger branches of each tree are grown as
+*       separate subtrees seeded from the tree's own random number generator, so the resulting model
+*       will differ from the one produced for the same seed by versions of this library which grew each
+*       tree in one go. Results are still reproducible for a given seed regardless of 'nthreads'.
 * - nthreads
 *       Number of parallel threads to use. Note that, the more threads, the more memory will be
 *       allocated, even if the thread does not end up being used.
@@ -557,6 +829,9 @@ typedef struct Imputer {
 *       (e.g. large sparse matrices with small sample sizes), adding more threads might result
 *       in only a very modest speed up (e.g. 1.5x faster with 4x more threads),
 *       even if all threads look fully utilized.
+*       When the sample size is large, bigger subtrees are grown by separate threads, which allows
+*       using more threads than there are trees. The resulting model does not depend on the number
+*       of threads.
 * 
 * Returns
 * =======
@@ -589,6 +864,7 @@ typedef struct Imputer {
 int fit_iforest(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
                 real_t numeric_data[],  size_t ncols_numeric,
                 int    categ_data[],    size_t ncols_categ,    int ncat[],
+                size_t ld_numeric,      size_t ld_categ,
                 real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
                 size_t ndim, size_t ntry, CoefType coef_type, bool coef_by_prop,
                 real_t sample_weights[], bool with_replacement, bool weight_as_sample,
@@ -600,7 +876,7 @@ int fit_iforest(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
                 double col_weights[], bool weigh_by_kurt,
                 double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
                 double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
-                double min_gain, MissingAction missing_action,
+                double min_gain, size_t max_bins, bool compensated_sums, MissingAction missing_action,
                 CategSplit cat_split_type, NewCategAction new_cat_action,
                 bool   all_perm, Imputer *imputer, size_t min_imp_obs,
                 UseDepthImp depth_imp, WeighImpRows weigh_imp_rows, bool impute_at_fit,
@@ -763,6 +1039,96 @@ int add_tree(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
              uint64_t random_seed);
 
 
+/* Fit Isolation Forest model to data that is read in chunks from a stream, taking the sample of rows
+*  for each tree while the data is read, in a single pass over it
+* 
+* Only the rows that end up in the sample of some tree are kept in memory, so the data does not need
+* to fit in memory. The samples are taken through weighted reservoirs, which have the same distribution
+* as the sub-samples taken by 'fit_iforest' without replacement (or with replacement, if passing
+* 'with_replacement=true'), but will not be the same rows for a given random seed.
+* 
+* Parameters:
+* ===========
+* - model_outputs (out)
+*       Same parameter as for 'fit_iforest' (see the documentation in there for details).
+* - model_outputs_ext (out)
+*       Same parameter as for 'fit_iforest' (see the documentation in there for details).
+* - read_chunk
+*       Function that reads the next rows from the stream. It will be called with 'reader_state', with
+*       pointers to arrays where to write the numeric data, categorical data, and sample weights of up to
+*       'max_rows' rows, and with 'max_rows' (which will be equal to 'chunk_size'), and must return the
+*       number of rows that it wrote, or zero once there are no more rows. The data is to be written in
+*       column-major order, with 'max_rows' as leading dimension (i.e. column 'col' of row 'row' goes in
+*       entry 'row + col * max_rows'), and with the same encoding as for 'fit_iforest'. The pointers will
+*       be NULL when there are no columns of a given type or no sample weights.
+* - reader_state
+*       Pointer that will be passed to 'read_chunk' in each call.
+* - chunk_size
+*       Maximum number of rows to read from the stream in each call to 'read_chunk'.
+* - ncols_numeric
+*       Number of numeric columns in the data. Only dense numeric data is supported.
+* - ncols_categ
+*       Number of categorical columns in the data.
+* - ncat[ncols_categ]
+*       Same parameter as for 'fit_iforest' (see the documentation in there for details).
+* - ndim, ntry, coef_type, coef_by_prop
+*       Same parameters as for 'fit_iforest' (see the documentation in there for details).
+* - has_weights
+*       Whether 'read_chunk' will produce sample weights for the rows. These are taken either as sampling
+*       importances or as density measurements according to 'weight_as_sample', same as the weights in
+*       'fit_iforest'. Rows with a sampling importance of zero or less are never taken.
+* - with_replacement, weight_as_sample
+*       Same parameters as for 'fit_iforest' (see the documentation in there for details).
+* - sample_size
+*       Sample size of the data sub-samples with which each binary tree will be built. Must be passed,
+*       as the number of rows in the stream is not known. If the stream ends up having fewer rows
+*       (with non-zero weight) than this, and sampling without replacement, the trees will be built
+*       with all of them.
+* - ntrees, max_depth, ncols_per_tree, limit_depth, penalize_range, col_weights, weigh_by_kurt,
+*   prob_pick_by_gain_avg, prob_split_by_gain_avg, prob_pick_by_gain_pl, prob_split_by_gain_pl,
+*   min_gain, max_bins, compensated_sums, missing_action, cat_split_type, new_cat_action, all_perm
+*       Same parameters as for 'fit_iforest' (see the documentation in there for details).
+* - imputer, min_imp_obs, depth_imp, weigh_imp_rows
+*       Same parameters as for 'fit_iforest' (see the documentation in there for details). Missing values
+*       cannot be imputed at fit time, as the rows are not kept.
+* - random_seed
+*       Seed that will be used to generate random numbers used by the model.
+* - nthreads
+*       Number of parallel threads to use. Note that the reservoirs for each tree are updated in
+*       parallel for each chunk, but the chunks are read one at a time by the calling thread.
+* 
+* Returns
+* =======
+* Will return macro 'EXIT_SUCCESS' (typically =0) upon completion.
+* If the process receives an interrupt signal, will return instead
+* 'EXIT_FAILURE' (typically =1).
+* 
+* References
+* ==========
+* [1] Efraimidis, Pavlos S., and Paul G. Spirakis.
+*     "Weighted random sampling with a reservoir."
+*     Information Processing Letters 97.5 (2006): 181-185.
+*/
+int fit_iforest_stream(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                       size_t (*read_chunk)(void *reader_state, real_t numeric_data[], int categ_data[],
+                                            real_t sample_weights[], size_t max_rows),
+                       void *reader_state, size_t chunk_size,
+                       size_t ncols_numeric, size_t ncols_categ, int ncat[],
+                       size_t ndim, size_t ntry, CoefType coef_type, bool coef_by_prop,
+                       bool has_weights, bool with_replacement, bool weight_as_sample,
+                       size_t sample_size, size_t ntrees,
+                       size_t max_depth, size_t ncols_per_tree,
+                       bool   limit_depth, bool penalize_range,
+                       real_t col_weights[], bool weigh_by_kurt,
+                       double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
+                       double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
+                       double min_gain, size_t max_bins, bool compensated_sums, MissingAction missing_action,
+                       CategSplit cat_split_type, NewCategAction new_cat_action,
+                       bool   all_perm, Imputer *imputer, size_t min_imp_obs,
+                       UseDepthImp depth_imp, WeighImpRows weigh_imp_rows,
+                       uint64_t random_seed, int nthreads);
+
+
 /* Predict outlier score, average depth, or terminal node numbers
 * 
 * Parameters
@@ -802,6 +1168,16 @@ int add_tree(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
 *       of columns to which the model was fit, and when using column-major order, must have
 *       the same number of columns as the data to which the model was fit (i.e. cannot have
 *       new columns).
+* - ld_numeric
+*       Leading dimension of 'numeric_data', i.e. the distance (in number of entries) between the start
+*       of one column and the start of the next one when using column-major order, or between the start
+*       of one row and the start of the next one when using row-major order. Passing a value larger than
+*       'nrows' (column-major) or 'ncols_numeric' (row-major) allows making predictions on a slice of a
+*       larger array without copying it. Pass zero to assume that the data is contiguous.
+*       Ignored when the data is sparse.
+* - ld_categ
+*       Leading dimension of 'categ_data', with the same meaning as 'ld_numeric'. Pass zero to assume
+*       that the data is contiguous.
 * - Xc[nnz]
 *       Pointer to numeric data in sparse numeric matrix in CSC format (column-compressed).
 *       Pass NULL if there are no sparse numeric columns.
@@ -855,15 +1231,320 @@ int add_tree(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
 *       Note that the mapping between tree node and terminal tree node is not stored in
 *       the model object for efficiency reasons, so this mapping will be determined on-the-fly
 *       when passing this parameter, and as such, there will be some overhead regardless of
-*       the actual number of rows. Pass NULL if only average depths or outlier scores are desired.
+*       the actual number of rows, unless passing 'terminal_mapping'. Pass NULL if only average
+*       depths or outlier scores are desired.
+* - terminal_mapping
+*       Pointer to a mapping from tree nodes to terminal node numbers for this same model, as
+*       produced by function 'build_terminal_mapping'. If passed, the terminal node numbers will be
+*       mapped right after passing each block of rows through a tree, without the overhead of
+*       determining the mapping on-the-fly. Pass NULL if not available or if not passing 'tree_num'.
 */
 void predict_iforest(real_t numeric_data[], int categ_data[],
                      bool is_col_major, size_t ncols_numeric, size_t ncols_categ,
+                     size_t ld_numeric, size_t ld_categ,
                      real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
                      real_t Xr[], sparse_ix Xr_ind[], sparse_ix Xr_indptr[],
                      size_t nrows, int nthreads, bool standardize,
                      IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
-                     double output_depths[],   sparse_ix tree_num[]);
+                     double output_depths[],   sparse_ix tree_num[],
+                     TerminalNodeMapping *terminal_mapping);
+
+
+
+/* Determine which rows have an outlier score above a given threshold, stopping early for a row
+* 
+* Will pass the rows through the trees in the same order as 'predict_iforest', but once the depths
+* obtained so far for a given row plus the smallest and largest depths that the remaining trees could
+* possibly produce (which are determined from their terminal nodes, accounting for range penalties)
+* leave no doubt about which side of the threshold the row will end up in, the remaining trees are
+* not evaluated for that row. Rows that are undecided until the last tree get the same score as
+* in 'predict_iforest'. This is typically much faster when most rows are clearly inliers.
+* 
+* Parameters
+* ==========
+* - numeric_data[nrows * ncols_numeric]
+*       Pointer to numeric data for which to make predictions. See the documentation of
+*       'predict_iforest' for details.
+* - categ_data[nrows * ncols_categ]
+*       Pointer to categorical data for which to make predictions. See the documentation of
+*       'predict_iforest' for details.
+* - is_col_major
+*       Whether 'numeric_data' and 'categ_data' come in column-major order.
+* - ncols_numeric
+*       Number of columns in 'numeric_data'.
+* - ncols_categ
+*       Number of columns in 'categ_data'.
+* - ld_numeric
+*       Leading dimension of 'numeric_data'. See the documentation of 'predict_iforest' for details.
+*       Pass zero to assume that the data is contiguous.
+* - ld_categ
+*       Leading dimension of 'categ_data'. Pass zero to assume that the data is contiguous.
+* - Xc[nnz], Xc_ind[nnz], Xc_indptr[ncols_numeric + 1]
+*       Sparse numeric data in CSC format, if the data is sparse. Pass NULL otherwise.
+* - Xr[nnz], Xr_ind[nnz], Xr_indptr[nrows + 1]
+*       Sparse numeric data in CSR format, if the data is sparse. Pass NULL otherwise.
+* - nrows
+*       Number of rows in 'numeric_data', 'Xc', 'Xr, 'categ_data'.
+* - nthreads
+*       Number of parallel threads to use. Ignored when not building with OpenMP support.
+* - threshold
+*       Threshold against which to compare the rows. If 'standardize' is 'true', this is an outlier
+*       score (between zero and one), and rows will be flagged when their score is strictly higher
+*       than it. If 'standardize' is 'false', this is an average depth, and rows will be flagged when
+*       their average depth is strictly lower than it.
+* - standardize
+*       Whether 'threshold' refers to standardized outlier scores or to average depths.
+* - model_outputs
+*       Pointer to fitted single-variable model object from function 'fit_iforest'. Pass NULL
+*       if the predictions are to be made from an extended model. Can only pass one of
+*       'model_outputs' and 'model_outputs_ext'.
+* - model_outputs_ext
+*       Pointer to fitted extended model object from function 'fit_iforest'. Pass NULL
+*       if the predictions are to be made from a single-variable model. Can only pass one of
+*       'model_outputs' and 'model_outputs_ext'.
+* - output_is_outlier[nrows] (out)
+*       Pointer to array where it will be written whether each row lies beyond the threshold.
+* - ntrees_used[nrows] (out)
+*       Pointer to array where the number of trees that were evaluated for each row will be
+*       written into. Pass NULL if not desired.
+*/
+void predict_iforest_threshold(real_t numeric_data[], int categ_data[],
+                               bool is_col_major, size_t ncols_numeric, size_t ncols_categ,
+                               size_t ld_numeric, size_t ld_categ,
+                               real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                               real_t Xr[], sparse_ix Xr_ind[], sparse_ix Xr_indptr[],
+                               size_t nrows, int nthreads, double threshold, bool standardize,
+                               IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                               bool output_is_outlier[], sparse_ix ntrees_used[]);
+
+
+
+/* Compile a single-variable model into a read-only structure for faster predictions
+* 
+* Parameters
+* ==========
+* - model_outputs
+*       Single-variable model object which has already been fit through 'fit_iforest'.
+*       Models fit with 'missing_action=Divide', or with 'new_cat_action=Weighted'
+*       and categorical splits, are not supported, as they need to follow both
+*       branches of a split for some observations.
+* - compiled_model (out)
+*       Object where the compiled model will be written into. Predictions from it can be
+*       obtained through function 'predict_iforest_compiled', and will be the same as
+*       those from 'predict_iforest' on the original model. Note that this object does
+*       not get updated if the original model gets modified afterwards (e.g. by adding
+*       more trees to it), in which case it needs to be compiled again.
+*/
+void compile_isoforest(IsoForest &model_outputs, CompiledIsoForest &compiled_model);
+
+
+
+/* Compile an extended model into a read-only structure for faster predictions
+* 
+* Parameters
+* ==========
+* - model_outputs_ext
+*       Extended model object which has already been fit through 'fit_iforest'.
+*       Models with categorical columns are not supported.
+* - compiled_model_ext (out)
+*       Object where the compiled model will be written into. Predictions from it can be
+*       obtained through function 'predict_iforest_compiled'. Since the means of the columns
+*       get folded into the split points, results might differ from those of 'predict_iforest'
+*       in the last digits of rounding for observations lying exactly at a split. Note that
+*       this object does not get updated if the original model gets modified afterwards.
+*/
+void compile_ext_isoforest(ExtIsoForest &model_outputs_ext, CompiledExtIsoForest &compiled_model_ext);
+
+
+
+/* Quantize the numeric split points of a compiled model to the data types in which each column will be passed
+* 
+* Parameters
+* ==========
+* - compiled_model (in, out)
+*       Single-variable model compiled through 'compile_isoforest', which will be modified in-place.
+*       After this, predictions from it can only be obtained through function 'predict_iforest_mixed',
+*       which reads each numeric column in its own format without converting the data beforehand.
+* - ncols_numeric
+*       Number of numeric columns in the data to which the model was fit.
+* - col_format[ncols_numeric]
+*       Format in which each numeric column will be passed. Floating point formats (ColFloat64, ColFloat32,
+*       ColFloat16, ColBFloat16) are taken as they are, while integer formats (ColInt8, ColUInt8, ColInt16,
+*       ColUInt16) are taken as quantized values 'q' standing for 'col_offset[col] + col_scale[col] * q',
+*       for which the split points and range limits of the model get converted to the equivalent integer
+*       thresholds, so that the results are the same as if the data were decoded to double precision
+*       before making predictions. Integer columns cannot have missing values.
+* - col_scale[ncols_numeric]
+*       Scale of the quantized values of each column. Must be positive for integer formats, and is ignored
+*       for floating point formats. Pass NULL to use a scale of one for all columns.
+* - col_offset[ncols_numeric]
+*       Offset of the quantized values of each column. Ignored for floating point formats. Pass NULL to
+*       use an offset of zero for all columns.
+*/
+void quantize_compiled_model(CompiledIsoForest &compiled_model, size_t ncols_numeric,
+                             NumericColFormat col_format[], double col_scale[], double col_offset[]);
+
+
+
+/* Predict outlier score, average depth, or terminal node numbers from a compiled model
+* 
+* Parameters
+* ==========
+* - numeric_data[nrows * ncols_numeric]
+*       Pointer to numeric data for which to make predictions. May be ordered by rows
+*       (i.e. entries 1..n contain row 0, n+1..2n row 1, etc.) - a.k.a. row-major - or by
+*       columns (i.e. entries 1..n contain column 0, n+1..2n column 1, etc.) - a.k.a. column-major
+*       (see parameter 'is_col_major'). Only dense data is supported.
+*       Pass NULL if there are no numeric columns.
+* - categ_data[nrows * ncols_categ]
+*       Pointer to categorical data for which to make predictions, in the same order as
+*       'numeric_data'. See the documentation of 'predict_iforest' for the encoding.
+*       Pass NULL if there are no categorical columns.
+* - is_col_major
+*       Whether 'numeric_data' and 'categ_data' come in column-major order. If passing 'false',
+*       will assume they are in row-major order, which is the preferred order here.
+* - ncols_numeric
+*       Number of columns in 'numeric_data'. Ignored when the data comes in column-major order.
+* - ncols_categ
+*       Number of columns in 'categ_data'. Ignored when the data comes in column-major order.
+* - ld_numeric
+*       Leading dimension of 'numeric_data'. See the documentation of 'predict_iforest' for details.
+*       Pass zero to assume that the data is contiguous.
+* - ld_categ
+*       Leading dimension of 'categ_data'. Pass zero to assume that the data is contiguous.
+* - nrows
+*       Number of rows in 'numeric_data' and 'categ_data'.
+* - nthreads
+*       Number of parallel threads to use. Ignored when not building with OpenMP support.
+* - standardize
+*       Whether to standardize the average depths for each row according to their relative magnitude
+*       compared to the expected average, in order to obtain an outlier score. If passing 'false',
+*       will output the average depth instead.
+* - compiled_model
+*       Pointer to compiled single-variable model object from function 'compile_isoforest'.
+*       Pass NULL if the predictions are to be made from an extended model. Can only pass one
+*       of 'compiled_model' and 'compiled_model_ext'.
+*       Models quantized through 'quantize_compiled_model' are not accepted here - these
+*       can only be used through 'predict_iforest_mixed'.
+* - compiled_model_ext
+*       Pointer to compiled extended model object from function 'compile_ext_isoforest'.
+*       Pass NULL if the predictions are to be made from a single-variable model. Can only pass
+*       one of 'compiled_model' and 'compiled_model_ext'.
+* - output_depths[nrows] (out)
+*       Pointer to array where the output average depths or outlier scores will be written into.
+*       Must already be initialized to zeros.
+* - tree_num[nrows * ntrees] (out)
+*       Pointer to array where the output terminal node numbers will be written into.
+*       Unlike in 'predict_iforest', the numbers are stored in the compiled model, so
+*       this output has no additional overhead. Pass NULL if not desired.
+*/
+void predict_iforest_compiled(real_t numeric_data[], int categ_data[],
+                              bool is_col_major, size_t ncols_numeric, size_t ncols_categ,
+                              size_t ld_numeric, size_t ld_categ,
+                              size_t nrows, int nthreads, bool standardize,
+                              CompiledIsoForest *compiled_model, CompiledExtIsoForest *compiled_model_ext,
+                              double output_depths[], sparse_ix tree_num[]);
+
+
+
+/* Predict outlier score, average depth, or terminal node numbers from a quantized compiled model,
+   on data in which each numeric column can come in a different format
+* 
+* Parameters
+* ==========
+* - numeric_cols[ncols_numeric]
+*       Pointers to the numeric columns of the data, each of them being an array with 'nrows' entries
+*       in the format that was specified for that column in 'quantize_compiled_model' (e.g. 'uint16_t*'
+*       holding the bits of half-precision numbers for 'ColFloat16', 'int8_t*' for 'ColInt8'). The
+*       columns are read as they are, without converting them to double precision beforehand.
+*       Pass NULL if there are no numeric columns.
+* - categ_data[nrows * ncols_categ]
+*       Pointer to categorical data in column-major order. See the documentation of 'predict_iforest'
+*       for the encoding. Pass NULL if there are no categorical columns.
+* - nrows
+*       Number of rows in the data.
+* - nthreads
+*       Number of parallel threads to use. Ignored when not building with OpenMP support.
+* - standardize
+*       Whether to output standardized outlier scores or average depths.
+* - compiled_model
+*       Compiled single-variable model, quantized through function 'quantize_compiled_model'.
+* - output_depths[nrows] (out)
+*       Pointer to array where the output average depths or outlier scores will be written into.
+*       Must already be initialized to zeros.
+* - tree_num[nrows * ntrees] (out)
+*       Pointer to array where the output terminal node numbers will be written into.
+*       Pass NULL if not desired.
+*/
+void predict_iforest_mixed(void *numeric_cols[], int categ_data[], size_t nrows, int nthreads, bool standardize,
+                           CompiledIsoForest &compiled_model, double output_depths[], sparse_ix tree_num[]);
+
+
+
+/* Prepare an object for making predictions on small batches of data with low overhead
+* 
+* Parameters
+* ==========
+* - model_outputs
+*       Pointer to fitted single-variable model object from function 'fit_iforest'. Pass NULL
+*       if the predictions are to be made from an extended model. Can only pass one of
+*       'model_outputs' and 'model_outputs_ext'.
+* - model_outputs_ext
+*       Pointer to fitted extended model object from function 'fit_iforest'. Pass NULL
+*       if the predictions are to be made from a single-variable model. Can only pass one of
+*       'model_outputs' and 'model_outputs_ext'.
+* - nthreads
+*       Number of parallel threads to use for batches which have at least 'min_rows_parallel' rows.
+* - predictor (out)
+*       Object where the compiled model (if the model can be compiled) or the terminal node mapping
+*       (if it cannot) will be written into. Predictions from it can be obtained through function
+*       'predict_iforest_predictor'. The model objects must not be modified or freed while it is
+*       in use - if the model gets modified, this function needs to be called again.
+*/
+void prepare_predictor(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext, int nthreads,
+                       IsoForestPredictor &predictor);
+
+
+
+/* Predict outlier score, average depth, or terminal node numbers with a prepared predictor object
+* 
+* Parameters
+* ==========
+* - predictor
+*       Object prepared from a fitted model through function 'prepare_predictor'.
+* - numeric_data[nrows * ncols_numeric]
+*       Pointer to numeric data for which to make predictions, in the same format as for
+*       'predict_iforest_compiled'. Only dense data is supported.
+*       Pass NULL if there are no numeric columns.
+* - categ_data[nrows * ncols_categ]
+*       Pointer to categorical data for which to make predictions, in the same format as for
+*       'predict_iforest_compiled'. Pass NULL if there are no categorical columns.
+* - is_col_major
+*       Whether 'numeric_data' and 'categ_data' come in column-major order.
+* - ncols_numeric
+*       Number of columns in 'numeric_data'. Ignored when the data comes in column-major order.
+* - ncols_categ
+*       Number of columns in 'categ_data'. Ignored when the data comes in column-major order.
+* - nrows
+*       Number of rows in 'numeric_data' and 'categ_data'. If this is lower than the predictor's
+*       'min_rows_parallel', the rows will be scored in the calling thread, without any memory
+*       allocations, otherwise this will call 'predict_iforest_compiled' or 'predict_iforest'.
+* - standardize
+*       Whether to standardize the average depths for each row according to their relative magnitude
+*       compared to the expected average, in order to obtain an outlier score. If passing 'false',
+*       will output the average depth instead.
+* - output_depths[nrows] (out)
+*       Pointer to array where the output average depths or outlier scores will be written into.
+*       Must already be initialized to zeros.
+* - tree_num[nrows * ntrees] (out)
+*       Pointer to array where the output terminal node numbers will be written into.
+*       Pass NULL if not desired.
+*/
+void predict_iforest_predictor(IsoForestPredictor &predictor,
+                               real_t numeric_data[], int categ_data[],
+                               bool is_col_major, size_t ncols_numeric, size_t ncols_categ,
+                               size_t nrows, bool standardize,
+                               double output_depths[], sparse_ix tree_num[]);
 
 
 
@@ -887,6 +1568,55 @@ void get_num_nodes(ExtIsoForest &model_outputs, sparse_ix *n_nodes, sparse_ix *n
 
 
 
+/* Build a mapping from tree nodes to terminal node numbers for a model
+* 
+* Parameters
+* ==========
+* - model_outputs
+*       Pointer to fitted single-variable model object from function 'fit_iforest'. Pass NULL
+*       if the mapping is to be built for an extended model. Can only pass one of
+*       'model_outputs' and 'model_outputs_ext'.
+* - model_outputs_ext
+*       Pointer to fitted extended model object from function 'fit_iforest'. Pass NULL
+*       if the mapping is to be built for a single-variable model. Can only pass one of
+*       'model_outputs' and 'model_outputs_ext'.
+* - terminal_mapping (out)
+*       Object where the mapping will be written into. Can be passed to 'predict_iforest' in order
+*       to avoid determining the terminal node numbers on-the-fly on each call, and to
+*       'get_leaf_embedding'. Needs to be built again if the model gets modified afterwards.
+*/
+void build_terminal_mapping(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext, TerminalNodeMapping &terminal_mapping);
+
+
+
+/* Convert terminal node numbers into a sparse one-hot encoded matrix in CSR format
+* 
+* Parameters
+* ==========
+* - tree_num[nrows * ntrees]
+*       Terminal node numbers as output by the prediction functions.
+* - nrows
+*       Number of rows in 'tree_num'.
+* - terminal_mapping
+*       Mapping for the same model that produced 'tree_num', obtained through function
+*       'build_terminal_mapping'. The output matrix will have a number of columns equal
+*       to the total number of terminal nodes across all trees, with the terminal nodes
+*       of each tree placed after those of the previous tree.
+* - nthreads
+*       Number of parallel threads to use.
+* - indptr[nrows + 1] (out)
+*       Array where the row index pointers of the CSR matrix will be written into.
+*       Each row has exactly one non-zero entry per tree, all of them being equal to one,
+*       so the values of the non-zero entries are not output.
+* - indices[nrows * ntrees] (out)
+*       Array where the column indices of the non-zero entries of the CSR matrix will be
+*       written into. These will be sorted within each row.
+*/
+void get_leaf_embedding(sparse_ix tree_num[], size_t nrows, TerminalNodeMapping &terminal_mapping, int nthreads,
+                        sparse_ix indptr[], sparse_ix indices[]);
+
+
+
 /* Calculate distance or similarity between data points
 * 
 * Parameters
@@ -928,9 +1658,9 @@ void get_num_nodes(ExtIsoForest &model_outputs, sparse_ix *n_nodes, sparse_ix *n
 * - nrows
 *       Number of rows in 'numeric_data', 'Xc', 'Xr, 'categ_data'.
 * - nthreads
-*       Number of parallel threads to use. Note that, the more threads, the more memory will be
-*       allocated, even if the thread does not end up being used. Ignored when not building with
-*       OpenMP support.
+*       Number of parallel threads to use. All threads add into the same output matrix, each one into
+*       its own block of rows, so using more threads does not require more memory. Ignored when not
+*       building with OpenMP support.
 * - assume_full_distr
 *       Whether to assume that the fitted model represents a full population distribution (will use a
 *       standardizing criterion assuming infinite sample, and the results of the similarity between two points
@@ -984,6 +1714,406 @@ void calc_similarity(real_t numeric_data[], int categ_data[],
                      double tmat[], double rmat[], size_t n_from);
 
 
+/* Calculate the nearest neighbors of each row, without calculating all the pairwise distances
+* 
+* Calculates the same distances or average separation depths as 'calc_similarity', but outputs only
+* the 'k' closest rows to each row as a sparse matrix in CSR format, so that it can be used with larger
+* datasets for which the full distance matrix would not fit in memory. Rows are arranged by the terminal
+* node in which they fall in each tree, and the candidate neighbors of a row are the rows that share with
+* it the smallest node containing other rows in each tree (taking an evenly-spaced subset when that node
+* has too many rows). The exact distances are then calculated for the candidates that share the deepest
+* nodes with it across trees, up to eight per requested neighbor, so the result might occasionally miss
+* a neighbor that shares deep nodes with a row in few trees only.
+* Rows with missing values in models with 'missing_action=Divide' are taken as separated from all other
+* rows at the root of the trees in which they would have been divided.
+* 
+* Parameters
+* ==========
+* - numeric_data[nrows * ncols_numeric]
+*       Pointer to numeric data for which to make calculations, in the same format as for 'calc_similarity'.
+*       Pass NULL if there are no dense numeric columns.
+* - categ_data[nrows * ncols_categ]
+*       Pointer to categorical data for which to make calculations, in the same format as for 'calc_similarity'.
+*       Pass NULL if there are no categorical columns.
+* - Xc[nnz], Xc_ind[nnz], Xc_indptr[ncols_numeric + 1]
+*       Sparse numeric data in CSC format, in the same format as for 'calc_similarity'.
+*       Pass NULL if there are no sparse numeric columns.
+* - nrows
+*       Number of rows in the data.
+* - nthreads
+*       Number of parallel threads to use. Each thread will allocate an array of size 'nrows'.
+* - assume_full_distr
+*       Same as for 'calc_similarity'.
+* - standardize_dist
+*       Same as for 'calc_similarity'. If passing 'false', the output will be the average separation
+*       depth, for which higher values mean closer rows.
+* - model_outputs
+*       Pointer to fitted single-variable model object from function 'fit_iforest'. Pass NULL
+*       if the calculations are to be made from an extended model. Can only pass one of
+*       'model_outputs' and 'model_outputs_ext'.
+* - model_outputs_ext
+*       Pointer to fitted extended model object from function 'fit_iforest'. Pass NULL
+*       if the calculations are to be made from a single-variable model. Can only pass one of
+*       'model_outputs' and 'model_outputs_ext'.
+* - k
+*       Number of neighbors to output for each row.
+* - knn_indptr[nrows + 1] (out)
+*       Array where the row index pointers of the CSR matrix with the neighbors will be written into.
+*       Rows with fewer than 'k' candidates will have fewer entries.
+* - knn_indices[nrows * k] (out)
+*       Array where the indices of the neighbors of each row will be written into, from the closest
+*       to the farthest (ties are broken by index), at the positions given by 'knn_indptr'.
+* - knn_dist[nrows * k] (out)
+*       Array where the distances or average separation depths to each neighbor will be written into,
+*       in the same positions as 'knn_indices'.
+*/
+void calc_similarity_knn(real_t numeric_data[], int categ_data[],
+                         real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                         size_t nrows, int nthreads, bool assume_full_distr, bool standardize_dist,
+                         IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                         size_t k, sparse_ix knn_indptr[], sparse_ix knn_indices[], double knn_dist[]);
+
+
+/* Calculate the distances between each row in a set of query rows and each row in a set of reference rows,
+   passing them to a callback one tile at a time
+* 
+* Calculates the same distances or average separation depths as 'calc_similarity' with 'rmat' would for the
+* query rows followed by the reference rows, but produces them by tiles of at most 'tile_rows' query rows
+* and 'tile_cols' reference rows, so that the full matrix does not need to be kept in memory. The terminal
+* node of each reference row in each tree is determined once, while the query rows are processed one tile
+* of rows at a time (plus a first pass over all of them for counting how many rows fall in each terminal
+* node, which is skipped when passing 'assume_full_distr=true').
+* Rows with missing values in models with 'missing_action=Divide' are taken as separated from all other
+* rows at the root of the trees in which they would have been divided.
+* 
+* Parameters
+* ==========
+* - numeric_data[nrows * ncols_numeric]
+*       Pointer to numeric data for the query rows, in the same format as for 'predict_iforest'.
+*       Pass NULL if there are no dense numeric columns.
+* - categ_data[nrows * ncols_categ]
+*       Pointer to categorical data for the query rows, in the same format as for 'predict_iforest'.
+*       Pass NULL if there are no categorical columns.
+* - is_col_major
+*       Whether the dense inputs (both for the query and the reference rows) are in column-major order.
+* - ncols_numeric
+*       Number of numeric columns. Only required when passing row-major dense data.
+* - ncols_categ
+*       Number of categorical columns. Only required when passing row-major dense data.
+* - Xr[nnz], Xr_ind[nnz], Xr_indptr[nrows + 1]
+*       Sparse numeric data for the query rows in CSR format, in the same format as for 'predict_iforest'.
+*       Pass NULL if there are no sparse numeric columns.
+* - nrows
+*       Number of query rows.
+* - ref_numeric_data[nrows_ref * ncols_numeric], ref_categ_data[nrows_ref * ncols_categ]
+*       Dense data for the reference rows, in the same order (row-major or column-major) as for the query rows.
+* - ref_Xr[nnz], ref_Xr_ind[nnz], ref_Xr_indptr[nrows_ref + 1]
+*       Sparse numeric data for the reference rows in CSR format.
+* - nrows_ref
+*       Number of reference rows.
+* - tile_rows
+*       Maximum number of query rows in each tile. Pass zero to make tiles of up to 2^23 entries.
+* - tile_cols
+*       Maximum number of reference rows in each tile. Pass zero to take all of the reference rows.
+* - nthreads
+*       Number of parallel threads to use.
+* - assume_full_distr
+*       Same as for 'calc_similarity'.
+* - standardize_dist
+*       Same as for 'calc_similarity'.
+* - model_outputs
+*       Pointer to fitted single-variable model object from function 'fit_iforest'. Pass NULL
+*       if the calculations are to be made from an extended model. Can only pass one of
+*       'model_outputs' and 'model_outputs_ext'.
+* - model_outputs_ext
+*       Pointer to fitted extended model object from function 'fit_iforest'. Pass NULL
+*       if the calculations are to be made from a single-variable model. Can only pass one of
+*       'model_outputs' and 'model_outputs_ext'.
+* - callback
+*       Function that will be called for each tile, in order of query rows first and reference rows
+*       second, from the same thread that called this function. It receives the tile in row-major
+*       order, with entry [i * ncols_tile + j] containing the distance between query row 'row_st + i'
+*       and reference row 'col_st + j'. The tile is overwritten after the callback returns, so it
+*       should be copied (e.g. into a file) if it needs to be kept.
+* - callback_data
+*       Pointer that will be passed to the callback as-is.
+*/
+void calc_similarity_tiled(real_t numeric_data[], int categ_data[],
+                           bool is_col_major, size_t ncols_numeric, size_t ncols_categ,
+                           real_t Xr[], sparse_ix Xr_ind[], sparse_ix Xr_indptr[],
+                           size_t nrows,
+                           real_t ref_numeric_data[], int ref_categ_data[],
+                           real_t ref_Xr[], sparse_ix ref_Xr_ind[], sparse_ix ref_Xr_indptr[],
+                           size_t nrows_ref,
+                           size_t tile_rows, size_t tile_cols,
+                           int nthreads, bool assume_full_distr, bool standardize_dist,
+                           IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                           SimilarityTileCallback callback, void *callback_data);
+
+
+/* Calculate the leaf signatures of rows, from which distances can be estimated later without the model
+* 
+* The signature of a row in a tree identifies the terminal node in which it falls through the branches
+* taken from the root to it, encoded as one bit per level (zero for left, one for right) starting from the
+* highest bit, followed by a single set bit which marks the depth of the node. Two rows then share the
+* first 'n' nodes of their paths in a tree if the first 'n' bits of their signatures are equal, so their
+* separation depth can be obtained from the signatures alone, in O(ntrees) time per pair (see function
+* 'signature_separation_depth'), and rows can be grouped by shared path prefixes for locality-sensitive
+* hashing (see function 'get_signature_buckets').
+* Paths deeper than 63 levels are truncated to their first 63 levels. Rows with missing values in models
+* with 'missing_action=Divide', which do not end up in a single terminal node, get a signature of zero
+* in the trees in which they would have been divided.
+* 
+* Parameters
+* ==========
+* - numeric_data[nrows * ncols_numeric]
+*       Pointer to numeric data, in the same format as for 'predict_iforest'.
+*       Pass NULL if there are no dense numeric columns.
+* - categ_data[nrows * ncols_categ]
+*       Pointer to categorical data, in the same format as for 'predict_iforest'.
+*       Pass NULL if there are no categorical columns.
+* - is_col_major
+*       Whether 'numeric_data' and 'categ_data' come in column-major order.
+* - ncols_numeric
+*       Number of columns in 'numeric_data'. Only required when passing row-major dense data.
+* - ncols_categ
+*       Number of columns in 'categ_data'. Only required when passing row-major dense data.
+* - Xc[nnz], Xc_ind[nnz], Xc_indptr[ncols_numeric + 1]
+*       Sparse numeric data in CSC format, if the data is sparse. Pass NULL otherwise.
+* - Xr[nnz], Xr_ind[nnz], Xr_indptr[nrows + 1]
+*       Sparse numeric data in CSR format, if the data is sparse. Pass NULL otherwise.
+* - nrows
+*       Number of rows in the data.
+* - nthreads
+*       Number of parallel threads to use.
+* - model_outputs
+*       Pointer to fitted single-variable model object from function 'fit_iforest'. Pass NULL
+*       if the calculations are to be made from an extended model. Can only pass one of
+*       'model_outputs' and 'model_outputs_ext'.
+* - model_outputs_ext
+*       Pointer to fitted extended model object from function 'fit_iforest'. Pass NULL
+*       if the calculations are to be made from a single-variable model. Can only pass one of
+*       'model_outputs' and 'model_outputs_ext'.
+* - signatures[nrows * ntrees] (out)
+*       Array where the signatures will be written into, in row-major order (i.e. entry
+*       [row * ntrees + tree] contains the signature of row 'row' in tree 'tree').
+*/
+void get_leaf_signatures(real_t numeric_data[], int categ_data[],
+                         bool is_col_major, size_t ncols_numeric, size_t ncols_categ,
+                         real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                         real_t Xr[], sparse_ix Xr_ind[], sparse_ix Xr_indptr[],
+                         size_t nrows, int nthreads,
+                         IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                         uint64_t signatures[]);
+
+
+/* Calculate the separation depth between two rows from their leaf signatures
+* 
+* Rows in different terminal nodes get the depth at which their paths diverge, and rows in the same
+* terminal node get the separation depth expected under 'assume_full_distr=true', so for trees not
+* deeper than 63 levels, the result is the same as what 'calc_similarity' would obtain (before adding
+* the first hop and standardizing) with 'assume_full_distr=true'. Trees in which one of the rows has
+* a signature of zero are taken as separating the rows at the root.
+* 
+* Parameters
+* ==========
+* - signature1[ntrees]
+*       Signatures of the first row, as output by 'get_leaf_signatures'.
+* - signature2[ntrees]
+*       Signatures of the second row, as output by 'get_leaf_signatures'.
+* - ntrees
+*       Number of trees in the model that produced the signatures.
+* 
+* Returns
+* =======
+* The sum across trees of the separation depths, without the first hop.
+*/
+double signature_separation_depth(const uint64_t signature1[], const uint64_t signature2[], size_t ntrees);
+
+
+/* Calculate distance or similarity between rows from their leaf signatures
+* 
+* Produces the same outputs as 'calc_similarity' with 'assume_full_distr=true' (see the documentation
+* of 'signature_separation_depth' for the exceptions), from the output of 'get_leaf_signatures'.
+* 
+* Parameters
+* ==========
+* - signatures[nrows * ntrees]
+*       Signatures of the rows, as output by 'get_leaf_signatures'.
+* - nrows
+*       Number of rows in 'signatures'.
+* - ntrees
+*       Number of trees in the model that produced the signatures.
+* - nthreads
+*       Number of parallel threads to use.
+* - standardize_dist
+*       Same as for 'calc_similarity'.
+* - tmat[nrows * (nrows - 1) / 2] (out)
+*       Same as for 'calc_similarity', but does not need to be initialized to zeros.
+* - rmat[n_from * (nrows - n_from)] (out)
+*       Same as for 'calc_similarity', but does not need to be initialized to zeros.
+* - n_from
+*       Same as for 'calc_similarity'.
+*/
+void calc_similarity_from_signatures(const uint64_t signatures[], size_t nrows, size_t ntrees, int nthreads,
+                                     bool standardize_dist, double tmat[], double rmat[], size_t n_from);
+
+
+/* Assign rows to hash buckets according to the prefixes of their leaf signatures
+* 
+* The trees are split into bands of 'trees_per_band' consecutive trees, and each row gets a bucket in
+* each band which is a hash of its signatures in the trees of that band, after truncating them to their
+* first 'prefix_depth' levels. Two rows then fall in the same bucket of a band if their paths share at
+* least the first 'prefix_depth' nodes in all of the trees of the band (or in the uncommon case of a hash
+* collision), which for rows that are close to each other happens more often than for rows that are far
+* apart. Rows that share a bucket in any band can then be taken as candidates for nearest neighbors, with
+* fewer trees per band or smaller prefixes producing more candidates.
+* Note that rows with a signature of zero in some tree fall in the same bucket as each other in the
+* band of that tree if they share the prefixes in the other trees of the band.
+* 
+* Parameters
+* ==========
+* - signatures[nrows * ntrees]
+*       Signatures of the rows, as output by 'get_leaf_signatures'.
+* - nrows
+*       Number of rows in 'signatures'.
+* - ntrees
+*       Number of trees in the model that produced the signatures.
+* - trees_per_band
+*       Number of trees in each band. The last band will have fewer trees if 'ntrees' is not a
+*       multiple of it.
+* - prefix_depth
+*       Number of levels of the paths to compare. Pass zero or a number larger than the depth of
+*       the trees to compare the full paths.
+* - nthreads
+*       Number of parallel threads to use.
+* - buckets[nrows * ceil(ntrees / trees_per_band)] (out)
+*       Array where the buckets will be written into, in row-major order (i.e. entry
+*       [row * nbands + band] contains the bucket of row 'row' in band 'band').
+*/
+void get_signature_buckets(const uint64_t signatures[], size_t nrows, size_t ntrees,
+                           size_t trees_per_band, size_t prefix_depth, int nthreads,
+                           uint64_t buckets[]);
+
+
+/* Build an index with the terminal node in which each row of the data to which a model was fit falls in
+   each tree, from which the distances between those rows can later be calculated without passing them
+   through the trees again
+* 
+* The index is built from a single pass of the rows through the trees, as done by 'predict_iforest' when
+* outputting terminal node numbers, and keeps those numbers bit-packed, using as many bits for each of them
+* as needed for the tree with the most terminal nodes. It can be serialized along with the model through
+* function 'serialize_training_leaf_index', and be used for calculating the distances between the rows
+* through function 'calc_similarity_from_leaf_index' or their nearest neighbors through function
+* 'calc_similarity_knn_from_leaf_index', which produce the same results as 'calc_similarity' and
+* 'calc_similarity_knn' would on the same data.
+* Note that the index covers all of the rows in each tree, not just the ones that were sampled for the tree
+* when fitting the model. Rows with missing values in models with 'missing_action=Divide' are taken as
+* separated from all other rows at the root of the trees in which they would have been divided.
+* 
+* Parameters
+* ==========
+* - numeric_data[nrows * ncols_numeric]
+*       Pointer to numeric data to which the model was fit, in column-major order.
+*       Pass NULL if there are no dense numeric columns.
+* - categ_data[nrows * ncols_categ]
+*       Pointer to categorical data to which the model was fit, in column-major order.
+*       Pass NULL if there are no categorical columns.
+* - Xc[nnz], Xc_ind[nnz], Xc_indptr[ncols_numeric + 1]
+*       Sparse numeric data in CSC format, if the data is sparse. Pass NULL otherwise.
+* - nrows
+*       Number of rows in the data.
+* - nthreads
+*       Number of parallel threads to use.
+* - model_outputs
+*       Pointer to fitted single-variable model object from function 'fit_iforest'. Pass NULL
+*       if the index is to be built for an extended model. Can only pass one of
+*       'model_outputs' and 'model_outputs_ext'.
+* - model_outputs_ext
+*       Pointer to fitted extended model object from function 'fit_iforest'. Pass NULL
+*       if the index is to be built for a single-variable model. Can only pass one of
+*       'model_outputs' and 'model_outputs_ext'.
+* - leaf_index (out)
+*       Object where the index will be written into. Needs to be built again if the model
+*       gets modified afterwards.
+*/
+void build_training_leaf_index(real_t numeric_data[], int categ_data[],
+                               real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                               size_t nrows, int nthreads,
+                               IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                               TrainingLeafIndex &leaf_index);
+
+
+/* Calculate distance or similarity between the rows of a training leaf index
+* 
+* Produces the same outputs as 'calc_similarity' would for the data from which the index was built,
+* but takes the terminal nodes of the rows from the index instead of passing them through the trees.
+* 
+* Parameters
+* ==========
+* - leaf_index
+*       Index for the model, as produced by function 'build_training_leaf_index'.
+* - model_outputs
+*       Pointer to the single-variable model for which the index was built. Pass NULL if the index
+*       was built for an extended model. Can only pass one of 'model_outputs' and 'model_outputs_ext'.
+* - model_outputs_ext
+*       Pointer to the extended model for which the index was built. Pass NULL if the index was
+*       built for a single-variable model. Can only pass one of 'model_outputs' and 'model_outputs_ext'.
+* - nthreads
+*       Number of parallel threads to use.
+* - assume_full_distr
+*       Same as for 'calc_similarity'.
+* - standardize_dist
+*       Same as for 'calc_similarity'.
+* - tmat[nrows * (nrows - 1) / 2] (out)
+*       Same as for 'calc_similarity', but does not need to be initialized to zeros.
+* - rmat[n_from * (nrows - n_from)] (out)
+*       Same as for 'calc_similarity', but does not need to be initialized to zeros.
+* - n_from
+*       Same as for 'calc_similarity'.
+*/
+void calc_similarity_from_leaf_index(TrainingLeafIndex &leaf_index,
+                                     IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                                     int nthreads, bool assume_full_distr, bool standardize_dist,
+                                     double tmat[], double rmat[], size_t n_from);
+
+
+/* Find the nearest neighbors of each row of a training leaf index
+* 
+* Produces the same outputs as 'calc_similarity_knn' would for the data from which the index was built,
+* but takes the terminal nodes of the rows from the index instead of passing them through the trees.
+* 
+* Parameters
+* ==========
+* - leaf_index
+*       Index for the model, as produced by function 'build_training_leaf_index'.
+* - model_outputs
+*       Pointer to the single-variable model for which the index was built. Pass NULL if the index
+*       was built for an extended model. Can only pass one of 'model_outputs' and 'model_outputs_ext'.
+* - model_outputs_ext
+*       Pointer to the extended model for which the index was built. Pass NULL if the index was
+*       built for a single-variable model. Can only pass one of 'model_outputs' and 'model_outputs_ext'.
+* - nthreads
+*       Number of parallel threads to use.
+* - assume_full_distr
+*       Same as for 'calc_similarity_knn'.
+* - standardize_dist
+*       Same as for 'calc_similarity_knn'.
+* - k
+*       Same as for 'calc_similarity_knn'.
+* - knn_indptr[nrows + 1] (out)
+*       Same as for 'calc_similarity_knn'.
+* - knn_indices[nrows * k] (out)
+*       Same as for 'calc_similarity_knn'.
+* - knn_dist[nrows * k] (out)
+*       Same as for 'calc_similarity_knn'.
+*/
+void calc_similarity_knn_from_leaf_index(TrainingLeafIndex &leaf_index,
+                                         IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                                         int nthreads, bool assume_full_distr, bool standardize_dist,
+                                         size_t k, sparse_ix knn_indptr[], sparse_ix knn_indices[], double knn_dist[]);
+
+
 /* Impute missing values in new data
 * 
 * Parameters
@@ -1122,6 +2252,9 @@ void merge_models(IsoForest*     model,      IsoForest*     other,
 * - imputer (in)
 *       An imputer object to serialize, after being fitted through function 'fit_iforest'
 *       with 'build_imputer=true'.
+* - leaf_index (in)
+*       A training leaf index to serialize, after being built through function
+*       'build_training_leaf_index'.
 * - output_obj (out)
 *       An already-allocated object into which a serialized object of the same class will
 *       be de-serialized. The contents of this object will be overwritten. Should be initialized
@@ -1172,6 +2305,12 @@ std::string serialize_imputer(Imputer &imputer);
 void deserialize_imputer(Imputer &output_obj, std::istream &serialized);
 void deserialize_imputer(Imputer &output_obj, const char *input_file_path);
 void deserialize_imputer(Imputer &output_obj, std::string &serialized, bool move_str);
+void serialize_training_leaf_index(TrainingLeafIndex &leaf_index, std::ostream &output);
+void serialize_training_leaf_index(TrainingLeafIndex &leaf_index, const char *output_file_path);
+std::string serialize_training_leaf_index(TrainingLeafIndex &leaf_index);
+void deserialize_training_leaf_index(TrainingLeafIndex &output_obj, std::istream &serialized);
+void deserialize_training_leaf_index(TrainingLeafIndex &output_obj, const char *input_file_path);
+void deserialize_training_leaf_index(TrainingLeafIndex &output_obj, std::string &serialized, bool move_str);
 #ifdef _MSC_VER
 void serialize_isoforest(IsoForest &model, const wchar_t *output_file_path);
 void deserialize_isoforest(IsoForest &output_obj, const wchar_t *input_file_path);
@@ -1179,6 +2318,8 @@ void serialize_ext_isoforest(ExtIsoForest &model, const wchar_t *output_file_pat
 void deserialize_ext_isoforest(ExtIsoForest &output_obj, const wchar_t *input_file_path);
 void serialize_imputer(Imputer &imputer, const wchar_t *output_file_path);
 void deserialize_imputer(Imputer &output_obj, const wchar_t *input_file_path);
+void serialize_training_leaf_index(TrainingLeafIndex &leaf_index, const wchar_t *output_file_path);
+void deserialize_training_leaf_index(TrainingLeafIndex &output_obj, const wchar_t *input_file_path);
 #endif /* _MSC_VER */
 bool has_msvc();
 #endif /* _ENABLE_CEREAL */
@@ -1277,3 +2418,79 @@ std::vector<std::string> generate_sql(IsoForest *model_outputs, ExtIsoForest *mo
                                       std::vector<std::vector<std::string>> &categ_levels,
                                       bool output_tree_num, bool index1, bool single_tree, size_t tree_num,
                                       int nthreads);
+
+
+/* Memory-map a dense matrix stored as a raw binary file
+* 
+* Parameters
+* ==========
+* - file_path
+*       Path to a file containing only the entries of the matrix in column-major order (i.e. entries
+*       1..n contain column 0, n+1..2n column 1, etc.), without any header, in the native byte order
+*       of the machine. Its size must be exactly 'nrows * ncols * bytes_per_value'.
+* - nrows
+*       Number of rows in the matrix.
+* - ncols
+*       Number of columns in the matrix.
+* - bytes_per_value
+*       Size of each entry in the file: 8 for 'double', or 4 for 'float'. Categorical data can also
+*       be mapped from a file with 'int' entries by passing 4.
+* - access
+*       How the data is expected to be accessed, which is passed as a hint to the OS. Pass 'RandomAccess'
+*       when fitting a model with sub-samples much smaller than the number of rows, and 'SequentialAccess'
+*       when making predictions for all the rows. Ignored on Windows.
+* - mapped (out)
+*       Object where the mapping will be written into. The data can then be passed as e.g.
+*       'numeric_data = (double*)mapped.values' to functions such as 'fit_iforest' and 'predict_iforest'.
+*       Must be released through function 'unmap_matrix'.
+*/
+void map_dense_matrix(const char *file_path, size_t nrows, size_t ncols, size_t bytes_per_value,
+                      MappedAccess access, MappedMatrix &mapped);
+
+
+
+/* Memory-map a sparse matrix in CSC format stored as raw binary files
+* 
+* Parameters
+* ==========
+* - values_path
+*       Path to a file containing the non-zero values of the matrix ('Xc'), without any header.
+*       Its size must be exactly 'nnz * bytes_per_value'.
+* - indices_path
+*       Path to a file containing the row indices of each non-zero value ('Xc_ind'), sorted within
+*       each column. Its size must be exactly 'nnz * bytes_per_index', and all of its entries must be
+*       lower than 'nrows'. Note that checking the indices requires reading the whole file once.
+* - indptr_path
+*       Path to a file containing the column pointers ('Xc_indptr'). Its size must be exactly
+*       '(ncols + 1) * bytes_per_index', its first entry must be zero, and its entries must be
+*       non-decreasing. The number of non-zeros 'nnz' is taken from its last entry.
+* - nrows
+*       Number of rows in the matrix.
+* - ncols
+*       Number of columns in the matrix.
+* - bytes_per_value
+*       Size of each non-zero value in the file: 8 for 'double', or 4 for 'float'.
+* - bytes_per_index
+*       Size of each index in the files: 4 for 'int', or 8 for 'int64_t' and 'size_t'.
+* - access
+*       How the data is expected to be accessed, which is passed as a hint to the OS. Ignored on Windows.
+* - mapped (out)
+*       Object where the mapping will be written into. The data can then be passed as e.g.
+*       'Xc = (double*)mapped.values', 'Xc_ind = (int*)mapped.indices', 'Xc_indptr = (int*)mapped.indptr'.
+*       Must be released through function 'unmap_matrix'.
+*/
+void map_csc_matrix(const char *values_path, const char *indices_path, const char *indptr_path,
+                    size_t nrows, size_t ncols, size_t bytes_per_value, size_t bytes_per_index,
+                    MappedAccess access, MappedMatrix &mapped);
+
+
+
+/* Release a matrix mapped through 'map_dense_matrix' or 'map_csc_matrix'
+* 
+* Parameters
+* ==========
+* - mapped
+*       Object with the mappings to release. Its pointers will be set to NULL. Models fitted to the data
+*       do not keep references to it, but the pointers must not be used after calling this function.
+*/
+void unmap_matrix(MappedMatrix &mapped);
@@ -38,14 +38,14 @@ def _is_col_major(X_num):
     else:
         return X_num.strides[0] == X_num.dtype.itemsize
 
-def _copy_if_subview(X_num):
-    ### TODO: the C++ functions should accept a 'leading dimension'
-    ### parameter so as to avoid copying the data here
+def _copy_if_subview(X_num, allow_subview = False):
+    ### Note: only 'fit_iforest' and 'predict_iforest' accept a 'leading dimension'
+    ### parameter, other functions need the data to be contiguous
     if (X_num is not None) and (not issparse(X_num)):
         col_major = _is_col_major(X_num)
         leading_dimension = int(X_num.strides[1 if col_major else 0] / X_num.dtype.itemsize)
         if (
-                (leading_dimension != X_num.shape[0 if col_major else 1]) or
+                ((leading_dimension != X_num.shape[0 if col_major else 1]) and (not allow_subview)) or
                 (len(X_num.strides) != 2) or
                 (not X_num.flags.aligned) or
                 (not _is_row_major(X_num) and not _is_col_major(X_num))
@@ -785,7 +785,7 @@ class IsolationForest:
         if column_weights is not None and self.weigh_by_kurtosis:
             raise ValueError("Cannot pass column weights when weighting columns by kurtosis.")
         self._reset_obj()
-        X_num, X_cat, ncat, sample_weights, column_weights, nrows = self._process_data(X, sample_weights, column_weights)
+        X_num, X_cat, ncat, sample_weights, column_weights, nrows = self._process_data(X, sample_weights, column_weights, allow_subview = True)
 
         if self.sample_size is None:
             sample_size = nrows
@@ -1049,7 +1049,7 @@ class IsolationForest:
                 outp["imputed"] = self._rearrange_imputed(X, X_num, X_cat)
             return outp
 
-    def _process_data(self, X, sample_weights, column_weights):
+    def _process_data(self, X, sample_weights, column_weights, allow_subview = False):
         if X.__class__.__name__ == "DataFrame":
             ### https://stackoverflow.com/questions/25039626/how-do-i-find-numeric-columns-in-pandas
             X_num = X.select_dtypes(include = [np.number, np.datetime64]).to_numpy()
@@ -1209,12 +1209,12 @@ class IsolationForest:
                 warnings.warn(msg)
                 self.ndim = ncols
 
-        X_num = _copy_if_subview(X_num)
-        X_cat = _copy_if_subview(X_cat)
+        X_num = _copy_if_subview(X_num, allow_subview)
+        X_cat = _copy_if_subview(X_cat, allow_subview)
 
         return X_num, X_cat, ncat, sample_weights, column_weights, nrows
 
-    def _process_data_new(self, X, allow_csr = True, allow_csc = True, prefer_row_major = False):
+    def _process_data_new(self, X, allow_csr = True, allow_csc = True, prefer_row_major = False, allow_subview = False):
         if X.__class__.__name__ == "DataFrame":
             if (self.cols_numeric_.shape[0] + self.cols_categ_.shape[0]) > 0:
                 missing_cols = np.setdiff1d(np.r_[self.cols_numeric_, self.cols_categ_], np.array(X.columns.values))
@@ -1330,8 +1330,8 @@ class IsolationForest:
                 X_num = X
             nrows = X_num.shape[0]
 
-        X_num = _copy_if_subview(X_num)
-        X_cat = _copy_if_subview(X_cat)
+        X_num = _copy_if_subview(X_num, allow_subview)
+        X_cat = _copy_if_subview(X_cat, allow_subview)
 
         return X_num, X_cat, nrows
 
@@ -1432,7 +1432,7 @@ class IsolationForest:
         """
         assert self.is_fitted_
         assert output in ["score", "avg_depth", "tree_num"]
-        X_num, X_cat, nrows = self._process_data_new(X, prefer_row_major = True)
+        X_num, X_cat, nrows = self._process_data_new(X, prefer_row_major = True, allow_subview = True)
         if output == "tree_num":
             if self.missing_action == "divide":
                 raise ValueError("Cannot output tree number when using 'missing_action' = 'divide'.")
@@ -168,6 +168,11 @@ cdef extern from "model_joined.hpp":
         vector[double]  col_means
         vector[int]     col_modes
 
+    ctypedef struct TerminalNodeMapping:
+        vector[size_t]  terminal_num
+        vector[size_t]  node_offset
+        vector[size_t]  terminal_offset
+
 
     void tmat_to_dense(double *tmat, double *dmat, size_t n, bool_t diag_to_one)
 
@@ -212,6 +217,7 @@ cdef extern from "model_joined.hpp":
                     IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
                     real_t_ *numeric_data,  size_t ncols_numeric,
                     int    *categ_data,    size_t ncols_categ,    int *ncat,
+                    size_t ld_numeric,      size_t ld_categ,
                     real_t_ *Xc, sparse_ix_ *Xc_ind, sparse_ix_ *Xc_indptr,
                     size_t ndim, size_t ntry, CoefType coef_type, bool_t coef_by_prop,
                     real_t_ *sample_weights, bool_t with_replacement, bool_t weight_as_sample,
@@ -223,7 +229,7 @@ cdef extern from "model_joined.hpp":
                     real_t_ *col_weights, bool_t weigh_by_kurt,
                     double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
                     double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
-                    double min_gain, MissingAction missing_action,
+                    double min_gain, size_t max_bins, bool_t compensated_sums, MissingAction missing_action,
                     CategSplit cat_split_type, NewCategAction new_cat_action,
                     bool_t all_perm, Imputer *imputer, size_t min_imp_obs,
                     UseDepthImp depth_imp, WeighImpRows weigh_imp_rows, bool_t impute_at_fit,
@@ -232,11 +238,13 @@ cdef extern from "model_joined.hpp":
     void predict_iforest[real_t_, sparse_ix_](
                          real_t_ *numeric_data, int *categ_data,
                          bool_t is_col_major, size_t ncols_numeric, size_t ncols_categ,
+                         size_t ld_numeric, size_t ld_categ,
                          real_t_ *Xc, sparse_ix_ *Xc_ind, sparse_ix_ *Xc_indptr,
                          real_t_ *Xr, sparse_ix_ *Xr_ind, sparse_ix_ *Xr_indptr,
                          size_t nrows, int nthreads, bool_t standardize,
                          IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
-                         double *output_depths, sparse_ix_ *tree_num) nogil except +
+                         double *output_depths, sparse_ix_ *tree_num,
+                         TerminalNodeMapping *terminal_mapping) nogil except +
 
     void get_num_nodes[sparse_ix_](IsoForest &model_outputs, sparse_ix_ *n_nodes, sparse_ix_ *n_terminal, int nthreads)
 
@@ -319,6 +327,14 @@ cdef int* get_ptr_int_mat(np.ndarray[int, ndim = 2] a):
 cdef float* get_ptr_float_mat(np.ndarray[float, ndim = 2] a):
     return &a[0, 0]
 
+def _is_col_major_view(X):
+    return np.isfortran(X) or ((X.strides[0] == X.dtype.itemsize) and (not X.flags.c_contiguous))
+
+cdef size_t get_leading_dimension(X, bool_t is_col_major):
+    if (X is None) or (issparse(X)):
+        return 0
+    return max(int(X.strides[1 if is_col_major else 0] / X.dtype.itemsize), X.shape[0 if is_col_major else 1])
+
 
 def _sort_csc_indices(Xcsc):
     cdef size_t ncols_numeric = Xcsc.shape[1] if isspmatrix_csc(Xcsc) else Xcsc.shape[0]
@@ -399,6 +415,8 @@ cdef class isoforest_cpp_obj:
         cdef sparse_ix*  Xc_indptr_ptr       =  NULL
         cdef real_t*     sample_weights_ptr  =  NULL
         cdef real_t*     col_weights_ptr     =  NULL
+        cdef size_t      ld_numeric          =  0
+        cdef size_t      ld_categ            =  0
 
         if X_num is not None:
             if not issparse(X_num):
@@ -408,6 +426,7 @@ cdef class isoforest_cpp_obj:
                     if X_num.dtype != ctypes.c_double:
                         X_num = X_num.astype(ctypes.c_double)
                     numeric_data_ptr  =  get_ptr_dbl_mat(X_num)
+                ld_numeric        =  get_leading_dimension(X_num, True)
             else:
                 if real_t is float:
                     Xc_ptr         =  get_ptr_float_vec(X_num.data)
@@ -431,6 +450,7 @@ cdef class isoforest_cpp_obj:
         if X_cat is not None:
             categ_data_ptr     =  get_ptr_int_mat(X_cat)
             ncat_ptr           =  get_ptr_int_vec(ncat)
+            ld_categ           =  get_leading_dimension(X_cat, True)
         if sample_weights is not None:
             if real_t is float:
                 sample_weights_ptr =  get_ptr_float_vec(sample_weights)
@@ -516,6 +536,7 @@ cdef class isoforest_cpp_obj:
             fit_iforest(model_ptr, ext_model_ptr,
                         numeric_data_ptr,  ncols_numeric,
                         categ_data_ptr,    ncols_categ,    ncat_ptr,
+                        ld_numeric,        ld_categ,
                         Xc_ptr, Xc_ind_ptr, Xc_indptr_ptr,
                         ndim, ntry, coef_type_C, coef_by_prop,
                         sample_weights_ptr, with_replacement, weight_as_sample,
@@ -527,7 +548,7 @@ cdef class isoforest_cpp_obj:
                         col_weights_ptr, weigh_by_kurt,
                         prob_pick_by_gain_avg, prob_split_by_gain_avg,
                         prob_pick_by_gain_pl,  prob_split_by_gain_pl,
-                        min_gain, missing_action_C,
+                        min_gain, 0, False, missing_action_C,
                         cat_split_type_C, new_cat_action_C,
                         all_perm, imputer_ptr, min_imp_obs,
                         depth_imp_C, weigh_imp_rows_C, impute_at_fit,
@@ -691,6 +712,8 @@ cdef class isoforest_cpp_obj:
         cdef bool_t is_col_major    =  True
         cdef size_t ncols_numeric   =  0
         cdef size_t ncols_categ     =  0
+        cdef size_t ld_numeric      =  0
+        cdef size_t ld_categ        =  0
 
         if X_num is not None:
             if not issparse(X_num):
@@ -701,7 +724,8 @@ cdef class isoforest_cpp_obj:
                         X_num = X_num.astype(ctypes.c_double)
                     numeric_data_ptr   =  get_ptr_dbl_mat(X_num)
                 ncols_numeric      =  X_num.shape[1]
-                is_col_major       =  np.isfortran(X_num)
+                is_col_major       =  _is_col_major_view(X_num)
+                ld_numeric         =  get_leading_dimension(X_num, is_col_major)
             else:
                 if isspmatrix_csc(X_num):
                     if X_num.data.shape[0]:
@@ -755,7 +779,8 @@ cdef class isoforest_cpp_obj:
         if X_cat is not None:
             categ_data_ptr    =  get_ptr_int_mat(X_cat)
             ncols_categ       =  X_cat.shape[1]
-            is_col_major      =  np.isfortran(X_cat)
+            is_col_major      =  _is_col_major_view(X_cat)
+            ld_categ          =  get_leading_dimension(X_cat, is_col_major)
 
         cdef np.ndarray[double, ndim = 1]    depths    =  np.zeros(nrows, dtype = ctypes.c_double)
         cdef np.ndarray[sparse_ix, ndim = 2] tree_num  =  np.empty((0, 0), order = 'F', dtype = placeholder_sparse_ix.dtype)
@@ -780,11 +805,13 @@ cdef class isoforest_cpp_obj:
         with nogil, boundscheck(False), nonecheck(False), wraparound(False):
             predict_iforest(numeric_data_ptr, categ_data_ptr,
                             is_col_major, ncols_numeric, ncols_categ,
+                            ld_numeric, ld_categ,
                             Xc_ptr, Xc_ind_ptr, Xc_indptr_ptr,
                             Xr_ptr, Xr_ind_ptr, Xr_indptr_ptr,
                             nrows, nthreads, standardize,
                             model_ptr, ext_model_ptr,
-                            depths_ptr, tree_num_ptr)
+                            depths_ptr, tree_num_ptr,
+                            <TerminalNodeMapping*>NULL)
 
         return depths, tree_num
 
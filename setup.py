@@ -93,7 +93,8 @@ setup(
                                 "isotree._cpp_interface",
                                 sources=["isotree/cpp_interface.pyx",
                                          "src/dealloc.cpp",
-                                         "src/merge_models.cpp", "src/serialize.cpp", "src/sql.cpp"],
+                                         "src/merge_models.cpp", "src/serialize.cpp", "src/sql.cpp",
+                                         "src/mapped_data.cpp"],
                                 include_dirs=[np.get_include(), ".", "./src", cereal_dir],
                                 language="c++",
                                 install_requires = ["numpy", "pandas>=0.24.0", "cython", "scipy"],
@@ -310,6 +310,7 @@ Rcpp::List fit_model(Rcpp::NumericVector X_num, Rcpp::IntegerVector X_cat, Rcpp:
     fit_iforest(model_ptr.get(), ext_model_ptr.get(),
                 numeric_data_ptr,  ncols_numeric,
                 categ_data_ptr,    ncols_categ,    ncat_ptr,
+                (size_t)0,         (size_t)0,
                 Xc_ptr, Xc_ind_ptr, Xc_indptr_ptr,
                 ndim, ntry, coef_type_C, coef_by_prop,
                 sample_weights_ptr, with_replacement, weight_as_sample,
@@ -320,7 +321,7 @@ Rcpp::List fit_model(Rcpp::NumericVector X_num, Rcpp::IntegerVector X_cat, Rcpp:
                 col_weights_ptr, weigh_by_kurt,
                 prob_pick_by_gain_avg, prob_split_by_gain_avg,
                 prob_pick_by_gain_pl,  prob_split_by_gain_pl,
-                min_gain, missing_action_C,
+                min_gain, (size_t)0, false, missing_action_C,
                 cat_split_type_C, new_cat_action_C,
                 all_perm, imputer_ptr.get(), min_imp_obs,
                 depth_imp_C, weigh_imp_rows_C, output_imputations,
@@ -610,11 +611,13 @@ void predict_iso(SEXP model_R_ptr, Rcpp::NumericVector outp, Rcpp::IntegerVector
 
     predict_iforest<double, int>(numeric_data_ptr, categ_data_ptr,
                                  true, (size_t)0, (size_t)0,
+                                 (size_t)0, (size_t)0,
                                  Xc_ptr, Xc_ind_ptr, Xc_indptr_ptr,
                                  Xr_ptr, Xr_ind_ptr, Xr_indptr_ptr,
                                  nrows, nthreads, standardize,
                                  model_ptr, ext_model_ptr,
-                                 depths_ptr, tree_num_ptr);
+                                 depths_ptr, tree_num_ptr,
+                                 (TerminalNodeMapping*)NULL);
 }
 
 // [[Rcpp::export(rng = false)]]
@@ -0,0 +1,480 @@
+/*    Isolation forests and variations thereof, with adjustments for incorporation
+*     of categorical variables and missing values.
+*     Writen for C++11 standard and aimed at being used in R and Python.
+*     
+*     This library is based on the following works:
+*     [1] Liu, Fei Tony, Kai Ming Ting, and Zhi-Hua Zhou.
+*         "Isolation forest."
+*         2008 Eighth IEEE International Conference on Data Mining. IEEE, 2008.
+*     [2] Liu, Fei Tony, Kai Ming Ting, and Zhi-Hua Zhou.
+*         "Isolation-based anomaly detection."
+*         ACM Transactions on Knowledge Discovery from Data (TKDD) 6.1 (2012): 3.
+*     [3] Hariri, Sahand, Matias Carrasco Kind, and Robert J. Brunner.
+*         "Extended Isolation Forest."
+*         arXiv preprint arXiv:1811.02141 (2018).
+*     [4] Liu, Fei Tony, Kai Ming Ting, and Zhi-Hua Zhou.
+*         "On detecting clustered anomalies using SCiForest."
+*         Joint European Conference on Machine Learning and Knowledge Discovery in Databases. Springer, Berlin, Heidelberg, 2010.
+*     [5] https://sourceforge.net/projects/iforest/
+*     [6] https://math.stackexchange.com/questions/3388518/expected-number-of-paths-required-to-separate-elements-in-a-binary-tree
+*     [7] Quinlan, J. Ross. C4. 5: programs for machine learning. Elsevier, 2014.
+*     [8] Cortes, David. "Distance approximation using Isolation Forests." arXiv preprint arXiv:1910.12362 (2019).
+*     [9] Cortes, David. "Imputing missing values with unsupervised random trees." arXiv preprint arXiv:1911.06646 (2019).
+* 
+*     BSD 2-Clause License
+*     Copyright (c) 2019-2021, David Cortes
+*     All rights reserved.
+*     Redistribution and use in source and binary forms, with or without
+*     modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this
+*       list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice,
+*       this list of conditions and the following disclaimer in the documentation
+*       and/or other materials provided with the distribution.
+*     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+*     AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+*     IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+*     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+*     FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+*     DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+*     SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*     CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+*     OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+*     OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "isotree.hpp"
+
+/* Compile a single-variable model into a read-only structure for faster predictions
+* 
+* Parameters
+* ==========
+* - model_outputs
+*       Single-variable model object which has already been fit through 'fit_iforest'.
+*       Models fit with 'missing_action=Divide', or with 'new_cat_action=Weighted'
+*       and categorical splits, are not supported, as they need to follow both
+*       branches of a split for some observations.
+* - compiled_model (out)
+*       Object where the compiled model will be written into. Predictions from it can be
+*       obtained through function 'predict_iforest_compiled', and will be the same as
+*       those from 'predict_iforest' on the original model. Note that this object does
+*       not get updated if the original model gets modified afterwards (e.g. by adding
+*       more trees to it), in which case it needs to be compiled again.
+*/
+void compile_isoforest(IsoForest &model_outputs, CompiledIsoForest &compiled_model)
+{
+    if (model_outputs.missing_action == Divide)
+        throw std::runtime_error("Cannot compile models fit with 'missing_action=Divide'.\n");
+
+    size_t n_nodes = 0;
+    size_t n_cat_bits = 0;
+    size_t n_cat_splits = 0;
+    bool has_range_penalty = false;
+    for (std::vector<IsoTree> &tree : model_outputs.trees)
+    {
+        n_nodes += tree.size();
+        for (IsoTree &node : tree)
+        {
+            if (node.score >= 0)
+                continue;
+            if (node.col_num > (size_t)COMPILED_COL_MASK)
+                throw std::runtime_error("Model has too many columns to be compiled.\n");
+            has_range_penalty = has_range_penalty || !isinf(node.range_low) || !isinf(node.range_high);
+            if (node.col_type == Categorical)
+            {
+                if (model_outputs.new_cat_action == Weighted)
+                    throw std::runtime_error("Cannot compile models with categorical splits fit with 'new_cat_action=Weighted'.\n");
+                n_cat_splits++;
+                if (model_outputs.cat_split_type == SubSet)
+                    n_cat_bits += node.cat_split.size()? ((node.cat_split.size() + 63) / 64) : 1;
+            }
+        }
+    }
+
+    if (n_nodes > (size_t)UINT32_MAX || n_cat_bits > (size_t)UINT32_MAX)
+        throw std::runtime_error("Model is too large to be compiled.\n");
+
+    compiled_model.missing_action = model_outputs.missing_action;
+    compiled_model.exp_avg_depth  = model_outputs.exp_avg_depth;
+    compiled_model.nodes.clear();
+    compiled_model.nodes.reserve(n_nodes);
+    compiled_model.tree_root.resize(model_outputs.trees.size());
+    compiled_model.range_low.clear();
+    compiled_model.range_high.clear();
+    if (has_range_penalty)
+    {
+        compiled_model.range_low.reserve(n_nodes);
+        compiled_model.range_high.reserve(n_nodes);
+    }
+    compiled_model.cat_splits.clear();
+    compiled_model.cat_splits.reserve(n_cat_splits);
+    compiled_model.cat_bits.assign(n_cat_bits, (uint64_t)0);
+
+    std::vector<size_t> queue;
+    std::vector<size_t> terminal_num;
+    size_t curr_bit = 0;
+    for (size_t tree = 0; tree < model_outputs.trees.size(); tree++)
+    {
+        std::vector<IsoTree> &nodes = model_outputs.trees[tree];
+
+        /* terminal nodes are numbered in the same order as in 'remap_terminal_trees' */
+        terminal_num.assign(nodes.size(), (size_t)0);
+        size_t curr_term = 0;
+        for (size_t node = 0; node < nodes.size(); node++)
+            if (nodes[node].score >= 0)
+                terminal_num[node] = curr_term++;
+
+        /* breadth-first, appending both children of a node at once */
+        size_t tree_st = compiled_model.nodes.size();
+        compiled_model.tree_root[tree] = tree_st;
+        queue.assign(1, (size_t)0);
+        for (size_t pos = 0; pos < queue.size(); pos++)
+        {
+            IsoTree &node = nodes[queue[pos]];
+            CompiledNode out;
+
+            if (node.score >= 0)
+            {
+                out.split_point = node.score;
+                out.col_num     = terminal_num[queue[pos]];
+                out.child_left  = 0;
+            }
+
+            else
+            {
+                out.col_num    = node.col_num;
+                out.child_left = tree_st + queue.size();
+                queue.push_back(node.tree_left);
+                queue.push_back(node.tree_right);
+
+                if (model_outputs.missing_action == Impute && node.pct_tree_left >= .5)
+                    out.col_num |= COMPILED_NA_LEFT_FLAG;
+
+                if (node.col_type == Numeric)
+                {
+                    out.split_point = node.num_split;
+                }
+
+                else
+                {
+                    out.col_num    |= COMPILED_CATEG_FLAG;
+                    out.split_point = (double)compiled_model.cat_splits.size();
+
+                    CompiledCategSplit split;
+                    split.offset      = curr_bit;
+                    split.chosen_cat  = node.chosen_cat;
+                    split.new_to_left = node.pct_tree_left < .5;
+                    switch(model_outputs.cat_split_type)
+                    {
+                        case SingleCateg:
+                        {
+                            split.ncat = 0;
+                            break;
+                        }
+
+                        case SubSet:
+                        {
+                            if (!node.cat_split.size()) /* this is for binary columns */
+                            {
+                                split.ncat = 2;
+                                compiled_model.cat_bits[curr_bit] = 1; /* category '0' goes to the left */
+                                curr_bit++;
+                            }
+
+                            else
+                            {
+                                split.ncat = node.cat_split.size();
+                                for (int cat = 0; cat < split.ncat; cat++)
+                                    if (node.cat_split[cat] > 0)
+                                        compiled_model.cat_bits[curr_bit + cat / 64] |= (uint64_t)1 << (cat % 64);
+                                curr_bit += (split.ncat + 63) / 64;
+                            }
+                            break;
+                        }
+                    }
+                    compiled_model.cat_splits.push_back(split);
+                }
+            }
+
+            compiled_model.nodes.push_back(out);
+            if (has_range_penalty)
+            {
+                compiled_model.range_low.push_back(node.range_low);
+                compiled_model.range_high.push_back(node.range_high);
+            }
+        }
+    }
+}
+
+/* Compile an extended model into a read-only structure for faster predictions
+* 
+* Parameters
+* ==========
+* - model_outputs_ext
+*       Extended model object which has already been fit through 'fit_iforest'.
+*       Models with categorical columns are not supported.
+* - compiled_model_ext (out)
+*       Object where the compiled model will be written into. Predictions from it can be
+*       obtained through function 'predict_iforest_compiled'. Since the means of the columns
+*       get folded into the split points, results might differ from those of 'predict_iforest'
+*       in the last digits of rounding for observations lying exactly at a split. Note that
+*       this object does not get updated if the original model gets modified afterwards.
+*/
+void compile_ext_isoforest(ExtIsoForest &model_outputs_ext, CompiledExtIsoForest &compiled_model_ext)
+{
+    size_t n_nodes = 0;
+    size_t n_coefs = 0;
+    bool has_range_penalty = false;
+    for (std::vector<IsoHPlane> &tree : model_outputs_ext.hplanes)
+    {
+        n_nodes += tree.size();
+        for (IsoHPlane &node : tree)
+        {
+            if (node.score >= 0)
+                continue;
+            for (size_t col = 0; col < node.col_num.size(); col++)
+            {
+                if (node.col_type[col] != Numeric)
+                    throw std::runtime_error("Cannot compile extended models with categorical columns.\n");
+                if (node.col_num[col] > (size_t)UINT32_MAX)
+                    throw std::runtime_error("Model has too many columns to be compiled.\n");
+            }
+            n_coefs += node.col_num.size();
+            has_range_penalty = has_range_penalty || !isinf(node.range_low) || !isinf(node.range_high);
+        }
+    }
+
+    if (n_nodes > (size_t)UINT32_MAX || n_coefs > (size_t)UINT32_MAX)
+        throw std::runtime_error("Model is too large to be compiled.\n");
+
+    bool impute_missing = model_outputs_ext.missing_action != Fail;
+    compiled_model_ext.missing_action = model_outputs_ext.missing_action;
+    compiled_model_ext.exp_avg_depth  = model_outputs_ext.exp_avg_depth;
+    compiled_model_ext.hplanes.clear();
+    compiled_model_ext.hplanes.reserve(n_nodes);
+    compiled_model_ext.tree_root.resize(model_outputs_ext.hplanes.size());
+    compiled_model_ext.col_num.clear();
+    compiled_model_ext.col_num.reserve(n_coefs);
+    compiled_model_ext.coef.clear();
+    compiled_model_ext.coef.reserve(n_coefs);
+    compiled_model_ext.fill_val.clear();
+    if (impute_missing)
+        compiled_model_ext.fill_val.reserve(n_coefs);
+    compiled_model_ext.range_low.clear();
+    compiled_model_ext.range_high.clear();
+    if (has_range_penalty)
+    {
+        compiled_model_ext.range_low.reserve(n_nodes);
+        compiled_model_ext.range_high.reserve(n_nodes);
+    }
+
+    std::vector<size_t> queue;
+    std::vector<size_t> terminal_num;
+    for (size_t tree = 0; tree < model_outputs_ext.hplanes.size(); tree++)
+    {
+        std::vector<IsoHPlane> &nodes = model_outputs_ext.hplanes[tree];
+
+        terminal_num.assign(nodes.size(), (size_t)0);
+        size_t curr_term = 0;
+        for (size_t node = 0; node < nodes.size(); node++)
+            if (nodes[node].score >= 0)
+                terminal_num[node] = curr_term++;
+
+        size_t tree_st = compiled_model_ext.hplanes.size();
+        compiled_model_ext.tree_root[tree] = tree_st;
+        queue.assign(1, (size_t)0);
+        for (size_t pos = 0; pos < queue.size(); pos++)
+        {
+            IsoHPlane &node = nodes[queue[pos]];
+            CompiledHPlane out;
+            double offset = 0;
+
+            if (node.score >= 0)
+            {
+                out.split_point = node.score;
+                out.col_st      = terminal_num[queue[pos]];
+                out.ncols       = 0;
+                out.child_left  = 0;
+            }
+
+            else
+            {
+                out.col_st     = compiled_model_ext.col_num.size();
+                out.ncols      = node.col_num.size();
+                out.child_left = tree_st + queue.size();
+                queue.push_back(node.hplane_left);
+                queue.push_back(node.hplane_right);
+
+                /* (x - mean) * coef <= split  <=>  x * coef <= split + mean * coef */
+                for (size_t col = 0; col < node.col_num.size(); col++)
+                {
+                    compiled_model_ext.col_num.push_back(node.col_num[col]);
+                    compiled_model_ext.coef.push_back(node.coef[col]);
+                    if (impute_missing)
+                        compiled_model_ext.fill_val.push_back(node.fill_val[col] + node.mean[col] * node.coef[col]);
+                    offset += node.mean[col] * node.coef[col];
+                }
+                out.split_point = node.split_point + offset;
+            }
+
+            compiled_model_ext.hplanes.push_back(out);
+            if (has_range_penalty)
+            {
+                compiled_model_ext.range_low.push_back(node.range_low + offset);
+                compiled_model_ext.range_high.push_back(node.range_high + offset);
+            }
+        }
+    }
+}
+
+
+/* Integer formats hold a quantized value 'q' which stands for 'offset + scale * q' */
+bool get_quantized_limits(NumericColFormat format, double &qmin, double &qmax)
+{
+    switch(format)
+    {
+        case ColInt8:   {qmin = INT8_MIN;  qmax = INT8_MAX;   return true;}
+        case ColUInt8:  {qmin = 0;         qmax = UINT8_MAX;  return true;}
+        case ColInt16:  {qmin = INT16_MIN; qmax = INT16_MAX;  return true;}
+        case ColUInt16: {qmin = 0;         qmax = UINT16_MAX; return true;}
+        default:        {return false;}
+    }
+}
+
+/* Largest 'q' for which 'offset + scale * q <= xval', or 'qmin - 1' if there is none */
+double quantize_upper(double xval, double offset, double scale, double qmin, double qmax)
+{
+    double q = std::floor((xval - offset) / scale);
+    q = isnan(q)? (qmin - 1) : std::max(qmin - 1, std::min(qmax, q));
+    while (q < qmax && offset + scale * (q + 1) <= xval) q++;
+    while (q >= qmin && offset + scale * q > xval) q--;
+    return q;
+}
+
+/* Smallest 'q' for which 'offset + scale * q >= xval', or 'qmax + 1' if there is none */
+double quantize_lower(double xval, double offset, double scale, double qmin, double qmax)
+{
+    double q = std::ceil((xval - offset) / scale);
+    q = isnan(q)? (qmax + 1) : std::max(qmin, std::min(qmax + 1, q));
+    while (q > qmin && offset + scale * (q - 1) >= xval) q--;
+    while (q <= qmax && offset + scale * q < xval) q++;
+    return q;
+}
+
+/* Quantize the numeric split points of a compiled model to the data types in which each column will be passed
+* 
+* Parameters
+* ==========
+* - compiled_model (in, out)
+*       Single-variable model compiled through 'compile_isoforest', which will be modified in-place.
+*       After this, predictions from it can only be obtained through function 'predict_iforest_mixed',
+*       which reads each numeric column in its own format without converting the data beforehand.
+* - ncols_numeric
+*       Number of numeric columns in the data to which the model was fit.
+* - col_format[ncols_numeric]
+*       Format in which each numeric column will be passed. Floating point formats (ColFloat64, ColFloat32,
+*       ColFloat16, ColBFloat16) are taken as they are, while integer formats (ColInt8, ColUInt8, ColInt16,
+*       ColUInt16) are taken as quantized values 'q' standing for 'col_offset[col] + col_scale[col] * q',
+*       for which the split points and range limits of the model get converted to the equivalent integer
+*       thresholds, so that the results are the same as if the data were decoded to double precision
+*       before making predictions. Integer columns cannot have missing values.
+* - col_scale[ncols_numeric]
+*       Scale of the quantized values of each column. Must be positive for integer formats, and is ignored
+*       for floating point formats. Pass NULL to use a scale of one for all columns.
+* - col_offset[ncols_numeric]
+*       Offset of the quantized values of each column. Ignored for floating point formats. Pass NULL to
+*       use an offset of zero for all columns.
+*/
+void quantize_compiled_model(CompiledIsoForest &compiled_model, size_t ncols_numeric,
+                             NumericColFormat col_format[], double col_scale[], double col_offset[])
+{
+    if (compiled_model.col_format.size())
+        throw std::runtime_error("Compiled model has already been quantized.\n");
+
+    double qmin, qmax;
+    for (size_t col = 0; col < ncols_numeric; col++)
+    {
+        if (get_quantized_limits(col_format[col], qmin, qmax) && col_scale != NULL &&
+            (!(col_scale[col] > 0) || isinf(col_scale[col])))
+            throw std::runtime_error("Scale of quantized columns must be a positive number.\n");
+    }
+
+    CompiledNode *nodes = compiled_model.nodes.data();
+    bool has_range_penalty = compiled_model.range_low.size() > 0;
+    for (size_t node = 0; node < compiled_model.nodes.size(); node++)
+    {
+        if (!nodes[node].child_left || (nodes[node].col_num & COMPILED_CATEG_FLAG))
+            continue;
+        size_t col = nodes[node].col_num & COMPILED_COL_MASK;
+        if (col >= ncols_numeric)
+            throw std::runtime_error("Model has more numeric columns than 'ncols_numeric'.\n");
+        if (!get_quantized_limits(col_format[col], qmin, qmax))
+            continue;
+
+        double scale  = (col_scale  == NULL)? 1. : col_scale[col];
+        double offset = (col_offset == NULL)? 0. : col_offset[col];
+        nodes[node].split_point = quantize_upper(nodes[node].split_point, offset, scale, qmin, qmax);
+
+        /* range limits are checked at the children, against the column of the parent */
+        if (has_range_penalty)
+        {
+            for (size_t child = nodes[node].child_left; child <= (size_t)nodes[node].child_left + 1; child++)
+            {
+                compiled_model.range_low[child]  = quantize_lower(compiled_model.range_low[child], offset, scale, qmin, qmax);
+                compiled_model.range_high[child] = quantize_upper(compiled_model.range_high[child], offset, scale, qmin, qmax);
+            }
+        }
+    }
+
+    compiled_model.col_format.assign(col_format, col_format + ncols_numeric);
+}
+
+/* Prepare an object for making predictions on small batches of data with low overhead
+* 
+* Parameters
+* ==========
+* - model_outputs
+*       Pointer to fitted single-variable model object from function 'fit_iforest'. Pass NULL
+*       if the predictions are to be made from an extended model. Can only pass one of
+*       'model_outputs' and 'model_outputs_ext'.
+* - model_outputs_ext
+*       Pointer to fitted extended model object from function 'fit_iforest'. Pass NULL
+*       if the predictions are to be made from a single-variable model. Can only pass one of
+*       'model_outputs' and 'model_outputs_ext'.
+* - nthreads
+*       Number of parallel threads to use for batches which have at least 'min_rows_parallel' rows.
+* - predictor (out)
+*       Object where the compiled model (if the model can be compiled) or the terminal node mapping
+*       (if it cannot) will be written into. Predictions from it can be obtained through function
+*       'predict_iforest_predictor'. The model objects must not be modified or freed while it is
+*       in use - if the model gets modified, this function needs to be called again.
+*/
+void prepare_predictor(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext, int nthreads,
+                       IsoForestPredictor &predictor)
+{
+    predictor.model_outputs     = model_outputs;
+    predictor.model_outputs_ext = model_outputs_ext;
+    predictor.nthreads          = std::max(nthreads, 1);
+    predictor.min_rows_parallel = PREDICTOR_MIN_ROWS_PARALLEL;
+    predictor.compiled_model     = CompiledIsoForest();
+    predictor.compiled_model_ext = CompiledExtIsoForest();
+    predictor.terminal_mapping   = TerminalNodeMapping();
+
+    /* models with splits that need to follow both branches can't be compiled */
+    predictor.is_compiled = true;
+    try
+    {
+        if (model_outputs != NULL)
+            compile_isoforest(*model_outputs, predictor.compiled_model);
+        else
+            compile_ext_isoforest(*model_outputs_ext, predictor.compiled_model_ext);
+    }
+    catch (std::runtime_error &e)
+    {
+        predictor.is_compiled = false;
+    }
+
+    if (predictor.is_compiled)
+        return;
+
+    build_terminal_mapping(model_outputs, model_outputs_ext, predictor.terminal_mapping);
+}
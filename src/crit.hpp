@@ -1096,6 +1096,10 @@ double eval_guided_crit(size_t *restrict ix_arr, size_t st, size_t end, real_t_
     {
         if (x[ix_arr[st]] == x[ix_arr[end]])
             return -HUGE_VAL;
+        /* the smaller value goes first, as 'split_ix' is taken as the last row of the left branch */
+        if (x[ix_arr[st]] > x[ix_arr[end]])
+            std::swap(ix_arr[st], ix_arr[end]);
+        xmin = x[ix_arr[st]]; xmax = x[ix_arr[end]];
         split_point = avg_between(x[ix_arr[st]], x[ix_arr[end]]);
         split_ix    = st;
         gain        = 1.;
@@ -1107,6 +1111,20 @@ double eval_guided_crit(size_t *restrict ix_arr, size_t st, size_t end, real_t_
 
     /* sort in ascending order */
     std::sort(ix_arr + st, ix_arr + end + 1, [&x](const size_t a, const size_t b){return x[a] < x[b];});
+    return eval_guided_crit_sorted(ix_arr, st, end, x, buffer_sd, as_relative_gain,
+                                   split_ix, split_point, xmin, xmax,
+                                   criterion, min_gain);
+}
+
+/* Same as above, but for 'ix_arr[st..end]' already sorted in ascending order of 'x', with no missing
+   values and with at least 3 observations */
+template <class real_t_>
+double eval_guided_crit_sorted(size_t *restrict ix_arr, size_t st, size_t end, real_t_ *restrict x,
+                               double *restrict buffer_sd, bool as_relative_gain,
+                               size_t &split_ix, double &split_point, double &xmin, double &xmax,
+                               GainCriterion criterion, double min_gain)
+{
+    double gain;
     if (x[ix_arr[st]] == x[ix_arr[end]]) return -HUGE_VAL;
     xmin = x[ix_arr[st]]; xmax = x[ix_arr[end]];
 
@@ -1145,6 +1163,10 @@ double eval_guided_crit_weighted(size_t *restrict ix_arr, size_t st, size_t end,
     {
         if (x[ix_arr[st]] == x[ix_arr[end]])
             return -HUGE_VAL;
+        /* the smaller value goes first, as 'split_ix' is taken as the last row of the left branch */
+        if (x[ix_arr[st]] > x[ix_arr[end]])
+            std::swap(ix_arr[st], ix_arr[end]);
+        xmin = x[ix_arr[st]]; xmax = x[ix_arr[end]];
         split_point = avg_between(x[ix_arr[st]], x[ix_arr[end]]);
         split_ix    = st;
         gain        = 1.;
@@ -1154,8 +1176,22 @@ double eval_guided_crit_weighted(size_t *restrict ix_arr, size_t st, size_t end,
             return 0.;
     }
 
-    /* sort in ascending order */
-    std::sort(ix_arr + st, ix_arr + end + 1, [&x](const size_t a, const size_t b){return x[a] < x[b];});
+    /* sort in ascending order, with ties in a fixed order so that the weighted sums do not depend on
+       the order in which the rows came (same as in 'build_presorted_cols') */
+    std::sort(ix_arr + st, ix_arr + end + 1,
+              [&x](const size_t a, const size_t b){return (x[a] < x[b]) || (x[a] == x[b] && a < b);});
+    return eval_guided_crit_sorted_weighted(ix_arr, st, end, x, buffer_sd, as_relative_gain,
+                                            split_ix, split_point, xmin, xmax,
+                                            criterion, min_gain, w);
+}
+
+template <class real_t_, class mapping>
+double eval_guided_crit_sorted_weighted(size_t *restrict ix_arr, size_t st, size_t end, real_t_ *restrict x,
+                                        double *restrict buffer_sd, bool as_relative_gain,
+                                        size_t &split_ix, double &split_point, double &xmin, double &xmax,
+                                        GainCriterion criterion, double min_gain, mapping &w)
+{
+    double gain;
     if (x[ix_arr[st]] == x[ix_arr[end]]) return -HUGE_VAL;
     xmin = x[ix_arr[st]]; xmax = x[ix_arr[end]];
 
@@ -1221,6 +1257,201 @@ double eval_guided_crit_weighted(size_t ix_arr[], size_t st, size_t end,
                                      xmin, xmax, criterion, min_gain, missing_action, buffer_w);
 }
 
+/* Same as the dense versions above, but evaluating splits from the counts, sums and sums of squares of the
+   observations in each bin of a discretized column ('x_bin') instead of sorting all of them. Splits between
+   bins are evaluated from bin statistics, while the observations in the first and last bins are sorted so as
+   to also evaluate exactly the splits that isolate the most extreme values, which are typically the ones with
+   the highest averaged gain. Split points are placed between the largest value in the left branch and the
+   smallest in the right branch, same as when evaluating all possible splits. Small nodes, or nodes in which
+   all the values fall in the same bin, are evaluated exactly instead. */
+template <class real_t_, class mapping>
+double eval_guided_crit_binned_t(size_t *restrict ix_arr, size_t st, size_t end, real_t_ *restrict x,
+                                 uint8_t *restrict x_bin, size_t nbins, double *restrict buffer_hist,
+                                 double *restrict buffer_sd, bool as_relative_gain,
+                                 size_t &split_ix, double &split_point, double &xmin, double &xmax,
+                                 GainCriterion criterion, double min_gain, MissingAction missing_action,
+                                 mapping &w, bool weighted)
+{
+    if ((end - st + 1) < 4 * nbins)
+        goto exact_eval;
+
+    {
+        double *restrict bin_w   = buffer_hist;
+        double *restrict bin_sum = buffer_hist + nbins;
+        double *restrict bin_ssq = buffer_hist + 2 * nbins;
+        double *restrict bin_min = buffer_hist + 3 * nbins;
+        double *restrict bin_max = buffer_hist + 4 * nbins;
+        std::fill(buffer_hist, buffer_hist + 3 * nbins, 0.);
+        std::fill(bin_min, bin_min + nbins,  HUGE_VAL);
+        std::fill(bin_max, bin_max + nbins, -HUGE_VAL);
+
+        /* values are shifted by one of them, so that the sums of squares do not lose precision */
+        double shift = NAN;
+        for (size_t row = st; row <= end; row++)
+        {
+            if (x_bin[ix_arr[row]] != HIST_NA_BIN)
+            {
+                shift = x[ix_arr[row]];
+                break;
+            }
+        }
+        if (isnan(shift)) return -HUGE_VAL;
+
+        size_t bin;
+        double xval, w_this;
+        for (size_t row = st; row <= end; row++)
+        {
+            bin = x_bin[ix_arr[row]];
+            if (bin == HIST_NA_BIN) continue;
+            xval = x[ix_arr[row]];
+            w_this = weighted? w[ix_arr[row]] : 1.;
+            bin_w[bin]   += w_this;
+            bin_sum[bin] += w_this * (xval - shift);
+            bin_ssq[bin] += w_this * square(xval - shift);
+            bin_min[bin]  = std::fmin(bin_min[bin], xval);
+            bin_max[bin]  = std::fmax(bin_max[bin], xval);
+        }
+
+        double w_tot = 0, sum_tot = 0, ssq_tot = 0;
+        size_t first_bin = SIZE_MAX, last_bin = 0;
+        xmin = HUGE_VAL; xmax = -HUGE_VAL;
+        for (bin = 0; bin < nbins; bin++)
+        {
+            if (bin_min[bin] > bin_max[bin]) continue;
+            w_tot   += bin_w[bin];
+            sum_tot += bin_sum[bin];
+            ssq_tot += bin_ssq[bin];
+            xmin = std::fmin(xmin, bin_min[bin]);
+            xmax = std::fmax(xmax, bin_max[bin]);
+            first_bin = std::min(first_bin, bin);
+            last_bin  = bin;
+        }
+        if (xmin >= xmax) return -HUGE_VAL;
+        if (first_bin == last_bin) goto exact_eval;
+
+        size_t *first_bin_end = std::partition(ix_arr + st, ix_arr + end + 1,
+                                               [&x_bin, first_bin](const size_t ix){return x_bin[ix] == first_bin;});
+        size_t *last_bin_st = std::partition(first_bin_end, ix_arr + end + 1,
+                                             [&x_bin, last_bin](const size_t ix){return x_bin[ix] != last_bin;});
+        std::sort(ix_arr + st, first_bin_end, [&x](const size_t a, const size_t b){return x[a] < x[b];});
+        std::sort(last_bin_st, ix_arr + end + 1, [&x](const size_t a, const size_t b){return x[a] < x[b];});
+
+        bool rel_gain = criterion == Pooled && as_relative_gain && min_gain <= 0 && !weighted;
+        double mean_tot = sum_tot / w_tot;
+        double full_sd = std::sqrt(std::fmax(0., ssq_tot / w_tot - square(mean_tot)));
+        double w_left = 0, sum_left = 0, ssq_left = 0;
+        double best_gain = -HUGE_VAL;
+
+        auto eval_split = [&](double x_left, double x_right)
+        {
+            double w_right   = w_tot - w_left;
+            double sum_right = sum_tot - sum_left;
+            double ssq_right = ssq_tot - ssq_left;
+            double this_gain;
+            if (rel_gain)
+            {
+                /* sums are centered by the overall mean, as in 'find_split_rel_gain' */
+                this_gain =   square(sum_left  - w_left  * mean_tot) / w_left
+                            + square(sum_right - w_right * mean_tot) / w_right;
+            }
+
+            else
+            {
+                double sd_left  = std::sqrt(std::fmax(0., ssq_left  / w_left  - square(sum_left  / w_left)));
+                double sd_right = std::sqrt(std::fmax(0., ssq_right / w_right - square(sum_right / w_right)));
+                this_gain = (criterion == Pooled)?
+                            (1. - (1. / full_sd) * ((w_left / w_tot) * sd_left + (w_right / w_tot) * sd_right))
+                                :
+                            sd_gain(full_sd, sd_left, sd_right);
+            }
+
+            if (this_gain > best_gain && (rel_gain || this_gain > min_gain))
+            {
+                best_gain = this_gain;
+                split_point = avg_between(x_left, x_right);
+            }
+        };
+        auto add_to_left = [&](size_t ix)
+        {
+            double w_this = weighted? w[ix] : 1.;
+            w_left   += w_this;
+            sum_left += w_this * (x[ix] - shift);
+            ssq_left += w_this * square(x[ix] - shift);
+        };
+
+        /* splits within the first bin */
+        for (size_t *row = ix_arr + st; row < first_bin_end - 1; row++)
+        {
+            add_to_left(*row);
+            if (x[*row] != x[*(row+1)])
+                eval_split(x[*row], x[*(row+1)]);
+        }
+        add_to_left(*(first_bin_end - 1));
+
+        /* splits between bins */
+        size_t last_left = first_bin;
+        for (bin = first_bin + 1; bin <= last_bin; bin++)
+        {
+            if (bin_min[bin] > bin_max[bin]) continue;
+            eval_split(bin_max[last_left], bin_min[bin]);
+            if (bin == last_bin) break;
+            w_left   += bin_w[bin];
+            sum_left += bin_sum[bin];
+            ssq_left += bin_ssq[bin];
+            last_left = bin;
+        }
+
+        /* splits within the last bin */
+        for (size_t *row = last_bin_st; row < ix_arr + end; row++)
+        {
+            add_to_left(*row);
+            if (x[*row] != x[*(row+1)])
+                eval_split(x[*row], x[*(row+1)]);
+        }
+
+        if (rel_gain && best_gain > -HUGE_VAL)
+            best_gain = std::fmax(best_gain, std::numeric_limits<double>::epsilon());
+        /* Note: a gain of -Inf signals that the data is unsplittable. Zero signals it's below the minimum. */
+        return std::fmax(0., best_gain);
+    }
+
+    exact_eval:
+    if (!weighted)
+        return eval_guided_crit(ix_arr, st, end, x, buffer_sd, as_relative_gain,
+                                split_ix, split_point, xmin, xmax,
+                                criterion, min_gain, missing_action);
+    else
+        return eval_guided_crit_weighted(ix_arr, st, end, x, buffer_sd, as_relative_gain,
+                                         split_ix, split_point, xmin, xmax,
+                                         criterion, min_gain, missing_action, w);
+}
+
+template <class real_t_>
+double eval_guided_crit_binned(size_t *restrict ix_arr, size_t st, size_t end, real_t_ *restrict x,
+                               uint8_t *restrict x_bin, size_t nbins, double *restrict buffer_hist,
+                               double *restrict buffer_sd, bool as_relative_gain,
+                               size_t &split_ix, double &split_point, double &xmin, double &xmax,
+                               GainCriterion criterion, double min_gain, MissingAction missing_action)
+{
+    double *no_weights = NULL;
+    return eval_guided_crit_binned_t(ix_arr, st, end, x, x_bin, nbins, buffer_hist, buffer_sd, as_relative_gain,
+                                     split_ix, split_point, xmin, xmax, criterion, min_gain, missing_action,
+                                     no_weights, false);
+}
+
+template <class real_t_, class mapping>
+double eval_guided_crit_binned_weighted(size_t *restrict ix_arr, size_t st, size_t end, real_t_ *restrict x,
+                                        uint8_t *restrict x_bin, size_t nbins, double *restrict buffer_hist,
+                                        double *restrict buffer_sd, bool as_relative_gain,
+                                        size_t &split_ix, double &split_point, double &xmin, double &xmax,
+                                        GainCriterion criterion, double min_gain, MissingAction missing_action,
+                                        mapping &w)
+{
+    return eval_guided_crit_binned_t(ix_arr, st, end, x, x_bin, nbins, buffer_hist, buffer_sd, as_relative_gain,
+                                     split_ix, split_point, xmin, xmax, criterion, min_gain, missing_action,
+                                     w, true);
+}
+
 /* How this works:
    - For Averaged criterion, will take the expected standard deviation that would be gotten with the category counts
      if each category got assigned a real number at random ~ Unif(0,1) and the data were thus converted to
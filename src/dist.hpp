@@ -86,9 +86,9 @@
 * - nrows
 *       Number of rows in 'numeric_data', 'Xc', 'Xr, 'categ_data'.
 * - nthreads
-*       Number of parallel threads to use. Note that, the more threads, the more memory will be
-*       allocated, even if the thread does not end up being used. Ignored when not building with
-*       OpenMP support.
+*       Number of parallel threads to use. All threads add into the same output matrix, each one into
+*       its own block of rows, so using more threads does not require more memory. Ignored when not
+*       building with OpenMP support.
 * - assume_full_distr
 *       Whether to assume that the fitted model represents a full population distribution (will use a
 *       standardizing criterion assuming infinite sample, and the results of the similarity between two points
@@ -144,7 +144,7 @@ void calc_similarity(real_t numeric_data[], int categ_data[],
 {
     PredictionData<real_t, sparse_ix>
                    prediction_data = {numeric_data, categ_data, nrows,
-                                      false, 0, 0,
+                                      false, 0, 0, nrows, nrows,
                                       Xc, Xc_ind, Xc_indptr,
                                       NULL, NULL, NULL};
 
@@ -152,13 +152,16 @@ void calc_similarity(real_t numeric_data[], int categ_data[],
 
     if (tmat != NULL) n_from = 0;
 
-    if ((size_t)nthreads > ntrees)
-        nthreads = (int)ntrees;
+    /* each worker goes through all the trees, adding only the pairs in its own block of the output */
+    size_t max_blocks = (tmat != NULL)? (nrows - 1) : std::max(n_from, nrows - n_from);
+    if ((size_t)nthreads > max_blocks)
+        nthreads = (int)std::max(max_blocks, (size_t)1);
     #ifdef _OPENMP
     std::vector<WorkerForSimilarity> worker_memory(nthreads);
     #else
     std::vector<WorkerForSimilarity> worker_memory(1);
     #endif
+    assign_sim_blocks(worker_memory, nrows, n_from, tmat, rmat);
 
     /* Global variable that determines if the procedure receives a stop signal */
     SignalSwitcher ss = SignalSwitcher();
@@ -167,54 +170,1417 @@ void calc_similarity(real_t numeric_data[], int categ_data[],
     if (interrupt_switch) return;
     #endif
 
-    if (model_outputs != NULL)
+    #pragma omp parallel for schedule(static, 1) num_threads(nthreads) shared(ntrees, worker_memory, prediction_data, model_outputs, model_outputs_ext)
+    for (size_t_for block = 0; block < (size_t_for)worker_memory.size(); block++)
     {
-        #pragma omp parallel for schedule(dynamic) num_threads(nthreads) shared(ntrees, worker_memory, prediction_data, model_outputs)
-        for (size_t_for tree = 0; tree < ntrees; tree++)
+        WorkerForSimilarity &workspace = worker_memory[block];
+        for (size_t tree = 0; tree < ntrees; tree++)
+        {
+            if (interrupt_switch) continue;
+
+            if (model_outputs != NULL)
+            {
+                initialize_worker_for_sim(workspace, prediction_data,
+                                          model_outputs, NULL, n_from, assume_full_distr);
+                traverse_tree_sim(workspace,
+                                  prediction_data,
+                                  *model_outputs,
+                                  model_outputs->trees[tree],
+                                  (size_t)0);
+            }
+
+            else
+            {
+                initialize_worker_for_sim(workspace, prediction_data,
+                                          NULL, model_outputs_ext, n_from, assume_full_distr);
+                traverse_hplane_sim(workspace,
+                                    prediction_data,
+                                    *model_outputs_ext,
+                                    model_outputs_ext->hplanes[tree],
+                                    (size_t)0);
+            }
+        }
+    }
+
+    check_interrupt_switch(ss);
+    #if defined(DONT_THROW_ON_INTERRUPT)
+    if (interrupt_switch) return;
+    #endif
+    
+    /* gather and transform the results */
+    gather_sim_result< PredictionData<real_t, sparse_ix>, InputData<real_t, sparse_ix> >
+                     (&prediction_data, NULL,
+                      model_outputs, model_outputs_ext,
+                      tmat, rmat, n_from,
+                      ntrees, assume_full_distr,
+                      standardize_dist, nthreads);
+
+    check_interrupt_switch(ss);
+    #if defined(DONT_THROW_ON_INTERRUPT)
+    if (interrupt_switch) return;
+    #endif
+}
+
+/* Calculate the nearest neighbors of each row, according to the same distance or similarity as 'calc_similarity'
+* 
+* Parameters
+* ==========
+* - numeric_data[nrows * ncols_numeric]
+*       Pointer to numeric data for which to make calculations, in the same format as for 'calc_similarity'.
+*       Pass NULL if there are no dense numeric columns.
+* - categ_data[nrows * ncols_categ]
+*       Pointer to categorical data for which to make calculations, in the same format as for 'calc_similarity'.
+*       Pass NULL if there are no categorical columns.
+* - Xc[nnz], Xc_ind[nnz], Xc_indptr[ncols_numeric + 1]
+*       Sparse numeric data in CSC format, in the same format as for 'calc_similarity'.
+*       Pass NULL if there are no sparse numeric columns.
+* - nrows
+*       Number of rows in the data.
+* - nthreads
+*       Number of parallel threads to use. Each thread will allocate an array of size 'nrows'.
+* - assume_full_distr
+*       Same as for 'calc_similarity'.
+* - standardize_dist
+*       Same as for 'calc_similarity'. If passing 'false', the output will be the average separation
+*       depth, for which higher values mean closer rows.
+* - model_outputs
+*       Pointer to fitted single-variable model object from function 'fit_iforest'. Pass NULL
+*       if the calculations are to be made from an extended model.
+* - model_outputs_ext
+*       Pointer to fitted extended model object from function 'fit_iforest'. Pass NULL
+*       if the calculations are to be made from a single-variable model.
+* - k
+*       Number of neighbors to output for each row.
+* - knn_indptr[nrows + 1] (out)
+*       Array where the row index pointers of the CSR matrix with the neighbors will be written into.
+*       Rows with fewer than 'k' candidates will have fewer entries.
+* - knn_indices[nrows * k] (out)
+*       Array where the indices of the neighbors of each row will be written into, from the closest
+*       to the farthest (ties are broken by index), at the positions given by 'knn_indptr'.
+* - knn_dist[nrows * k] (out)
+*       Array where the distances or average separation depths to each neighbor will be written into,
+*       in the same positions as 'knn_indices'.
+*/
+template <class real_t, class sparse_ix>
+void calc_similarity_knn(real_t numeric_data[], int categ_data[],
+                         real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                         size_t nrows, int nthreads, bool assume_full_distr, bool standardize_dist,
+                         IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                         size_t k, sparse_ix knn_indptr[], sparse_ix knn_indices[], double knn_dist[])
+{
+    if (nrows < 2) k = 0;
+    k = std::min(k, nrows - 1);
+    if (!k)
+    {
+        std::fill(knn_indptr, knn_indptr + nrows + 1, (sparse_ix)0);
+        return;
+    }
+
+    if ((size_t)nthreads > nrows)
+        nthreads = (int)nrows;
+
+    /* Global variable that determines if the procedure receives a stop signal */
+    SignalSwitcher ss = SignalSwitcher();
+
+    NodeRowIndex node_index;
+    build_node_row_index(numeric_data, categ_data, Xc, Xc_ind, Xc_indptr,
+                         nrows, nthreads, assume_full_distr,
+                         model_outputs, model_outputs_ext, node_index);
+
+    check_interrupt_switch(ss);
+    #if defined(DONT_THROW_ON_INTERRUPT)
+    if (interrupt_switch) return;
+    #endif
+
+    find_knn_from_node_index(node_index, nthreads, standardize_dist,
+                             similarity_divisor(model_outputs, model_outputs_ext, nrows, assume_full_distr),
+                             k, knn_indptr, knn_indices, knn_dist);
+}
+
+/* Find the 'k' nearest neighbors of each row in 'node_index' (with 'k' already limited to the number of
+   other rows), in the same format as 'calc_similarity_knn', with the distances transformed according to
+   'div_trees' as obtained from 'similarity_divisor' */
+template <class sparse_ix>
+void find_knn_from_node_index(NodeRowIndex &node_index, int nthreads, bool standardize_dist, double div_trees,
+                              size_t k, sparse_ix knn_indptr[], sparse_ix knn_indices[], double knn_dist[])
+{
+    size_t nrows = node_index.row_nodes.size() / node_index.ntrees;
+    double ntrees_dbl = (double) node_index.ntrees;
+    if ((size_t)nthreads > nrows)
+        nthreads = (int)nrows;
+
+    /* Global variable that determines if the procedure receives a stop signal */
+    SignalSwitcher ss = SignalSwitcher();
+
+    #ifdef _OPENMP
+    std::vector<WorkerForKNN> worker_memory(nthreads);
+    #else
+    std::vector<WorkerForKNN> worker_memory(1);
+    #endif
+    std::vector<size_t> n_found(nrows);
+
+    #pragma omp parallel for schedule(dynamic) num_threads(nthreads) shared(nrows, k, node_index, worker_memory, n_found, knn_indices, knn_dist, standardize_dist, div_trees, ntrees_dbl)
+    for (size_t_for row = 0; row < nrows; row++)
+    {
+        if (interrupt_switch) continue;
+
+        WorkerForKNN &workspace = worker_memory[omp_get_thread_num()];
+        n_found[row] = find_nearest_rows(node_index, workspace, row, k);
+        for (size_t ix = 0; ix < n_found[row]; ix++)
+        {
+            double sep_depth = workspace.sep_depth[ix].first;
+            knn_indices[row * k + ix] = (sparse_ix) workspace.sep_depth[ix].second;
+            knn_dist[row * k + ix] = standardize_dist?
+                                      exp2( - sep_depth / div_trees)
+                                        :
+                                      ((sep_depth + ntrees_dbl) / ntrees_dbl);
+        }
+    }
+
+    check_interrupt_switch(ss);
+    #if defined(DONT_THROW_ON_INTERRUPT)
+    if (interrupt_switch) return;
+    #endif
+
+    /* move the entries of rows with fewer than 'k' neighbors so as to leave no gaps */
+    knn_indptr[0] = 0;
+    for (size_t row = 0; row < nrows; row++)
+    {
+        size_t st = knn_indptr[row];
+        if (st != row * k)
+        {
+            std::copy(knn_indices + row * k, knn_indices + row * k + n_found[row], knn_indices + st);
+            std::copy(knn_dist + row * k, knn_dist + row * k + n_found[row], knn_dist + st);
+        }
+        knn_indptr[row + 1] = (sparse_ix)(st + n_found[row]);
+    }
+}
+
+/* Divisor for the sums of separation depths across trees, as used in 'gather_sim_result' for the
+   standardized distances, for 'nrows' new rows */
+double similarity_divisor(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext, size_t nrows, bool assume_full_distr)
+{
+    double ntrees_dbl = (double)((model_outputs != NULL)? model_outputs->trees.size() : model_outputs_ext->hplanes.size());
+    if (assume_full_distr)
+        return ntrees_dbl * 2;
+    return ntrees_dbl * ((
+                             (model_outputs != NULL)?
+                              expected_separation_depth_hotstart(model_outputs->exp_avg_sep,
+                                                                  model_outputs->orig_sample_size,
+                                                                  model_outputs->orig_sample_size + nrows)
+                                  :
+                              expected_separation_depth_hotstart(model_outputs_ext->exp_avg_sep,
+                                                                  model_outputs_ext->orig_sample_size,
+                                                                  model_outputs_ext->orig_sample_size + nrows)
+                         ) - 1);
+}
+
+/* Calculate the distances between each row in a set of query rows and each row in a set of reference rows,
+   passing them to a callback one tile at a time
+* 
+* Calculates the same distances or average separation depths as 'calc_similarity' with 'rmat' would for the
+* query rows followed by the reference rows, but produces them by tiles of at most 'tile_rows' query rows
+* and 'tile_cols' reference rows, so that the full matrix does not need to be kept in memory. The terminal
+* node of each reference row in each tree is determined once, while the query rows are processed one tile
+* of rows at a time (plus a first pass over all of them for counting how many rows fall in each terminal
+* node, which is skipped when passing 'assume_full_distr=true').
+* Rows with missing values in models with 'missing_action=Divide' are taken as separated from all other
+* rows at the root of the trees in which they would have been divided.
+* 
+* Parameters
+* ==========
+* - numeric_data[nrows * ncols_numeric]
+*       Pointer to numeric data for the query rows, in the same format as for 'predict_iforest'.
+*       Pass NULL if there are no dense numeric columns.
+* - categ_data[nrows * ncols_categ]
+*       Pointer to categorical data for the query rows, in the same format as for 'predict_iforest'.
+*       Pass NULL if there are no categorical columns.
+* - is_col_major
+*       Whether the dense inputs (both for the query and the reference rows) are in column-major order.
+* - ncols_numeric
+*       Number of numeric columns. Only required when passing row-major dense data.
+* - ncols_categ
+*       Number of categorical columns. Only required when passing row-major dense data.
+* - Xr[nnz], Xr_ind[nnz], Xr_indptr[nrows + 1]
+*       Sparse numeric data for the query rows in CSR format, in the same format as for 'predict_iforest'.
+*       Pass NULL if there are no sparse numeric columns.
+* - nrows
+*       Number of query rows.
+* - ref_numeric_data[nrows_ref * ncols_numeric], ref_categ_data[nrows_ref * ncols_categ]
+*       Dense data for the reference rows, in the same order (row-major or column-major) as for the query rows.
+* - ref_Xr[nnz], ref_Xr_ind[nnz], ref_Xr_indptr[nrows_ref + 1]
+*       Sparse numeric data for the reference rows in CSR format.
+* - nrows_ref
+*       Number of reference rows.
+* - tile_rows
+*       Maximum number of query rows in each tile. Pass zero to make tiles of up to 2^23 entries.
+* - tile_cols
+*       Maximum number of reference rows in each tile. Pass zero to take all of the reference rows.
+* - nthreads
+*       Number of parallel threads to use.
+* - assume_full_distr
+*       Same as for 'calc_similarity'.
+* - standardize_dist
+*       Same as for 'calc_similarity'.
+* - model_outputs
+*       Pointer to fitted single-variable model object from function 'fit_iforest'. Pass NULL
+*       if the calculations are to be made from an extended model. Can only pass one of
+*       'model_outputs' and 'model_outputs_ext'.
+* - model_outputs_ext
+*       Pointer to fitted extended model object from function 'fit_iforest'. Pass NULL
+*       if the calculations are to be made from a single-variable model. Can only pass one of
+*       'model_outputs' and 'model_outputs_ext'.
+* - callback
+*       Function that will be called for each tile, in order of query rows first and reference rows
+*       second, from the same thread that called this function. It receives the tile in row-major
+*       order, with entry [i * ncols_tile + j] containing the distance between query row 'row_st + i'
+*       and reference row 'col_st + j'. The tile is overwritten after the callback returns, so it
+*       should be copied (e.g. into a file) if it needs to be kept.
+* - callback_data
+*       Pointer that will be passed to the callback as-is.
+*/
+template <class real_t, class sparse_ix>
+void calc_similarity_tiled(real_t numeric_data[], int categ_data[],
+                           bool is_col_major, size_t ncols_numeric, size_t ncols_categ,
+                           real_t Xr[], sparse_ix Xr_ind[], sparse_ix Xr_indptr[],
+                           size_t nrows,
+                           real_t ref_numeric_data[], int ref_categ_data[],
+                           real_t ref_Xr[], sparse_ix ref_Xr_ind[], sparse_ix ref_Xr_indptr[],
+                           size_t nrows_ref,
+                           size_t tile_rows, size_t tile_cols,
+                           int nthreads, bool assume_full_distr, bool standardize_dist,
+                           IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                           SimilarityTileCallback callback, void *callback_data)
+{
+    if (!nrows || !nrows_ref)
+        return;
+    if (!tile_cols || tile_cols > nrows_ref)
+        tile_cols = nrows_ref;
+    if (!tile_rows)
+        tile_rows = std::max(((size_t)1 << 23) / tile_cols, (size_t)1);
+    tile_rows = std::min(tile_rows, nrows);
+
+    /* Global variable that determines if the procedure receives a stop signal */
+    SignalSwitcher ss = SignalSwitcher();
+
+    NodeRowIndex node_index;
+    init_node_index(model_outputs, model_outputs_ext, node_index);
+    size_t ntrees = node_index.ntrees;
+    size_t tot_nodes = node_index.node_offset.back();
+
+    /* the query rows are passed by pieces, which are located in the same way as for the full data */
+    size_t ld_numeric = is_col_major? nrows : ncols_numeric;
+    size_t ld_categ   = is_col_major? nrows : ncols_categ;
+    std::vector<size_t> query_nodes(tile_rows * ntrees);
+    auto get_query_nodes = [&](size_t row_st, size_t n)
+    {
+        get_row_nodes(
+            (numeric_data == NULL)? (real_t*)NULL : (numeric_data + (is_col_major? row_st : row_st * ncols_numeric)),
+            (categ_data == NULL)? (int*)NULL : (categ_data + (is_col_major? row_st : row_st * ncols_categ)),
+            is_col_major, ncols_numeric, ncols_categ, ld_numeric, ld_categ,
+            (real_t*)NULL, (sparse_ix*)NULL, (sparse_ix*)NULL,
+            Xr, Xr_ind, (Xr_indptr == NULL)? (sparse_ix*)NULL : (Xr_indptr + row_st),
+            n, nthreads,
+            model_outputs, model_outputs_ext,
+            node_index, query_nodes.data(), false
+        );
+    };
+
+    /* the reference rows are kept by tree, so that each tile is filled one tree at a time */
+    std::vector<size_t> ref_nodes(nrows_ref * ntrees);
+    get_row_nodes(ref_numeric_data, ref_categ_data,
+                  is_col_major, ncols_numeric, ncols_categ, (size_t)0, (size_t)0,
+                  (real_t*)NULL, (sparse_ix*)NULL, (sparse_ix*)NULL,
+                  ref_Xr, ref_Xr_ind, ref_Xr_indptr,
+                  nrows_ref, nthreads,
+                  model_outputs, model_outputs_ext,
+                  node_index, ref_nodes.data(), true);
+
+    /* the separation depth of rows falling in the same terminal node depends on how many rows end up there */
+    std::vector<size_t> rows_per_node;
+    if (!assume_full_distr)
+    {
+        rows_per_node.resize(tot_nodes, 0);
+        for (size_t node : ref_nodes)
+            rows_per_node[node]++;
+        for (size_t row_st = 0; row_st < nrows; row_st += tile_rows)
+        {
+            size_t n = std::min(tile_rows, nrows - row_st);
+            get_query_nodes(row_st, n);
+            for (size_t ix = 0; ix < n * ntrees; ix++)
+                rows_per_node[query_nodes[ix]]++;
+            check_interrupt_switch(ss);
+            #if defined(DONT_THROW_ON_INTERRUPT)
+            if (interrupt_switch) return;
+            #endif
+        }
+    }
+
+    #pragma omp parallel for schedule(dynamic) num_threads(nthreads) shared(ntrees, model_outputs, model_outputs_ext, assume_full_distr, node_index, rows_per_node)
+    for (size_t_for tree = 0; tree < ntrees; tree++)
+    {
+        const size_t *extra_rows = rows_per_node.size()? rows_per_node.data() : (size_t*)NULL;
+        if (model_outputs != NULL)
+            add_tree_to_node_index(model_outputs->trees[tree], tree, assume_full_distr, node_index, extra_rows);
+        else
+            add_tree_to_node_index(model_outputs_ext->hplanes[tree], tree, assume_full_distr, node_index, extra_rows);
+    }
+    rows_per_node.clear();
+    rows_per_node.shrink_to_fit();
+
+    check_interrupt_switch(ss);
+    #if defined(DONT_THROW_ON_INTERRUPT)
+    if (interrupt_switch) return;
+    #endif
+
+    /* same transformation as in 'gather_sim_result', with the query and reference rows as a single dataset */
+    double ntrees_dbl = (double) ntrees;
+    double div_trees  = similarity_divisor(model_outputs, model_outputs_ext, nrows + nrows_ref, assume_full_distr);
+
+    std::vector<double> tile(tile_rows * tile_cols);
+    for (size_t row_st = 0; row_st < nrows; row_st += tile_rows)
+    {
+        size_t n_rows_tile = std::min(tile_rows, nrows - row_st);
+        get_query_nodes(row_st, n_rows_tile);
+
+        for (size_t col_st = 0; col_st < nrows_ref; col_st += tile_cols)
+        {
+            size_t n_cols_tile = std::min(tile_cols, nrows_ref - col_st);
+            double *restrict tile_ptr = tile.data();
+            #pragma omp parallel for schedule(dynamic) num_threads(nthreads) shared(n_rows_tile, n_cols_tile, col_st, tile_ptr, node_index, query_nodes, ref_nodes, standardize_dist, div_trees, ntrees_dbl)
+            for (size_t_for row = 0; row < n_rows_tile; row++)
+            {
+                if (interrupt_switch) continue;
+                double *restrict sep_depth = tile_ptr + row * n_cols_tile;
+                std::fill(sep_depth, sep_depth + n_cols_tile, 0.);
+                for (size_t tree = 0; tree < node_index.ntrees; tree++)
+                    add_tree_separation_depths(node_index, query_nodes[row * node_index.ntrees + tree],
+                                               ref_nodes.data() + tree * nrows_ref + col_st, n_cols_tile,
+                                               sep_depth);
+                for (size_t col = 0; col < n_cols_tile; col++)
+                    sep_depth[col] = standardize_dist?
+                                      exp2( - sep_depth[col] / div_trees)
+                                        :
+                                      ((sep_depth[col] + ntrees_dbl) / ntrees_dbl);
+            }
+
+            check_interrupt_switch(ss);
+            #if defined(DONT_THROW_ON_INTERRUPT)
+            if (interrupt_switch) return;
+            #endif
+
+            callback(tile.data(), row_st, col_st, n_rows_tile, n_cols_tile, callback_data);
+        }
+    }
+}
+
+/* Calculate the leaf signatures of rows, from which distances can be estimated later without the model
+* 
+* The signature of a row in a tree identifies the terminal node in which it falls through the branches
+* taken from the root to it, encoded as one bit per level (zero for left, one for right) starting from the
+* highest bit, followed by a single set bit which marks the depth of the node. Two rows then share the
+* first 'n' nodes of their paths in a tree if the first 'n' bits of their signatures are equal, so their
+* separation depth can be obtained from the signatures alone, in O(ntrees) time per pair (see function
+* 'signature_separation_depth'), and rows can be grouped by shared path prefixes for locality-sensitive
+* hashing (see function 'get_signature_buckets').
+* Paths deeper than 63 levels are truncated to their first 63 levels. Rows with missing values in models
+* with 'missing_action=Divide', which do not end up in a single terminal node, get a signature of zero
+* in the trees in which they would have been divided.
+* 
+* Parameters
+* ==========
+* - numeric_data[nrows * ncols_numeric]
+*       Pointer to numeric data, in the same format as for 'predict_iforest'.
+*       Pass NULL if there are no dense numeric columns.
+* - categ_data[nrows * ncols_categ]
+*       Pointer to categorical data, in the same format as for 'predict_iforest'.
+*       Pass NULL if there are no categorical columns.
+* - is_col_major
+*       Whether 'numeric_data' and 'categ_data' come in column-major order.
+* - ncols_numeric
+*       Number of columns in 'numeric_data'. Only required when passing row-major dense data.
+* - ncols_categ
+*       Number of columns in 'categ_data'. Only required when passing row-major dense data.
+* - Xc[nnz], Xc_ind[nnz], Xc_indptr[ncols_numeric + 1]
+*       Sparse numeric data in CSC format, if the data is sparse. Pass NULL otherwise.
+* - Xr[nnz], Xr_ind[nnz], Xr_indptr[nrows + 1]
+*       Sparse numeric data in CSR format, if the data is sparse. Pass NULL otherwise.
+* - nrows
+*       Number of rows in the data.
+* - nthreads
+*       Number of parallel threads to use.
+* - model_outputs
+*       Pointer to fitted single-variable model object from function 'fit_iforest'. Pass NULL
+*       if the calculations are to be made from an extended model. Can only pass one of
+*       'model_outputs' and 'model_outputs_ext'.
+* - model_outputs_ext
+*       Pointer to fitted extended model object from function 'fit_iforest'. Pass NULL
+*       if the calculations are to be made from a single-variable model. Can only pass one of
+*       'model_outputs' and 'model_outputs_ext'.
+* - signatures[nrows * ntrees] (out)
+*       Array where the signatures will be written into, in row-major order (i.e. entry
+*       [row * ntrees + tree] contains the signature of row 'row' in tree 'tree').
+*/
+template <class real_t, class sparse_ix>
+void get_leaf_signatures(real_t numeric_data[], int categ_data[],
+                         bool is_col_major, size_t ncols_numeric, size_t ncols_categ,
+                         real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                         real_t Xr[], sparse_ix Xr_ind[], sparse_ix Xr_indptr[],
+                         size_t nrows, int nthreads,
+                         IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                         uint64_t signatures[])
+{
+    if (!nrows)
+        return;
+
+    NodeRowIndex node_index;
+    init_node_index(model_outputs, model_outputs_ext, node_index);
+    size_t ntrees = node_index.ntrees;
+
+    #pragma omp parallel for schedule(dynamic) num_threads(nthreads) shared(ntrees, model_outputs, model_outputs_ext, node_index)
+    for (size_t_for tree = 0; tree < ntrees; tree++)
+    {
+        if (model_outputs != NULL)
+            add_tree_to_node_index(model_outputs->trees[tree], tree, true, node_index, (size_t*)NULL);
+        else
+            add_tree_to_node_index(model_outputs_ext->hplanes[tree], tree, true, node_index, (size_t*)NULL);
+    }
+
+    size_t tot_nodes = node_index.node_offset.back();
+    std::vector<uint64_t> node_signature(tot_nodes);
+    for (size_t node = 0; node < tot_nodes; node++)
+        node_signature[node] = (node_index.terminal_sep[node] < 0)?
+                                (uint64_t)0 : make_signature(node_index.path[node], node_index.depth[node]);
+
+    /* rows which do not end up in a single terminal node are left at the root, which is not a terminal
+       node unless the tree has only one node */
+    TerminalNodeMapping node_numbers;
+    build_node_number_mapping(node_index, node_numbers);
+    std::vector<sparse_ix> tree_num(nrows * ntrees, 0);
+    std::vector<double> depths(nrows, 0);
+    predict_iforest<real_t, sparse_ix>(numeric_data, categ_data,
+                                       is_col_major, ncols_numeric, ncols_categ, (size_t)0, (size_t)0,
+                                       Xc, Xc_ind, Xc_indptr,
+                                       Xr, Xr_ind, Xr_indptr,
+                                       nrows, nthreads, false,
+                                       model_outputs, model_outputs_ext,
+                                       depths.data(), tree_num.data(), &node_numbers);
+
+    size_t *restrict node_offset = node_index.node_offset.data();
+    #pragma omp parallel for schedule(static) num_threads(nthreads) shared(nrows, ntrees, signatures, node_signature, node_offset, tree_num)
+    for (size_t_for row = 0; row < nrows; row++)
+        for (size_t tree = 0; tree < ntrees; tree++)
+            signatures[row * ntrees + tree] = node_signature[node_offset[tree] + (size_t)tree_num[row + nrows * tree]];
+}
+
+/* Signature of a node with the given path bits (as in 'NodeRowIndex'), truncated to the first 63 levels */
+uint64_t make_signature(uint64_t path, size_t depth)
+{
+    depth = std::min(depth, (size_t)63);
+    uint64_t marker = (uint64_t)1 << (63 - depth);
+    return (path & ~(marker | (marker - 1))) | marker;
+}
+
+size_t signature_depth(uint64_t signature)
+{
+    #if defined(__GNUC__) || defined(__clang__)
+    return (size_t)63 - (size_t)__builtin_ctzll((unsigned long long)signature);
+    #else
+    size_t depth = 63;
+    while (!(signature & 1)) { signature >>= 1; depth--; }
+    return depth;
+    #endif
+}
+
+/* Calculate the separation depth between two rows from their leaf signatures
+* 
+* Rows in different terminal nodes get the depth at which their paths diverge, and rows in the same
+* terminal node get the separation depth expected under 'assume_full_distr=true', so for trees not
+* deeper than 63 levels, the result is the same as what 'calc_similarity' would obtain (before adding
+* the first hop and standardizing) with 'assume_full_distr=true'. Trees in which one of the rows has
+* a signature of zero are taken as separating the rows at the root.
+* 
+* Parameters
+* ==========
+* - signature1[ntrees]
+*       Signatures of the first row, as output by 'get_leaf_signatures'.
+* - signature2[ntrees]
+*       Signatures of the second row, as output by 'get_leaf_signatures'.
+* - ntrees
+*       Number of trees in the model that produced the signatures.
+* 
+* Returns
+* =======
+* The sum across trees of the separation depths, without the first hop.
+*/
+double signature_separation_depth(const uint64_t *restrict signature1, const uint64_t *restrict signature2, size_t ntrees)
+{
+    size_t sep_depth = 0;
+    for (size_t tree = 0; tree < ntrees; tree++)
+    {
+        uint64_t sig1 = signature1[tree], sig2 = signature2[tree];
+        if (!sig1 || !sig2)
+            continue;
+        if (sig1 == sig2)
+        {
+            sep_depth += std::max(signature_depth(sig1), (size_t)1) + 2;
+            continue;
+        }
+
+        uint64_t diff = sig1 ^ sig2;
+        #if defined(__GNUC__) || defined(__clang__)
+        sep_depth += (size_t)__builtin_clzll((unsigned long long)diff);
+        #else
+        while (!(diff & ((uint64_t)1 << 63))) { diff <<= 1; sep_depth++; }
+        #endif
+    }
+    return (double)sep_depth;
+}
+
+/* Calculate distance or similarity between rows from their leaf signatures
+* 
+* Produces the same outputs as 'calc_similarity' with 'assume_full_distr=true' (see the documentation
+* of 'signature_separation_depth' for the exceptions), from the output of 'get_leaf_signatures'.
+* 
+* Parameters
+* ==========
+* - signatures[nrows * ntrees]
+*       Signatures of the rows, as output by 'get_leaf_signatures'.
+* - nrows
+*       Number of rows in 'signatures'.
+* - ntrees
+*       Number of trees in the model that produced the signatures.
+* - nthreads
+*       Number of parallel threads to use.
+* - standardize_dist
+*       Same as for 'calc_similarity'.
+* - tmat[nrows * (nrows - 1) / 2] (out)
+*       Same as for 'calc_similarity', but does not need to be initialized to zeros.
+* - rmat[n_from * (nrows - n_from)] (out)
+*       Same as for 'calc_similarity', but does not need to be initialized to zeros.
+* - n_from
+*       Same as for 'calc_similarity'.
+*/
+void calc_similarity_from_signatures(const uint64_t signatures[], size_t nrows, size_t ntrees, int nthreads,
+                                     bool standardize_dist, double tmat[], double rmat[], size_t n_from)
+{
+    if (nrows < 2)
+        return;
+
+    /* Global variable that determines if the procedure receives a stop signal */
+    SignalSwitcher ss = SignalSwitcher();
+
+    double ntrees_dbl = (double) ntrees;
+    double div_trees  = 2 * ntrees_dbl;
+    size_t ncomb = (nrows * (nrows - 1)) / 2;
+    size_t n_to  = nrows - n_from;
+    size_t row_end = (tmat != NULL)? (nrows - 1) : n_from;
+
+    #pragma omp parallel for schedule(dynamic) num_threads(nthreads) shared(signatures, nrows, ntrees, tmat, rmat, n_from, n_to, ncomb, row_end, standardize_dist, div_trees, ntrees_dbl)
+    for (size_t_for row = 0; row < row_end; row++)
+    {
+        if (interrupt_switch) continue;
+
+        /* the pairs of a row with the rows after it are contiguous in 'tmat', starting at 'ix_comb(row, row + 1)' */
+        size_t col_st = (tmat != NULL)? (row + 1) : n_from;
+        double *restrict out = (tmat != NULL)?
+                                (tmat + ncomb - ((nrows - row) * (nrows - row - 1)) / 2)
+                                  :
+                                (rmat + row * n_to);
+        for (size_t col = col_st; col < nrows; col++)
+        {
+            double sep_depth = signature_separation_depth(signatures + row * ntrees, signatures + col * ntrees, ntrees);
+            out[col - col_st] = standardize_dist?
+                                 exp2( - sep_depth / div_trees)
+                                   :
+                                 ((sep_depth + ntrees_dbl) / ntrees_dbl);
+        }
+    }
+
+    check_interrupt_switch(ss);
+}
+
+/* Assign rows to hash buckets according to the prefixes of their leaf signatures
+* 
+* The trees are split into bands of 'trees_per_band' consecutive trees, and each row gets a bucket in
+* each band which is a hash of its signatures in the trees of that band, after truncating them to their
+* first 'prefix_depth' levels. Two rows then fall in the same bucket of a band if their paths share at
+* least the first 'prefix_depth' nodes in all of the trees of the band (or in the uncommon case of a hash
+* collision), which for rows that are close to each other happens more often than for rows that are far
+* apart. Rows that share a bucket in any band can then be taken as candidates for nearest neighbors, with
+* fewer trees per band or smaller prefixes producing more candidates.
+* Note that rows with a signature of zero in some tree fall in the same bucket as each other in the
+* band of that tree if they share the prefixes in the other trees of the band.
+* 
+* Parameters
+* ==========
+* - signatures[nrows * ntrees]
+*       Signatures of the rows, as output by 'get_leaf_signatures'.
+* - nrows
+*       Number of rows in 'signatures'.
+* - ntrees
+*       Number of trees in the model that produced the signatures.
+* - trees_per_band
+*       Number of trees in each band. The last band will have fewer trees if 'ntrees' is not a
+*       multiple of it.
+* - prefix_depth
+*       Number of levels of the paths to compare. Pass zero or a number larger than the depth of
+*       the trees to compare the full paths.
+* - nthreads
+*       Number of parallel threads to use.
+* - buckets[nrows * ceil(ntrees / trees_per_band)] (out)
+*       Array where the buckets will be written into, in row-major order (i.e. entry
+*       [row * nbands + band] contains the bucket of row 'row' in band 'band').
+*/
+void get_signature_buckets(const uint64_t signatures[], size_t nrows, size_t ntrees,
+                           size_t trees_per_band, size_t prefix_depth, int nthreads,
+                           uint64_t buckets[])
+{
+    if (!trees_per_band)
+        throw std::runtime_error("'trees_per_band' must be positive.\n");
+    if (!prefix_depth || prefix_depth > 63)
+        prefix_depth = 63;
+    size_t nbands = (ntrees + trees_per_band - 1) / trees_per_band;
+
+    #pragma omp parallel for schedule(static) num_threads(nthreads) shared(signatures, nrows, ntrees, trees_per_band, prefix_depth, nbands, buckets)
+    for (size_t_for row = 0; row < nrows; row++)
+    {
+        for (size_t band = 0; band < nbands; band++)
+        {
+            size_t tree_end = std::min((band + 1) * trees_per_band, ntrees);
+            uint64_t bucket = hash_signature((uint64_t)band, (uint64_t)0);
+            for (size_t tree = band * trees_per_band; tree < tree_end; tree++)
+            {
+                uint64_t sig = signatures[row * ntrees + tree];
+                if (sig && signature_depth(sig) > prefix_depth)
+                    sig = make_signature(sig, prefix_depth);
+                bucket = hash_signature(bucket, sig);
+            }
+            buckets[row * nbands + band] = bucket;
+        }
+    }
+}
+
+/* Combines a signature into a hash, mixing the bits as in the finalizer of 'splitmix64' */
+uint64_t hash_signature(uint64_t hash, uint64_t signature)
+{
+    uint64_t z = hash ^ (signature + (uint64_t)0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2));
+    z = (z ^ (z >> 30)) * (uint64_t)0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * (uint64_t)0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+/* Build an index with the terminal node in which each row of the data to which a model was fit falls in
+   each tree, from which the distances between those rows can later be calculated without passing them
+   through the trees again
+* 
+* The index is built from a single pass of the rows through the trees, as done by 'predict_iforest' when
+* outputting terminal node numbers, and keeps those numbers bit-packed, using as many bits for each of them
+* as needed for the tree with the most terminal nodes. It can be serialized along with the model through
+* function 'serialize_training_leaf_index', and be used for calculating the distances between the rows
+* through function 'calc_similarity_from_leaf_index' or their nearest neighbors through function
+* 'calc_similarity_knn_from_leaf_index', which produce the same results as 'calc_similarity' and
+* 'calc_similarity_knn' would on the same data.
+* Note that the index covers all of the rows in each tree, not just the ones that were sampled for the tree
+* when fitting the model. Rows with missing values in models with 'missing_action=Divide' are taken as
+* separated from all other rows at the root of the trees in which they would have been divided.
+* 
+* Parameters
+* ==========
+* - numeric_data[nrows * ncols_numeric]
+*       Pointer to numeric data to which the model was fit, in column-major order.
+*       Pass NULL if there are no dense numeric columns.
+* - categ_data[nrows * ncols_categ]
+*       Pointer to categorical data to which the model was fit, in column-major order.
+*       Pass NULL if there are no categorical columns.
+* - Xc[nnz], Xc_ind[nnz], Xc_indptr[ncols_numeric + 1]
+*       Sparse numeric data in CSC format, if the data is sparse. Pass NULL otherwise.
+* - nrows
+*       Number of rows in the data.
+* - nthreads
+*       Number of parallel threads to use.
+* - model_outputs
+*       Pointer to fitted single-variable model object from function 'fit_iforest'. Pass NULL
+*       if the index is to be built for an extended model. Can only pass one of
+*       'model_outputs' and 'model_outputs_ext'.
+* - model_outputs_ext
+*       Pointer to fitted extended model object from function 'fit_iforest'. Pass NULL
+*       if the index is to be built for a single-variable model. Can only pass one of
+*       'model_outputs' and 'model_outputs_ext'.
+* - leaf_index (out)
+*       Object where the index will be written into. Needs to be built again if the model
+*       gets modified afterwards.
+*/
+template <class real_t, class sparse_ix>
+void build_training_leaf_index(real_t numeric_data[], int categ_data[],
+                               real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                               size_t nrows, int nthreads,
+                               IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                               TrainingLeafIndex &leaf_index)
+{
+    NodeRowIndex node_index;
+    init_node_index(model_outputs, model_outputs_ext, node_index);
+    size_t ntrees = node_index.ntrees;
+
+    TerminalNodeMapping terminal_mapping;
+    build_terminal_mapping(model_outputs, model_outputs_ext, terminal_mapping);
+    size_t max_terminal = 0;
+    for (size_t tree = 0; tree < ntrees; tree++)
+        max_terminal = std::max(max_terminal, terminal_mapping.terminal_offset[tree + 1] - terminal_mapping.terminal_offset[tree]);
+
+    /* the largest number that fits in the bits is left for rows that do not end up in a single terminal node */
+    size_t bits_per_leaf = 1;
+    while ((((uint64_t)1 << bits_per_leaf) - 1) < (uint64_t)max_terminal)
+        bits_per_leaf++;
+    leaf_index.nrows = nrows;
+    leaf_index.ntrees = ntrees;
+    leaf_index.bits_per_leaf = bits_per_leaf;
+    leaf_index.words_per_tree = (nrows * bits_per_leaf + 63) / 64;
+    leaf_index.leaves.assign(ntrees * leaf_index.words_per_tree, 0);
+    leaf_index.leaves.shrink_to_fit();
+
+    TerminalNodeMapping node_numbers;
+    build_node_number_mapping(node_index, node_numbers);
+    std::vector<sparse_ix> tree_num(nrows * ntrees, 0);
+    std::vector<double> depths(nrows, 0);
+    predict_iforest<real_t, sparse_ix>(numeric_data, categ_data,
+                                       true, (size_t)0, (size_t)0, (size_t)0, (size_t)0,
+                                       Xc, Xc_ind, Xc_indptr,
+                                       (real_t*)NULL, (sparse_ix*)NULL, (sparse_ix*)NULL,
+                                       nrows, nthreads, false,
+                                       model_outputs, model_outputs_ext,
+                                       depths.data(), tree_num.data(), &node_numbers);
+
+    uint64_t not_terminal = ((uint64_t)1 << bits_per_leaf) - 1;
+    #pragma omp parallel for schedule(dynamic) num_threads(nthreads) shared(nrows, ntrees, model_outputs, model_outputs_ext, terminal_mapping, tree_num, leaf_index, not_terminal)
+    for (size_t_for tree = 0; tree < ntrees; tree++)
+    {
+        const size_t *restrict terminal_num = terminal_mapping.terminal_num.data() + terminal_mapping.node_offset[tree];
+        for (size_t row = 0; row < nrows; row++)
         {
-            initialize_worker_for_sim(worker_memory[omp_get_thread_num()], prediction_data,
-                                      model_outputs, NULL, n_from, assume_full_distr);
-            traverse_tree_sim(worker_memory[omp_get_thread_num()],
-                              prediction_data,
-                              *model_outputs,
-                              model_outputs->trees[tree],
-                              (size_t)0);
+            size_t node = (size_t)tree_num[row + nrows * tree];
+            bool is_terminal = (model_outputs != NULL)?
+                                (model_outputs->trees[tree][node].score >= 0)
+                                  :
+                                (model_outputs_ext->hplanes[tree][node].score >= 0);
+            set_packed_leaf(leaf_index, tree, row, is_terminal? (uint64_t)terminal_num[node] : not_terminal);
         }
     }
+}
 
-    else
+/* The leaves of each tree start at a new word, so that each tree can be written by a different thread.
+   Setting a leaf assumes that its bits are still zero. */
+void set_packed_leaf(TrainingLeafIndex &leaf_index, size_t tree, size_t row, uint64_t leaf)
+{
+    uint64_t *restrict words = leaf_index.leaves.data() + tree * leaf_index.words_per_tree;
+    size_t bit = row * leaf_index.bits_per_leaf;
+    size_t word = bit / 64, offset = bit % 64;
+    words[word] |= leaf << offset;
+    if (offset + leaf_index.bits_per_leaf > 64)
+        words[word + 1] |= leaf >> (64 - offset);
+}
+
+uint64_t get_packed_leaf(const TrainingLeafIndex &leaf_index, size_t tree, size_t row)
+{
+    const uint64_t *restrict words = leaf_index.leaves.data() + tree * leaf_index.words_per_tree;
+    size_t bit = row * leaf_index.bits_per_leaf;
+    size_t word = bit / 64, offset = bit % 64;
+    uint64_t leaf = words[word] >> offset;
+    if (offset + leaf_index.bits_per_leaf > 64)
+        leaf |= words[word + 1] << (64 - offset);
+    return leaf & ((((uint64_t)1 << leaf_index.bits_per_leaf) - 1));
+}
+
+/* Node numbers (as in 'node_index', which must have been initialized through 'init_node_index') of the rows
+   in a leaf index, written at 'row_nodes[row * ntrees + tree]', or at 'row_nodes[tree * nrows + row]' if
+   passing 'tree_major'. Rows that do not end up in a single terminal node are left at the root. */
+void get_leaf_index_nodes(TrainingLeafIndex &leaf_index, IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                          NodeRowIndex &node_index, size_t row_nodes[], bool tree_major, int nthreads)
+{
+    size_t ntrees = node_index.ntrees;
+    size_t nrows  = leaf_index.nrows;
+    if (leaf_index.ntrees != ntrees)
+        throw std::runtime_error("Leaf index was built for a different model.\n");
+
+    /* invert the mapping from nodes to terminal node numbers */
+    TerminalNodeMapping terminal_mapping;
+    build_terminal_mapping(model_outputs, model_outputs_ext, terminal_mapping);
+    std::vector<size_t> terminal_nodes(terminal_mapping.terminal_offset.back());
+    for (size_t tree = 0; tree < ntrees; tree++)
+    {
+        for (size_t node = 0; node < node_index.node_offset[tree + 1] - node_index.node_offset[tree]; node++)
+        {
+            bool is_terminal = (model_outputs != NULL)?
+                                (model_outputs->trees[tree][node].score >= 0)
+                                  :
+                                (model_outputs_ext->hplanes[tree][node].score >= 0);
+            if (is_terminal)
+                terminal_nodes[terminal_mapping.terminal_offset[tree] + terminal_mapping.terminal_num[node_index.node_offset[tree] + node]]
+                    = node_index.node_offset[tree] + node;
+        }
+    }
+
+    bool mismatched_model = false;
+    #pragma omp parallel for schedule(dynamic) num_threads(nthreads) shared(nrows, ntrees, leaf_index, node_index, terminal_mapping, terminal_nodes, row_nodes, tree_major, mismatched_model)
+    for (size_t_for tree = 0; tree < ntrees; tree++)
     {
-        #pragma omp parallel for schedule(dynamic) num_threads(nthreads) shared(ntrees, worker_memory, prediction_data, model_outputs_ext)
-        for (size_t_for hplane = 0; hplane < ntrees; hplane++)
+        size_t n_terminal = terminal_mapping.terminal_offset[tree + 1] - terminal_mapping.terminal_offset[tree];
+        uint64_t not_terminal = ((uint64_t)1 << leaf_index.bits_per_leaf) - 1;
+        for (size_t row = 0; row < nrows; row++)
         {
-            initialize_worker_for_sim(worker_memory[omp_get_thread_num()], prediction_data,
-                                      NULL, model_outputs_ext, n_from, assume_full_distr);
-            traverse_hplane_sim(worker_memory[omp_get_thread_num()],
-                                prediction_data,
-                                *model_outputs_ext,
-                                model_outputs_ext->hplanes[hplane],
-                                (size_t)0);
-        }    
+            uint64_t leaf = get_packed_leaf(leaf_index, tree, row);
+            size_t node = node_index.node_offset[tree];
+            if (leaf != not_terminal)
+            {
+                if (leaf >= n_terminal)
+                {
+                    mismatched_model = true;
+                    break;
+                }
+                node = terminal_nodes[terminal_mapping.terminal_offset[tree] + leaf];
+            }
+            row_nodes[tree_major? (tree * nrows + row) : (row * ntrees + tree)] = node;
+        }
+    }
+
+    if (mismatched_model)
+        throw std::runtime_error("Leaf index was built for a different model.\n");
+}
+
+/* Calculate distance or similarity between the rows of a training leaf index
+* 
+* Produces the same outputs as 'calc_similarity' would for the data from which the index was built,
+* but takes the terminal nodes of the rows from the index instead of passing them through the trees.
+* 
+* Parameters
+* ==========
+* - leaf_index
+*       Index for the model, as produced by function 'build_training_leaf_index'.
+* - model_outputs
+*       Pointer to the single-variable model for which the index was built. Pass NULL if the index
+*       was built for an extended model. Can only pass one of 'model_outputs' and 'model_outputs_ext'.
+* - model_outputs_ext
+*       Pointer to the extended model for which the index was built. Pass NULL if the index was
+*       built for a single-variable model. Can only pass one of 'model_outputs' and 'model_outputs_ext'.
+* - nthreads
+*       Number of parallel threads to use.
+* - assume_full_distr
+*       Same as for 'calc_similarity'.
+* - standardize_dist
+*       Same as for 'calc_similarity'.
+* - tmat[nrows * (nrows - 1) / 2] (out)
+*       Same as for 'calc_similarity', but does not need to be initialized to zeros.
+* - rmat[n_from * (nrows - n_from)] (out)
+*       Same as for 'calc_similarity', but does not need to be initialized to zeros.
+* - n_from
+*       Same as for 'calc_similarity'.
+*/
+void calc_similarity_from_leaf_index(TrainingLeafIndex &leaf_index,
+                                     IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                                     int nthreads, bool assume_full_distr, bool standardize_dist,
+                                     double tmat[], double rmat[], size_t n_from)
+{
+    size_t nrows = leaf_index.nrows;
+    if (nrows < 2)
+        return;
+
+    /* Global variable that determines if the procedure receives a stop signal */
+    SignalSwitcher ss = SignalSwitcher();
+
+    /* the rows are kept by tree, so that each row of the output is filled one tree at a time */
+    NodeRowIndex node_index;
+    init_node_index(model_outputs, model_outputs_ext, node_index);
+    size_t ntrees = node_index.ntrees;
+    std::vector<size_t> nodes(nrows * ntrees);
+    get_leaf_index_nodes(leaf_index, model_outputs, model_outputs_ext, node_index, nodes.data(), true, nthreads);
+
+    /* the separation depth of rows falling in the same terminal node depends on how many rows end up there */
+    std::vector<size_t> rows_per_node;
+    if (!assume_full_distr)
+    {
+        rows_per_node.resize(node_index.node_offset.back(), 0);
+        for (size_t node : nodes)
+            rows_per_node[node]++;
+    }
+
+    #pragma omp parallel for schedule(dynamic) num_threads(nthreads) shared(ntrees, model_outputs, model_outputs_ext, assume_full_distr, node_index, rows_per_node)
+    for (size_t_for tree = 0; tree < ntrees; tree++)
+    {
+        const size_t *extra_rows = rows_per_node.size()? rows_per_node.data() : (size_t*)NULL;
+        if (model_outputs != NULL)
+            add_tree_to_node_index(model_outputs->trees[tree], tree, assume_full_distr, node_index, extra_rows);
+        else
+            add_tree_to_node_index(model_outputs_ext->hplanes[tree], tree, assume_full_distr, node_index, extra_rows);
     }
+    rows_per_node.clear();
+    rows_per_node.shrink_to_fit();
 
     check_interrupt_switch(ss);
     #if defined(DONT_THROW_ON_INTERRUPT)
     if (interrupt_switch) return;
     #endif
-    
-    /* gather and transform the results */
-    gather_sim_result< PredictionData<real_t, sparse_ix>, InputData<real_t, sparse_ix>, WorkerMemory<ImputedData<sparse_ix>> >
-                     (&worker_memory, NULL,
-                      &prediction_data, NULL,
-                      model_outputs, model_outputs_ext,
-                      tmat, rmat, n_from,
-                      ntrees, assume_full_distr,
-                      standardize_dist, nthreads);
+
+    double ntrees_dbl = (double) ntrees;
+    double div_trees  = similarity_divisor(model_outputs, model_outputs_ext, nrows, assume_full_distr);
+    size_t ncomb = (nrows * (nrows - 1)) / 2;
+    size_t n_to  = nrows - n_from;
+    size_t row_end = (tmat != NULL)? (nrows - 1) : n_from;
+
+    #pragma omp parallel for schedule(dynamic) num_threads(nthreads) shared(nrows, ntrees, nodes, node_index, tmat, rmat, n_from, n_to, ncomb, row_end, standardize_dist, div_trees, ntrees_dbl)
+    for (size_t_for row = 0; row < row_end; row++)
+    {
+        if (interrupt_switch) continue;
+
+        /* the pairs of a row with the rows after it are contiguous in 'tmat', starting at 'ix_comb(row, row + 1)' */
+        size_t col_st = (tmat != NULL)? (row + 1) : n_from;
+        double *restrict sep_depth = (tmat != NULL)?
+                                      (tmat + ncomb - ((nrows - row) * (nrows - row - 1)) / 2)
+                                        :
+                                      (rmat + row * n_to);
+        std::fill(sep_depth, sep_depth + (nrows - col_st), 0.);
+        for (size_t tree = 0; tree < ntrees; tree++)
+            add_tree_separation_depths(node_index, nodes[tree * nrows + row],
+                                       nodes.data() + tree * nrows + col_st, nrows - col_st,
+                                       sep_depth);
+        for (size_t col = 0; col < nrows - col_st; col++)
+            sep_depth[col] = standardize_dist?
+                              exp2( - sep_depth[col] / div_trees)
+                                :
+                              ((sep_depth[col] + ntrees_dbl) / ntrees_dbl);
+    }
 
     check_interrupt_switch(ss);
-    #if defined(DONT_THROW_ON_INTERRUPT)
-    if (interrupt_switch) return;
-    #endif
+}
+
+/* Find the nearest neighbors of each row of a training leaf index
+* 
+* Produces the same outputs as 'calc_similarity_knn' would for the data from which the index was built,
+* but takes the terminal nodes of the rows from the index instead of passing them through the trees.
+* 
+* Parameters
+* ==========
+* - leaf_index
+*       Index for the model, as produced by function 'build_training_leaf_index'.
+* - model_outputs
+*       Pointer to the single-variable model for which the index was built. Pass NULL if the index
+*       was built for an extended model. Can only pass one of 'model_outputs' and 'model_outputs_ext'.
+* - model_outputs_ext
+*       Pointer to the extended model for which the index was built. Pass NULL if the index was
+*       built for a single-variable model. Can only pass one of 'model_outputs' and 'model_outputs_ext'.
+* - nthreads
+*       Number of parallel threads to use.
+* - assume_full_distr
+*       Same as for 'calc_similarity_knn'.
+* - standardize_dist
+*       Same as for 'calc_similarity_knn'.
+* - k
+*       Same as for 'calc_similarity_knn'.
+* - knn_indptr[nrows + 1] (out)
+*       Same as for 'calc_similarity_knn'.
+* - knn_indices[nrows * k] (out)
+*       Same as for 'calc_similarity_knn'.
+* - knn_dist[nrows * k] (out)
+*       Same as for 'calc_similarity_knn'.
+*/
+template <class sparse_ix>
+void calc_similarity_knn_from_leaf_index(TrainingLeafIndex &leaf_index,
+                                         IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                                         int nthreads, bool assume_full_distr, bool standardize_dist,
+                                         size_t k, sparse_ix knn_indptr[], sparse_ix knn_indices[], double knn_dist[])
+{
+    size_t nrows = leaf_index.nrows;
+    if (nrows < 2) k = 0;
+    k = std::min(k, nrows - 1);
+    if (!k)
+    {
+        std::fill(knn_indptr, knn_indptr + nrows + 1, (sparse_ix)0);
+        return;
+    }
+
+    NodeRowIndex node_index;
+    init_node_index(model_outputs, model_outputs_ext, node_index);
+    node_index.row_nodes.resize(nrows * node_index.ntrees);
+    get_leaf_index_nodes(leaf_index, model_outputs, model_outputs_ext,
+                         node_index, node_index.row_nodes.data(), false, nthreads);
+    index_node_rows(node_index, nthreads, assume_full_distr, model_outputs, model_outputs_ext);
+
+    find_knn_from_node_index(node_index, nthreads, standardize_dist,
+                             similarity_divisor(model_outputs, model_outputs_ext, nrows, assume_full_distr),
+                             k, knn_indptr, knn_indices, knn_dist);
+}
+
+/* Determine the terminal node of each row in each tree and arrange the rows by node */
+template <class real_t, class sparse_ix>
+void build_node_row_index(real_t numeric_data[], int categ_data[],
+                          real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                          size_t nrows, int nthreads, bool assume_full_distr,
+                          IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                          NodeRowIndex &node_index)
+{
+    init_node_index(model_outputs, model_outputs_ext, node_index);
+    node_index.row_nodes.resize(nrows * node_index.ntrees);
+    get_row_nodes(numeric_data, categ_data,
+                  true, (size_t)0, (size_t)0, (size_t)0, (size_t)0,
+                  Xc, Xc_ind, Xc_indptr,
+                  (real_t*)NULL, (sparse_ix*)NULL, (sparse_ix*)NULL,
+                  nrows, nthreads,
+                  model_outputs, model_outputs_ext,
+                  node_index, node_index.row_nodes.data(), false);
+    index_node_rows(node_index, nthreads, assume_full_distr, model_outputs, model_outputs_ext);
+}
+
+/* Fill in the nodes of all the trees and arrange the rows by node, once 'row_nodes' has been filled */
+void index_node_rows(NodeRowIndex &node_index, int nthreads, bool assume_full_distr,
+                     IsoForest *model_outputs, ExtIsoForest *model_outputs_ext)
+{
+    size_t ntrees = node_index.ntrees;
+    size_t tot_nodes = node_index.node_offset.back();
+    node_index.rows_st.resize(tot_nodes);
+    node_index.rows_end.resize(tot_nodes);
+    node_index.rows.resize(node_index.row_nodes.size());
+
+    #pragma omp parallel for schedule(dynamic) num_threads(nthreads) shared(ntrees, model_outputs, model_outputs_ext, assume_full_distr, node_index)
+    for (size_t_for tree = 0; tree < ntrees; tree++)
+    {
+        if (model_outputs != NULL)
+            add_tree_to_node_index(model_outputs->trees[tree], tree, assume_full_distr, node_index, (size_t*)NULL);
+        else
+            add_tree_to_node_index(model_outputs_ext->hplanes[tree], tree, assume_full_distr, node_index, (size_t*)NULL);
+    }
+}
+
+/* Allocate the per-node arrays of the index, without assigning any rows to the nodes */
+void init_node_index(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext, NodeRowIndex &node_index)
+{
+    size_t ntrees = (model_outputs != NULL)? model_outputs->trees.size() : model_outputs_ext->hplanes.size();
+    node_index.ntrees = ntrees;
+    node_index.node_offset.resize(ntrees + 1);
+    node_index.node_offset[0] = 0;
+    for (size_t tree = 0; tree < ntrees; tree++)
+        node_index.node_offset[tree + 1] = node_index.node_offset[tree]
+                                            +
+                                           ((model_outputs != NULL)?
+                                            model_outputs->trees[tree].size() : model_outputs_ext->hplanes[tree].size());
+    size_t tot_nodes = node_index.node_offset.back();
+    node_index.parent.resize(tot_nodes);
+    node_index.depth.resize(tot_nodes);
+    node_index.path.resize(tot_nodes);
+    node_index.terminal_sep.resize(tot_nodes);
+}
+
+/* Determine the node in which each row falls in each tree, numbered as in 'node_index', and write them
+   at 'row_nodes[row * ntrees + tree]', or at 'row_nodes[tree * nrows + row]' if passing 'tree_major'.
+   Takes the data in the same format as 'predict_iforest'. */
+template <class real_t, class sparse_ix>
+void get_row_nodes(real_t numeric_data[], int categ_data[],
+                   bool is_col_major, size_t ncols_numeric, size_t ncols_categ,
+                   size_t ld_numeric, size_t ld_categ,
+                   real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                   real_t Xr[], sparse_ix Xr_ind[], sparse_ix Xr_indptr[],
+                   size_t nrows, int nthreads,
+                   IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                   NodeRowIndex &node_index, size_t row_nodes[], bool tree_major)
+{
+    size_t ntrees = node_index.ntrees;
+    TerminalNodeMapping node_numbers;
+    build_node_number_mapping(node_index, node_numbers);
+
+    /* rows which do not end up in a single terminal node (e.g. missing values with 'missing_action=Divide')
+       are left at the root, which means they are considered to be separated from all others there */
+    std::vector<sparse_ix> tree_num(nrows * ntrees, 0);
+    std::vector<double> depths(nrows, 0);
+    predict_iforest<real_t, sparse_ix>(numeric_data, categ_data,
+                                       is_col_major, ncols_numeric, ncols_categ, ld_numeric, ld_categ,
+                                       Xc, Xc_ind, Xc_indptr,
+                                       Xr, Xr_ind, Xr_indptr,
+                                       nrows, nthreads, false,
+                                       model_outputs, model_outputs_ext,
+                                       depths.data(), tree_num.data(), &node_numbers);
+
+    size_t *restrict node_offset = node_index.node_offset.data();
+    if (tree_major)
+    {
+        #pragma omp parallel for schedule(static) num_threads(nthreads) shared(nrows, ntrees, row_nodes, node_offset, tree_num)
+        for (size_t_for tree = 0; tree < ntrees; tree++)
+            for (size_t row = 0; row < nrows; row++)
+                row_nodes[tree * nrows + row] = node_offset[tree] + (size_t)tree_num[row + nrows * tree];
+    }
+
+    else
+    {
+        #pragma omp parallel for schedule(static) num_threads(nthreads) shared(nrows, ntrees, row_nodes, node_offset, tree_num)
+        for (size_t_for row = 0; row < nrows; row++)
+            for (size_t tree = 0; tree < ntrees; tree++)
+                row_nodes[row * ntrees + tree] = node_offset[tree] + (size_t)tree_num[row + nrows * tree];
+    }
+}
+
+/* The prediction function renumbers the terminal nodes unless it receives a mapping, so this builds
+   one that leaves the node numbers as they are */
+void build_node_number_mapping(NodeRowIndex &node_index, TerminalNodeMapping &node_numbers)
+{
+    node_numbers.node_offset = node_index.node_offset;
+    node_numbers.terminal_num.resize(node_index.node_offset.back());
+    for (size_t tree = 0; tree < node_index.ntrees; tree++)
+        std::iota(node_numbers.terminal_num.begin() + node_index.node_offset[tree],
+                  node_numbers.terminal_num.begin() + node_index.node_offset[tree + 1],
+                  (size_t)0);
+}
+
+size_t node_left(IsoTree &node)    {return node.tree_left;}
+size_t node_left(IsoHPlane &node)  {return node.hplane_left;}
+size_t node_right(IsoTree &node)   {return node.tree_right;}
+size_t node_right(IsoHPlane &node) {return node.hplane_right;}
+
+/* Fills in the nodes of a tree, counting in 'extra_rows' (if not NULL) rows that are not in the index */
+template <class Node>
+void add_tree_to_node_index(std::vector<Node> &nodes, size_t tree, bool assume_full_distr, NodeRowIndex &node_index,
+                            const size_t *extra_rows)
+{
+    size_t ntrees = node_index.ntrees;
+    size_t nrows  = node_index.row_nodes.size() / ntrees;
+    size_t offset = node_index.node_offset[tree];
+    size_t *restrict parent = node_index.parent.data() + offset;
+    size_t *restrict depth  = node_index.depth.data() + offset;
+    uint64_t *restrict path = node_index.path.data() + offset;
+    double *restrict terminal_sep = node_index.terminal_sep.data() + offset;
+
+    /* depth-first traversal, taking the left branch first */
+    std::vector<size_t> order;
+    order.reserve(nodes.size());
+    std::vector<size_t> pending(1, (size_t)0);
+    parent[0] = offset;
+    depth[0]  = 0;
+    path[0]   = 0;
+    while (!pending.empty())
+    {
+        size_t node = pending.back();
+        pending.pop_back();
+        order.push_back(node);
+        if (nodes[node].score < 0)
+        {
+            size_t left = node_left(nodes[node]), right = node_right(nodes[node]);
+            parent[left]  = parent[right] = offset + node;
+            depth[left]   = depth[right]  = depth[node] + 1;
+            path[left]    = path[right]   = path[node];
+            if (depth[node] < 64)
+                path[right] |= (uint64_t)1 << (63 - depth[node]);
+            pending.push_back(right);
+            pending.push_back(left);
+        }
+    }
+
+    std::vector<size_t> n_rows(nodes.size(), 0);
+    for (size_t row = 0; row < nrows; row++)
+    {
+        size_t node = node_index.row_nodes[row * ntrees + tree] - offset;
+        n_rows[node] += nodes[node].score >= 0;
+    }
+
+    for (size_t node : order)
+    {
+        if (nodes[node].score >= 0)
+            terminal_sep[node] = (double)(std::max(depth[node], (size_t)1) - 1)
+                                  +
+                                 (assume_full_distr? 3. :
+                                  expected_separation_depth((long double)nodes[node].remainder
+                                                             + (long double)n_rows[node]
+                                                             + (long double)((extra_rows != NULL)? extra_rows[offset + node] : 0)));
+        else
+            terminal_sep[node] = -1;
+    }
+
+    if (node_index.rows.empty())
+        return;
+    size_t *restrict rows_st  = node_index.rows_st.data() + offset;
+    size_t *restrict rows_end = node_index.rows_end.data() + offset;
+
+    /* the rows under a node are those of the terminal nodes that follow it in the traversal order
+       until the end of its right branch, which is reached after all of its other descendants */
+    size_t curr_pos = tree * nrows;
+    for (size_t node : order)
+    {
+        rows_st[node] = curr_pos;
+        if (nodes[node].score >= 0)
+        {
+            curr_pos += n_rows[node];
+            rows_end[node] = curr_pos;
+        }
+    }
+    for (size_t ix = order.size(); ix > 0; ix--)
+    {
+        size_t node = order[ix - 1];
+        if (nodes[node].score < 0)
+            rows_end[node] = rows_end[node_right(nodes[node])];
+    }
+
+    for (size_t row = 0; row < nrows; row++)
+    {
+        size_t node = node_index.row_nodes[row * ntrees + tree] - offset;
+        if (nodes[node].score >= 0)
+            node_index.rows[rows_st[node] + (--n_rows[node])] = row;
+    }
+}
+
+/* Sum across trees of the separation depths of two rows, without the first hop */
+double pair_separation_depth(NodeRowIndex &node_index, size_t row1, size_t row2)
+{
+    size_t ntrees = node_index.ntrees;
+    return nodes_separation_depth(node_index,
+                                  node_index.row_nodes.data() + row1 * ntrees,
+                                  node_index.row_nodes.data() + row2 * ntrees);
+}
+
+/* Same, for two rows given by the nodes in which they fall in each tree */
+double nodes_separation_depth(NodeRowIndex &node_index, const size_t *restrict nodes1, const size_t *restrict nodes2)
+{
+    size_t ntrees = node_index.ntrees;
+    double sep_depth = 0;
+    for (size_t tree = 0; tree < ntrees; tree++)
+    {
+        size_t node1 = nodes1[tree], node2 = nodes2[tree];
+        if (node1 == node2 && node_index.terminal_sep[node1] >= 0)
+        {
+            sep_depth += node_index.terminal_sep[node1];
+            continue;
+        }
+
+        /* otherwise, they get +1 for each non-root node that they share before being separated */
+        sep_depth += (double)shared_path_depth(node_index, node1, node2);
+    }
+    return sep_depth;
+}
+
+/* Adds the separation depths in one tree between a row that falls in node 'node' and 'n' rows that fall
+   in nodes 'other_nodes', in the same way as 'nodes_separation_depth' */
+void add_tree_separation_depths(NodeRowIndex &node_index, size_t node, const size_t *restrict other_nodes, size_t n,
+                                double *restrict sep_depth)
+{
+    const size_t *restrict depth = node_index.depth.data();
+    const uint64_t *restrict path = node_index.path.data();
+    size_t node_depth = depth[node];
+    uint64_t node_path = path[node];
+    double node_sep = node_index.terminal_sep[node];
+
+    if (node_depth > 64)
+    {
+        for (size_t ix = 0; ix < n; ix++)
+            sep_depth[ix] += (other_nodes[ix] == node && node_sep >= 0)?
+                              node_sep : (double)shared_path_depth(node_index, node, other_nodes[ix]);
+        return;
+    }
+
+    for (size_t ix = 0; ix < n; ix++)
+    {
+        size_t other = other_nodes[ix];
+        if (other == node && node_sep >= 0)
+        {
+            sep_depth[ix] += node_sep;
+            continue;
+        }
+        uint64_t diff = node_path ^ path[other];
+        size_t n_common = 64;
+        if (diff)
+        {
+            #if defined(__GNUC__) || defined(__clang__)
+            n_common = (size_t)__builtin_clzll((unsigned long long)diff);
+            #else
+            n_common = 0;
+            while (!(diff & ((uint64_t)1 << (63 - n_common)))) n_common++;
+            #endif
+        }
+        sep_depth[ix] += (double)std::min(n_common, std::min(node_depth, depth[other]));
+    }
+}
+
+/* Depth of the deepest node that is an ancestor of both nodes (or one of them) */
+size_t shared_path_depth(NodeRowIndex &node_index, size_t node1, size_t node2)
+{
+    const size_t *restrict depth = node_index.depth.data();
+    size_t min_depth = std::min(depth[node1], depth[node2]);
+    if (min_depth <= 64)
+    {
+        uint64_t diff = node_index.path[node1] ^ node_index.path[node2];
+        if (!diff) return min_depth;
+        #if defined(__GNUC__) || defined(__clang__)
+        size_t n_common = (size_t)__builtin_clzll((unsigned long long)diff);
+        #else
+        size_t n_common = 0;
+        while (!(diff & ((uint64_t)1 << (63 - n_common)))) n_common++;
+        #endif
+        return std::min(n_common, min_depth);
+    }
+
+    const size_t *restrict parent = node_index.parent.data();
+    while (depth[node1] > depth[node2]) node1 = parent[node1];
+    while (depth[node2] > depth[node1]) node2 = parent[node2];
+    while (node1 != node2)
+    {
+        node1 = parent[node1];
+        node2 = parent[node2];
+    }
+    return depth[node1];
+}
+
+/* Find the 'k' rows with the highest separation depth from a given row. Candidates are the rows in the
+   smallest node that contains some other row in each tree, ranked by how deep those nodes are, and the
+   exact separation depths are calculated only for the best 'KNN_CANDIDATES_PER_NEIGHBOR * k' of them.
+   As all the rows in a node are equally close to the row in that tree, nodes with many rows contribute
+   only an evenly-spaced subset of them, which is enough for ranking the candidates across trees.
+   The results are left at the beginning of 'workspace.sep_depth', sorted from highest to lowest. */
+size_t find_nearest_rows(NodeRowIndex &node_index, WorkerForKNN &workspace, size_t row, size_t k)
+{
+    size_t ntrees = node_index.ntrees;
+    size_t nrows  = node_index.row_nodes.size() / ntrees;
+    if (!workspace.shared_depth.size())
+        workspace.shared_depth.resize(nrows, 0);
+    double *restrict shared_depth = workspace.shared_depth.data();
+    workspace.candidates.clear();
+    size_t max_candidates = k * KNN_CANDIDATES_PER_NEIGHBOR;
+    size_t max_node_rows  = max_candidates * KNN_MAX_NODE_ROWS_PER_CANDIDATE;
+
+    for (size_t tree = 0; tree < ntrees; tree++)
+    {
+        size_t node = node_index.row_nodes[row * ntrees + tree];
+        if (node_index.terminal_sep[node] < 0)
+            continue;
+        while (node_index.rows_end[node] - node_index.rows_st[node] < 2 && node_index.depth[node] > 0)
+            node = node_index.parent[node];
+
+        double weight = (double)(node_index.depth[node] + 1);
+        size_t st = node_index.rows_st[node];
+        size_t n_rows = node_index.rows_end[node] - st;
+        size_t n_take = std::min(n_rows, max_node_rows);
+        for (size_t ix = 0; ix < n_take; ix++)
+        {
+            size_t other = node_index.rows[st + ((n_take < n_rows)? ((ix * n_rows) / n_take) : ix)];
+            if (other == row) continue;
+            if (!shared_depth[other])
+                workspace.candidates.push_back(other);
+            shared_depth[other] += weight;
+        }
+    }
+
+    size_t n_candidates = std::min(workspace.candidates.size(), max_candidates);
+    if (n_candidates < workspace.candidates.size())
+        std::nth_element(workspace.candidates.begin(),
+                         workspace.candidates.begin() + n_candidates,
+                         workspace.candidates.end(),
+                         [shared_depth](const size_t a, const size_t b)
+                         {return (shared_depth[a] > shared_depth[b]) || (shared_depth[a] == shared_depth[b] && a < b);});
+
+    workspace.sep_depth.clear();
+    for (size_t ix = 0; ix < n_candidates; ix++)
+        workspace.sep_depth.emplace_back(pair_separation_depth(node_index, row, workspace.candidates[ix]),
+                                         workspace.candidates[ix]);
+    for (size_t other : workspace.candidates)
+        shared_depth[other] = 0;
+
+    size_t n_out = std::min(k, workspace.sep_depth.size());
+    std::partial_sort(workspace.sep_depth.begin(), workspace.sep_depth.begin() + n_out, workspace.sep_depth.end(),
+                      [](const std::pair<double, size_t> &a, const std::pair<double, size_t> &b)
+                      {return (a.first > b.first) || (a.first == b.first && a.second < b.second);});
+    return n_out;
 }
 
 template <class PredictionData>
@@ -230,14 +1596,10 @@ void traverse_tree_sim(WorkerForSimilarity   &workspace,
     if (workspace.st == workspace.end)
         return;
 
-    if (!workspace.tmat_sep.size())
-    {
-        std::sort(workspace.ix_arr.begin() + workspace.st, workspace.ix_arr.begin() + workspace.end + 1);
-        if (workspace.ix_arr[workspace.st] >= workspace.n_from)
-            return;
-        if (workspace.ix_arr[workspace.end] < workspace.n_from)
-            return;
-    }
+    /* rows are kept sorted so that the pairs falling in the block of this worker can be located directly */
+    std::sort(workspace.ix_arr.begin() + workspace.st, workspace.ix_arr.begin() + workspace.end + 1);
+    if (!node_has_pairs_in_block(workspace))
+        return;
 
     /* Note: the first separation step will not be added here, as it simply consists of adding +1
        to every combination regardless. It has to be added at the end in 'gather_sim_result' to
@@ -248,13 +1610,16 @@ void traverse_tree_sim(WorkerForSimilarity   &workspace,
         if (!workspace.weights_arr.size())
         {
             rem += (long double)(workspace.end - workspace.st + 1);
-            if (workspace.tmat_sep.size())
-                increase_comb_counter(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                      prediction_data.nrows, workspace.tmat_sep.data(),
-                                      workspace.assume_full_distr? 3. : expected_separation_depth(rem));
+            if (workspace.tmat != NULL)
+                increase_comb_counter_in_rows(workspace.ix_arr.data(), workspace.st, workspace.end,
+                                              prediction_data.nrows, workspace.row_st, workspace.row_end,
+                                              workspace.tmat,
+                                              workspace.assume_full_distr? 3. : expected_separation_depth(rem));
             else
                 increase_comb_counter_in_groups(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                                workspace.n_from, prediction_data.nrows, workspace.rmat.data(),
+                                                workspace.n_from, prediction_data.nrows,
+                                                workspace.row_st, workspace.row_end, workspace.col_st, workspace.col_end,
+                                                workspace.rmat,
                                                 workspace.assume_full_distr? 3. : expected_separation_depth(rem));
         }
 
@@ -263,22 +1628,24 @@ void traverse_tree_sim(WorkerForSimilarity   &workspace,
             if (!workspace.assume_full_distr)
             {
                 rem += std::accumulate(workspace.ix_arr.begin() + workspace.st,
-                                       workspace.ix_arr.begin() + workspace.end,
+                                       workspace.ix_arr.begin() + workspace.end + 1,
                                        (long double) 0.,
                                        [&workspace](long double curr, size_t ix)
                                                       {return curr + (long double)workspace.weights_arr[ix];}
                                       );
             }
 
-            if (workspace.tmat_sep.size())
-                increase_comb_counter(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                      prediction_data.nrows, workspace.tmat_sep.data(),
-                                      workspace.weights_arr.data(),
+            if (workspace.tmat != NULL)
+                increase_comb_counter_in_rows(workspace.ix_arr.data(), workspace.st, workspace.end,
+                                              prediction_data.nrows, workspace.row_st, workspace.row_end,
+                                              workspace.tmat,
+                                              workspace.weights_arr.data(),
                                       workspace.assume_full_distr? 3. : expected_separation_depth(rem));
             else
                 increase_comb_counter_in_groups(workspace.ix_arr.data(), workspace.st, workspace.end,
                                                 workspace.n_from, prediction_data.nrows,
-                                                workspace.rmat.data(), workspace.weights_arr.data(),
+                                                workspace.row_st, workspace.row_end, workspace.col_st, workspace.col_end,
+                                                workspace.rmat, workspace.weights_arr.data(),
                                                 workspace.assume_full_distr? 3. : expected_separation_depth(rem));
         }
         return;
@@ -286,28 +1653,31 @@ void traverse_tree_sim(WorkerForSimilarity   &workspace,
 
     else if (curr_tree > 0)
     {
-        if (workspace.tmat_sep.size())
+        if (workspace.tmat != NULL)
             if (!workspace.weights_arr.size())
-                increase_comb_counter(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                      prediction_data.nrows, workspace.tmat_sep.data(), -1.);
+                increase_comb_counter_in_rows(workspace.ix_arr.data(), workspace.st, workspace.end,
+                                              prediction_data.nrows, workspace.row_st, workspace.row_end,
+                                              workspace.tmat, -1.);
             else
-                increase_comb_counter(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                      prediction_data.nrows, workspace.tmat_sep.data(),
-                                      workspace.weights_arr.data(), -1.);
+                increase_comb_counter_in_rows(workspace.ix_arr.data(), workspace.st, workspace.end,
+                                              prediction_data.nrows, workspace.row_st, workspace.row_end,
+                                              workspace.tmat,
+                                              workspace.weights_arr.data(), -1.);
         else
             if (!workspace.weights_arr.size())
                 increase_comb_counter_in_groups(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                                workspace.n_from, prediction_data.nrows, workspace.rmat.data(), -1.);
+                                                workspace.n_from, prediction_data.nrows,
+                                                workspace.row_st, workspace.row_end, workspace.col_st, workspace.col_end,
+                                                workspace.rmat, -1.);
             else
                 increase_comb_counter_in_groups(workspace.ix_arr.data(), workspace.st, workspace.end,
                                                 workspace.n_from, prediction_data.nrows,
-                                                workspace.rmat.data(), workspace.weights_arr.data(), -1.);
+                                                workspace.row_st, workspace.row_end, workspace.col_st, workspace.col_end,
+                                                workspace.rmat, workspace.weights_arr.data(), -1.);
     }
 
 
     /* divide according to tree */
-    if (prediction_data.Xc_indptr != NULL && workspace.tmat_sep.size())
-        std::sort(workspace.ix_arr.begin() + workspace.st, workspace.ix_arr.begin() + workspace.end + 1);
     size_t st_NA, end_NA, split_ix;
     switch(trees[curr_tree].col_type)
     {
@@ -315,7 +1685,7 @@ void traverse_tree_sim(WorkerForSimilarity   &workspace,
         {
             if (prediction_data.Xc_indptr == NULL)
                 divide_subset_split(workspace.ix_arr.data(),
-                                    prediction_data.numeric_data + prediction_data.nrows * trees[curr_tree].col_num,
+                                    prediction_data.numeric_data + prediction_data.ld_numeric * trees[curr_tree].col_num,
                                     workspace.st, workspace.end, trees[curr_tree].num_split,
                                     model_outputs.missing_action, st_NA, end_NA, split_ix);
             else
@@ -334,7 +1704,7 @@ void traverse_tree_sim(WorkerForSimilarity   &workspace,
                 case SingleCateg:
                 {
                     divide_subset_split(workspace.ix_arr.data(),
-                                        prediction_data.categ_data + prediction_data.nrows * trees[curr_tree].col_num,
+                                        prediction_data.categ_data + prediction_data.ld_categ * trees[curr_tree].col_num,
                                         workspace.st, workspace.end, trees[curr_tree].chosen_cat,
                                          model_outputs.missing_action, st_NA, end_NA, split_ix);
                     break;
@@ -344,13 +1714,13 @@ void traverse_tree_sim(WorkerForSimilarity   &workspace,
                 {
                     if (!trees[curr_tree].cat_split.size())
                         divide_subset_split(workspace.ix_arr.data(),
-                                            prediction_data.categ_data + prediction_data.nrows * trees[curr_tree].col_num,
+                                            prediction_data.categ_data + prediction_data.ld_categ * trees[curr_tree].col_num,
                                             workspace.st, workspace.end,
                                             model_outputs.missing_action, model_outputs.new_cat_action,
                                             trees[curr_tree].pct_tree_left < .5, st_NA, end_NA, split_ix);
                     else
                         divide_subset_split(workspace.ix_arr.data(),
-                                            prediction_data.categ_data + prediction_data.nrows * trees[curr_tree].col_num,
+                                            prediction_data.categ_data + prediction_data.ld_categ * trees[curr_tree].col_num,
                                             workspace.st, workspace.end, trees[curr_tree].cat_split.data(),
                                             (int) trees[curr_tree].cat_split.size(),
                                             model_outputs.missing_action, model_outputs.new_cat_action,
@@ -369,7 +1739,7 @@ void traverse_tree_sim(WorkerForSimilarity   &workspace,
     {
         case Impute:
         {
-            split_ix = (trees.back().pct_tree_left >= .5)? end_NA : st_NA;
+            split_ix = (trees[curr_tree].pct_tree_left >= .5)? end_NA : st_NA;
         }
 
         case Fail:
@@ -400,14 +1770,18 @@ void traverse_tree_sim(WorkerForSimilarity   &workspace,
 
         case Divide: /* new_cat_action = 'Weighted' will also fall here */
         {
+            /* the left branch re-orders the rows and changes the weights of those with missing values,
+               so the weights are saved for the rows themselves in order to restore them afterwards */
             std::vector<double> weights_arr;
             std::vector<size_t> ix_arr;
+            size_t orig_st = workspace.st;
             if (end_NA > workspace.st)
             {
-                weights_arr.assign(workspace.weights_arr.begin(),
-                                   workspace.weights_arr.begin() + end_NA);
-                ix_arr.assign(workspace.ix_arr.begin(),
+                ix_arr.assign(workspace.ix_arr.begin() + workspace.st,
                               workspace.ix_arr.begin() + end_NA);
+                weights_arr.resize(ix_arr.size());
+                for (size_t row = 0; row < ix_arr.size(); row++)
+                    weights_arr[row] = workspace.weights_arr[ix_arr[row]];
             }
 
             if (end_NA > workspace.st)
@@ -428,12 +1802,11 @@ void traverse_tree_sim(WorkerForSimilarity   &workspace,
                 workspace.end = orig_end;
                 if (weights_arr.size())
                 {
-                    std::copy(weights_arr.begin(),
-                              weights_arr.end(),
-                              workspace.weights_arr.begin());
                     std::copy(ix_arr.begin(),
                               ix_arr.end(),
-                              workspace.ix_arr.begin());
+                              workspace.ix_arr.begin() + orig_st);
+                    for (size_t row = 0; row < ix_arr.size(); row++)
+                        workspace.weights_arr[ix_arr[row]] = weights_arr[row];
                     weights_arr.clear();
                     weights_arr.shrink_to_fit();
                     ix_arr.clear();
@@ -466,30 +1839,29 @@ void traverse_hplane_sim(WorkerForSimilarity     &workspace,
     if (workspace.st == workspace.end)
         return;
 
-    if (!workspace.tmat_sep.size())
-    {
-        std::sort(workspace.ix_arr.begin() + workspace.st, workspace.ix_arr.begin() + workspace.end + 1);
-        if (workspace.ix_arr[workspace.st] >= workspace.n_from)
-            return;
-        if (workspace.ix_arr[workspace.end] < workspace.n_from)
-            return;
-    }
+    /* rows are kept sorted so that the pairs falling in the block of this worker can be located directly */
+    std::sort(workspace.ix_arr.begin() + workspace.st, workspace.ix_arr.begin() + workspace.end + 1);
+    if (!node_has_pairs_in_block(workspace))
+        return;
 
     /* Note: the first separation step will not be added here, as it simply consists of adding +1
        to every combination regardless. It has to be added at the end in 'gather_sim_result' to
        obtain the average separation depth. */
     if (hplanes[curr_tree].score >= 0)
     {
-        if (workspace.tmat_sep.size())
-            increase_comb_counter(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                  prediction_data.nrows, workspace.tmat_sep.data(),
-                                  workspace.assume_full_distr? 3. : 
-                                  expected_separation_depth((long double) hplanes[curr_tree].remainder
-                                                              + (long double)(workspace.end - workspace.st + 1))
-                                  );
+        if (workspace.tmat != NULL)
+            increase_comb_counter_in_rows(workspace.ix_arr.data(), workspace.st, workspace.end,
+                                          prediction_data.nrows, workspace.row_st, workspace.row_end,
+                                          workspace.tmat,
+                                          workspace.assume_full_distr? 3. : 
+                                          expected_separation_depth((long double) hplanes[curr_tree].remainder
+                                                                      + (long double)(workspace.end - workspace.st + 1))
+                                          );
         else
-            increase_comb_counter_in_groups(workspace.ix_arr.data(), workspace.st, workspace.end, workspace.n_from,
-                                            prediction_data.nrows, workspace.rmat.data(),
+            increase_comb_counter_in_groups(workspace.ix_arr.data(), workspace.st, workspace.end,
+                                            workspace.n_from, prediction_data.nrows,
+                                            workspace.row_st, workspace.row_end, workspace.col_st, workspace.col_end,
+                                            workspace.rmat,
                                             workspace.assume_full_distr? 3. : 
                                             expected_separation_depth((long double) hplanes[curr_tree].remainder
                                                                         + (long double)(workspace.end - workspace.st + 1))
@@ -499,17 +1871,17 @@ void traverse_hplane_sim(WorkerForSimilarity     &workspace,
 
     else if (curr_tree > 0)
     {
-        if (workspace.tmat_sep.size())
-            increase_comb_counter(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                  prediction_data.nrows, workspace.tmat_sep.data(), -1.);
+        if (workspace.tmat != NULL)
+            increase_comb_counter_in_rows(workspace.ix_arr.data(), workspace.st, workspace.end,
+                                          prediction_data.nrows, workspace.row_st, workspace.row_end,
+                                          workspace.tmat, -1.);
         else
-            increase_comb_counter_in_groups(workspace.ix_arr.data(), workspace.st, workspace.end, workspace.n_from,
-                                            prediction_data.nrows, workspace.rmat.data(), -1.);
+            increase_comb_counter_in_groups(workspace.ix_arr.data(), workspace.st, workspace.end,
+                                            workspace.n_from, prediction_data.nrows,
+                                            workspace.row_st, workspace.row_end, workspace.col_st, workspace.col_end,
+                                            workspace.rmat, -1.);
     }
 
-    if (prediction_data.Xc_indptr != NULL && workspace.tmat_sep.size())
-        std::sort(workspace.ix_arr.begin() + workspace.st, workspace.ix_arr.begin() + workspace.end + 1);
-
     /* reconstruct linear combination */
     size_t ncols_numeric = 0;
     size_t ncols_categ   = 0;
@@ -524,7 +1896,7 @@ void traverse_hplane_sim(WorkerForSimilarity     &workspace,
                 {
                     if (prediction_data.Xc_indptr == NULL)
                         add_linear_comb(workspace.ix_arr.data(), workspace.st, workspace.end, workspace.comb_val.data(),
-                                        prediction_data.numeric_data + prediction_data.nrows * hplanes[curr_tree].col_num[col],
+                                        prediction_data.numeric_data + prediction_data.ld_numeric * hplanes[curr_tree].col_num[col],
                                         hplanes[curr_tree].coef[ncols_numeric], (double)0, hplanes[curr_tree].mean[ncols_numeric],
                                         (model_outputs.missing_action == Fail)?  workspace.comb_val[0] : hplanes[curr_tree].fill_val[col],
                                         model_outputs.missing_action, NULL, NULL, false);
@@ -546,7 +1918,7 @@ void traverse_hplane_sim(WorkerForSimilarity     &workspace,
                         case SingleCateg:
                         {
                             add_linear_comb(workspace.ix_arr.data(), workspace.st, workspace.end, workspace.comb_val.data(),
-                                            prediction_data.categ_data + prediction_data.nrows * hplanes[curr_tree].col_num[col],
+                                            prediction_data.categ_data + prediction_data.ld_categ * hplanes[curr_tree].col_num[col],
                                             (int)0, NULL, hplanes[curr_tree].fill_new[ncols_categ],
                                             hplanes[curr_tree].chosen_cat[ncols_categ],
                                             (model_outputs.missing_action == Fail)?  workspace.comb_val[0] : hplanes[curr_tree].fill_val[col],
@@ -558,7 +1930,7 @@ void traverse_hplane_sim(WorkerForSimilarity     &workspace,
                         case SubSet:
                         {
                             add_linear_comb(workspace.ix_arr.data(), workspace.st, workspace.end, workspace.comb_val.data(),
-                                            prediction_data.categ_data + prediction_data.nrows * hplanes[curr_tree].col_num[col],
+                                            prediction_data.categ_data + prediction_data.ld_categ * hplanes[curr_tree].col_num[col],
                                             (int) hplanes[curr_tree].cat_coef[ncols_categ].size(),
                                             hplanes[curr_tree].cat_coef[ncols_categ].data(), (double) 0, (int) 0,
                                             (model_outputs.missing_action == Fail)? workspace.comb_val[0] : hplanes[curr_tree].fill_val[col],
@@ -579,7 +1951,7 @@ void traverse_hplane_sim(WorkerForSimilarity     &workspace,
     {
         for (size_t col = 0; col < hplanes[curr_tree].col_num.size(); col++)
             add_linear_comb(workspace.ix_arr.data(), workspace.st, workspace.end, workspace.comb_val.data(),
-                            prediction_data.numeric_data + prediction_data.nrows * hplanes[curr_tree].col_num[col],
+                            prediction_data.numeric_data + prediction_data.ld_numeric * hplanes[curr_tree].col_num[col],
                             hplanes[curr_tree].coef[col], (double)0, hplanes[curr_tree].mean[col],
                             (model_outputs.missing_action == Fail)?  workspace.comb_val[0] : hplanes[curr_tree].fill_val[col],
                             model_outputs.missing_action, NULL, NULL, false);
@@ -614,76 +1986,90 @@ void traverse_hplane_sim(WorkerForSimilarity     &workspace,
 
 }
 
-template <class PredictionData, class InputData, class WorkerMemory>
-void gather_sim_result(std::vector<WorkerForSimilarity> *worker_memory,
-                       std::vector<WorkerMemory> *worker_memory_m,
-                       PredictionData *prediction_data, InputData *input_data,
-                       IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
-                       double *restrict tmat, double *restrict rmat, size_t n_from,
-                       size_t ntrees, bool assume_full_distr,
-                       bool standardize_dist, int nthreads)
+/* Whether the current node has any pair of rows that falls in the block of the output assigned to the
+   worker - if it doesn't, its children won't have any either. Requires the rows to be sorted. */
+bool node_has_pairs_in_block(WorkerForSimilarity &workspace)
 {
-    if (interrupt_switch)
-        return;
-    
-    size_t ncomb = (prediction_data != NULL)?
-                    (prediction_data->nrows * (prediction_data->nrows - 1)) / 2
-                        :
-                    (input_data->nrows * (input_data->nrows - 1)) / 2;
-    size_t n_to  = (prediction_data != NULL)? (prediction_data->nrows - n_from) : 0;
+    size_t *ix_st  = workspace.ix_arr.data() + workspace.st;
+    size_t *ix_end = workspace.ix_arr.data() + workspace.end + 1;
+    size_t *from = std::lower_bound(ix_st, ix_end, workspace.row_st);
+    if (from == ix_end || *from >= workspace.row_end)
+        return false;
+    if (workspace.tmat != NULL)
+        return from < ix_end - 1;
+    size_t *to = std::lower_bound(from, ix_end, workspace.col_st);
+    return to < ix_end && *to < workspace.col_end;
+}
 
-    #ifdef _OPENMP
-    if (nthreads > 1)
+/* Splits the output matrix into one block per worker, so that all of them can add into the same array
+   without synchronization. For 'tmat', each block is a range of rows with roughly the same number of
+   pairs. For 'rmat', the blocks are ranges of rows if there are enough of them, or of columns otherwise. */
+void assign_sim_blocks(std::vector<WorkerForSimilarity> &worker_memory, size_t nrows, size_t n_from,
+                       double tmat[], double rmat[])
+{
+    size_t nblocks = worker_memory.size();
+    for (size_t block = 0; block < nblocks; block++)
     {
-        if (worker_memory != NULL)
+        WorkerForSimilarity &workspace = worker_memory[block];
+        workspace.tmat = tmat;
+        workspace.rmat = (tmat == NULL)? rmat : NULL;
+        workspace.col_st = n_from;
+        workspace.col_end = nrows;
+    }
+
+    if (tmat != NULL)
+    {
+        size_t ncomb = (nrows * (nrows - 1)) / 2;
+        size_t row = 0;
+        size_t pairs_before = 0;
+        for (size_t block = 0; block < nblocks; block++)
         {
-            for (WorkerForSimilarity &w : *worker_memory)
-            {
-                if (w.tmat_sep.size())
-                {
-                    #pragma omp parallel for schedule(static) num_threads(nthreads) shared(ncomb, tmat, w, worker_memory)
-                    for (size_t_for ix = 0; ix < ncomb; ix++)
-                        tmat[ix] += w.tmat_sep[ix];
-                }
-                else if (w.rmat.size())
-                {
-                    #pragma omp parallel for schedule(static) num_threads(nthreads) shared(rmat, w, worker_memory)
-                    for (size_t_for ix = 0; ix < w.rmat.size(); ix++)
-                        rmat[ix] += w.rmat[ix];
-                }
-            }
+            worker_memory[block].row_st = row;
+            size_t pairs_end = (block == nblocks - 1)? ncomb : (ncomb / nblocks) * (block + 1);
+            while (row < nrows && (pairs_before < pairs_end || row == worker_memory[block].row_st))
+                pairs_before += nrows - 1 - row++;
+            worker_memory[block].row_end = (block == nblocks - 1)? nrows : row;
         }
+    }
 
-        else
+    else if (n_from >= nblocks)
+    {
+        for (size_t block = 0; block < nblocks; block++)
         {
-            for (WorkerMemory &w : *worker_memory_m)
-            {
-                if (w.tmat_sep.size())
-                {
-                    #pragma omp parallel for schedule(static) num_threads(nthreads) shared(ncomb, tmat, w, worker_memory_m)
-                    for (size_t_for ix = 0; ix < ncomb; ix++)
-                        tmat[ix] += w.tmat_sep[ix];
-                }
-            }
+            worker_memory[block].row_st  = (n_from * block) / nblocks;
+            worker_memory[block].row_end = (n_from * (block + 1)) / nblocks;
         }
     }
-    
+
     else
-    #endif
     {
-        if (worker_memory != NULL)
-        {
-            if ((*worker_memory)[0].tmat_sep.size())
-                std::copy((*worker_memory)[0].tmat_sep.begin(), (*worker_memory)[0].tmat_sep.end(), tmat);
-            else
-                std::copy((*worker_memory)[0].rmat.begin(), (*worker_memory)[0].rmat.end(), rmat);
-        }
-        
-        else
+        size_t n_to = nrows - n_from;
+        for (size_t block = 0; block < nblocks; block++)
         {
-            std::copy((*worker_memory_m)[0].tmat_sep.begin(), (*worker_memory_m)[0].tmat_sep.end(), tmat);
+            worker_memory[block].row_st  = 0;
+            worker_memory[block].row_end = n_from;
+            worker_memory[block].col_st  = n_from + (n_to * block) / nblocks;
+            worker_memory[block].col_end = n_from + (n_to * (block + 1)) / nblocks;
         }
     }
+}
+
+/* Note: the workers add directly into the output matrix, so all that's left here is to transform it */
+template <class PredictionData, class InputData>
+void gather_sim_result(PredictionData *prediction_data, InputData *input_data,
+                       IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                       double *restrict tmat, double *restrict rmat, size_t n_from,
+                       size_t ntrees, bool assume_full_distr,
+                       bool standardize_dist, int nthreads)
+{
+    if (interrupt_switch)
+        return;
+    
+    size_t ncomb = (prediction_data != NULL)?
+                    (prediction_data->nrows * (prediction_data->nrows - 1)) / 2
+                        :
+                    (input_data->nrows * (input_data->nrows - 1)) / 2;
+    size_t n_to  = (prediction_data != NULL)? (prediction_data->nrows - n_from) : 0;
 
     double ntrees_dbl = (double) ntrees;
     if (standardize_dist)
@@ -759,10 +2145,6 @@ void initialize_worker_for_sim(WorkerForSimilarity  &workspace,
     {
         workspace.ix_arr.resize(prediction_data.nrows);
         std::iota(workspace.ix_arr.begin(), workspace.ix_arr.end(), (size_t)0);
-        if (!n_from)
-          workspace.tmat_sep.resize((prediction_data.nrows * (prediction_data.nrows - 1)) / 2, 0);
-        else
-          workspace.rmat.resize(prediction_data.nrows * n_from, 0);
     }
 
     if (model_outputs != NULL && (model_outputs->missing_action == Divide || model_outputs->new_cat_action == Weighted))
@@ -45,19 +45,64 @@
 #include "isotree.hpp"
 
 template <class InputData, class WorkerMemory>
-void split_hplane_recursive(std::vector<IsoHPlane>   &hplanes,
-                            WorkerMemory             &workspace,
-                            InputData                &input_data,
-                            ModelParams              &model_params,
-                            std::vector<ImputeNode> *impute_nodes,
-                            size_t                   curr_depth)
+void grow_hplanes(std::vector<IsoHPlane>   &hplanes,
+                  WorkerMemory             &workspace,
+                  InputData                &input_data,
+                  ModelParams              &model_params,
+                  std::vector<ImputeNode> *impute_nodes,
+                  size_t                   curr_depth)
 {
-    if (interrupt_switch) return;
+    /* same depth-first order as in the single-variable model, see 'grow_itree' */
+    workspace.pending_branches.clear();
+    workspace.compact_active = false;
+    while (true)
+    {
+        if (split_hplane_node(hplanes, workspace, input_data, model_params, impute_nodes, curr_depth))
+        {
+            curr_depth++;
+            continue;
+        }
+
+        while (true)
+        {
+            if (workspace.pending_branches.empty() || interrupt_switch) return;
+            PendingBranch branch = workspace.pending_branches.back();
+            workspace.pending_branches.pop_back();
+
+            hplanes[branch.node].hplane_right = hplanes.size();
+            if (branch.subtree != NULL)
+            {
+                branch.subtree->node = hplanes.size();
+                hplanes.emplace_back();
+                continue;
+            }
+
+            /* follow right branch */
+            workspace.recursion_states[branch.depth].restore_state(workspace);
+            hplanes.emplace_back();
+            if (impute_nodes != NULL) impute_nodes->emplace_back(branch.node);
+            workspace.st = workspace.split_ix;
+            curr_depth = branch.depth + 1;
+            break;
+        }
+    }
+}
+
+template <class InputData, class WorkerMemory>
+bool split_hplane_node(std::vector<IsoHPlane>   &hplanes,
+                       WorkerMemory             &workspace,
+                       InputData                &input_data,
+                       ModelParams              &model_params,
+                       std::vector<ImputeNode> *impute_nodes,
+                       size_t                   curr_depth)
+{
+    if (interrupt_switch) return false;
     long double sum_weight = -HUGE_VAL;
     size_t hplane_from = hplanes.size() - 1;
-    std::unique_ptr<RecursionState> recursion_state;
-    std::vector<bool> col_is_taken;
-    std::unordered_set<size_t> col_is_taken_s;
+    RecursionState *recursion_state;
+    DeferredSubtree *right_subtree;
+    std::vector<bool> &col_is_taken = workspace.col_is_taken;
+    std::unordered_set<size_t> &col_is_taken_s = workspace.col_is_taken_s;
 
     /* calculate imputation statistics if desired */
     if (impute_nodes != NULL)
@@ -71,6 +116,9 @@ void split_hplane_recursive(std::vector<IsoHPlane>   &hplanes,
                           model_params.min_imp_obs);
     }
 
+    /* small nodes take their data from a contiguous copy */
+    update_compact_rows(workspace, input_data);
+
     /* check for potential isolated leafs */
     if (workspace.end == workspace.st || curr_depth >= model_params.max_depth)
         goto terminal_statistics;
@@ -162,7 +210,7 @@ void split_hplane_recursive(std::vector<IsoHPlane>   &hplanes,
                 workspace.col_sampler.sample_col(workspace.col_chosen, workspace.rnd_generator)
             )
         {
-            if (interrupt_switch) return;
+            if (interrupt_switch) return false;
             
             workspace.ntried++;
             if (!workspace.try_all && workspace.ntried >= threshold_shuffle)
@@ -297,7 +345,7 @@ void split_hplane_recursive(std::vector<IsoHPlane>   &hplanes,
                     if (input_data.Xc_indptr == NULL)
                     {
                         add_linear_comb(workspace.ix_arr.data(), workspace.st, workspace.end, workspace.comb_val.data(),
-                                        input_data.numeric_data + hplanes.back().col_num[col] * input_data.nrows,
+                                        get_numeric_col(workspace, input_data, hplanes.back().col_num[col]),
                                         hplanes.back().coef[col], (double)0, hplanes.back().mean[col],
                                         hplanes.back().fill_val.size()? hplanes.back().fill_val[col] : workspace.this_split_point, /* second case is not used */
                                         model_params.missing_action, NULL, NULL, false);
@@ -319,7 +367,7 @@ void split_hplane_recursive(std::vector<IsoHPlane>   &hplanes,
                 case Categorical:
                 {
                     add_linear_comb(workspace.ix_arr.data(), workspace.st, workspace.end, workspace.comb_val.data(),
-                                    input_data.categ_data + hplanes.back().col_num[col] * input_data.nrows,
+                                    get_categ_col(workspace, input_data, hplanes.back().col_num[col]),
                                     input_data.ncat[hplanes.back().col_num[col]],
                                     (model_params.cat_split_type == SubSet)? hplanes.back().cat_coef[col].data() : NULL,
                                     (model_params.cat_split_type == SingleCateg)? hplanes.back().fill_new[col] : (double)0,
@@ -382,38 +430,27 @@ void split_hplane_recursive(std::vector<IsoHPlane>   &hplanes,
     /* now split */
 
     /* back-up where it was */
-    recursion_state = std::unique_ptr<RecursionState>(new RecursionState(workspace, true));
+    recursion_state = &get_recursion_state(workspace, curr_depth);
+    recursion_state->save_state(workspace, true);
+
+    /* if the right branch is large enough, leave it to another thread */
+    right_subtree = defer_subtree(workspace, workspace.split_ix, workspace.end, curr_depth + 1);
+
+    /* the right branch is followed once the left one is finished */
+    workspace.pending_branches.push_back({hplane_from, curr_depth, right_subtree});
 
     /* follow left branch */
     hplanes[hplane_from].hplane_left = hplanes.size();
     hplanes.emplace_back();
     if (impute_nodes != NULL) impute_nodes->emplace_back(hplane_from);
     workspace.end = workspace.split_ix - 1;
-    split_hplane_recursive(hplanes,
-                           workspace,
-                           input_data,
-                           model_params,
-                           impute_nodes,
-                           curr_depth + 1);
-
-
-    /* follow right branch */
-    hplanes[hplane_from].hplane_right = hplanes.size();
-    recursion_state->restore_state(workspace);
-    hplanes.emplace_back();
-    if (impute_nodes != NULL) impute_nodes->emplace_back(hplane_from);
-    workspace.st = workspace.split_ix;
-    split_hplane_recursive(hplanes,
-                           workspace,
-                           input_data,
-                           model_params,
-                           impute_nodes,
-                           curr_depth + 1);
-
-    return;
+    return true;
 
     terminal_statistics:
     {
+        if (workspace.compact_active)
+            restore_compact_rows(workspace);
+
         if (!workspace.weights_arr.size() && !workspace.weights_map.size())
         {
             hplanes.back().score = (double)(curr_depth + expected_avg_depth(workspace.end - workspace.st + 1));
@@ -448,6 +485,7 @@ void split_hplane_recursive(std::vector<IsoHPlane>   &hplanes,
         if (model_params.impute_at_fit)
             add_from_impute_node(impute_nodes->back(), workspace, input_data);
     }
+    return false;
 }
 
 
@@ -483,10 +521,11 @@ void add_chosen_column(WorkerMemory &workspace, InputData &input_data, ModelPara
                 if (!workspace.weights_arr.size() && !workspace.weights_map.size())
                 {
                     calc_mean_and_sd(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                     input_data.numeric_data + workspace.col_chosen * input_data.nrows,
-                                     model_params.missing_action, workspace.ext_sd, workspace.ext_mean[workspace.ntaken]);
+                                     get_numeric_col(workspace, input_data, workspace.col_chosen),
+                                     model_params.missing_action, model_params.compensated_sums,
+                                     workspace.ext_sd, workspace.ext_mean[workspace.ntaken]);
                     add_linear_comb(workspace.ix_arr.data(), workspace.st, workspace.end, workspace.comb_val.data(),
-                                    input_data.numeric_data + workspace.col_chosen * input_data.nrows,
+                                    get_numeric_col(workspace, input_data, workspace.col_chosen),
                                     workspace.ext_coef[workspace.ntaken], workspace.ext_sd, workspace.ext_mean[workspace.ntaken],
                                     workspace.ext_fill_val[workspace.ntaken], model_params.missing_action,
                                     workspace.buffer_dbl.data(), workspace.buffer_szt.data(), true);
@@ -494,12 +533,12 @@ void add_chosen_column(WorkerMemory &workspace, InputData &input_data, ModelPara
                 else if (workspace.weights_arr.size())
                 {
                     calc_mean_and_sd_weighted(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                              input_data.numeric_data + workspace.col_chosen * input_data.nrows,
+                                              get_numeric_col(workspace, input_data, workspace.col_chosen),
                                               workspace.weights_arr,
                                               model_params.missing_action, workspace.ext_sd,
                                               workspace.ext_mean[workspace.ntaken]);
                     add_linear_comb_weighted(workspace.ix_arr.data(), workspace.st, workspace.end, workspace.comb_val.data(),
-                                             input_data.numeric_data + workspace.col_chosen * input_data.nrows,
+                                             get_numeric_col(workspace, input_data, workspace.col_chosen),
                                              workspace.ext_coef[workspace.ntaken], workspace.ext_sd, workspace.ext_mean[workspace.ntaken],
                                              workspace.ext_fill_val[workspace.ntaken], model_params.missing_action,
                                              workspace.buffer_dbl.data(), workspace.buffer_szt.data(), true,
@@ -509,12 +548,12 @@ void add_chosen_column(WorkerMemory &workspace, InputData &input_data, ModelPara
                 else
                 {
                     calc_mean_and_sd_weighted(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                              input_data.numeric_data + workspace.col_chosen * input_data.nrows,
+                                              get_numeric_col(workspace, input_data, workspace.col_chosen),
                                               workspace.weights_map,
                                               model_params.missing_action, workspace.ext_sd,
                                               workspace.ext_mean[workspace.ntaken]);
                     add_linear_comb_weighted(workspace.ix_arr.data(), workspace.st, workspace.end, workspace.comb_val.data(),
-                                             input_data.numeric_data + workspace.col_chosen * input_data.nrows,
+                                             get_numeric_col(workspace, input_data, workspace.col_chosen),
                                              workspace.ext_coef[workspace.ntaken], workspace.ext_sd, workspace.ext_mean[workspace.ntaken],
                                              workspace.ext_fill_val[workspace.ntaken], model_params.missing_action,
                                              workspace.buffer_dbl.data(), workspace.buffer_szt.data(), true,
@@ -583,7 +622,7 @@ void add_chosen_column(WorkerMemory &workspace, InputData &input_data, ModelPara
                     if (!workspace.weights_arr.size() && !workspace.weights_map.size())
                     {
                         add_linear_comb(workspace.ix_arr.data(), workspace.st, workspace.end, workspace.comb_val.data(),
-                                        input_data.categ_data + workspace.col_chosen * input_data.nrows,
+                                        get_categ_col(workspace, input_data, workspace.col_chosen),
                                         input_data.ncat[workspace.col_chosen],
                                         NULL, workspace.ext_fill_new[workspace.ntaken],
                                         workspace.chosen_cat[workspace.ntaken],
@@ -594,7 +633,7 @@ void add_chosen_column(WorkerMemory &workspace, InputData &input_data, ModelPara
                     else if (workspace.weights_arr.size())
                     {
                         add_linear_comb_weighted(workspace.ix_arr.data(), workspace.st, workspace.end, workspace.comb_val.data(),
-                                                 input_data.categ_data + workspace.col_chosen * input_data.nrows,
+                                                 get_categ_col(workspace, input_data, workspace.col_chosen),
                                                  input_data.ncat[workspace.col_chosen],
                                                  NULL, workspace.ext_fill_new[workspace.ntaken],
                                                  workspace.chosen_cat[workspace.ntaken],
@@ -606,7 +645,7 @@ void add_chosen_column(WorkerMemory &workspace, InputData &input_data, ModelPara
                     else
                     {
                         add_linear_comb_weighted(workspace.ix_arr.data(), workspace.st, workspace.end, workspace.comb_val.data(),
-                                                 input_data.categ_data + workspace.col_chosen * input_data.nrows,
+                                                 get_categ_col(workspace, input_data, workspace.col_chosen),
                                                  input_data.ncat[workspace.col_chosen],
                                                  NULL, workspace.ext_fill_new[workspace.ntaken],
                                                  workspace.chosen_cat[workspace.ntaken],
@@ -631,8 +670,8 @@ void add_chosen_column(WorkerMemory &workspace, InputData &input_data, ModelPara
                         /* calculate counts and sort by them */
                         std::fill(counts, counts + ncat, (size_t)0);
                         for (size_t ix = workspace.st; ix <= workspace.end; ix++)
-                            if (input_data.categ_data[workspace.col_chosen * input_data.nrows + ix] >= 0)
-                                counts[input_data.categ_data[workspace.col_chosen * input_data.nrows + ix]]++;
+                            if (input_data.categ_data[workspace.col_chosen * input_data.ld_categ + ix] >= 0)
+                                counts[input_data.categ_data[workspace.col_chosen * input_data.ld_categ + ix]]++;
                         std::iota(sorted_ix, sorted_ix + ncat, (size_t)0);
                         std::sort(sorted_ix, sorted_ix + ncat,
                                   [&counts](const size_t a, const size_t b){return counts[a] < counts[b];});
@@ -649,7 +688,7 @@ void add_chosen_column(WorkerMemory &workspace, InputData &input_data, ModelPara
                     if (!workspace.weights_arr.size() && !workspace.weights_map.size())
                     {
                         add_linear_comb(workspace.ix_arr.data(), workspace.st, workspace.end, workspace.comb_val.data(),
-                                        input_data.categ_data + workspace.col_chosen * input_data.nrows,
+                                        get_categ_col(workspace, input_data, workspace.col_chosen),
                                         input_data.ncat[workspace.col_chosen],
                                         workspace.ext_cat_coef[workspace.ntaken].data(), (double)0, (int)0,
                                         workspace.ext_fill_val[workspace.ntaken], workspace.ext_fill_new[workspace.ntaken],
@@ -660,7 +699,7 @@ void add_chosen_column(WorkerMemory &workspace, InputData &input_data, ModelPara
                     else if (workspace.weights_arr.size())
                     {
                         add_linear_comb_weighted(workspace.ix_arr.data(), workspace.st, workspace.end, workspace.comb_val.data(),
-                                                 input_data.categ_data + workspace.col_chosen * input_data.nrows,
+                                                 get_categ_col(workspace, input_data, workspace.col_chosen),
                                                  input_data.ncat[workspace.col_chosen],
                                                  workspace.ext_cat_coef[workspace.ntaken].data(), (double)0, (int)0,
                                                  workspace.ext_fill_val[workspace.ntaken], workspace.ext_fill_new[workspace.ntaken],
@@ -672,7 +711,7 @@ void add_chosen_column(WorkerMemory &workspace, InputData &input_data, ModelPara
                     else
                     {
                         add_linear_comb_weighted(workspace.ix_arr.data(), workspace.st, workspace.end, workspace.comb_val.data(),
-                                                 input_data.categ_data + workspace.col_chosen * input_data.nrows,
+                                                 get_categ_col(workspace, input_data, workspace.col_chosen),
                                                  input_data.ncat[workspace.col_chosen],
                                                  workspace.ext_cat_coef[workspace.ntaken].data(), (double)0, (int)0,
                                                  workspace.ext_fill_val[workspace.ntaken], workspace.ext_fill_new[workspace.ntaken],
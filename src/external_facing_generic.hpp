@@ -45,6 +45,7 @@
 int fit_iforest(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
                 real_t numeric_data[],  size_t ncols_numeric,
                 int    categ_data[],    size_t ncols_categ,    int ncat[],
+                size_t ld_numeric,      size_t ld_categ,
                 real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
                 size_t ndim, size_t ntry, CoefType coef_type, bool coef_by_prop,
                 real_t sample_weights[], bool with_replacement, bool weight_as_sample,
@@ -55,7 +56,7 @@ int fit_iforest(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
                 double col_weights[], bool weigh_by_kurt,
                 double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
                 double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
-                double min_gain, MissingAction missing_action,
+                double min_gain, size_t max_bins, bool compensated_sums, MissingAction missing_action,
                 CategSplit cat_split_type, NewCategAction new_cat_action,
                 bool   all_perm, Imputer *imputer, size_t min_imp_obs,
                 UseDepthImp depth_imp, WeighImpRows weigh_imp_rows, bool impute_at_fit,
@@ -75,20 +76,112 @@ int add_tree(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
              UseDepthImp depth_imp, WeighImpRows weigh_imp_rows,
              bool   all_perm, std::vector<ImputeNode> *impute_nodes, size_t min_imp_obs,
              uint64_t random_seed);
+int fit_iforest_stream(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                       size_t (*read_chunk)(void *reader_state, real_t numeric_data[], int categ_data[],
+                                            real_t sample_weights[], size_t max_rows),
+                       void *reader_state, size_t chunk_size,
+                       size_t ncols_numeric, size_t ncols_categ, int ncat[],
+                       size_t ndim, size_t ntry, CoefType coef_type, bool coef_by_prop,
+                       bool has_weights, bool with_replacement, bool weight_as_sample,
+                       size_t sample_size, size_t ntrees,
+                       size_t max_depth, size_t ncols_per_tree,
+                       bool   limit_depth, bool penalize_range,
+                       real_t col_weights[], bool weigh_by_kurt,
+                       double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
+                       double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
+                       double min_gain, size_t max_bins, bool compensated_sums, MissingAction missing_action,
+                       CategSplit cat_split_type, NewCategAction new_cat_action,
+                       bool   all_perm, Imputer *imputer, size_t min_imp_obs,
+                       UseDepthImp depth_imp, WeighImpRows weigh_imp_rows,
+                       uint64_t random_seed, int nthreads);
 void predict_iforest(real_t numeric_data[], int categ_data[],
                      bool is_col_major, size_t ncols_numeric, size_t ncols_categ,
+                     size_t ld_numeric, size_t ld_categ,
                      real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
                      real_t Xr[], sparse_ix Xr_ind[], sparse_ix Xr_indptr[],
                      size_t nrows, int nthreads, bool standardize,
                      IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
-                     double output_depths[],   sparse_ix tree_num[]);
+                     double output_depths[],   sparse_ix tree_num[],
+                     TerminalNodeMapping *terminal_mapping);
+void predict_iforest_threshold(real_t numeric_data[], int categ_data[],
+                               bool is_col_major, size_t ncols_numeric, size_t ncols_categ,
+                               size_t ld_numeric, size_t ld_categ,
+                               real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                               real_t Xr[], sparse_ix Xr_ind[], sparse_ix Xr_indptr[],
+                               size_t nrows, int nthreads, double threshold, bool standardize,
+                               IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                               bool output_is_outlier[], sparse_ix ntrees_used[]);
+void build_terminal_mapping(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext, TerminalNodeMapping &terminal_mapping);
+void compile_isoforest(IsoForest &model_outputs, CompiledIsoForest &compiled_model);
+void compile_ext_isoforest(ExtIsoForest &model_outputs_ext, CompiledExtIsoForest &compiled_model_ext);
+void quantize_compiled_model(CompiledIsoForest &compiled_model, size_t ncols_numeric,
+                             NumericColFormat col_format[], double col_scale[], double col_offset[]);
+void prepare_predictor(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext, int nthreads,
+                       IsoForestPredictor &predictor);
+void predict_iforest_compiled(real_t numeric_data[], int categ_data[],
+                              bool is_col_major, size_t ncols_numeric, size_t ncols_categ,
+                              size_t ld_numeric, size_t ld_categ,
+                              size_t nrows, int nthreads, bool standardize,
+                              CompiledIsoForest *compiled_model, CompiledExtIsoForest *compiled_model_ext,
+                              double output_depths[], sparse_ix tree_num[]);
+void predict_iforest_predictor(IsoForestPredictor &predictor,
+                               real_t numeric_data[], int categ_data[],
+                               bool is_col_major, size_t ncols_numeric, size_t ncols_categ,
+                               size_t nrows, bool standardize,
+                               double output_depths[], sparse_ix tree_num[]);
 void get_num_nodes(IsoForest &model_outputs, sparse_ix *n_nodes, sparse_ix *n_terminal, int nthreads);
 void get_num_nodes(ExtIsoForest &model_outputs, sparse_ix *n_nodes, sparse_ix *n_terminal, int nthreads);
+void get_leaf_embedding(sparse_ix tree_num[], size_t nrows, TerminalNodeMapping &terminal_mapping, int nthreads,
+                        sparse_ix indptr[], sparse_ix indices[]);
+void predict_iforest_mixed(void *numeric_cols[], int categ_data[], size_t nrows, int nthreads, bool standardize,
+                           CompiledIsoForest &compiled_model, double output_depths[], sparse_ix tree_num[]);
 void calc_similarity(real_t numeric_data[], int categ_data[],
                      real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
                      size_t nrows, int nthreads, bool assume_full_distr, bool standardize_dist,
                      IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
                      double tmat[], double rmat[], size_t n_from);
+void calc_similarity_knn(real_t numeric_data[], int categ_data[],
+                         real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                         size_t nrows, int nthreads, bool assume_full_distr, bool standardize_dist,
+                         IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                         size_t k, sparse_ix knn_indptr[], sparse_ix knn_indices[], double knn_dist[]);
+void calc_similarity_tiled(real_t numeric_data[], int categ_data[],
+                           bool is_col_major, size_t ncols_numeric, size_t ncols_categ,
+                           real_t Xr[], sparse_ix Xr_ind[], sparse_ix Xr_indptr[],
+                           size_t nrows,
+                           real_t ref_numeric_data[], int ref_categ_data[],
+                           real_t ref_Xr[], sparse_ix ref_Xr_ind[], sparse_ix ref_Xr_indptr[],
+                           size_t nrows_ref,
+                           size_t tile_rows, size_t tile_cols,
+                           int nthreads, bool assume_full_distr, bool standardize_dist,
+                           IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                           SimilarityTileCallback callback, void *callback_data);
+void get_leaf_signatures(real_t numeric_data[], int categ_data[],
+                         bool is_col_major, size_t ncols_numeric, size_t ncols_categ,
+                         real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                         real_t Xr[], sparse_ix Xr_ind[], sparse_ix Xr_indptr[],
+                         size_t nrows, int nthreads,
+                         IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                         uint64_t signatures[]);
+double signature_separation_depth(const uint64_t signature1[], const uint64_t signature2[], size_t ntrees);
+void calc_similarity_from_signatures(const uint64_t signatures[], size_t nrows, size_t ntrees, int nthreads,
+                                     bool standardize_dist, double tmat[], double rmat[], size_t n_from);
+void get_signature_buckets(const uint64_t signatures[], size_t nrows, size_t ntrees,
+                           size_t trees_per_band, size_t prefix_depth, int nthreads,
+                           uint64_t buckets[]);
+void build_training_leaf_index(real_t numeric_data[], int categ_data[],
+                               real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                               size_t nrows, int nthreads,
+                               IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                               TrainingLeafIndex &leaf_index);
+void calc_similarity_from_leaf_index(TrainingLeafIndex &leaf_index,
+                                     IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                                     int nthreads, bool assume_full_distr, bool standardize_dist,
+                                     double tmat[], double rmat[], size_t n_from);
+void calc_similarity_knn_from_leaf_index(TrainingLeafIndex &leaf_index,
+                                         IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                                         int nthreads, bool assume_full_distr, bool standardize_dist,
+                                         size_t k, sparse_ix knn_indptr[], sparse_ix knn_indices[], double knn_dist[]);
 void impute_missing_values(real_t numeric_data[], int categ_data[], bool is_col_major,
                            real_t Xr[], sparse_ix Xr_ind[], sparse_ix Xr_indptr[],
                            size_t nrows, int nthreads,
@@ -116,6 +209,12 @@ std::string serialize_imputer(Imputer &imputer);
 void deserialize_imputer(Imputer &output_obj, std::istream &serialized);
 void deserialize_imputer(Imputer &output_obj, const char *input_file_path);
 void deserialize_imputer(Imputer &output_obj, std::string &serialized, bool move_str);
+void serialize_training_leaf_index(TrainingLeafIndex &leaf_index, std::ostream &output);
+void serialize_training_leaf_index(TrainingLeafIndex &leaf_index, const char *output_file_path);
+std::string serialize_training_leaf_index(TrainingLeafIndex &leaf_index);
+void deserialize_training_leaf_index(TrainingLeafIndex &output_obj, std::istream &serialized);
+void deserialize_training_leaf_index(TrainingLeafIndex &output_obj, const char *input_file_path);
+void deserialize_training_leaf_index(TrainingLeafIndex &output_obj, std::string &serialized, bool move_str);
 #ifdef _MSC_VER
 void serialize_isoforest(IsoForest &model, const wchar_t *output_file_path);
 void deserialize_isoforest(IsoForest &output_obj, const wchar_t *input_file_path);
@@ -123,6 +222,8 @@ void serialize_ext_isoforest(ExtIsoForest &model, const wchar_t *output_file_pat
 void deserialize_ext_isoforest(ExtIsoForest &output_obj, const wchar_t *input_file_path);
 void serialize_imputer(Imputer &imputer, const wchar_t *output_file_path);
 void deserialize_imputer(Imputer &output_obj, const wchar_t *input_file_path);
+void serialize_training_leaf_index(TrainingLeafIndex &leaf_index, const wchar_t *output_file_path);
+void deserialize_training_leaf_index(TrainingLeafIndex &output_obj, const wchar_t *input_file_path);
 #endif /* _MSC_VER */
 bool has_msvc();
 #endif /* _ENABLE_CEREAL */
@@ -78,6 +78,14 @@
 * - ncat[ncols_categ]
 *       Number of categories in each categorical column. E.g. if the highest code for a column is '4',
 *       the number of categories for that column is '5' (zero is one category).
+* - ld_numeric
+*       Leading dimension of 'numeric_data', i.e. the distance (in number of entries) between the start
+*       of one column and the start of the next one. Passing a value larger than 'nrows' allows fitting
+*       to a subset of the rows of a larger column-major array without copying it. Pass zero to assume
+*       that it is the same as 'nrows'. Ignored when the numeric data is sparse.
+* - ld_categ
+*       Leading dimension of 'categ_data', with the same meaning as 'ld_numeric'. Pass zero to assume
+*       that it is the same as 'nrows'.
 * - Xc[nnz]
 *       Pointer to numeric data in sparse numeric matrix in CSC format (column-compressed).
 *       Pass NULL if there are no sparse numeric columns.
@@ -155,7 +163,8 @@
 *       Array in which to calculate average separation depths or standardized distance metric (see documentation
 *       for 'standardize_dist') as the model is being fit. Pass NULL to avoid doing these calculations alongside
 *       the regular model process. If passing this output argument, the sample size must be the same as the number
-*       of rows, and there cannot be sample weights. If not NULL, must already be initialized to zeros. As the
+*       of rows, and there cannot be sample weights. If not NULL, must already be initialized to zeros. All
+*       threads add into this same array, so its memory usage does not grow with the number of threads. As the
 *       output is a symmetric matrix, this function will only fill in the upper-triangular part, in which
 *       entry 0 <= i < j < n will be located at position
 *           p(i,j) = (i * (n - (i+1)/2) + j - i - 1).
@@ -230,6 +239,22 @@
 *       Minimum gain that a split threshold needs to produce in order to proceed with a split. Only used when the splits
 *       are decided by a gain criterion (either pooled or averaged). If the highest possible gain in the evaluated
 *       splits at a node is below this  threshold, that node becomes a terminal node.
+* - max_bins
+*       When splits are decided by a gain criterion in the single-variable model, numeric columns from dense data can be
+*       discretized into at most this many bins (up to 255) before fitting, with roughly the same number of observations
+*       in each bin. Gains are then evaluated only for splits between bins, calculated from statistics of each bin rather
+*       than by sorting the values at each node, which is much faster for large sample sizes. Nodes with few observations
+*       are still evaluated exactly. Pass zero to always evaluate all possible splits. In that case, if there are no missing
+*       values (or if passing "Fail" for 'missing_action'), the numeric columns might be sorted only once per tree and have
+*       their order passed down to each node, which requires additional memory for 'sample_size' indices per numeric column
+*       and per thread.
+* - compensated_sums
+*       In the extended model, whether to calculate the means and standard deviations of dense numeric columns at each
+*       node (used to standardize them in the linear combinations) with sums in 'double' precision spread over multiple
+*       lanes, using compensated (Neumaier) summation for nodes with at least 1e6 observations, instead of the default
+*       running (Welford) calculation, which uses 'long double' for such nodes. This can be computed with SIMD instructions
+*       and is much faster, and its results do not depend on the CPU, but the means and standard deviations will differ in
+*       the last digits from those of the default, and hence so will the fitted model. Not used with sparse data or weights.
 * - missing_action
 *       How to handle missing data at both fitting and prediction time. Options are a) "Divide" (for the single-variable
 *       model only, recommended), which will follow both branches and combine the result with the weight given by the fraction of
@@ -298,6 +323,11 @@
 *       'categ_data', and 'Xc', will get overwritten with the imputations produced.
 * - random_seed
 *       Seed that will be used to generate random numbers used by the model.
+*       Note that when 'sample_size' is at least 65536 (and there is no imputer, 'missing_action' is not
+*       'Divide', and weights are not used as densities), the larger branches of each tree are grown as
+*       separate subtrees seeded from the tree's own random number generator, so the resulting model
+*       will differ from the one produced for the same seed by versions of this library which grew each
+*       tree in one go. Results are still reproducible for a given seed regardless of 'nthreads'.
 * - nthreads
 *       Number of parallel threads to use. Note that, the more threads, the more memory will be
 *       allocated, even if the thread does not end up being used.
@@ -306,6 +336,9 @@
 *       (e.g. large sparse matrices with small sample sizes), adding more threads might result
 *       in only a very modest speed up (e.g. 1.5x faster with 4x more threads),
 *       even if all threads look fully utilized.
+*       When the sample size is large, bigger subtrees are grown by separate threads, which allows
+*       using more threads than there are trees. The resulting model does not depend on the number
+*       of threads.
 *       Ignored when not building with OpenMP support.
 * 
 * Returns
@@ -340,6 +373,7 @@ template <class real_t, class sparse_ix>
 int fit_iforest(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
                 real_t numeric_data[],  size_t ncols_numeric,
                 int    categ_data[],    size_t ncols_categ,    int ncat[],
+                size_t ld_numeric,      size_t ld_categ,
                 real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
                 size_t ndim, size_t ntry, CoefType coef_type, bool coef_by_prop,
                 real_t sample_weights[], bool with_replacement, bool weight_as_sample,
@@ -351,7 +385,7 @@ int fit_iforest(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
                 real_t col_weights[], bool weigh_by_kurt,
                 double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
                 double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
-                double min_gain, MissingAction missing_action,
+                double min_gain, size_t max_bins, bool compensated_sums, MissingAction missing_action,
                 CategSplit cat_split_type, NewCategAction new_cat_action,
                 bool   all_perm, Imputer *imputer, size_t min_imp_obs,
                 UseDepthImp depth_imp, WeighImpRows weigh_imp_rows, bool impute_at_fit,
@@ -364,10 +398,6 @@ int fit_iforest(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
         throw std::runtime_error("Must pass 'ndim>0' in the extended model.\n");
 
 
-    /* TODO: this function should also accept the array as a memoryview with a
-       leading dimension that might not correspond to the number of columns,
-       so as to avoid having to make deep copies of memoryviews in python. */
-
     /* calculate maximum number of categories to use later */
     int max_categ = 0;
     for (size_t col = 0; col < ncols_categ; col++)
@@ -381,11 +411,13 @@ int fit_iforest(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
     /* put data in structs to shorten function calls */
     InputData<real_t, sparse_ix>
               input_data     = {numeric_data, ncols_numeric, categ_data, ncat, max_categ, ncols_categ,
-                                nrows, ncols_numeric + ncols_categ, sample_weights,
+                                nrows, ld_numeric? ld_numeric : nrows, ld_categ? ld_categ : nrows,
+                                ncols_numeric + ncols_categ, sample_weights,
                                 weight_as_sample, col_weights,
                                 Xc, Xc_ind, Xc_indptr,
                                 0, 0, std::vector<double>(),
-                                std::vector<char>(), 0};
+                                std::vector<char>(), 0,
+                                std::vector<uint8_t>(), 0, false, false, NULL, false};
     ModelParams model_params = {with_replacement, sample_size, ntrees, ncols_per_tree,
                                 limit_depth? log2ceil(sample_size) : max_depth? max_depth : (sample_size - 1),
                                 penalize_range, random_seed, weigh_by_kurt,
@@ -394,7 +426,25 @@ int fit_iforest(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
                                 min_gain, cat_split_type, new_cat_action, missing_action, all_perm,
                                 (model_outputs != NULL)? 0 : ndim, (model_outputs != NULL)? 0 : ntry,
                                 coef_type, coef_by_prop, calc_dist, (bool)(output_depths != NULL), impute_at_fit,
-                                depth_imp, weigh_imp_rows, min_imp_obs};
+                                depth_imp, weigh_imp_rows, min_imp_obs,
+                                compensated_sums};
+
+    return fit_iforest_internal(model_outputs, model_outputs_ext, input_data, model_params,
+                                max_bins, standardize_dist, tmat, output_depths, standardize_depth,
+                                imputer, nthreads);
+}
+
+/* Fits the trees of a model to data already put into the internal structs, taking the
+   remaining parameters from 'fit_iforest' */
+template <class real_t, class sparse_ix>
+int fit_iforest_internal(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                         InputData<real_t, sparse_ix> &input_data, ModelParams &model_params,
+                         size_t max_bins, bool standardize_dist, double tmat[],
+                         double output_depths[], bool standardize_depth,
+                         Imputer *imputer, int nthreads)
+{
+    size_t ntrees = model_params.ntrees;
+    size_t nrows  = input_data.nrows;
 
     /* if using weights as sampling probability, build a binary tree for faster sampling */
     if (input_data.weight_as_sample && input_data.sample_weights != NULL)
@@ -403,6 +453,26 @@ int fit_iforest(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
                             input_data.nrows, input_data.log2_n, input_data.btree_offset);
     }
 
+    /* if evaluating guided splits from histograms, discretize the numeric columns once for all trees */
+    if (max_bins > 0 && model_outputs != NULL && input_data.numeric_data != NULL &&
+        (model_params.prob_pick_by_gain_avg > 0 || model_params.prob_split_by_gain_avg > 0 ||
+         model_params.prob_pick_by_gain_pl > 0  || model_params.prob_split_by_gain_pl > 0))
+    {
+        bin_numeric_columns(input_data, max_bins, nthreads);
+    }
+
+    /* otherwise, guided splits can be evaluated exactly without sorting the numeric columns at each node */
+    else if (model_outputs != NULL && input_data.numeric_data != NULL &&
+             (model_params.prob_pick_by_gain_avg > 0 || model_params.prob_split_by_gain_avg > 0 ||
+              model_params.prob_pick_by_gain_pl > 0  || model_params.prob_split_by_gain_pl > 0))
+    {
+        input_data.presort_numeric = should_presort_numeric(input_data, model_params);
+    }
+
+    input_data.compact_nodes = should_compact_nodes(input_data, model_params, imputer != NULL);
+    input_data.advise_rows = model_params.sample_size < input_data.nrows &&
+                             (is_mapped_memory(input_data.numeric_data) || is_mapped_memory(input_data.categ_data));
+
     /* if imputing missing values on-the-fly, need to determine which are missing */
     std::vector<ImputedData<sparse_ix>> impute_vec;
     std::unordered_map<size_t, ImputedData<sparse_ix>> impute_map;
@@ -414,10 +484,10 @@ int fit_iforest(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
     {
         model_outputs->trees.resize(ntrees);
         model_outputs->trees.shrink_to_fit();
-        model_outputs->new_cat_action = new_cat_action;
-        model_outputs->cat_split_type = cat_split_type;
-        model_outputs->missing_action = missing_action;
-        model_outputs->exp_avg_depth  = expected_avg_depth(sample_size);
+        model_outputs->new_cat_action = model_params.new_cat_action;
+        model_outputs->cat_split_type = model_params.cat_split_type;
+        model_outputs->missing_action = model_params.missing_action;
+        model_outputs->exp_avg_depth  = expected_avg_depth(model_params.sample_size);
         model_outputs->exp_avg_sep = expected_separation_depth(model_params.sample_size);
         model_outputs->orig_sample_size = input_data.nrows;
     }
@@ -426,10 +496,10 @@ int fit_iforest(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
     {
         model_outputs_ext->hplanes.resize(ntrees);
         model_outputs_ext->hplanes.shrink_to_fit();
-        model_outputs_ext->new_cat_action = new_cat_action;
-        model_outputs_ext->cat_split_type = cat_split_type;
-        model_outputs_ext->missing_action = missing_action;
-        model_outputs_ext->exp_avg_depth  = expected_avg_depth(sample_size);
+        model_outputs_ext->new_cat_action = model_params.new_cat_action;
+        model_outputs_ext->cat_split_type = model_params.cat_split_type;
+        model_outputs_ext->missing_action = model_params.missing_action;
+        model_outputs_ext->exp_avg_depth  = expected_avg_depth(model_params.sample_size);
         model_outputs_ext->exp_avg_sep = expected_separation_depth(model_params.sample_size);
         model_outputs_ext->orig_sample_size = input_data.nrows;
     }
@@ -437,59 +507,105 @@ int fit_iforest(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
     if (imputer != NULL)
         initialize_imputer(*imputer, input_data, ntrees, nthreads);
 
+    /* when the trees are large, their bigger subtrees are grown separately so that threads
+       are not left idle when there are few trees, and so that a tree is not left waiting
+       for a single thread to finish it. This is not done when the nodes need to keep
+       track of weights or imputation statistics for their rows. */
+    const size_t min_rows_subtree = 32768;
+    bool grow_subtrees = model_params.sample_size >= 2 * min_rows_subtree &&
+                         imputer == NULL &&
+                         model_params.missing_action != Divide &&
+                         (input_data.sample_weights == NULL || input_data.weight_as_sample);
+
     /* initialize thread-private memory */
-    if ((size_t)nthreads > ntrees)
+    if ((size_t)nthreads > ntrees && !grow_subtrees)
         nthreads = (int)ntrees;
     #ifdef _OPENMP
         std::vector<WorkerMemory<ImputedData<sparse_ix>>> worker_memory(nthreads);
     #else
         std::vector<WorkerMemory<ImputedData<sparse_ix>>> worker_memory(1);
     #endif
+    TreeScheduler scheduler(ntrees, worker_memory.size(), grow_subtrees? min_rows_subtree : SIZE_MAX);
+    for (size_t thread = 0; thread < worker_memory.size(); thread++)
+    {
+        worker_memory[thread].scheduler = &scheduler;
+        worker_memory[thread].thread_num = thread;
+        /* separation depths are added straight into the output, atomically if there is more than one thread */
+        worker_memory[thread].tmat_sep = tmat;
+        worker_memory[thread].tmat_atomic = worker_memory.size() > 1;
+    }
 
     /* Global variable that determines if the procedure receives a stop signal */
     SignalSwitcher ss = SignalSwitcher();
 
-    /* grow trees */
-    #pragma omp parallel for num_threads(nthreads) schedule(dynamic) shared(model_outputs, model_outputs_ext, worker_memory, input_data, model_params)
-    for (size_t_for tree = 0; tree < ntrees; tree++)
+    /* grow trees - since each tree and subtree has its own seed, it doesn't matter which thread grows it */
+    #pragma omp parallel num_threads(nthreads) shared(model_outputs, model_outputs_ext, worker_memory, input_data, model_params, scheduler, grow_subtrees)
     {
-        if (interrupt_switch)
-            continue; /* Cannot break with OpenMP==2.0 (MSVC) */
-
-        if (
-            model_params.impute_at_fit &&
-            input_data.n_missing &&
-            !worker_memory[omp_get_thread_num()].impute_vec.size() &&
-            !worker_memory[omp_get_thread_num()].impute_map.size()
-            )
+        WorkerMemory<ImputedData<sparse_ix>> &workspace = worker_memory[omp_get_thread_num()];
+        size_t task;
+        while (true)
         {
-            #ifdef _OPENMP
-            if (nthreads > 1)
+            if (!scheduler.get_task(workspace.thread_num, task))
             {
-                worker_memory[omp_get_thread_num()].impute_vec = impute_vec;
-                worker_memory[omp_get_thread_num()].impute_map = impute_map;
+                /* others might still add subtrees */
+                if (!grow_subtrees || !scheduler.n_unfinished || interrupt_switch)
+                    break;
+                std::this_thread::yield();
+                continue;
             }
 
-            else
-            #endif
+            if (interrupt_switch)
             {
-                worker_memory[0].impute_vec = std::move(impute_vec);
-                worker_memory[0].impute_map = std::move(impute_map);
+                scheduler.finish_task();
+                continue;
             }
-        }
 
-        fit_itree((model_outputs != NULL)? &model_outputs->trees[tree] : NULL,
-                  (model_outputs_ext != NULL)? &model_outputs_ext->hplanes[tree] : NULL,
-                  worker_memory[omp_get_thread_num()],
-                  input_data,
-                  model_params,
-                  (imputer != NULL)? &(imputer->imputer_tree[tree]) : NULL,
-                  tree);
+            if (task >= ntrees)
+            {
+                grow_deferred_subtree(scheduler.get_subtree(task - ntrees), task - ntrees, workspace,
+                                      input_data, model_params, model_outputs == NULL);
+                scheduler.finish_task();
+                continue;
+            }
 
-        if ((model_outputs != NULL))
-            model_outputs->trees[tree].shrink_to_fit();
-        else
-            model_outputs_ext->hplanes[tree].shrink_to_fit();
+            size_t tree = task;
+            if (
+                model_params.impute_at_fit &&
+                input_data.n_missing &&
+                !workspace.impute_vec.size() &&
+                !workspace.impute_map.size()
+                )
+            {
+                #ifdef _OPENMP
+                if (nthreads > 1)
+                {
+                    workspace.impute_vec = impute_vec;
+                    workspace.impute_map = impute_map;
+                }
+
+                else
+                #endif
+                {
+                    workspace.impute_vec = std::move(impute_vec);
+                    workspace.impute_map = std::move(impute_map);
+                }
+            }
+
+            fit_itree((model_outputs != NULL)? &model_outputs->trees[tree] : NULL,
+                      (model_outputs_ext != NULL)? &model_outputs_ext->hplanes[tree] : NULL,
+                      workspace,
+                      input_data,
+                      model_params,
+                      (imputer != NULL)? &(imputer->imputer_tree[tree]) : NULL,
+                      tree);
+
+            if ((model_outputs != NULL))
+                model_outputs->trees[tree].shrink_to_fit();
+            else
+                model_outputs_ext->hplanes[tree].shrink_to_fit();
+
+            scheduler.finish_task();
+        }
     }
 
     /* check if the procedure got interrupted */
@@ -498,16 +614,25 @@ int fit_iforest(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
     if (interrupt_switch) return EXIT_FAILURE;
     #endif
 
+    /* put the subtrees in their place */
+    if (scheduler.subtrees.size())
+    {
+        if (model_outputs != NULL)
+            join_deferred_subtrees(model_outputs->trees, scheduler, nthreads);
+        else
+            join_deferred_subtrees(model_outputs_ext->hplanes, scheduler, nthreads);
+        scheduler.subtrees.clear();
+    }
+
     if ((model_outputs != NULL))
         model_outputs->trees.shrink_to_fit();
     else
         model_outputs_ext->hplanes.shrink_to_fit();
 
     /* if calculating similarity/distance, now need to reduce and average */
-    if (calc_dist)
+    if (model_params.calc_dist)
         gather_sim_result< PredictionData<real_t, sparse_ix>, InputData<real_t, sparse_ix> >
-                         (NULL, &worker_memory,
-                          NULL, &input_data,
+                         (NULL, &input_data,
                           model_outputs, model_outputs_ext,
                           tmat, NULL, 0,
                           model_params.ntrees, false,
@@ -590,6 +715,251 @@ int fit_iforest(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
 }
 
 
+/* Fit Isolation Forest model to data that is read in chunks from a stream, taking the sample of rows
+*  for each tree while the data is read, in a single pass over it
+* 
+* Only the rows that end up in the sample of some tree are kept in memory, so the data does not need
+* to fit in memory. The samples are taken through weighted reservoirs, which have the same distribution
+* as the sub-samples taken by 'fit_iforest' without replacement (or with replacement, if passing
+* 'with_replacement=true'), but will not be the same rows for a given random seed.
+* 
+* Parameters:
+* ===========
+* - model_outputs (out)
+*       Same parameter as for 'fit_iforest' (see the documentation in there for details).
+* - model_outputs_ext (out)
+*       Same parameter as for 'fit_iforest' (see the documentation in there for details).
+* - read_chunk
+*       Function that reads the next rows from the stream. It will be called with 'reader_state', with
+*       pointers to arrays where to write the numeric data, categorical data, and sample weights of up to
+*       'max_rows' rows, and with 'max_rows' (which will be equal to 'chunk_size'), and must return the
+*       number of rows that it wrote, or zero once there are no more rows. The data is to be written in
+*       column-major order, with 'max_rows' as leading dimension (i.e. column 'col' of row 'row' goes in
+*       entry 'row + col * max_rows'), and with the same encoding as for 'fit_iforest'. The pointers will
+*       be NULL when there are no columns of a given type or no sample weights.
+* - reader_state
+*       Pointer that will be passed to 'read_chunk' in each call.
+* - chunk_size
+*       Maximum number of rows to read from the stream in each call to 'read_chunk'.
+* - ncols_numeric
+*       Number of numeric columns in the data. Only dense numeric data is supported.
+* - ncols_categ
+*       Number of categorical columns in the data.
+* - ncat[ncols_categ]
+*       Same parameter as for 'fit_iforest' (see the documentation in there for details).
+* - ndim, ntry, coef_type, coef_by_prop
+*       Same parameters as for 'fit_iforest' (see the documentation in there for details).
+* - has_weights
+*       Whether 'read_chunk' will produce sample weights for the rows. These are taken either as sampling
+*       importances or as density measurements according to 'weight_as_sample', same as the weights in
+*       'fit_iforest'. Rows with a sampling importance of zero or less are never taken.
+* - with_replacement, weight_as_sample
+*       Same parameters as for 'fit_iforest' (see the documentation in there for details).
+* - sample_size
+*       Sample size of the data sub-samples with which each binary tree will be built. Must be passed,
+*       as the number of rows in the stream is not known. If the stream ends up having fewer rows
+*       (with non-zero weight) than this, and sampling without replacement, the trees will be built
+*       with all of them.
+* - ntrees, max_depth, ncols_per_tree, limit_depth, penalize_range, col_weights, weigh_by_kurt,
+*   prob_pick_by_gain_avg, prob_split_by_gain_avg, prob_pick_by_gain_pl, prob_split_by_gain_pl,
+*   min_gain, max_bins, compensated_sums, missing_action, cat_split_type, new_cat_action, all_perm
+*       Same parameters as for 'fit_iforest' (see the documentation in there for details).
+* - imputer, min_imp_obs, depth_imp, weigh_imp_rows
+*       Same parameters as for 'fit_iforest' (see the documentation in there for details). Missing values
+*       cannot be imputed at fit time, as the rows are not kept.
+* - random_seed
+*       Seed that will be used to generate random numbers used by the model.
+* - nthreads
+*       Number of parallel threads to use. Note that the reservoirs for each tree are updated in
+*       parallel for each chunk, but the chunks are read one at a time by the calling thread.
+* 
+* Returns
+* =======
+* Will return macro 'EXIT_SUCCESS' (typically =0) upon completion.
+* If the process receives an interrupt signal, will return instead
+* 'EXIT_FAILURE' (typically =1).
+* 
+* References
+* ==========
+* [1] Efraimidis, Pavlos S., and Paul G. Spirakis.
+*     "Weighted random sampling with a reservoir."
+*     Information Processing Letters 97.5 (2006): 181-185.
+*/
+template <class real_t>
+int fit_iforest_stream(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                       size_t (*read_chunk)(void *reader_state, real_t numeric_data[], int categ_data[],
+                                            real_t sample_weights[], size_t max_rows),
+                       void *reader_state, size_t chunk_size,
+                       size_t ncols_numeric, size_t ncols_categ, int ncat[],
+                       size_t ndim, size_t ntry, CoefType coef_type, bool coef_by_prop,
+                       bool has_weights, bool with_replacement, bool weight_as_sample,
+                       size_t sample_size, size_t ntrees,
+                       size_t max_depth, size_t ncols_per_tree,
+                       bool   limit_depth, bool penalize_range,
+                       real_t col_weights[], bool weigh_by_kurt,
+                       double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
+                       double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
+                       double min_gain, size_t max_bins, bool compensated_sums, MissingAction missing_action,
+                       CategSplit cat_split_type, NewCategAction new_cat_action,
+                       bool   all_perm, Imputer *imputer, size_t min_imp_obs,
+                       UseDepthImp depth_imp, WeighImpRows weigh_imp_rows,
+                       uint64_t random_seed, int nthreads)
+{
+    if (prob_pick_by_gain_avg < 0 || prob_split_by_gain_avg < 0 ||
+        prob_pick_by_gain_pl < 0  || prob_split_by_gain_pl < 0)
+        throw std::runtime_error("Cannot pass negative probabilities.\n");
+    if (ndim == 0 && model_outputs == NULL)
+        throw std::runtime_error("Must pass 'ndim>0' in the extended model.\n");
+    if (sample_size == 0 || chunk_size == 0 || ntrees == 0)
+        throw std::runtime_error("Must pass 'sample_size', 'chunk_size' and 'ntrees' when fitting to a stream.\n");
+
+    /* when sampling with replacement, each row of the sample is a reservoir of size one */
+    std::vector<StreamReservoirs> reservoirs(ntrees);
+    for (size_t tree = 0; tree < ntrees; tree++)
+        reservoirs[tree].initialize(with_replacement? sample_size : 1, with_replacement? 1 : sample_size,
+                                    random_seed + tree);
+
+    std::vector<real_t> chunk_numeric(chunk_size * ncols_numeric);
+    std::vector<int>    chunk_categ(chunk_size * ncols_categ);
+    std::vector<real_t> chunk_weights(has_weights? chunk_size : 0);
+    std::vector<double> row_weights(chunk_size);
+    std::vector<double> cum_weights(chunk_size);
+    std::vector<char>   is_taken(chunk_size);
+    double cum_weight = 0;
+    size_t nrows = 0;
+    size_t max_rows_kept = ntrees * sample_size;
+
+    /* rows that are in the sample of some tree, in row-major order and sorted by their position in the stream */
+    std::vector<size_t> kept_rows;
+    std::vector<real_t> kept_numeric;
+    std::vector<int>    kept_categ;
+    std::vector<real_t> kept_weights;
+    bool keep_weights = has_weights && !weight_as_sample;
+
+    SignalSwitcher ss = SignalSwitcher();
+
+    while (!interrupt_switch)
+    {
+        size_t n = read_chunk(reader_state,
+                              ncols_numeric? chunk_numeric.data() : NULL,
+                              ncols_categ? chunk_categ.data() : NULL,
+                              has_weights? chunk_weights.data() : NULL,
+                              chunk_size);
+        if (!n) break;
+        if (n > chunk_size)
+            throw std::runtime_error("Function 'read_chunk' returned more rows than requested.\n");
+
+        /* the cumulative weights are accumulated row by row so that they do not depend on the chunk size */
+        for (size_t row = 0; row < n; row++)
+        {
+            row_weights[row] = (has_weights && weight_as_sample)? (double)chunk_weights[row] : 1.;
+            if (!(row_weights[row] > 0)) row_weights[row] = 0;
+            cum_weight += row_weights[row];
+            cum_weights[row] = cum_weight;
+        }
+
+        #pragma omp parallel for schedule(dynamic) num_threads(nthreads) shared(reservoirs, row_weights, cum_weights, n, nrows, ntrees)
+        for (size_t_for tree = 0; tree < ntrees; tree++)
+            reservoirs[tree].take_rows(row_weights.data(), cum_weights.data(), n, nrows);
+
+        /* keep the rows from this chunk that were taken, even if some got replaced later in the same chunk */
+        std::fill(is_taken.begin(), is_taken.begin() + n, false);
+        for (StreamReservoirs &res : reservoirs)
+            for (size_t row : res.rows_taken)
+                is_taken[row - nrows] = true;
+        for (size_t row = 0; row < n; row++)
+        {
+            if (!is_taken[row]) continue;
+            kept_rows.push_back(nrows + row);
+            for (size_t col = 0; col < ncols_numeric; col++)
+                kept_numeric.push_back(chunk_numeric[row + col * chunk_size]);
+            for (size_t col = 0; col < ncols_categ; col++)
+                kept_categ.push_back(chunk_categ[row + col * chunk_size]);
+            if (keep_weights)
+                kept_weights.push_back(chunk_weights[row]);
+        }
+        nrows += n;
+
+        /* once there are too many rows that are no longer in any sample, drop them */
+        if (kept_rows.size() >= 2 * max_rows_kept)
+            drop_unused_stream_rows(reservoirs, kept_rows, kept_numeric, kept_categ, kept_weights,
+                                    ncols_numeric, ncols_categ, keep_weights);
+    }
+
+    check_interrupt_switch(ss);
+    #if defined(DONT_THROW_ON_INTERRUPT)
+    if (interrupt_switch) return EXIT_FAILURE;
+    #endif
+
+    if (!reservoirs[0].n_filled)
+        throw std::runtime_error("Stream does not contain any rows with non-zero weight.\n");
+    drop_unused_stream_rows(reservoirs, kept_rows, kept_numeric, kept_categ, kept_weights,
+                            ncols_numeric, ncols_categ, keep_weights);
+    if (!with_replacement)
+        sample_size = reservoirs[0].n_filled;
+
+    /* the rows are put in column-major order, and each tree takes them by their position in it */
+    size_t nrows_kept = kept_rows.size();
+    std::vector<real_t> numeric_data(nrows_kept * ncols_numeric);
+    std::vector<int>    categ_data(nrows_kept * ncols_categ);
+    for (size_t row = 0; row < nrows_kept; row++)
+    {
+        for (size_t col = 0; col < ncols_numeric; col++)
+            numeric_data[row + col * nrows_kept] = kept_numeric[row * ncols_numeric + col];
+        for (size_t col = 0; col < ncols_categ; col++)
+            categ_data[row + col * nrows_kept] = kept_categ[row * ncols_categ + col];
+    }
+    kept_numeric.clear(); kept_numeric.shrink_to_fit();
+    kept_categ.clear();   kept_categ.shrink_to_fit();
+
+    std::vector<size_t> tree_rows(ntrees * sample_size);
+    for (size_t tree = 0; tree < ntrees; tree++)
+    {
+        size_t *rows_this = tree_rows.data() + tree * sample_size;
+        for (size_t ix = 0; ix < sample_size; ix++)
+            rows_this[ix] = std::lower_bound(kept_rows.begin(), kept_rows.end(), reservoirs[tree].keys[ix].second)
+                                - kept_rows.begin();
+        std::sort(rows_this, rows_this + sample_size);
+    }
+    reservoirs.clear();
+
+    int max_categ = 0;
+    for (size_t col = 0; col < ncols_categ; col++)
+        max_categ = (ncat[col] > max_categ)? ncat[col] : max_categ;
+
+    InputData<real_t, size_t>
+              input_data     = {ncols_numeric? numeric_data.data() : NULL, ncols_numeric,
+                                ncols_categ? categ_data.data() : NULL, ncat, max_categ, ncols_categ,
+                                nrows_kept, nrows_kept, nrows_kept,
+                                ncols_numeric + ncols_categ, keep_weights? kept_weights.data() : NULL,
+                                false, col_weights,
+                                NULL, NULL, NULL,
+                                0, 0, std::vector<double>(),
+                                std::vector<char>(), 0,
+                                std::vector<uint8_t>(), 0, false, false, tree_rows.data(), false};
+    ModelParams model_params = {with_replacement, sample_size, ntrees, ncols_per_tree,
+                                limit_depth? log2ceil(sample_size) : max_depth? max_depth : (sample_size - 1),
+                                penalize_range, random_seed, weigh_by_kurt,
+                                prob_pick_by_gain_avg, (model_outputs == NULL)? 0 : prob_split_by_gain_avg,
+                                prob_pick_by_gain_pl,  (model_outputs == NULL)? 0 : prob_split_by_gain_pl,
+                                min_gain, cat_split_type, new_cat_action, missing_action, all_perm,
+                                (model_outputs != NULL)? 0 : ndim, (model_outputs != NULL)? 0 : ntry,
+                                coef_type, coef_by_prop, false, false, false,
+                                depth_imp, weigh_imp_rows, min_imp_obs,
+                                compensated_sums};
+
+    int ret = fit_iforest_internal(model_outputs, model_outputs_ext, input_data, model_params,
+                                   max_bins, false, (double*)NULL, (double*)NULL, false,
+                                   imputer, nthreads);
+
+    if (model_outputs != NULL)
+        model_outputs->orig_sample_size = nrows;
+    else
+        model_outputs_ext->orig_sample_size = nrows;
+    return ret;
+}
+
+
 /* Add additional trees to already-fitted isolation forest model
 * 
 * Parameters
@@ -757,11 +1127,12 @@ int add_tree(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
 
     InputData<real_t, sparse_ix>
               input_data     = {numeric_data, ncols_numeric, categ_data, ncat, max_categ, ncols_categ,
-                                nrows, ncols_numeric + ncols_categ, sample_weights,
+                                nrows, nrows, nrows, ncols_numeric + ncols_categ, sample_weights,
                                 false, col_weights,
                                 Xc, Xc_ind, Xc_indptr,
                                 0, 0, std::vector<double>(),
-                                std::vector<char>(), 0};
+                                std::vector<char>(), 0,
+                                std::vector<uint8_t>(), 0, false, false, NULL, false};
     ModelParams model_params = {false, nrows, (size_t)1, ncols_per_tree,
                                 max_depth? max_depth : (nrows - 1),
                                 penalize_range, random_seed, weigh_by_kurt,
@@ -769,7 +1140,10 @@ int add_tree(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
                                 prob_pick_by_gain_pl,  (model_outputs == NULL)? 0 : prob_split_by_gain_pl,
                                 min_gain, cat_split_type, new_cat_action, missing_action, all_perm,
                                 (model_outputs != NULL)? 0 : ndim, (model_outputs != NULL)? 0 : ntry,
-                                coef_type, coef_by_prop, false, false, false, depth_imp, weigh_imp_rows, min_imp_obs};
+                                coef_type, coef_by_prop, false, false, false, depth_imp, weigh_imp_rows, min_imp_obs, false};
+    input_data.compact_nodes = should_compact_nodes(input_data, model_params, impute_nodes != NULL);
+    input_data.advise_rows = model_params.sample_size < input_data.nrows &&
+                             (is_mapped_memory(input_data.numeric_data) || is_mapped_memory(input_data.categ_data));
 
     std::unique_ptr<WorkerMemory<ImputedData<sparse_ix>>> workspace = std::unique_ptr<WorkerMemory<ImputedData<sparse_ix>>>(new WorkerMemory<ImputedData<sparse_ix>>);
 
@@ -822,13 +1196,32 @@ void fit_itree(std::vector<IsoTree>    *tree_root,
                                        input_data.btree_weights_init.end());
     workspace.rnd_generator.seed(model_params.random_seed + tree_num);
     workspace.rbin  = std::uniform_real_distribution<double>(0, 1);
-    sample_random_rows(workspace.ix_arr, input_data.nrows, model_params.with_replacement,
-                       workspace.rnd_generator, workspace.ix_all,
-                       (input_data.weight_as_sample)? input_data.sample_weights : NULL,
-                       workspace.btree_weights, input_data.log2_n, input_data.btree_offset,
-                       workspace.is_repeated);
+    if (input_data.tree_rows != NULL)
+        std::copy(input_data.tree_rows + tree_num * model_params.sample_size,
+                  input_data.tree_rows + (tree_num + 1) * model_params.sample_size,
+                  workspace.ix_arr.begin());
+    else
+        sample_random_rows(workspace.ix_arr, input_data.nrows, model_params.with_replacement,
+                           workspace.rnd_generator, workspace.ix_all,
+                           (input_data.weight_as_sample)? input_data.sample_weights : NULL,
+                           workspace.btree_weights, input_data.log2_n, input_data.btree_offset,
+                           workspace.is_repeated);
+    if (input_data.advise_rows)
+    {
+        /* have the OS start reading the pages with the sampled rows before they are needed */
+        if (is_mapped_memory(input_data.numeric_data))
+            advise_mapped_rows(input_data.numeric_data, sizeof(*input_data.numeric_data),
+                               input_data.ld_numeric, input_data.ncols_numeric,
+                               workspace.ix_arr.data(), model_params.sample_size);
+        if (is_mapped_memory(input_data.categ_data))
+            advise_mapped_rows(input_data.categ_data, sizeof(*input_data.categ_data),
+                               input_data.ld_categ, input_data.ncols_categ,
+                               workspace.ix_arr.data(), model_params.sample_size);
+    }
     workspace.st  = 0;
     workspace.end = model_params.sample_size - 1;
+    workspace.curr_tree = tree_num;
+    workspace.curr_subtree = SIZE_MAX;
 
     /* in some cases, it's not possible to use column weights even if they are given */
     bool avoid_col_weights = (tree_root != NULL && model_params.ndim < 2 &&
@@ -863,10 +1256,6 @@ void fit_itree(std::vector<IsoTree>    *tree_root,
         }
     }
 
-    /* initialize array with candidate categories if not already done */
-    if (!workspace.categs.size())
-        workspace.categs.resize(input_data.max_categ);
-
     /* IMPORTANT!!!!!
        The standard library implementation is likely going to use the ziggurat method
        for normal sampling, which has some state memory in the **distribution object itself**
@@ -875,7 +1264,7 @@ void fit_itree(std::vector<IsoTree>    *tree_root,
        irreproducibility when the number of splitting dimensions is odd and the number
        of threads is more than 1. This is a very hard issue to debug since everything
        works fine depending on the order in which trees are assigned to threads.
-       DO NOT PUT THESE LINES BELOW THE NEXT IF. */
+       DO NOT MOVE THESE LINES INTO 'initialize_split_buffers'. */
     if (hplane_root != NULL)
     {
         if (input_data.ncols_categ || model_params.coef_type == Normal)
@@ -884,45 +1273,6 @@ void fit_itree(std::vector<IsoTree>    *tree_root,
             workspace.coef_unif = std::uniform_real_distribution<double>(-1, 1);
     }
 
-    /* for the extended model, initialize extra vectors and objects */
-    if (hplane_root != NULL && !workspace.comb_val.size())
-    {
-        workspace.comb_val.resize(model_params.sample_size);
-        workspace.col_take.resize(model_params.ndim);
-        workspace.col_take_type.resize(model_params.ndim);
-
-        if (input_data.ncols_numeric)
-        {
-            workspace.ext_offset.resize(input_data.ncols_tot);
-            workspace.ext_coef.resize(input_data.ncols_tot);
-            workspace.ext_mean.resize(input_data.ncols_tot);
-        }
-
-        if (input_data.ncols_categ)
-        {
-            workspace.ext_fill_new.resize(input_data.max_categ);
-            switch(model_params.cat_split_type)
-            {
-                case SingleCateg:
-                {
-                    workspace.chosen_cat.resize(input_data.max_categ);
-                    break;
-                }
-
-                case SubSet:
-                {
-                    workspace.ext_cat_coef.resize(input_data.ncols_tot);
-                    for (std::vector<double> &v : workspace.ext_cat_coef)
-                        v.resize(input_data.max_categ);
-                    break;
-                }
-            }
-        }
-
-        workspace.ext_fill_val.resize(input_data.ncols_tot);
-
-    }
-
     /* if it contains missing values, also have to set an array of weights,
        which will be modified during iterations when there are NAs.
        If there are already density weights, need to standardize them to sum up to
@@ -1006,101 +1356,7 @@ void fit_itree(std::vector<IsoTree>    *tree_root,
         }
     }
 
-    /* if producing distance/similarity, also need to initialize the triangular matrix */
-    if (model_params.calc_dist && !workspace.tmat_sep.size())
-        workspace.tmat_sep.resize((input_data.nrows * (input_data.nrows - 1)) / 2, 0);
-
-    /* make space for buffers if not already allocated */
-    if (
-            (model_params.prob_split_by_gain_avg > 0 || model_params.prob_pick_by_gain_avg > 0 ||
-             model_params.prob_split_by_gain_pl > 0  || model_params.prob_pick_by_gain_pl > 0  ||
-             model_params.weigh_by_kurt || hplane_root != NULL)
-                &&
-            (!workspace.buffer_dbl.size() && !workspace.buffer_szt.size() && !workspace.buffer_chr.size())
-        )
-    {
-        size_t min_size_dbl = 0;
-        size_t min_size_szt = 0;
-        size_t min_size_chr = 0;
-
-        bool gain = model_params.prob_split_by_gain_avg > 0 || model_params.prob_pick_by_gain_avg > 0 ||
-                    model_params.prob_split_by_gain_pl > 0  || model_params.prob_pick_by_gain_pl > 0;
-
-        if (input_data.ncols_categ)
-        {
-            min_size_szt = 2 * input_data.max_categ;
-            min_size_dbl = input_data.max_categ + 1;
-            if (gain && model_params.cat_split_type == SubSet)
-                min_size_chr = input_data.max_categ;
-        }
-
-        if (input_data.Xc_indptr != NULL && gain)
-        {
-            min_size_szt = std::max(min_size_szt, model_params.sample_size);
-            min_size_dbl = std::max(min_size_dbl, model_params.sample_size);
-        }
-
-        if (gain && (model_params.ntry > 1 ||
-                     model_params.prob_pick_by_gain_avg > 0 ||
-                     model_params.prob_split_by_gain_avg > 0 ||
-                     (model_params.ndim < 2 && model_params.prob_pick_by_gain_pl > 0) ||
-                     model_params.min_gain > 0)
-        )
-        {
-            min_size_dbl = std::max(min_size_dbl, model_params.sample_size);
-            if (model_params.ndim < 2 && input_data.Xc_indptr != NULL)
-                min_size_dbl = std::max(min_size_dbl, (size_t)2*model_params.sample_size);
-        }
-
-        /* for the extended model */
-        if (hplane_root != NULL)
-        {
-            min_size_dbl = std::max(min_size_dbl, pow2(log2ceil(input_data.ncols_tot) + 1));
-            if (model_params.missing_action != Fail)
-            {
-                min_size_szt = std::max(min_size_szt, model_params.sample_size);
-                min_size_dbl = std::max(min_size_dbl, model_params.sample_size);
-            }
-
-            if (input_data.ncols_categ && model_params.cat_split_type == SubSet)
-            {
-                min_size_szt = std::max(min_size_szt, 2 * (size_t)input_data.max_categ + 1);
-                min_size_dbl = std::max(min_size_dbl, (size_t)input_data.max_categ);
-            }
-
-            if (model_params.weigh_by_kurt)
-                min_size_szt = std::max(min_size_szt, input_data.ncols_tot);
-
-            if (gain && (workspace.weights_arr.size() || workspace.weights_map.size()))
-            {
-                workspace.sample_weights.resize(model_params.sample_size);
-                min_size_szt = std::max(min_size_szt, model_params.sample_size);
-            }
-        }
-
-        /* now resize */
-        if (workspace.buffer_dbl.size() < min_size_dbl)
-            workspace.buffer_dbl.resize(min_size_dbl);
-
-        if (workspace.buffer_szt.size() < min_size_szt)
-            workspace.buffer_szt.resize(min_size_szt);
-
-        if (workspace.buffer_chr.size() < min_size_chr)
-            workspace.buffer_chr.resize(min_size_chr);
-
-        /* for guided column choice, need to also remember the best split so far */
-        if (
-            model_params.cat_split_type == SubSet &&
-            (
-                model_params.prob_pick_by_gain_avg  || 
-                model_params.prob_pick_by_gain_pl
-            )
-           )
-        {
-            workspace.this_split_categ.resize(input_data.max_categ);
-        }
-
-    }
+    initialize_split_buffers(workspace, input_data, model_params, hplane_root != NULL);
 
     /* weigh columns by kurtosis in the sample if required */
     if (model_params.weigh_by_kurt && !avoid_col_weights)
@@ -1117,15 +1373,15 @@ void fit_itree(std::vector<IsoTree>    *tree_root,
                 {
                     if (!workspace.weights_arr.size() && !workspace.weights_map.size())
                         kurt_weights[col] = calc_kurtosis(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                                          input_data.numeric_data + col * input_data.nrows,
+                                                          input_data.numeric_data + col * input_data.ld_numeric,
                                                           model_params.missing_action);
                     else if (workspace.weights_arr.size())
                         kurt_weights[col] = calc_kurtosis_weighted(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                                                   input_data.numeric_data + col * input_data.nrows,
+                                                                   input_data.numeric_data + col * input_data.ld_numeric,
                                                                    model_params.missing_action, workspace.weights_arr);
                     else
                         kurt_weights[col] = calc_kurtosis_weighted(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                                                   input_data.numeric_data + col * input_data.nrows,
+                                                                   input_data.numeric_data + col * input_data.ld_numeric,
                                                                    model_params.missing_action, workspace.weights_map);
                 }
             }
@@ -1155,20 +1411,20 @@ void fit_itree(std::vector<IsoTree>    *tree_root,
                 if (!workspace.weights_arr.size() && !workspace.weights_map.size())
                     kurt_weights[col + input_data.ncols_numeric] =
                         calc_kurtosis(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                      input_data.categ_data + col * input_data.nrows, input_data.ncat[col],
+                                      input_data.categ_data + col * input_data.ld_categ, input_data.ncat[col],
                                       workspace.buffer_szt.data(), workspace.buffer_dbl.data(),
                                       model_params.missing_action, model_params.cat_split_type, workspace.rnd_generator);
                 else if (workspace.weights_arr.size())
                     kurt_weights[col + input_data.ncols_numeric] =
                         calc_kurtosis_weighted(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                               input_data.categ_data + col * input_data.nrows, input_data.ncat[col],
+                                               input_data.categ_data + col * input_data.ld_categ, input_data.ncat[col],
                                                workspace.buffer_dbl.data(),
                                                model_params.missing_action, model_params.cat_split_type, workspace.rnd_generator,
                                                workspace.weights_arr);
                 else
                     kurt_weights[col + input_data.ncols_numeric] =
                         calc_kurtosis_weighted(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                               input_data.categ_data + col * input_data.nrows, input_data.ncat[col],
+                                               input_data.categ_data + col * input_data.ld_categ, input_data.ncat[col],
                                                workspace.buffer_dbl.data(),
                                                model_params.missing_action, model_params.cat_split_type, workspace.rnd_generator,
                                                workspace.weights_map);
@@ -1201,15 +1457,15 @@ void fit_itree(std::vector<IsoTree>    *tree_root,
                     {
                         if (!workspace.weights_arr.size() && !workspace.weights_map.size())
                             kurt_weights[col] = calc_kurtosis(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                                              input_data.numeric_data + col * input_data.nrows,
+                                                              input_data.numeric_data + col * input_data.ld_numeric,
                                                               model_params.missing_action);
                         else if (workspace.weights_arr.size())
                             kurt_weights[col] = calc_kurtosis_weighted(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                                                       input_data.numeric_data + col * input_data.nrows,
+                                                                       input_data.numeric_data + col * input_data.ld_numeric,
                                                                        model_params.missing_action, workspace.weights_arr);
                         else
                             kurt_weights[col] = calc_kurtosis_weighted(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                                                       input_data.numeric_data + col * input_data.nrows,
+                                                                       input_data.numeric_data + col * input_data.ld_numeric,
                                                                        model_params.missing_action, workspace.weights_map);
                         kurt_weights[col] = std::fmax(1e-8, -1. + kurt_weights[col]);
                     }
@@ -1237,14 +1493,14 @@ void fit_itree(std::vector<IsoTree>    *tree_root,
                     if (!workspace.weights_arr.size() && !workspace.weights_map.size())
                         kurt_weights[col] =
                             calc_kurtosis(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                          input_data.categ_data + (col - input_data.ncols_numeric) * input_data.nrows,
+                                          input_data.categ_data + (col - input_data.ncols_numeric) * input_data.ld_categ,
                                           input_data.ncat[col - input_data.ncols_numeric],
                                           workspace.buffer_szt.data(), workspace.buffer_dbl.data(),
                                           model_params.missing_action, model_params.cat_split_type, workspace.rnd_generator);
                     else if (workspace.weights_arr.size())
                         kurt_weights[col] =
                             calc_kurtosis_weighted(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                                  input_data.categ_data + (col - input_data.ncols_numeric) * input_data.nrows,
+                                                  input_data.categ_data + (col - input_data.ncols_numeric) * input_data.ld_categ,
                                                   input_data.ncat[col - input_data.ncols_numeric],
                                                   workspace.buffer_dbl.data(),
                                                   model_params.missing_action, model_params.cat_split_type, workspace.rnd_generator,
@@ -1252,7 +1508,7 @@ void fit_itree(std::vector<IsoTree>    *tree_root,
                     else
                         kurt_weights[col] =
                             calc_kurtosis_weighted(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                                  input_data.categ_data + (col - input_data.ncols_numeric) * input_data.nrows,
+                                                  input_data.categ_data + (col - input_data.ncols_numeric) * input_data.ld_categ,
                                                   input_data.ncat[col - input_data.ncols_numeric],
                                                   workspace.buffer_dbl.data(),
                                                   model_params.missing_action, model_params.cat_split_type, workspace.rnd_generator,
@@ -1273,23 +1529,228 @@ void fit_itree(std::vector<IsoTree>    *tree_root,
     if (hplane_root != NULL && model_params.ndim >= input_data.ncols_tot)
         workspace.try_all = true;
 
+    if (input_data.presort_numeric)
+        build_presorted_cols(workspace, input_data);
+
 
     if (tree_root != NULL)
-        split_itree_recursive(*tree_root,
-                              workspace,
-                              input_data,
-                              model_params,
-                              impute_nodes,
-                              0);
+        grow_itree(*tree_root,
+                   workspace,
+                   input_data,
+                   model_params,
+                   impute_nodes,
+                   0);
     else
-        split_hplane_recursive(*hplane_root,
-                               workspace,
-                               input_data,
-                               model_params,
-                               impute_nodes,
-                               0);
+        grow_hplanes(*hplane_root,
+                     workspace,
+                     input_data,
+                     model_params,
+                     impute_nodes,
+                     0);
 
     /* if producing imputation structs, only need to keep the ones for terminal nodes */
     if (impute_nodes != NULL)
         drop_nonterminal_imp_node(*impute_nodes, tree_root, hplane_root);
 }
+
+/* Allocates the buffers used while splitting nodes, if not already done. These
+   are kept in the worker memory and reused for subsequent trees and subtrees. */
+template <class InputData, class WorkerMemory>
+void initialize_split_buffers(WorkerMemory &workspace, InputData &input_data, ModelParams &model_params, bool is_hplane)
+{
+    /* initialize array with candidate categories if not already done */
+    if (!workspace.categs.size())
+        workspace.categs.resize(input_data.max_categ);
+
+    /* for the extended model, initialize extra vectors and objects */
+    if (is_hplane && !workspace.comb_val.size())
+    {
+        workspace.comb_val.resize(model_params.sample_size);
+        workspace.col_take.resize(model_params.ndim);
+        workspace.col_take_type.resize(model_params.ndim);
+
+        if (input_data.ncols_numeric)
+        {
+            workspace.ext_offset.resize(input_data.ncols_tot);
+            workspace.ext_coef.resize(input_data.ncols_tot);
+            workspace.ext_mean.resize(input_data.ncols_tot);
+        }
+
+        if (input_data.ncols_categ)
+        {
+            workspace.ext_fill_new.resize(input_data.max_categ);
+            switch(model_params.cat_split_type)
+            {
+                case SingleCateg:
+                {
+                    workspace.chosen_cat.resize(input_data.max_categ);
+                    break;
+                }
+
+                case SubSet:
+                {
+                    workspace.ext_cat_coef.resize(input_data.ncols_tot);
+                    for (std::vector<double> &v : workspace.ext_cat_coef)
+                        v.resize(input_data.max_categ);
+                    break;
+                }
+            }
+        }
+
+        workspace.ext_fill_val.resize(input_data.ncols_tot);
+
+    }
+
+    /* make space for buffers if not already allocated */
+    if (
+            (model_params.prob_split_by_gain_avg > 0 || model_params.prob_pick_by_gain_avg > 0 ||
+             model_params.prob_split_by_gain_pl > 0  || model_params.prob_pick_by_gain_pl > 0  ||
+             model_params.weigh_by_kurt || is_hplane)
+                &&
+            (!workspace.buffer_dbl.size() && !workspace.buffer_szt.size() && !workspace.buffer_chr.size())
+        )
+    {
+        size_t min_size_dbl = 0;
+        size_t min_size_szt = 0;
+        size_t min_size_chr = 0;
+
+        bool gain = model_params.prob_split_by_gain_avg > 0 || model_params.prob_pick_by_gain_avg > 0 ||
+                    model_params.prob_split_by_gain_pl > 0  || model_params.prob_pick_by_gain_pl > 0;
+
+        if (input_data.ncols_categ)
+        {
+            min_size_szt = 2 * input_data.max_categ;
+            min_size_dbl = input_data.max_categ + 1;
+            if (gain && model_params.cat_split_type == SubSet)
+                min_size_chr = input_data.max_categ;
+        }
+
+        if (input_data.Xc_indptr != NULL && gain)
+        {
+            min_size_szt = std::max(min_size_szt, model_params.sample_size);
+            min_size_dbl = std::max(min_size_dbl, model_params.sample_size);
+        }
+
+        if (gain && (model_params.ntry > 1 ||
+                     model_params.prob_pick_by_gain_avg > 0 ||
+                     model_params.prob_split_by_gain_avg > 0 ||
+                     (model_params.ndim < 2 && (model_params.prob_pick_by_gain_pl > 0 ||
+                                                model_params.prob_split_by_gain_pl > 0)) ||
+                     model_params.min_gain > 0)
+        )
+        {
+            min_size_dbl = std::max(min_size_dbl, model_params.sample_size);
+            if (model_params.ndim < 2 && input_data.Xc_indptr != NULL)
+                min_size_dbl = std::max(min_size_dbl, (size_t)2*model_params.sample_size);
+        }
+
+        /* for the extended model */
+        if (is_hplane)
+        {
+            min_size_dbl = std::max(min_size_dbl, pow2(log2ceil(input_data.ncols_tot) + 1));
+            if (model_params.missing_action != Fail)
+            {
+                min_size_szt = std::max(min_size_szt, model_params.sample_size);
+                min_size_dbl = std::max(min_size_dbl, model_params.sample_size);
+            }
+
+            if (input_data.ncols_categ && model_params.cat_split_type == SubSet)
+            {
+                min_size_szt = std::max(min_size_szt, 2 * (size_t)input_data.max_categ + 1);
+                min_size_dbl = std::max(min_size_dbl, (size_t)input_data.max_categ);
+            }
+
+            if (model_params.weigh_by_kurt)
+                min_size_szt = std::max(min_size_szt, input_data.ncols_tot);
+
+            if (gain && (workspace.weights_arr.size() || workspace.weights_map.size()))
+            {
+                workspace.sample_weights.resize(model_params.sample_size);
+                min_size_szt = std::max(min_size_szt, model_params.sample_size);
+            }
+        }
+
+        /* now resize */
+        if (workspace.buffer_dbl.size() < min_size_dbl)
+            workspace.buffer_dbl.resize(min_size_dbl);
+
+        if (workspace.buffer_szt.size() < min_size_szt)
+            workspace.buffer_szt.resize(min_size_szt);
+
+        if (workspace.buffer_chr.size() < min_size_chr)
+            workspace.buffer_chr.resize(min_size_chr);
+
+        if (gain && input_data.binned_numeric.size())
+            workspace.buffer_hist.resize(5 * input_data.nbins);
+
+        /* for guided column choice, need to also remember the best split so far */
+        if (
+            model_params.cat_split_type == SubSet &&
+            (
+                model_params.prob_pick_by_gain_avg  || 
+                model_params.prob_pick_by_gain_pl
+            )
+           )
+        {
+            workspace.this_split_categ.resize(input_data.max_categ);
+        }
+
+    }
+}
+
+/* Grows a subtree that was left pending by 'defer_subtree', using the worker memory of whichever
+   thread took it (so that depths and separations keep being accumulated in the same place as for
+   the trees that the thread grows). */
+template <class InputData, class WorkerMemory>
+void grow_deferred_subtree(DeferredSubtree &subtree, size_t subtree_num, WorkerMemory &workspace,
+                           InputData &input_data, ModelParams &model_params, bool is_hplane)
+{
+    if (!workspace.ix_arr.size())
+    {
+        if (model_params.calc_depth)
+            workspace.row_depths.resize(input_data.nrows, 0);
+        workspace.ix_arr.resize(model_params.sample_size);
+    }
+    std::copy(subtree.ix_arr.begin(), subtree.ix_arr.end(), workspace.ix_arr.begin());
+    workspace.st  = 0;
+    workspace.end = subtree.ix_arr.size() - 1;
+    subtree.ix_arr.clear();
+    subtree.ix_arr.shrink_to_fit();
+
+    workspace.rnd_generator.seed(subtree.seed);
+    workspace.rbin = std::uniform_real_distribution<double>(0, 1);
+    /* see the comment about these in 'fit_itree' */
+    if (is_hplane)
+    {
+        if (input_data.ncols_categ || model_params.coef_type == Normal)
+            workspace.coef_norm = std::normal_distribution<double>(0, 1);
+        if (model_params.coef_type == Uniform)
+            workspace.coef_unif = std::uniform_real_distribution<double>(-1, 1);
+    }
+    initialize_split_buffers(workspace, input_data, model_params, is_hplane);
+    workspace.col_sampler = std::move(subtree.col_sampler);
+    workspace.try_all = is_hplane && model_params.ndim >= input_data.ncols_tot;
+    workspace.curr_tree = subtree.tree_num;
+    workspace.curr_subtree = subtree_num;
+    if (input_data.presort_numeric)
+        build_presorted_cols(workspace, input_data);
+
+    size_t exp_nodes = 2 * (workspace.end + 1);
+    if (!is_hplane)
+    {
+        subtree.trees.reserve(exp_nodes);
+        subtree.trees.emplace_back();
+        grow_itree(subtree.trees, workspace, input_data, model_params,
+                   (std::vector<ImputeNode>*)NULL, subtree.depth);
+        subtree.trees.shrink_to_fit();
+    }
+
+    else
+    {
+        subtree.hplanes.reserve(exp_nodes);
+        subtree.hplanes.emplace_back();
+        grow_hplanes(subtree.hplanes, workspace, input_data, model_params,
+                     (std::vector<ImputeNode>*)NULL, subtree.depth);
+        subtree.hplanes.shrink_to_fit();
+    }
+}
@@ -54,7 +54,7 @@ void get_split_range(WorkerMemory &workspace, InputData &input_data, ModelParams
         tree.col_type = Numeric;
 
         if (input_data.Xc_indptr == NULL)
-            get_range(workspace.ix_arr.data(), input_data.numeric_data + input_data.nrows * tree.col_num,
+            get_range(workspace.ix_arr.data(), get_numeric_col(workspace, input_data, tree.col_num),
                       workspace.st, workspace.end, model_params.missing_action,
                       workspace.xmin, workspace.xmax, workspace.unsplittable);
         else
@@ -68,7 +68,7 @@ void get_split_range(WorkerMemory &workspace, InputData &input_data, ModelParams
         tree.col_num -= input_data.ncols_numeric;
         tree.col_type = Categorical;
 
-        get_categs(workspace.ix_arr.data(), input_data.categ_data + input_data.nrows * tree.col_num,
+        get_categs(workspace.ix_arr.data(), get_categ_col(workspace, input_data, tree.col_num),
                    workspace.st, workspace.end, input_data.ncat[tree.col_num],
                    model_params.missing_action, workspace.categs.data(), workspace.npresent, workspace.unsplittable);
     }
@@ -83,7 +83,7 @@ void get_split_range(WorkerMemory &workspace, InputData &input_data, ModelParams
         workspace.col_type = Numeric;
 
         if (input_data.Xc_indptr == NULL)
-            get_range(workspace.ix_arr.data(), input_data.numeric_data + input_data.nrows * workspace.col_chosen,
+            get_range(workspace.ix_arr.data(), get_numeric_col(workspace, input_data, workspace.col_chosen),
                       workspace.st, workspace.end, model_params.missing_action,
                       workspace.xmin, workspace.xmax, workspace.unsplittable);
         else
@@ -97,7 +97,7 @@ void get_split_range(WorkerMemory &workspace, InputData &input_data, ModelParams
         workspace.col_type = Categorical;
         workspace.col_chosen -= input_data.ncols_numeric;
 
-        get_categs(workspace.ix_arr.data(), input_data.categ_data + input_data.nrows * workspace.col_chosen,
+        get_categs(workspace.ix_arr.data(), get_categ_col(workspace, input_data, workspace.col_chosen),
                    workspace.st, workspace.end, input_data.ncat[workspace.col_chosen],
                    model_params.missing_action, workspace.categs.data(), workspace.npresent, workspace.unsplittable);
     }
@@ -147,15 +147,28 @@ void set_col_as_taken(std::vector<bool> &col_is_taken, std::unordered_set<size_t
 template <class InputData, class WorkerMemory>
 void add_separation_step(WorkerMemory &workspace, InputData &input_data, double remainder)
 {
-    if (workspace.weights_arr.size())
+    if (workspace.tmat_atomic)
+    {
+        if (workspace.weights_arr.size())
+            increase_comb_counter_atomic(workspace.ix_arr.data(), workspace.st, workspace.end,
+                                         input_data.nrows, workspace.tmat_sep, workspace.weights_arr.data(), remainder);
+        else if (workspace.weights_map.size())
+            increase_comb_counter_atomic(workspace.ix_arr.data(), workspace.st, workspace.end,
+                                         input_data.nrows, workspace.tmat_sep, workspace.weights_map, remainder);
+        else
+            increase_comb_counter_atomic(workspace.ix_arr.data(), workspace.st, workspace.end,
+                                         input_data.nrows, workspace.tmat_sep, remainder);
+    }
+
+    else if (workspace.weights_arr.size())
         increase_comb_counter(workspace.ix_arr.data(), workspace.st, workspace.end,
-                              input_data.nrows, workspace.tmat_sep.data(), workspace.weights_arr.data(), remainder);
+                              input_data.nrows, workspace.tmat_sep, workspace.weights_arr.data(), remainder);
     else if (workspace.weights_map.size())
         increase_comb_counter(workspace.ix_arr.data(), workspace.st, workspace.end,
-                              input_data.nrows, workspace.tmat_sep.data(), workspace.weights_map, remainder);
+                              input_data.nrows, workspace.tmat_sep, workspace.weights_map, remainder);
     else
         increase_comb_counter(workspace.ix_arr.data(), workspace.st, workspace.end,
-                              input_data.nrows, workspace.tmat_sep.data(), remainder);
+                              input_data.nrows, workspace.tmat_sep, remainder);
 }
 
 template <class InputData, class WorkerMemory>
@@ -176,61 +189,425 @@ void add_remainder_separation_steps(WorkerMemory &workspace, InputData &input_da
     }
 }
 
-template <class PredictionData, class sparse_ix>
-void remap_terminal_trees(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
-                          PredictionData &prediction_data, sparse_ix *restrict tree_num, int nthreads)
+/* Terminal nodes are numbered in the order in which they appear in each tree */
+void build_terminal_mapping(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext, TerminalNodeMapping &terminal_mapping)
 {
     size_t ntrees = (model_outputs != NULL)? model_outputs->trees.size() : model_outputs_ext->hplanes.size();
-    size_t max_tree, curr_term;
-    std::vector<sparse_ix> tree_mapping;
-    if (model_outputs != NULL)
+    terminal_mapping.node_offset.resize(ntrees + 1);
+    terminal_mapping.terminal_offset.resize(ntrees + 1);
+    terminal_mapping.node_offset[0] = 0;
+    for (size_t tree = 0; tree < ntrees; tree++)
+        terminal_mapping.node_offset[tree + 1] = terminal_mapping.node_offset[tree]
+                                                  + ((model_outputs != NULL)?
+                                                     model_outputs->trees[tree].size() : model_outputs_ext->hplanes[tree].size());
+    terminal_mapping.terminal_num.assign(terminal_mapping.node_offset[ntrees], (size_t)0);
+
+    size_t curr_term;
+    size_t *restrict terminal_num;
+    terminal_mapping.terminal_offset[0] = 0;
+    for (size_t tree = 0; tree < ntrees; tree++)
     {
-        max_tree = std::accumulate(model_outputs->trees.begin(),
-                                   model_outputs->trees.end(),
-                                   (size_t)0,
-                                   [](const size_t curr_max, const std::vector<IsoTree> &tr)
-                                   {return std::max(curr_max, tr.size());});
-        tree_mapping.resize(max_tree);
-        for (size_t tree = 0; tree < ntrees; tree++)
+        curr_term = 0;
+        terminal_num = terminal_mapping.terminal_num.data() + terminal_mapping.node_offset[tree];
+        if (model_outputs != NULL)
         {
-            std::fill(tree_mapping.begin(), tree_mapping.end(), (size_t)0);
-            curr_term = 0;
             for (size_t node = 0; node < model_outputs->trees[tree].size(); node++)
                 if (model_outputs->trees[tree][node].score >= 0)
-                    tree_mapping[node] = curr_term++;
+                    terminal_num[node] = curr_term++;
+        }
 
-            #pragma omp parallel for schedule(static) num_threads(nthreads) shared(tree_num, tree_mapping, tree, prediction_data)
-            for (size_t_for row = 0; row < prediction_data.nrows; row++)
-                tree_num[row + tree * prediction_data.nrows] = tree_mapping[tree_num[row + tree * prediction_data.nrows]];
+        else
+        {
+            for (size_t node = 0; node < model_outputs_ext->hplanes[tree].size(); node++)
+                if (model_outputs_ext->hplanes[tree][node].score >= 0)
+                    terminal_num[node] = curr_term++;
         }
+        terminal_mapping.terminal_offset[tree + 1] = terminal_mapping.terminal_offset[tree] + curr_term;
     }
+}
 
-    else
+template <class sparse_ix>
+void map_terminal_nodes(TerminalNodeMapping &terminal_mapping, size_t tree,
+                        sparse_ix *restrict tree_num, size_t row_st, size_t row_end)
+{
+    const size_t *restrict terminal_num = terminal_mapping.terminal_num.data() + terminal_mapping.node_offset[tree];
+    for (size_t row = row_st; row < row_end; row++)
+        tree_num[row] = terminal_num[tree_num[row]];
+}
+
+template <class PredictionData, class sparse_ix>
+void remap_terminal_trees(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                          PredictionData &prediction_data, sparse_ix *restrict tree_num, int nthreads)
+{
+    TerminalNodeMapping terminal_mapping;
+    build_terminal_mapping(model_outputs, model_outputs_ext, terminal_mapping);
+    size_t ntrees = terminal_mapping.node_offset.size() - 1;
+
+    #pragma omp parallel for schedule(static) num_threads(nthreads) shared(tree_num, terminal_mapping, ntrees, prediction_data)
+    for (size_t_for tree = 0; tree < ntrees; tree++)
+        map_terminal_nodes(terminal_mapping, tree, tree_num + tree * prediction_data.nrows, (size_t)0, prediction_data.nrows);
+}
+
+
+TreeScheduler::TreeScheduler(size_t ntrees, size_t nthreads, size_t min_size)
+{
+    this->ntrees = ntrees;
+    this->min_size = min_size;
+    this->n_unfinished = ntrees;
+    this->tasks.resize(nthreads);
+    this->tasks_lock = std::unique_ptr<std::mutex[]>(new std::mutex[nthreads]);
+
+    /* each thread starts with a contiguous block of trees, which it will take in ascending order */
+    for (size_t thread = 0; thread < nthreads; thread++)
+    {
+        size_t st  = (ntrees * thread) / nthreads;
+        size_t end = (ntrees * (thread + 1)) / nthreads;
+        for (size_t tree = end; tree > st; tree--)
+            this->tasks[thread].push_back(tree - 1);
+    }
+}
+
+DeferredSubtree* TreeScheduler::add_subtree(DeferredSubtree &subtree, size_t thread_num)
+{
+    DeferredSubtree *out;
+    size_t subtree_num;
+    {
+        std::lock_guard<std::mutex> lock(this->subtrees_lock);
+        subtree_num = this->subtrees.size();
+        this->subtrees.push_back(std::move(subtree));
+        out = &this->subtrees.back();
+    }
+
+    this->n_unfinished++;
+    std::lock_guard<std::mutex> lock(this->tasks_lock[thread_num]);
+    this->tasks[thread_num].push_back(this->ntrees + subtree_num);
+    return out;
+}
+
+DeferredSubtree& TreeScheduler::get_subtree(size_t subtree_num)
+{
+    std::lock_guard<std::mutex> lock(this->subtrees_lock);
+    return this->subtrees[subtree_num];
+}
+
+bool TreeScheduler::get_task(size_t thread_num, size_t &task)
+{
+    /* newest task from the thread's own queue, which is likely to have its data still in cache */
     {
-        max_tree = std::accumulate(model_outputs_ext->hplanes.begin(),
-                                   model_outputs_ext->hplanes.end(),
-                                   (size_t)0,
-                                   [](const size_t curr_max, const std::vector<IsoHPlane> &tr)
-                                   {return std::max(curr_max, tr.size());});
-        tree_mapping.resize(max_tree);
-        for (size_t tree = 0; tree < ntrees; tree++)
+        std::lock_guard<std::mutex> lock(this->tasks_lock[thread_num]);
+        if (this->tasks[thread_num].size())
         {
-            std::fill(tree_mapping.begin(), tree_mapping.end(), (size_t)0);
-            curr_term = 0;
-            for (size_t node = 0; node < model_outputs_ext->hplanes[tree].size(); node++)
-                if (model_outputs_ext->hplanes[tree][node].score >= 0)
-                    tree_mapping[node] = curr_term++;
-            
-            #pragma omp parallel for schedule(static) num_threads(nthreads) shared(tree_num, tree_mapping, tree, prediction_data)
-            for (size_t_for row = 0; row < prediction_data.nrows; row++)
-                tree_num[row + tree * prediction_data.nrows] = tree_mapping[tree_num[row + tree * prediction_data.nrows]];
+            task = this->tasks[thread_num].back();
+            this->tasks[thread_num].pop_back();
+            return true;
+        }
+    }
+
+    /* oldest task from another thread, which is likely to be the largest one */
+    for (size_t other = 1; other < this->tasks.size(); other++)
+    {
+        size_t victim = (thread_num + other) % this->tasks.size();
+        std::lock_guard<std::mutex> lock(this->tasks_lock[victim]);
+        if (this->tasks[victim].size())
+        {
+            task = this->tasks[victim].front();
+            this->tasks[victim].pop_front();
+            return true;
         }
     }
+
+    return false;
+}
+
+void TreeScheduler::finish_task()
+{
+    this->n_unfinished--;
+}
+
+/* Leaves the rows in 'workspace.ix_arr[st..end]' to be split as a separate subtree by whichever thread gets to
+   it first, if there is a scheduler for them and there are enough rows. The caller is then supposed to leave an
+   empty node in its place and to pass its index to 'DeferredSubtree::node'. Returns NULL if it should be split
+   right away. */
+template <class WorkerMemory>
+DeferredSubtree* defer_subtree(WorkerMemory &workspace, size_t st, size_t end, size_t curr_depth)
+{
+    if (workspace.scheduler == NULL || end - st + 1 < workspace.scheduler->min_size)
+        return NULL;
+
+    DeferredSubtree subtree;
+    subtree.tree_num = workspace.curr_tree;
+    subtree.parent   = workspace.curr_subtree;
+    subtree.node     = 0;
+    subtree.depth    = curr_depth;
+    subtree.seed     = workspace.rnd_generator();
+    subtree.ix_arr.assign(workspace.ix_arr.begin() + st, workspace.ix_arr.begin() + end + 1);
+    subtree.col_sampler = workspace.col_sampler;
+
+    return workspace.scheduler->add_subtree(subtree, workspace.thread_num);
+}
+
+/* Sorts the rows in 'workspace.ix_arr[st..end]' according to each numeric column that the tree can split on,
+   so that guided splits do not need to sort them again at each node. The orders are kept in the same positions
+   as the rows in 'ix_arr', and are passed down to the children by 'partition_presorted_cols'. */
+template <class InputData, class WorkerMemory>
+void build_presorted_cols(WorkerMemory &workspace, InputData &input_data)
+{
+    workspace.presorted_cols.clear();
+    workspace.col_sampler.prepare_full_pass();
+    size_t col;
+    while (workspace.col_sampler.sample_col(col))
+        if (col < input_data.ncols_numeric) workspace.presorted_cols.push_back(col);
+
+    size_t n = workspace.ix_arr.size();
+    workspace.presorted_ix.resize(n * workspace.presorted_cols.size());
+    workspace.presorted_pos.assign(input_data.ncols_numeric, SIZE_MAX);
+    if (!workspace.goes_left.size()) workspace.goes_left.resize(input_data.nrows);
+    if (!workspace.buffer_presort.size()) workspace.buffer_presort.resize(n);
+
+    for (size_t ix = 0; ix < workspace.presorted_cols.size(); ix++)
+    {
+        col = workspace.presorted_cols[ix];
+        workspace.presorted_pos[col] = ix;
+        size_t *restrict sorted_ix = workspace.presorted_ix.data() + ix * n;
+        auto x = input_data.numeric_data + col * input_data.ld_numeric;
+        std::copy(workspace.ix_arr.begin() + workspace.st, workspace.ix_arr.begin() + workspace.end + 1,
+                  sorted_ix + workspace.st);
+        std::sort(sorted_ix + workspace.st, sorted_ix + workspace.end + 1,
+                  [&x](const size_t a, const size_t b){return (x[a] < x[b]) || (x[a] == x[b] && a < b);});
+    }
+}
+
+template <class WorkerMemory>
+size_t* get_presorted_col(WorkerMemory &workspace, size_t col)
+{
+    return workspace.presorted_ix.data() + workspace.presorted_pos[col] * workspace.ix_arr.size();
 }
 
+/* Rearranges the sorted orders of the current node so that the rows in 'ix_arr[st..split_pos-1]' come
+   first and the rest after them, keeping each part sorted (i.e. a stable partition of each column). */
+template <class WorkerMemory>
+void partition_presorted_cols(WorkerMemory &workspace, size_t split_pos)
+{
+    for (size_t row = workspace.st; row < split_pos; row++)
+        workspace.goes_left[workspace.ix_arr[row]] = true;
+    for (size_t row = split_pos; row <= workspace.end; row++)
+        workspace.goes_left[workspace.ix_arr[row]] = false;
+
+    size_t n = workspace.ix_arr.size();
+    size_t *restrict buffer = workspace.buffer_presort.data();
+    for (size_t ix = 0; ix < workspace.presorted_cols.size(); ix++)
+    {
+        size_t *restrict sorted_ix = workspace.presorted_ix.data() + ix * n;
+        size_t n_left = workspace.st;
+        size_t n_right = 0;
+        for (size_t row = workspace.st; row <= workspace.end; row++)
+        {
+            if (workspace.goes_left[sorted_ix[row]])
+                sorted_ix[n_left++] = sorted_ix[row];
+            else
+                buffer[n_right++] = sorted_ix[row];
+        }
+        std::copy(buffer, buffer + n_right, sorted_ix + n_left);
+    }
+}
+
+/* When the input data is large, the rows of a small node are scattered over the columns, so a node with
+   at most 'MAX_ROWS_COMPACT' rows has its data copied into contiguous buffers that are used for the
+   whole subtree under it. While in such a subtree, 'ix_arr' holds positions in these buffers (the
+   original rows are in 'compact_rows'), and each column gets copied the first time it is needed. */
+template <class InputData, class WorkerMemory>
+void update_compact_rows(WorkerMemory &workspace, InputData &input_data)
+{
+    if (workspace.compact_active && workspace.st >= workspace.compact_st && workspace.end <= workspace.compact_end)
+        return;
+
+    workspace.compact_active = false;
+    if (!input_data.compact_nodes || workspace.end - workspace.st + 1 > MAX_ROWS_COMPACT)
+        return;
+
+    workspace.compact_st  = workspace.st;
+    workspace.compact_end = workspace.end;
+    workspace.compact_rows.assign(workspace.ix_arr.begin() + workspace.st, workspace.ix_arr.begin() + workspace.end + 1);
+    std::iota(workspace.ix_arr.begin() + workspace.st, workspace.ix_arr.begin() + workspace.end + 1, (size_t)0);
+    workspace.compact_col_pos.assign(input_data.ncols_tot, SIZE_MAX);
+    workspace.compact_numeric.clear();
+    workspace.compact_numeric_flt.clear();
+    workspace.compact_categ.clear();
+    workspace.compact_active = true;
+}
+
+/* Puts back the original rows of the current node in 'ix_arr' */
+template <class WorkerMemory>
+void restore_compact_rows(WorkerMemory &workspace)
+{
+    for (size_t row = workspace.st; row <= workspace.end; row++)
+        workspace.ix_arr[row] = workspace.compact_rows[workspace.ix_arr[row]];
+}
+
+template <class WorkerMemory>
+std::vector<double>& get_compact_buffer(WorkerMemory &workspace, double*)
+{
+    return workspace.compact_numeric;
+}
+
+template <class WorkerMemory>
+std::vector<float>& get_compact_buffer(WorkerMemory &workspace, float*)
+{
+    return workspace.compact_numeric_flt;
+}
+
+template <class WorkerMemory>
+std::vector<int>& get_compact_buffer(WorkerMemory &workspace, int*)
+{
+    return workspace.compact_categ;
+}
+
+/* 'col' is counted among all columns, numeric first. The pointer is valid until another column is copied. */
+template <class real_t, class WorkerMemory>
+real_t* get_compact_col(WorkerMemory &workspace, real_t *restrict x, size_t col)
+{
+    std::vector<real_t> &buffer = get_compact_buffer(workspace, x);
+    if (workspace.compact_col_pos[col] == SIZE_MAX)
+    {
+        workspace.compact_col_pos[col] = buffer.size();
+        for (size_t row : workspace.compact_rows)
+            buffer.push_back(x[row]);
+    }
+    return buffer.data() + workspace.compact_col_pos[col];
+}
+
+template <class real_t, class sparse_ix, class WorkerMemory>
+real_t* get_numeric_col(WorkerMemory &workspace, InputData<real_t, sparse_ix> &input_data, size_t col)
+{
+    real_t *x = input_data.numeric_data + col * input_data.ld_numeric;
+    return workspace.compact_active? get_compact_col(workspace, x, col) : x;
+}
+
+template <class real_t, class sparse_ix, class WorkerMemory>
+int* get_categ_col(WorkerMemory &workspace, InputData<real_t, sparse_ix> &input_data, size_t col)
+{
+    int *x = input_data.categ_data + col * input_data.ld_categ;
+    return workspace.compact_active? get_compact_col(workspace, x, input_data.ncols_numeric + col) : x;
+}
+
+size_t& get_left_child(IsoTree &node)
+{
+    return node.tree_left;
+}
+
+size_t& get_right_child(IsoTree &node)
+{
+    return node.tree_right;
+}
+
+size_t& get_left_child(IsoHPlane &node)
+{
+    return node.hplane_left;
+}
+
+size_t& get_right_child(IsoHPlane &node)
+{
+    return node.hplane_right;
+}
+
+std::vector<IsoTree>& get_subtree_nodes(DeferredSubtree &subtree, std::vector<IsoTree>&)
+{
+    return subtree.trees;
+}
+
+std::vector<IsoHPlane>& get_subtree_nodes(DeferredSubtree &subtree, std::vector<IsoHPlane>&)
+{
+    return subtree.hplanes;
+}
+
+/* Copies nodes in depth-first order, replacing the empty ones left by 'defer_subtree' with the subtree
+   that was grown for them, so that the result is the same as if the tree were grown in one go. */
+template <class Node>
+void append_joined_nodes(std::vector<Node> &joined, std::vector<Node> &nodes, size_t node,
+                         std::unordered_map<size_t, size_t> &deferred_here,
+                         std::vector<std::unordered_map<size_t, size_t>> &deferred_in_subtree,
+                         std::deque<DeferredSubtree> &subtrees)
+{
+    /* nodes are visited in depth-first order using an explicit stack, as trees can be very deep */
+    struct NodeToJoin {
+        std::vector<Node> *nodes;
+        std::unordered_map<size_t, size_t> *deferred_here;
+        size_t node;
+        size_t parent; /* position in 'joined', SIZE_MAX for the root */
+        bool   is_left;
+    };
+    std::vector<NodeToJoin> pending;
+    pending.push_back({&nodes, &deferred_here, node, SIZE_MAX, false});
+
+    while (!pending.empty())
+    {
+        NodeToJoin curr_node = pending.back();
+        pending.pop_back();
+
+        auto subtree = curr_node.deferred_here->find(curr_node.node);
+        while (subtree != curr_node.deferred_here->end())
+        {
+            curr_node.nodes = &get_subtree_nodes(subtrees[subtree->second], *curr_node.nodes);
+            curr_node.deferred_here = &deferred_in_subtree[subtree->second];
+            curr_node.node = 0;
+            subtree = curr_node.deferred_here->find(curr_node.node);
+        }
+
+        size_t curr = joined.size();
+        if (curr_node.parent != SIZE_MAX)
+        {
+            if (curr_node.is_left)
+                get_left_child(joined[curr_node.parent]) = curr;
+            else
+                get_right_child(joined[curr_node.parent]) = curr;
+        }
+        joined.push_back(std::move((*curr_node.nodes)[curr_node.node]));
+        if (joined[curr].score < 0)
+        {
+            pending.push_back({curr_node.nodes, curr_node.deferred_here, get_right_child(joined[curr]), curr, false});
+            pending.push_back({curr_node.nodes, curr_node.deferred_here, get_left_child(joined[curr]), curr, true});
+        }
+    }
+}
+
+template <class Node>
+void join_deferred_subtrees(std::vector<std::vector<Node>> &trees, TreeScheduler &scheduler, int nthreads)
+{
+    std::vector<std::unordered_map<size_t, size_t>> deferred_in_tree(trees.size());
+    std::vector<std::unordered_map<size_t, size_t>> deferred_in_subtree(scheduler.subtrees.size());
+    std::vector<size_t> added_nodes(trees.size(), 0);
+    for (size_t ix = 0; ix < scheduler.subtrees.size(); ix++)
+    {
+        DeferredSubtree &subtree = scheduler.subtrees[ix];
+        if (subtree.parent == SIZE_MAX)
+            deferred_in_tree[subtree.tree_num][subtree.node] = ix;
+        else
+            deferred_in_subtree[subtree.parent][subtree.node] = ix;
+        added_nodes[subtree.tree_num] += get_subtree_nodes(subtree, trees[subtree.tree_num]).size() - 1;
+    }
+
+    #pragma omp parallel for schedule(dynamic) num_threads(nthreads) shared(trees, scheduler, deferred_in_tree, deferred_in_subtree, added_nodes)
+    for (size_t_for tree = 0; tree < trees.size(); tree++)
+    {
+        if (!deferred_in_tree[tree].size()) continue;
+        std::vector<Node> joined;
+        joined.reserve(trees[tree].size() + added_nodes[tree]);
+        append_joined_nodes(joined, trees[tree], (size_t)0, deferred_in_tree[tree], deferred_in_subtree, scheduler.subtrees);
+        trees[tree] = std::move(joined);
+    }
+}
+
+template <class WorkerMemory>
+RecursionState& get_recursion_state(WorkerMemory &workspace, size_t curr_depth)
+{
+    /* states are kept throughout the whole fitting procedure so as to reuse their allocated memory */
+    if (workspace.recursion_states.size() <= curr_depth)
+        workspace.recursion_states.resize(curr_depth + 1);
+    return workspace.recursion_states[curr_depth];
+}
 
 template <class WorkerMemory>
-RecursionState::RecursionState(WorkerMemory &workspace, bool full_state)
+void RecursionState::save_state(WorkerMemory &workspace, bool full_state)
 {
     this->full_state = full_state;
 
@@ -252,11 +629,11 @@ RecursionState::RecursionState(WorkerMemory &workspace, bool full_state)
         /* for the extended model, it's not necessary to copy everything */
         if (!workspace.comb_val.size())
         {
-            this->ix_arr = std::vector<size_t>(workspace.ix_arr.begin() + workspace.st_NA,
-                                                         workspace.ix_arr.begin() + workspace.end + 1);
+            this->ix_arr.assign(workspace.ix_arr.begin() + workspace.st_NA,
+                                workspace.ix_arr.begin() + workspace.end + 1);
             size_t tot = workspace.end - workspace.st_NA + 1;
             if (workspace.weights_arr.size() || workspace.weights_map.size())
-                this->weights_arr = std::unique_ptr<double[]>(new double[tot]);
+                this->weights_arr.resize(tot);
             if (workspace.weights_arr.size())
                 for (size_t ix = 0; ix < tot; ix++)
                     this->weights_arr[ix] = workspace.weights_arr[workspace.ix_arr[ix + workspace.st_NA]];
@@ -276,7 +653,7 @@ void RecursionState::restore_state(WorkerMemory &workspace)
     if (!workspace.col_sampler.has_weights())
         workspace.col_sampler.curr_pos = this->sampler_pos;
     else  {
-        workspace.col_sampler.tree_weights  =  std::move(this->col_sampler_weights);
+        workspace.col_sampler.tree_weights.swap(this->col_sampler_weights);
         workspace.col_sampler.n_dropped     =  this->n_dropped;
     }
 
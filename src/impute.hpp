@@ -123,6 +123,8 @@ void impute_missing_values(real_t numeric_data[], int categ_data[], bool is_col_
     PredictionData<real_t, sparse_ix>
                    prediction_data = {numeric_data, categ_data, nrows,
                                       is_col_major, imputer.ncols_numeric, imputer.ncols_categ,
+                                      is_col_major? nrows : imputer.ncols_numeric,
+                                      is_col_major? nrows : imputer.ncols_categ,
                                       NULL, NULL, NULL,
                                       Xr, Xr_ind, Xr_indptr};
 
@@ -225,7 +227,7 @@ void initialize_imputer(Imputer &imputer, InputData &input_data, size_t ntrees,
         for (size_t_for col = 0; col < input_data.ncols_numeric; col++)
         {
             cnt    = input_data.nrows;
-            offset = col * input_data.nrows;
+            offset = col * input_data.ld_numeric;
             for (size_t row = 0; row < input_data.nrows; row++)
             {
                 imputer.col_means[col] += (!is_na_or_inf(input_data.numeric_data[row + offset]))?
@@ -259,7 +261,7 @@ void initialize_imputer(Imputer &imputer, InputData &input_data, size_t ntrees,
         for (size_t_for col = 0; col < input_data.ncols_categ; col++)
         {
             std::fill(cat_counts.begin(), cat_counts.end(), 0);
-            offset = col * input_data.nrows;
+            offset = col * input_data.ld_categ;
             for (size_t row = 0; row < input_data.nrows; row++)
             {
                 if (input_data.categ_data[row + offset] >= 0)
@@ -327,7 +329,7 @@ void build_impute_node(ImputeNode &imputer,    WorkerMemory &workspace,
                     cnt = 0;
                     for (size_t row = workspace.st; row <= workspace.end; row++)
                     {
-                        xnum = input_data.numeric_data[workspace.ix_arr[row] + col * input_data.nrows];
+                        xnum = input_data.numeric_data[workspace.ix_arr[row] + col * input_data.ld_numeric];
                         if (!is_na_or_inf(xnum))
                         {
                             cnt++;
@@ -345,7 +347,7 @@ void build_impute_node(ImputeNode &imputer,    WorkerMemory &workspace,
                     cnt = 0;
                     for (size_t row = workspace.st; row <= workspace.end; row++)
                     {
-                        xcat = input_data.categ_data[workspace.ix_arr[row] + col * input_data.nrows];
+                        xcat = input_data.categ_data[workspace.ix_arr[row] + col * input_data.ld_categ];
                         if (xcat >= 0)
                         {
                             cnt++;
@@ -368,7 +370,7 @@ void build_impute_node(ImputeNode &imputer,    WorkerMemory &workspace,
                     prod_sum = 0; corr = 0;
                     for (size_t row = workspace.st; row <= workspace.end; row++)
                     {
-                        xnum = input_data.numeric_data[workspace.ix_arr[row] + col * input_data.nrows];
+                        xnum = input_data.numeric_data[workspace.ix_arr[row] + col * input_data.ld_numeric];
                         if (!is_na_or_inf(xnum))
                         {
                             if (workspace.weights_arr.size())
@@ -400,7 +402,7 @@ void build_impute_node(ImputeNode &imputer,    WorkerMemory &workspace,
 
                     for (size_t col = 0; col < input_data.ncols_categ; col++)
                     {
-                        xcat = input_data.categ_data[ix + col * input_data.nrows];
+                        xcat = input_data.categ_data[ix + col * input_data.ld_categ];
                         if (xcat >= 0)
                         {
                             imputer.cat_sum[col][xcat] += weight; /* later gets divided */
@@ -855,11 +857,11 @@ void apply_imputation_results(imp_arr    &impute_vec,
             {
                 col = impute_vec[row].missing_num[ix];
                 if (impute_vec[row].num_weight[ix] > 0 && !is_na_or_inf(impute_vec[row].num_sum[ix]))
-                    input_data.numeric_data[row + col * input_data.nrows]
+                    input_data.numeric_data[row + col * input_data.ld_numeric]
                         =
                     impute_vec[row].num_sum[ix] / impute_vec[row].num_weight[ix];
                 else
-                    input_data.numeric_data[row + col * input_data.nrows]
+                    input_data.numeric_data[row + col * input_data.ld_numeric]
                         =
                     imputer.col_means[col];
             }
@@ -867,14 +869,14 @@ void apply_imputation_results(imp_arr    &impute_vec,
             for (size_t ix = 0; ix < impute_vec[row].n_missing_cat; ix++)
             {
                 col = impute_vec[row].missing_cat[ix];
-                input_data.categ_data[row + col * input_data.nrows]
+                input_data.categ_data[row + col * input_data.ld_categ]
                     =
                 std::distance(impute_vec[row].cat_sum[col].begin(),
                               std::max_element(impute_vec[row].cat_sum[col].begin(),
                                                  impute_vec[row].cat_sum[col].end()));
 
-                if (input_data.categ_data[row + col * input_data.nrows] == 0 && impute_vec[row].cat_sum[col][0] <= 0)
-                    input_data.categ_data[row + col * input_data.nrows]
+                if (input_data.categ_data[row + col * input_data.ld_categ] == 0 && impute_vec[row].cat_sum[col][0] <= 0)
+                    input_data.categ_data[row + col * input_data.ld_categ]
                         =
                     imputer.col_modes[col];
             }
@@ -910,11 +912,11 @@ void apply_imputation_results(PredictionData  &prediction_data,
         {
             col = imp.missing_num[ix];
             if (imp.num_weight[ix] > 0 && !is_na_or_inf(imp.num_sum[ix]))
-                prediction_data.numeric_data[row + col * prediction_data.nrows]
+                prediction_data.numeric_data[row + col * prediction_data.ld_numeric]
                     =
                 imp.num_sum[ix] / imp.num_weight[ix];
             else
-                prediction_data.numeric_data[row + col * prediction_data.nrows]
+                prediction_data.numeric_data[row + col * prediction_data.ld_numeric]
                     =
                 imputer.col_means[col];
         }
@@ -926,11 +928,11 @@ void apply_imputation_results(PredictionData  &prediction_data,
         {
             col = imp.missing_num[ix];
             if (imp.num_weight[ix] > 0 && !is_na_or_inf(imp.num_sum[ix]))
-                prediction_data.numeric_data[col + row * imputer.ncols_numeric]
+                prediction_data.numeric_data[col + row * prediction_data.ld_numeric]
                     =
                 imp.num_sum[ix] / imp.num_weight[ix];
             else
-                prediction_data.numeric_data[col + row * imputer.ncols_numeric]
+                prediction_data.numeric_data[col + row * prediction_data.ld_numeric]
                     =
                 imputer.col_means[col];
         }
@@ -958,13 +960,13 @@ void apply_imputation_results(PredictionData  &prediction_data,
         for (size_t ix = 0; ix < imp.n_missing_cat; ix++)
         {
             col = imp.missing_cat[ix];
-            prediction_data.categ_data[row + col * prediction_data.nrows]
+            prediction_data.categ_data[row + col * prediction_data.ld_categ]
                         =
             std::distance(imp.cat_sum[col].begin(),
                           std::max_element(imp.cat_sum[col].begin(), imp.cat_sum[col].end()));
 
-            if (prediction_data.categ_data[row + col * prediction_data.nrows] == 0 && imp.cat_sum[col][0] <= 0)
-                prediction_data.categ_data[row + col * prediction_data.nrows]
+            if (prediction_data.categ_data[row + col * prediction_data.ld_categ] == 0 && imp.cat_sum[col][0] <= 0)
+                prediction_data.categ_data[row + col * prediction_data.ld_categ]
                     =
                 imputer.col_modes[col];
         }
@@ -975,13 +977,13 @@ void apply_imputation_results(PredictionData  &prediction_data,
         for (size_t ix = 0; ix < imp.n_missing_cat; ix++)
         {
             col = imp.missing_cat[ix];
-            prediction_data.categ_data[col + row * imputer.ncols_categ]
+            prediction_data.categ_data[col + row * prediction_data.ld_categ]
                         =
             std::distance(imp.cat_sum[col].begin(),
                           std::max_element(imp.cat_sum[col].begin(), imp.cat_sum[col].end()));
 
-            if (prediction_data.categ_data[col + row * imputer.ncols_categ] == 0 && imp.cat_sum[col][0] <= 0)
-                prediction_data.categ_data[col + row * imputer.ncols_categ]
+            if (prediction_data.categ_data[col + row * prediction_data.ld_categ] == 0 && imp.cat_sum[col][0] <= 0)
+                prediction_data.categ_data[col + row * prediction_data.ld_categ]
                     =
                 imputer.col_modes[col];
         }
@@ -1000,7 +1002,7 @@ void initialize_impute_calc(ImputedData &imp, InputData &input_data, size_t row)
     {
         imp.missing_num.resize(input_data.ncols_numeric);
         for (size_t col = 0; col < input_data.ncols_numeric; col++)
-            if (is_na_or_inf(input_data.numeric_data[row + col * input_data.nrows]))
+            if (is_na_or_inf(input_data.numeric_data[row + col * input_data.ld_numeric]))
                 imp.missing_num[imp.n_missing_num++] = col;
         imp.missing_num.resize(imp.n_missing_num);
         imp.num_sum.assign(imp.n_missing_num,    0);
@@ -1033,7 +1035,7 @@ void initialize_impute_calc(ImputedData &imp, InputData &input_data, size_t row)
     {
         imp.missing_cat.resize(input_data.ncols_categ);
         for (size_t col = 0; col < input_data.ncols_categ; col++)
-            if (input_data.categ_data[row + col * input_data.nrows] < 0)
+            if (input_data.categ_data[row + col * input_data.ld_categ] < 0)
                 imp.missing_cat[imp.n_missing_cat++] = col;
         imp.missing_cat.resize(imp.n_missing_cat);
         imp.cat_weight.assign(imp.n_missing_cat, 0);
@@ -1058,14 +1060,14 @@ void initialize_impute_calc(ImputedData &imp, PredictionData &prediction_data, I
         if (prediction_data.is_col_major)
         {
             for (size_t col = 0; col < imputer.ncols_numeric; col++)
-                if (is_na_or_inf(prediction_data.numeric_data[row + col * prediction_data.nrows]))
+                if (is_na_or_inf(prediction_data.numeric_data[row + col * prediction_data.ld_numeric]))
                     imp.missing_num[imp.n_missing_num++] = col;
         }
 
         else
         {
             for (size_t col = 0; col < imputer.ncols_numeric; col++)
-                if (is_na_or_inf(prediction_data.numeric_data[col + row * imputer.ncols_numeric]))
+                if (is_na_or_inf(prediction_data.numeric_data[col + row * prediction_data.ld_numeric]))
                     imp.missing_num[imp.n_missing_num++] = col;
         }
 
@@ -1112,7 +1114,7 @@ void initialize_impute_calc(ImputedData &imp, PredictionData &prediction_data, I
         {
             for (size_t col = 0; col < imputer.ncols_categ; col++)
             {
-                if (prediction_data.categ_data[row + col * prediction_data.nrows] < 0)
+                if (prediction_data.categ_data[row + col * prediction_data.ld_categ] < 0)
                     imp.missing_cat[imp.n_missing_cat++] = col;
             }
         }
@@ -1121,7 +1123,7 @@ void initialize_impute_calc(ImputedData &imp, PredictionData &prediction_data, I
         {
             for (size_t col = 0; col < imputer.ncols_categ; col++)
             {
-                if (prediction_data.categ_data[col + row * imputer.ncols_categ] < 0)
+                if (prediction_data.categ_data[col + row * prediction_data.ld_categ] < 0)
                     imp.missing_cat[imp.n_missing_cat++] = col;
             }
         }
@@ -1209,7 +1211,7 @@ void check_for_missing(InputData &input_data,
         {
             for (size_t col = 0; col < input_data.ncols_numeric; col++)
             {
-                if (is_na_or_inf(input_data.numeric_data[row + col * input_data.nrows]))
+                if (is_na_or_inf(input_data.numeric_data[row + col * input_data.ld_numeric]))
                 {
                     input_data.has_missing[row] = true;
                     break;
@@ -1219,7 +1221,7 @@ void check_for_missing(InputData &input_data,
             if (!input_data.has_missing[row])
                 for (size_t col = 0; col < input_data.ncols_categ; col++)
                 {
-                    if (input_data.categ_data[row + col * input_data.nrows] < 0)
+                    if (input_data.categ_data[row + col * input_data.ld_categ] < 0)
                     {
                         input_data.has_missing[row] = true;
                         break;
@@ -1249,7 +1251,7 @@ size_t check_for_missing(PredictionData  &prediction_data,
             {
                 for (size_t col = 0; col < imputer.ncols_numeric; col++)
                 {
-                    if (is_na_or_inf(prediction_data.numeric_data[row + col * prediction_data.nrows]))
+                    if (is_na_or_inf(prediction_data.numeric_data[row + col * prediction_data.ld_numeric]))
                     {
                         has_missing[row] = true;
                         break;
@@ -1261,7 +1263,7 @@ size_t check_for_missing(PredictionData  &prediction_data,
             {
                 for (size_t col = 0; col < imputer.ncols_numeric; col++)
                 {
-                    if (is_na_or_inf(prediction_data.numeric_data[col + row * imputer.ncols_numeric]))
+                    if (is_na_or_inf(prediction_data.numeric_data[col + row * prediction_data.ld_numeric]))
                     {
                         has_missing[row] = true;
                         break;
@@ -1288,7 +1290,7 @@ size_t check_for_missing(PredictionData  &prediction_data,
             {
                 for (size_t col = 0; col < imputer.ncols_categ; col++)
                 {
-                    if (prediction_data.categ_data[row + col * prediction_data.nrows] < 0)
+                    if (prediction_data.categ_data[row + col * prediction_data.ld_categ] < 0)
                     {
                         has_missing[row] = true;
                         break;
@@ -1300,7 +1302,7 @@ size_t check_for_missing(PredictionData  &prediction_data,
             {
                 for (size_t col = 0; col < imputer.ncols_categ; col++)
                 {
-                    if (prediction_data.categ_data[col + row * imputer.ncols_categ] < 0)
+                    if (prediction_data.categ_data[col + row * prediction_data.ld_categ] < 0)
                     {
                         has_missing[row] = true;
                         break;
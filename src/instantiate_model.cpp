@@ -59,6 +59,8 @@
 #undef real_t
 #undef sparse_ix
 
+#define _NO_SPARSE_IX
+
 #define real_t double
 #define sparse_ix int64_t
 #include "instantiate_model.hpp"
@@ -71,6 +73,8 @@
 #undef real_t
 #undef sparse_ix
 
+#undef _NO_SPARSE_IX
+
 #define _NO_REAL_T
 
 #define real_t float
@@ -79,6 +83,8 @@
 #undef real_t
 #undef sparse_ix
 
+#define _NO_SPARSE_IX
+
 #define real_t float
 #define sparse_ix int64_t
 #include "instantiate_model.hpp"
@@ -91,6 +97,8 @@
 #undef real_t
 #undef sparse_ix
 
+#undef _NO_SPARSE_IX
+
 #undef _NO_REAL_T
 
 #endif
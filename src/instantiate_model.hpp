@@ -46,6 +46,7 @@
 int fit_iforest(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
                 real_t numeric_data[],  size_t ncols_numeric,
                 int    categ_data[],    size_t ncols_categ,    int ncat[],
+                size_t ld_numeric,      size_t ld_categ,
                 real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
                 size_t ndim, size_t ntry, CoefType coef_type, bool coef_by_prop,
                 real_t sample_weights[], bool with_replacement, bool weight_as_sample,
@@ -57,7 +58,7 @@ int fit_iforest(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
                 real_t col_weights[], bool weigh_by_kurt,
                 double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
                 double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
-                double min_gain, MissingAction missing_action,
+                double min_gain, size_t max_bins, bool compensated_sums, MissingAction missing_action,
                 CategSplit cat_split_type, NewCategAction new_cat_action,
                 bool   all_perm, Imputer *imputer, size_t min_imp_obs,
                 UseDepthImp depth_imp, WeighImpRows weigh_imp_rows, bool impute_at_fit,
@@ -67,6 +68,7 @@ int fit_iforest(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
                (model_outputs, model_outputs_ext,
                 numeric_data,  ncols_numeric,
                 categ_data,    ncols_categ,    ncat,
+                ld_numeric,    ld_categ,
                 Xc, Xc_ind, Xc_indptr,
                 ndim, ntry, coef_type, coef_by_prop,
                 sample_weights, with_replacement, weight_as_sample,
@@ -78,7 +80,7 @@ int fit_iforest(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
                 col_weights, weigh_by_kurt,
                 prob_pick_by_gain_avg, prob_split_by_gain_avg,
                 prob_pick_by_gain_pl,  prob_split_by_gain_pl,
-                min_gain, missing_action,
+                min_gain, max_bins, compensated_sums, missing_action,
                 cat_split_type, new_cat_action,
                 all_perm, imputer, min_imp_obs,
                 depth_imp, weigh_imp_rows, impute_at_fit,
@@ -119,22 +121,112 @@ int add_tree(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
              all_perm, impute_nodes, min_imp_obs,
              random_seed);
 }
+#ifndef _NO_SPARSE_IX
+int fit_iforest_stream(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                       size_t (*read_chunk)(void *reader_state, real_t numeric_data[], int categ_data[],
+                                            real_t sample_weights[], size_t max_rows),
+                       void *reader_state, size_t chunk_size,
+                       size_t ncols_numeric, size_t ncols_categ, int ncat[],
+                       size_t ndim, size_t ntry, CoefType coef_type, bool coef_by_prop,
+                       bool has_weights, bool with_replacement, bool weight_as_sample,
+                       size_t sample_size, size_t ntrees,
+                       size_t max_depth, size_t ncols_per_tree,
+                       bool   limit_depth, bool penalize_range,
+                       real_t col_weights[], bool weigh_by_kurt,
+                       double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
+                       double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
+                       double min_gain, size_t max_bins, bool compensated_sums, MissingAction missing_action,
+                       CategSplit cat_split_type, NewCategAction new_cat_action,
+                       bool   all_perm, Imputer *imputer, size_t min_imp_obs,
+                       UseDepthImp depth_imp, WeighImpRows weigh_imp_rows,
+                       uint64_t random_seed, int nthreads)
+{
+    return fit_iforest_stream<real_t>
+               (model_outputs, model_outputs_ext,
+                read_chunk, reader_state, chunk_size,
+                ncols_numeric, ncols_categ, ncat,
+                ndim, ntry, coef_type, coef_by_prop,
+                has_weights, with_replacement, weight_as_sample,
+                sample_size, ntrees,
+                max_depth, ncols_per_tree,
+                limit_depth, penalize_range,
+                col_weights, weigh_by_kurt,
+                prob_pick_by_gain_avg, prob_split_by_gain_avg,
+                prob_pick_by_gain_pl,  prob_split_by_gain_pl,
+                min_gain, max_bins, compensated_sums, missing_action,
+                cat_split_type, new_cat_action,
+                all_perm, imputer, min_imp_obs,
+                depth_imp, weigh_imp_rows,
+                random_seed, nthreads);
+}
+#endif
 void predict_iforest(real_t numeric_data[], int categ_data[],
                      bool is_col_major, size_t ncols_numeric, size_t ncols_categ,
+                     size_t ld_numeric, size_t ld_categ,
                      real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
                      real_t Xr[], sparse_ix Xr_ind[], sparse_ix Xr_indptr[],
                      size_t nrows, int nthreads, bool standardize,
                      IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
-                     double output_depths[],   sparse_ix tree_num[])
+                     double output_depths[],   sparse_ix tree_num[],
+                     TerminalNodeMapping *terminal_mapping)
 {
     predict_iforest<real_t, sparse_ix>
                     (numeric_data, categ_data,
                      is_col_major, ncols_numeric, ncols_categ,
+                     ld_numeric, ld_categ,
                      Xc, Xc_ind, Xc_indptr,
                      Xr, Xr_ind, Xr_indptr,
                      nrows, nthreads, standardize,
                      model_outputs, model_outputs_ext,
-                     output_depths,   tree_num);
+                     output_depths,   tree_num,
+                     terminal_mapping);
+}
+void predict_iforest_threshold(real_t numeric_data[], int categ_data[],
+                               bool is_col_major, size_t ncols_numeric, size_t ncols_categ,
+                               size_t ld_numeric, size_t ld_categ,
+                               real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                               real_t Xr[], sparse_ix Xr_ind[], sparse_ix Xr_indptr[],
+                               size_t nrows, int nthreads, double threshold, bool standardize,
+                               IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                               bool output_is_outlier[], sparse_ix ntrees_used[])
+{
+    predict_iforest_threshold<real_t, sparse_ix>
+                              (numeric_data, categ_data,
+                               is_col_major, ncols_numeric, ncols_categ,
+                               ld_numeric, ld_categ,
+                               Xc, Xc_ind, Xc_indptr,
+                               Xr, Xr_ind, Xr_indptr,
+                               nrows, nthreads, threshold, standardize,
+                               model_outputs, model_outputs_ext,
+                               output_is_outlier, ntrees_used);
+}
+void predict_iforest_compiled(real_t numeric_data[], int categ_data[],
+                              bool is_col_major, size_t ncols_numeric, size_t ncols_categ,
+                              size_t ld_numeric, size_t ld_categ,
+                              size_t nrows, int nthreads, bool standardize,
+                              CompiledIsoForest *compiled_model, CompiledExtIsoForest *compiled_model_ext,
+                              double output_depths[], sparse_ix tree_num[])
+{
+    predict_iforest_compiled<real_t, sparse_ix>
+                             (numeric_data, categ_data,
+                              is_col_major, ncols_numeric, ncols_categ,
+                              ld_numeric, ld_categ,
+                              nrows, nthreads, standardize,
+                              compiled_model, compiled_model_ext,
+                              output_depths, tree_num);
+}
+void predict_iforest_predictor(IsoForestPredictor &predictor,
+                               real_t numeric_data[], int categ_data[],
+                               bool is_col_major, size_t ncols_numeric, size_t ncols_categ,
+                               size_t nrows, bool standardize,
+                               double output_depths[], sparse_ix tree_num[])
+{
+    predict_iforest_predictor<real_t, sparse_ix>
+                              (predictor,
+                               numeric_data, categ_data,
+                               is_col_major, ncols_numeric, ncols_categ,
+                               nrows, standardize,
+                               output_depths, tree_num);
 }
 void calc_similarity(real_t numeric_data[], int categ_data[],
                      real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
@@ -149,6 +241,74 @@ void calc_similarity(real_t numeric_data[], int categ_data[],
                      model_outputs, model_outputs_ext,
                      tmat, rmat, n_from);
 }
+void calc_similarity_knn(real_t numeric_data[], int categ_data[],
+                         real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                         size_t nrows, int nthreads, bool assume_full_distr, bool standardize_dist,
+                         IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                         size_t k, sparse_ix knn_indptr[], sparse_ix knn_indices[], double knn_dist[])
+{
+    calc_similarity_knn<real_t, sparse_ix>
+                        (numeric_data, categ_data,
+                         Xc, Xc_ind, Xc_indptr,
+                         nrows, nthreads, assume_full_distr, standardize_dist,
+                         model_outputs, model_outputs_ext,
+                         k, knn_indptr, knn_indices, knn_dist);
+}
+void calc_similarity_tiled(real_t numeric_data[], int categ_data[],
+                           bool is_col_major, size_t ncols_numeric, size_t ncols_categ,
+                           real_t Xr[], sparse_ix Xr_ind[], sparse_ix Xr_indptr[],
+                           size_t nrows,
+                           real_t ref_numeric_data[], int ref_categ_data[],
+                           real_t ref_Xr[], sparse_ix ref_Xr_ind[], sparse_ix ref_Xr_indptr[],
+                           size_t nrows_ref,
+                           size_t tile_rows, size_t tile_cols,
+                           int nthreads, bool assume_full_distr, bool standardize_dist,
+                           IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                           SimilarityTileCallback callback, void *callback_data)
+{
+    calc_similarity_tiled<real_t, sparse_ix>
+                          (numeric_data, categ_data,
+                           is_col_major, ncols_numeric, ncols_categ,
+                           Xr, Xr_ind, Xr_indptr,
+                           nrows,
+                           ref_numeric_data, ref_categ_data,
+                           ref_Xr, ref_Xr_ind, ref_Xr_indptr,
+                           nrows_ref,
+                           tile_rows, tile_cols,
+                           nthreads, assume_full_distr, standardize_dist,
+                           model_outputs, model_outputs_ext,
+                           callback, callback_data);
+}
+void get_leaf_signatures(real_t numeric_data[], int categ_data[],
+                         bool is_col_major, size_t ncols_numeric, size_t ncols_categ,
+                         real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                         real_t Xr[], sparse_ix Xr_ind[], sparse_ix Xr_indptr[],
+                         size_t nrows, int nthreads,
+                         IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                         uint64_t signatures[])
+{
+    get_leaf_signatures<real_t, sparse_ix>
+                        (numeric_data, categ_data,
+                         is_col_major, ncols_numeric, ncols_categ,
+                         Xc, Xc_ind, Xc_indptr,
+                         Xr, Xr_ind, Xr_indptr,
+                         nrows, nthreads,
+                         model_outputs, model_outputs_ext,
+                         signatures);
+}
+void build_training_leaf_index(real_t numeric_data[], int categ_data[],
+                               real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                               size_t nrows, int nthreads,
+                               IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                               TrainingLeafIndex &leaf_index)
+{
+    build_training_leaf_index<real_t, sparse_ix>
+                              (numeric_data, categ_data,
+                               Xc, Xc_ind, Xc_indptr,
+                               nrows, nthreads,
+                               model_outputs, model_outputs_ext,
+                               leaf_index);
+}
 void impute_missing_values(real_t numeric_data[], int categ_data[], bool is_col_major,
                            real_t Xr[], sparse_ix Xr_ind[], sparse_ix Xr_indptr[],
                            size_t nrows, int nthreads,
@@ -172,5 +332,27 @@ void get_num_nodes(ExtIsoForest &model_outputs, sparse_ix *n_nodes, sparse_ix *n
 {
     get_num_nodes<sparse_ix>(model_outputs, n_nodes, n_terminal, nthreads);
 }
+void get_leaf_embedding(sparse_ix tree_num[], size_t nrows, TerminalNodeMapping &terminal_mapping, int nthreads,
+                        sparse_ix indptr[], sparse_ix indices[])
+{
+    get_leaf_embedding<sparse_ix>(tree_num, nrows, terminal_mapping, nthreads, indptr, indices);
+}
+void calc_similarity_knn_from_leaf_index(TrainingLeafIndex &leaf_index,
+                                         IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                                         int nthreads, bool assume_full_distr, bool standardize_dist,
+                                         size_t k, sparse_ix knn_indptr[], sparse_ix knn_indices[], double knn_dist[])
+{
+    calc_similarity_knn_from_leaf_index<sparse_ix>
+                                        (leaf_index,
+                                         model_outputs, model_outputs_ext,
+                                         nthreads, assume_full_distr, standardize_dist,
+                                         k, knn_indptr, knn_indices, knn_dist);
+}
+void predict_iforest_mixed(void *numeric_cols[], int categ_data[], size_t nrows, int nthreads, bool standardize,
+                           CompiledIsoForest &compiled_model, double output_depths[], sparse_ix tree_num[])
+{
+    predict_iforest_mixed<sparse_ix>(numeric_cols, categ_data, nrows, nthreads, standardize,
+                                     compiled_model, output_depths, tree_num);
+}
 #endif
 
@@ -45,14 +45,91 @@
 #include "isotree.hpp"
 
 template <class InputData, class WorkerMemory>
-void split_itree_recursive(std::vector<IsoTree>     &trees,
-                           WorkerMemory             &workspace,
-                           InputData                &input_data,
-                           ModelParams              &model_params,
-                           std::vector<ImputeNode> *impute_nodes,
-                           size_t                   curr_depth)
+void grow_itree(std::vector<IsoTree>     &trees,
+                WorkerMemory             &workspace,
+                InputData                &input_data,
+                ModelParams              &model_params,
+                std::vector<ImputeNode> *impute_nodes,
+                size_t                   curr_depth)
 {
-    if (interrupt_switch) return;
+    /* Nodes are split in depth-first order, following always the left branch first. The right
+       branches that are still to be followed are kept in an explicit stack along with the depth
+       at which their state was saved, so the depth of the tree is not limited by the call stack. */
+    workspace.pending_branches.clear();
+    workspace.compact_active = false;
+    while (true)
+    {
+        if (split_itree_node(trees, workspace, input_data, model_params, impute_nodes, curr_depth))
+        {
+            curr_depth++;
+            continue;
+        }
+
+        /* when a branch ends, continue from the most recent node whose right branch is pending */
+        while (true)
+        {
+            if (workspace.pending_branches.empty() || interrupt_switch) return;
+            PendingBranch branch = workspace.pending_branches.back();
+            workspace.pending_branches.pop_back();
+
+            trees[branch.node].tree_right = trees.size();
+            if (branch.subtree != NULL)
+            {
+                branch.subtree->node = trees.size();
+                trees.emplace_back();
+                continue;
+            }
+
+            workspace.recursion_states[branch.depth].restore_state(workspace);
+            if (model_params.missing_action != Fail)
+            {
+                switch(model_params.missing_action)
+                {
+                    case Impute:
+                    {
+                        if (trees[branch.node].pct_tree_left >= .5)
+                            workspace.st = workspace.end_NA;
+                        else
+                            workspace.st = workspace.st_NA;
+                        break;
+                    }
+
+                    case Divide:
+                    {
+                        if (workspace.weights_map.size())
+                            for (size_t row = workspace.st_NA; row < workspace.end_NA; row++)
+                                workspace.weights_map[workspace.ix_arr[row]] *= (1 - trees[branch.node].pct_tree_left);
+                        else
+                            for (size_t row = workspace.st_NA; row < workspace.end_NA; row++)
+                                workspace.weights_arr[workspace.ix_arr[row]] *= (1 - trees[branch.node].pct_tree_left);
+                        workspace.st = workspace.st_NA;
+                        break;
+                    }
+                }
+            }
+
+            else
+            {
+                workspace.st = workspace.split_ix;
+            }
+
+            trees.emplace_back();
+            if (impute_nodes != NULL) impute_nodes->emplace_back(branch.node);
+            curr_depth = branch.depth + 1;
+            break;
+        }
+    }
+}
+
+template <class InputData, class WorkerMemory>
+bool split_itree_node(std::vector<IsoTree>     &trees,
+                      WorkerMemory             &workspace,
+                      InputData                &input_data,
+                      ModelParams              &model_params,
+                      std::vector<ImputeNode> *impute_nodes,
+                      size_t                   curr_depth)
+{
+    if (interrupt_switch) return false;
     long double sum_weight = -HUGE_VAL;
 
     /* calculate imputation statistics if desired */
@@ -67,6 +144,9 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
                           model_params.min_imp_obs);
     }
 
+    /* small nodes take their data from a contiguous copy */
+    update_compact_rows(workspace, input_data);
+
     /* check for potential isolated leafs */
     if (workspace.end == workspace.st || curr_depth >= model_params.max_depth)
         goto terminal_statistics;
@@ -113,15 +193,79 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
         workspace.col_sampler.prepare_full_pass();
         while (workspace.col_sampler.sample_col(workspace.col_chosen))
         {
-            if (interrupt_switch) return;
+            if (interrupt_switch) return false;
 
             if (workspace.col_chosen < input_data.ncols_numeric)
             {
-                if (input_data.Xc_indptr == NULL)
+                if (input_data.binned_numeric.size())
+                {
+                    if (!workspace.weights_arr.size() && !workspace.weights_map.size())
+                        workspace.this_gain = eval_guided_crit_binned(workspace.ix_arr.data(), workspace.st, workspace.end,
+                                                                      get_numeric_col(workspace, input_data, workspace.col_chosen),
+                                                                      input_data.binned_numeric.data() + workspace.col_chosen * input_data.nrows,
+                                                                      input_data.nbins, workspace.buffer_hist.data(),
+                                                                      workspace.buffer_dbl.data(), false,
+                                                                      workspace.split_ix, workspace.this_split_point,
+                                                                      workspace.xmin, workspace.xmax,
+                                                                      workspace.criterion, model_params.min_gain,
+                                                                      model_params.missing_action);
+                    else if (workspace.weights_arr.size())
+                        workspace.this_gain = eval_guided_crit_binned_weighted(workspace.ix_arr.data(), workspace.st, workspace.end,
+                                                                               get_numeric_col(workspace, input_data, workspace.col_chosen),
+                                                                               input_data.binned_numeric.data() + workspace.col_chosen * input_data.nrows,
+                                                                               input_data.nbins, workspace.buffer_hist.data(),
+                                                                               workspace.buffer_dbl.data(), false,
+                                                                               workspace.split_ix, workspace.this_split_point,
+                                                                               workspace.xmin, workspace.xmax,
+                                                                               workspace.criterion, model_params.min_gain,
+                                                                               model_params.missing_action,
+                                                                               workspace.weights_arr);
+                    else
+                        workspace.this_gain = eval_guided_crit_binned_weighted(workspace.ix_arr.data(), workspace.st, workspace.end,
+                                                                               get_numeric_col(workspace, input_data, workspace.col_chosen),
+                                                                               input_data.binned_numeric.data() + workspace.col_chosen * input_data.nrows,
+                                                                               input_data.nbins, workspace.buffer_hist.data(),
+                                                                               workspace.buffer_dbl.data(), false,
+                                                                               workspace.split_ix, workspace.this_split_point,
+                                                                               workspace.xmin, workspace.xmax,
+                                                                               workspace.criterion, model_params.min_gain,
+                                                                               model_params.missing_action,
+                                                                               workspace.weights_map);
+                }
+
+                else if (input_data.presort_numeric && workspace.end - workspace.st > 1)
+                {
+                    size_t *sorted_ix = get_presorted_col(workspace, workspace.col_chosen);
+                    if (!workspace.weights_arr.size() && !workspace.weights_map.size())
+                        workspace.this_gain = eval_guided_crit_sorted(sorted_ix, workspace.st, workspace.end,
+                                                                      get_numeric_col(workspace, input_data, workspace.col_chosen),
+                                                                      workspace.buffer_dbl.data(), false,
+                                                                      workspace.split_ix, workspace.this_split_point,
+                                                                      workspace.xmin, workspace.xmax,
+                                                                      workspace.criterion, model_params.min_gain);
+                    else if (workspace.weights_arr.size())
+                        workspace.this_gain = eval_guided_crit_sorted_weighted(sorted_ix, workspace.st, workspace.end,
+                                                                               get_numeric_col(workspace, input_data, workspace.col_chosen),
+                                                                               workspace.buffer_dbl.data(), false,
+                                                                               workspace.split_ix, workspace.this_split_point,
+                                                                               workspace.xmin, workspace.xmax,
+                                                                               workspace.criterion, model_params.min_gain,
+                                                                               workspace.weights_arr);
+                    else
+                        workspace.this_gain = eval_guided_crit_sorted_weighted(sorted_ix, workspace.st, workspace.end,
+                                                                               get_numeric_col(workspace, input_data, workspace.col_chosen),
+                                                                               workspace.buffer_dbl.data(), false,
+                                                                               workspace.split_ix, workspace.this_split_point,
+                                                                               workspace.xmin, workspace.xmax,
+                                                                               workspace.criterion, model_params.min_gain,
+                                                                               workspace.weights_map);
+                }
+
+                else if (input_data.Xc_indptr == NULL)
                 {
                     if (!workspace.weights_arr.size() && !workspace.weights_map.size())
                         workspace.this_gain = eval_guided_crit(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                                               input_data.numeric_data + workspace.col_chosen * input_data.nrows,
+                                                               get_numeric_col(workspace, input_data, workspace.col_chosen),
                                                                workspace.buffer_dbl.data(), false,
                                                                workspace.split_ix, workspace.this_split_point,
                                                                workspace.xmin, workspace.xmax,
@@ -129,7 +273,7 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
                                                                model_params.missing_action);
                     else if (workspace.weights_arr.size())
                         workspace.this_gain = eval_guided_crit_weighted(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                                                        input_data.numeric_data + workspace.col_chosen * input_data.nrows,
+                                                                        get_numeric_col(workspace, input_data, workspace.col_chosen),
                                                                         workspace.buffer_dbl.data(), false,
                                                                         workspace.split_ix, workspace.this_split_point,
                                                                         workspace.xmin, workspace.xmax,
@@ -138,7 +282,7 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
                                                                         workspace.weights_arr);
                     else
                         workspace.this_gain = eval_guided_crit_weighted(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                                                        input_data.numeric_data + workspace.col_chosen * input_data.nrows,
+                                                                        get_numeric_col(workspace, input_data, workspace.col_chosen),
                                                                         workspace.buffer_dbl.data(), false,
                                                                         workspace.split_ix, workspace.this_split_point,
                                                                         workspace.xmin, workspace.xmax,
@@ -176,7 +320,7 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
             {
                 if (!workspace.weights_arr.size() && !workspace.weights_map.size())
                     workspace.this_gain = eval_guided_crit(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                                           input_data.categ_data + (workspace.col_chosen - input_data.ncols_numeric) * input_data.nrows,
+                                                           get_categ_col(workspace, input_data, workspace.col_chosen - input_data.ncols_numeric),
                                                            input_data.ncat[workspace.col_chosen - input_data.ncols_numeric],
                                                            workspace.buffer_szt.data(), workspace.buffer_szt.data() + input_data.max_categ,
                                                            workspace.buffer_dbl.data(), workspace.this_categ, workspace.this_split_categ.data(),
@@ -184,7 +328,7 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
                                                            model_params.all_perm, model_params.missing_action, model_params.cat_split_type);
                 else if (workspace.weights_arr.size())
                     workspace.this_gain = eval_guided_crit_weighted(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                                                    input_data.categ_data + (workspace.col_chosen - input_data.ncols_numeric) * input_data.nrows,
+                                                                    get_categ_col(workspace, input_data, workspace.col_chosen - input_data.ncols_numeric),
                                                                     input_data.ncat[workspace.col_chosen - input_data.ncols_numeric],
                                                                     workspace.buffer_szt.data(),
                                                                     workspace.buffer_dbl.data(), workspace.this_categ, workspace.this_split_categ.data(),
@@ -193,7 +337,7 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
                                                                     workspace.weights_arr);
                 else
                     workspace.this_gain = eval_guided_crit_weighted(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                                                    input_data.categ_data + (workspace.col_chosen - input_data.ncols_numeric) * input_data.nrows,
+                                                                    get_categ_col(workspace, input_data, workspace.col_chosen - input_data.ncols_numeric),
                                                                     input_data.ncat[workspace.col_chosen - input_data.ncols_numeric],
                                                                     workspace.buffer_szt.data(),
                                                                     workspace.buffer_dbl.data(), workspace.this_categ, workspace.this_split_categ.data(),
@@ -290,7 +434,7 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
         {
             while (workspace.col_sampler.sample_col(trees.back().col_num, workspace.rnd_generator))
             {
-                if (interrupt_switch) return;
+                if (interrupt_switch) return false;
                 
                 get_split_range(workspace, input_data, model_params, trees.back());
                 if (workspace.unsplittable)
@@ -315,7 +459,7 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
                     workspace.col_sampler.sample_col(trees.back().col_num, workspace.rnd_generator)
                    )
             {
-                if (interrupt_switch) return;
+                if (interrupt_switch) return false;
 
                 get_split_range(workspace, input_data, model_params, trees.back());
                 if (workspace.unsplittable)
@@ -357,34 +501,103 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
 
                 default:
                 {
-                    if (input_data.Xc_indptr == NULL)
+                    if (input_data.binned_numeric.size())
                     {
                         if (!workspace.weights_arr.size() && !workspace.weights_map.size())
-                            eval_guided_crit(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                             input_data.numeric_data + trees.back().col_num * input_data.nrows,
-                                             workspace.buffer_dbl.data(), true,
-                                             workspace.split_ix, trees.back().num_split,
-                                             workspace.xmin, workspace.xmax,
-                                             workspace.criterion, model_params.min_gain,
-                                             model_params.missing_action);
+                            eval_guided_crit_binned(workspace.ix_arr.data(), workspace.st, workspace.end,
+                                                    get_numeric_col(workspace, input_data, trees.back().col_num),
+                                                    input_data.binned_numeric.data() + trees.back().col_num * input_data.nrows,
+                                                    input_data.nbins, workspace.buffer_hist.data(),
+                                                    workspace.buffer_dbl.data(), true,
+                                                    workspace.split_ix, trees.back().num_split,
+                                                    workspace.xmin, workspace.xmax,
+                                                    workspace.criterion, model_params.min_gain,
+                                                    model_params.missing_action);
                         else if (workspace.weights_arr.size())
-                            eval_guided_crit_weighted(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                                      input_data.numeric_data + trees.back().col_num * input_data.nrows,
-                                                      workspace.buffer_dbl.data(), true,
-                                                      workspace.split_ix, trees.back().num_split,
-                                                      workspace.xmin, workspace.xmax,
-                                                      workspace.criterion, model_params.min_gain,
-                                                      model_params.missing_action,
-                                                      workspace.weights_arr);
+                            eval_guided_crit_binned_weighted(workspace.ix_arr.data(), workspace.st, workspace.end,
+                                                             get_numeric_col(workspace, input_data, trees.back().col_num),
+                                                             input_data.binned_numeric.data() + trees.back().col_num * input_data.nrows,
+                                                             input_data.nbins, workspace.buffer_hist.data(),
+                                                             workspace.buffer_dbl.data(), true,
+                                                             workspace.split_ix, trees.back().num_split,
+                                                             workspace.xmin, workspace.xmax,
+                                                             workspace.criterion, model_params.min_gain,
+                                                             model_params.missing_action,
+                                                             workspace.weights_arr);
                         else
-                            eval_guided_crit_weighted(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                                      input_data.numeric_data + trees.back().col_num * input_data.nrows,
-                                                      workspace.buffer_dbl.data(), true,
-                                                      workspace.split_ix, trees.back().num_split,
-                                                      workspace.xmin, workspace.xmax,
-                                                      workspace.criterion, model_params.min_gain,
-                                                      model_params.missing_action,
-                                                      workspace.weights_map);
+                            eval_guided_crit_binned_weighted(workspace.ix_arr.data(), workspace.st, workspace.end,
+                                                             get_numeric_col(workspace, input_data, trees.back().col_num),
+                                                             input_data.binned_numeric.data() + trees.back().col_num * input_data.nrows,
+                                                             input_data.nbins, workspace.buffer_hist.data(),
+                                                             workspace.buffer_dbl.data(), true,
+                                                             workspace.split_ix, trees.back().num_split,
+                                                             workspace.xmin, workspace.xmax,
+                                                             workspace.criterion, model_params.min_gain,
+                                                             model_params.missing_action,
+                                                             workspace.weights_map);
+                    }
+
+                    else if (input_data.Xc_indptr == NULL)
+                    {
+                        if (input_data.presort_numeric && workspace.end - workspace.st > 1)
+                        {
+                            size_t *sorted_ix = get_presorted_col(workspace, trees.back().col_num);
+                            std::copy(sorted_ix + workspace.st, sorted_ix + workspace.end + 1,
+                                      workspace.ix_arr.begin() + workspace.st);
+                            if (!workspace.weights_arr.size() && !workspace.weights_map.size())
+                                eval_guided_crit_sorted(workspace.ix_arr.data(), workspace.st, workspace.end,
+                                                        get_numeric_col(workspace, input_data, trees.back().col_num),
+                                                        workspace.buffer_dbl.data(), true,
+                                                        workspace.split_ix, trees.back().num_split,
+                                                        workspace.xmin, workspace.xmax,
+                                                        workspace.criterion, model_params.min_gain);
+                            else if (workspace.weights_arr.size())
+                                eval_guided_crit_sorted_weighted(workspace.ix_arr.data(), workspace.st, workspace.end,
+                                                                 get_numeric_col(workspace, input_data, trees.back().col_num),
+                                                                 workspace.buffer_dbl.data(), true,
+                                                                 workspace.split_ix, trees.back().num_split,
+                                                                 workspace.xmin, workspace.xmax,
+                                                                 workspace.criterion, model_params.min_gain,
+                                                                 workspace.weights_arr);
+                            else
+                                eval_guided_crit_sorted_weighted(workspace.ix_arr.data(), workspace.st, workspace.end,
+                                                                 get_numeric_col(workspace, input_data, trees.back().col_num),
+                                                                 workspace.buffer_dbl.data(), true,
+                                                                 workspace.split_ix, trees.back().num_split,
+                                                                 workspace.xmin, workspace.xmax,
+                                                                 workspace.criterion, model_params.min_gain,
+                                                                 workspace.weights_map);
+                        }
+
+                        else
+                        {
+                            if (!workspace.weights_arr.size() && !workspace.weights_map.size())
+                                eval_guided_crit(workspace.ix_arr.data(), workspace.st, workspace.end,
+                                                 get_numeric_col(workspace, input_data, trees.back().col_num),
+                                                 workspace.buffer_dbl.data(), true,
+                                                 workspace.split_ix, trees.back().num_split,
+                                                 workspace.xmin, workspace.xmax,
+                                                 workspace.criterion, model_params.min_gain,
+                                                 model_params.missing_action);
+                            else if (workspace.weights_arr.size())
+                                eval_guided_crit_weighted(workspace.ix_arr.data(), workspace.st, workspace.end,
+                                                          get_numeric_col(workspace, input_data, trees.back().col_num),
+                                                          workspace.buffer_dbl.data(), true,
+                                                          workspace.split_ix, trees.back().num_split,
+                                                          workspace.xmin, workspace.xmax,
+                                                          workspace.criterion, model_params.min_gain,
+                                                          model_params.missing_action,
+                                                          workspace.weights_arr);
+                            else
+                                eval_guided_crit_weighted(workspace.ix_arr.data(), workspace.st, workspace.end,
+                                                          get_numeric_col(workspace, input_data, trees.back().col_num),
+                                                          workspace.buffer_dbl.data(), true,
+                                                          workspace.split_ix, trees.back().num_split,
+                                                          workspace.xmin, workspace.xmax,
+                                                          workspace.criterion, model_params.min_gain,
+                                                          model_params.missing_action,
+                                                          workspace.weights_map);
+                        }
                         if (model_params.missing_action == Fail) /* data is already split */
                         {
                             workspace.split_ix++;
@@ -438,7 +651,7 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
             throw std::runtime_error("Data has missing values. Try using a different value for 'missing_action'.\n");
         
         if (input_data.Xc_indptr == NULL)
-            divide_subset_split(workspace.ix_arr.data(), input_data.numeric_data + input_data.nrows * trees.back().col_num,
+            divide_subset_split(workspace.ix_arr.data(), get_numeric_col(workspace, input_data, trees.back().col_num),
                                 workspace.st, workspace.end, trees.back().num_split, model_params.missing_action,
                                 workspace.st_NA, workspace.end_NA, workspace.split_ix);
         else
@@ -454,7 +667,7 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
         if (input_data.ncat[trees.back().col_num] <= 2)
         {
             trees.back().chosen_cat = 0;
-            divide_subset_split(workspace.ix_arr.data(), input_data.categ_data + input_data.nrows * trees.back().col_num,
+            divide_subset_split(workspace.ix_arr.data(), get_categ_col(workspace, input_data, trees.back().col_num),
                                 workspace.st, workspace.end, (int)0, model_params.missing_action,
                                 workspace.st_NA, workspace.end_NA, workspace.split_ix);
             trees.back().cat_split.clear();
@@ -486,14 +699,14 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
                             {
                                 if (!workspace.weights_arr.size() && !workspace.weights_map.size())
                                     eval_guided_crit(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                                     input_data.categ_data + trees.back().col_num * input_data.nrows, input_data.ncat[trees.back().col_num],
+                                                     get_categ_col(workspace, input_data, trees.back().col_num), input_data.ncat[trees.back().col_num],
                                                      workspace.buffer_szt.data(), workspace.buffer_szt.data() + input_data.max_categ,
                                                      workspace.buffer_dbl.data(), trees.back().chosen_cat, workspace.this_split_categ.data(),
                                                      workspace.buffer_chr.data(), workspace.criterion, model_params.min_gain,
                                                      model_params.all_perm, model_params.missing_action, model_params.cat_split_type);
                                 else if (workspace.weights_arr.size())
                                     eval_guided_crit_weighted(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                                              input_data.categ_data + trees.back().col_num * input_data.nrows, input_data.ncat[trees.back().col_num],
+                                                              get_categ_col(workspace, input_data, trees.back().col_num), input_data.ncat[trees.back().col_num],
                                                               workspace.buffer_szt.data(),
                                                               workspace.buffer_dbl.data(), trees.back().chosen_cat, workspace.this_split_categ.data(),
                                                               workspace.buffer_chr.data(), workspace.criterion, model_params.min_gain,
@@ -501,7 +714,7 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
                                                               workspace.weights_arr);
                                 else
                                     eval_guided_crit_weighted(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                                              input_data.categ_data + trees.back().col_num * input_data.nrows, input_data.ncat[trees.back().col_num],
+                                                              get_categ_col(workspace, input_data, trees.back().col_num), input_data.ncat[trees.back().col_num],
                                                               workspace.buffer_szt.data(),
                                                               workspace.buffer_dbl.data(), trees.back().chosen_cat, workspace.this_split_categ.data(),
                                                               workspace.buffer_chr.data(), workspace.criterion, model_params.min_gain,
@@ -513,7 +726,7 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
                     }
 
 
-                    divide_subset_split(workspace.ix_arr.data(), input_data.categ_data + input_data.nrows * trees.back().col_num,
+                    divide_subset_split(workspace.ix_arr.data(), get_categ_col(workspace, input_data, trees.back().col_num),
                                         workspace.st, workspace.end, trees.back().chosen_cat, model_params.missing_action,
                                         workspace.st_NA, workspace.end_NA, workspace.split_ix);
                     break;
@@ -555,14 +768,14 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
                                 trees.back().cat_split.resize(input_data.ncat[trees.back().col_num]);
                                 if (!workspace.weights_arr.size() && !workspace.weights_map.size())
                                     eval_guided_crit(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                                     input_data.categ_data + trees.back().col_num * input_data.nrows, input_data.ncat[trees.back().col_num],
+                                                     get_categ_col(workspace, input_data, trees.back().col_num), input_data.ncat[trees.back().col_num],
                                                      workspace.buffer_szt.data(), workspace.buffer_szt.data() + input_data.max_categ,
                                                      workspace.buffer_dbl.data(), trees.back().chosen_cat, trees.back().cat_split.data(),
                                                      workspace.buffer_chr.data(), workspace.criterion, model_params.min_gain,
                                                      model_params.all_perm, model_params.missing_action, model_params.cat_split_type);
                                 else if (workspace.weights_arr.size())
                                     eval_guided_crit_weighted(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                                              input_data.categ_data + trees.back().col_num * input_data.nrows, input_data.ncat[trees.back().col_num],
+                                                              get_categ_col(workspace, input_data, trees.back().col_num), input_data.ncat[trees.back().col_num],
                                                               workspace.buffer_szt.data(),
                                                               workspace.buffer_dbl.data(), trees.back().chosen_cat, trees.back().cat_split.data(),
                                                               workspace.buffer_chr.data(), workspace.criterion, model_params.min_gain,
@@ -570,7 +783,7 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
                                                               workspace.weights_arr);
                                 else
                                     eval_guided_crit_weighted(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                                              input_data.categ_data + trees.back().col_num * input_data.nrows, input_data.ncat[trees.back().col_num],
+                                                              get_categ_col(workspace, input_data, trees.back().col_num), input_data.ncat[trees.back().col_num],
                                                               workspace.buffer_szt.data(),
                                                               workspace.buffer_dbl.data(), trees.back().chosen_cat, trees.back().cat_split.data(),
                                                               workspace.buffer_chr.data(), workspace.criterion, model_params.min_gain,
@@ -586,7 +799,7 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
                             if (trees.back().cat_split[cat] < 0)
                                 trees.back().cat_split[cat] = workspace.rbin(workspace.rnd_generator) < 0.5;
 
-                    divide_subset_split(workspace.ix_arr.data(), input_data.categ_data + input_data.nrows * trees.back().col_num,
+                    divide_subset_split(workspace.ix_arr.data(), get_categ_col(workspace, input_data, trees.back().col_num),
                                         workspace.st, workspace.end, trees.back().cat_split.data(), model_params.missing_action,
                                         workspace.st_NA, workspace.end_NA, workspace.split_ix);
                 }
@@ -601,13 +814,17 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
     /* if it hasn't reached the limit, continue splitting from here */
     follow_branches:
     {
+        /* the sorted orders of the columns are passed down to the children, which take the same rows */
+        if (input_data.presort_numeric)
+            partition_presorted_cols(workspace, (model_params.missing_action == Fail)? workspace.split_ix : workspace.st_NA);
+
         /* add another round of separation depth for distance */
         if (model_params.calc_dist && curr_depth > 0)
             add_separation_step(workspace, input_data, (double)(-1));
         
         size_t tree_from = trees.size() - 1;
-        std::unique_ptr<RecursionState>
-        recursion_state(new RecursionState(workspace, model_params.missing_action != Fail));
+        RecursionState &recursion_state = get_recursion_state(workspace, curr_depth);
+        recursion_state.save_state(workspace, model_params.missing_action != Fail);
         trees.back().score = -1;
 
         /* compute statistics for NAs and remember recursion indices/weights */
@@ -665,67 +882,29 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
                     trees.back().cat_split[cat] = new_to_left;
         }
 
-        /* left branch */
-        trees.back().tree_left = trees.size();
-        trees.emplace_back();
-        if (impute_nodes != NULL) impute_nodes->emplace_back(tree_from);
-        split_itree_recursive(trees,
-                              workspace,
-                              input_data,
-                              model_params,
-                              impute_nodes,
-                              curr_depth + 1);
-
-
-        /* right branch */
-        recursion_state->restore_state(workspace);
-        if (model_params.missing_action != Fail)
-        {
-            switch(model_params.missing_action)
-            {
-                case Impute:
-                {
-                    if (trees[tree_from].pct_tree_left >= .5)
-                        workspace.st = workspace.end_NA;
-                    else
-                        workspace.st = workspace.st_NA;
-                    break;
-                }
-
-                case Divide:
-                {
-                    if (workspace.weights_map.size())
-                        for (size_t row = workspace.st_NA; row < workspace.end_NA; row++)
-                            workspace.weights_map[workspace.ix_arr[row]] *= (1 - trees[tree_from].pct_tree_left);
-                    else
-                        for (size_t row = workspace.st_NA; row < workspace.end_NA; row++)
-                            workspace.weights_arr[workspace.ix_arr[row]] *= (1 - trees[tree_from].pct_tree_left);
-                    workspace.st = workspace.st_NA;
-                    break;
-                }
-            }
-        }
+        /* if the right branch is large enough, leave it to another thread while this one follows the left branch */
+        DeferredSubtree *right_subtree = NULL;
+        if (model_params.missing_action == Fail || workspace.st_NA == workspace.end_NA)
+            right_subtree = defer_subtree(workspace,
+                                          (model_params.missing_action == Fail)? workspace.split_ix : workspace.end_NA,
+                                          recursion_state.end, curr_depth + 1);
 
-        else
-        {
-            workspace.st = workspace.split_ix;
-        }
+        /* the right branch is followed once the left one is finished */
+        workspace.pending_branches.push_back({tree_from, curr_depth, right_subtree});
 
-        trees[tree_from].tree_right = trees.size();
+        /* left branch */
+        trees.back().tree_left = trees.size();
         trees.emplace_back();
         if (impute_nodes != NULL) impute_nodes->emplace_back(tree_from);
-        split_itree_recursive(trees,
-                              workspace,
-                              input_data,
-                              model_params,
-                              impute_nodes,
-                              curr_depth + 1);
     }
-    return;
+    return true;
 
     /* if it reached the limit, calculate terminal statistics */
     terminal_statistics:
     {
+        if (workspace.compact_active)
+            restore_compact_rows(workspace);
+
         if (!workspace.weights_arr.size() && !workspace.weights_map.size())
         {
             trees.back().score = (double)(curr_depth + expected_avg_depth(workspace.end - workspace.st + 1));
@@ -777,5 +956,5 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
         if (model_params.impute_at_fit)
             add_from_impute_node(impute_nodes->back(), workspace, input_data);
     }
-
+    return false;
 }
@@ -52,9 +52,11 @@
 #include <limits.h>
 #include <string.h>
 #include <vector>
+#include <deque>
 #include <iterator>
 #include <numeric>
 #include <algorithm>
+#include <functional>
 #include <random>
 #include <unordered_set>
 #include <unordered_map>
@@ -62,6 +64,9 @@
 #include <utility>
 #include <cstdint>
 #include <iostream>
+#include <thread>
+#include <mutex>
+#include <atomic>
 #ifndef _FOR_R
     #include <stdio.h> 
 #else
@@ -87,6 +92,13 @@
 #include <signal.h>
 typedef void (*sig_t_)(int);
 
+/* Vectorized prediction kernels are compiled separately and picked at runtime
+   according to what the CPU supports, so they don't depend on '-march=native' */
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    #define HAS_AVX2_DISPATCH
+    #include <immintrin.h>
+#endif
+
 
 /* By default, will use Mersenne-Twister for RNG, but can be switched to something faster */
 #ifdef _USE_MERSENNE_TWISTER
@@ -160,6 +172,27 @@ typedef void (*sig_t_)(int);
 /* Some aggregation functions will prefer more precise data types when the data is large */
 #define THRESHOLD_LONG_DOUBLE (size_t)1e6
 
+/* Nodes with at most this many rows read their data from a contiguous copy when the input
+   data is at least this large (in bytes), see 'update_compact_rows' */
+#define MAX_ROWS_COMPACT (size_t)4096
+#define MIN_BYTES_COMPACT (size_t)(1 << 24)
+
+/* Flags stored in the upper bits of the split column in compiled models */
+#define COMPILED_CATEG_FLAG   ((uint32_t)1 << 31)
+#define COMPILED_NA_LEFT_FLAG ((uint32_t)1 << 30)
+#define COMPILED_COL_MASK     (COMPILED_NA_LEFT_FLAG - 1)
+
+#define PREDICTOR_MIN_ROWS_PARALLEL (size_t)64
+
+/* Discretized numeric columns for guided splits - the last bin is reserved for missing values */
+#define HIST_MAX_BINS (size_t)255
+#define HIST_NA_BIN   (uint8_t)255
+
+/* Nearest neighbors are taken from the candidates that share the most nodes with a row, this many per neighbor */
+#define KNN_CANDIDATES_PER_NEIGHBOR (size_t)8
+/* Nodes with more rows than this many times the number of candidates contribute an evenly-spaced subset of them */
+#define KNN_MAX_NODE_ROWS_PER_CANDIDATE (size_t)4
+
 /* Types used through the package */
 typedef enum  NewCategAction {Weighted, Smallest, Random}      NewCategAction; /* Weighted means Impute in the extended model */
 typedef enum  MissingAction  {Divide,   Impute,   Fail}        MissingAction;  /* Divide is only for non-extended model */
@@ -169,6 +202,9 @@ typedef enum  GainCriterion  {Averaged, Pooled,   NoCrit}      Criterion;      /
 typedef enum  CoefType       {Uniform,  Normal}                CoefType;       /* For extended model */
 typedef enum  UseDepthImp    {Lower,    Higher,   Same}        UseDepthImp;    /* For NA imputation */
 typedef enum  WeighImpRows   {Inverse,  Prop,     Flat}        WeighImpRows;   /* For NA imputation */
+typedef enum  NumericColFormat {ColFloat64, ColFloat32, ColFloat16, ColBFloat16,
+                                ColInt8,    ColUInt8,   ColInt16,   ColUInt16} NumericColFormat; /* For compiled models */
+typedef enum  MappedAccess   {NormalAccess, SequentialAccess, RandomAccess} MappedAccess; /* For memory-mapped data */
 
 /* Notes about new categorical action:
 *  - For single-variable case, if using 'Smallest', can then pass data at prediction time
@@ -381,6 +417,245 @@ typedef struct Imputer {
 
 } Imputer;
 
+/* Read-only version of a single-variable model, meant only for making predictions faster.
+   The nodes from all the trees are laid out in a single flat array, in breadth-first order
+   within each tree and with the two children of a node next to each other, keeping only
+   what's needed for traversal in the node itself, while the range limits (when using
+   'penalize_range') and the categorical splits are kept in separate arrays.
+   Obtained through function 'compile_isoforest'. */
+typedef struct CompiledNode {
+    double    split_point; /* holds the score in terminal nodes, and index in 'cat_splits' for categorical */
+    uint32_t  col_num;     /* holds the terminal node number in terminal nodes, has flags in the upper bits otherwise */
+    uint32_t  child_left;  /* right child is 'child_left + 1', zero for terminal nodes */
+
+    #ifdef _ENABLE_CEREAL
+    template<class Archive>
+    void serialize(Archive &archive)
+    {
+        archive(
+            this->split_point,
+            this->col_num,
+            this->child_left
+            );
+    }
+    #endif
+
+    CompiledNode() = default;
+} CompiledNode;
+
+typedef struct CompiledCategSplit {
+    uint32_t  offset;      /* position in 'cat_bits' where the bitset for this node starts */
+    int       ncat;        /* number of categories in the bitset, zero when splitting by 'chosen_cat' */
+    int       chosen_cat;
+    bool      new_to_left; /* where categories beyond 'ncat' go */
+
+    #ifdef _ENABLE_CEREAL
+    template<class Archive>
+    void serialize(Archive &archive)
+    {
+        archive(
+            this->offset,
+            this->ncat,
+            this->chosen_cat,
+            this->new_to_left
+            );
+    }
+    #endif
+
+    CompiledCategSplit() = default;
+} CompiledCategSplit;
+
+typedef struct CompiledIsoForest {
+    std::vector<CompiledNode>        nodes;
+    std::vector<size_t>              tree_root;
+    std::vector<double>              range_low;  /* empty when the model has no range penalties */
+    std::vector<double>              range_high; /* empty when the model has no range penalties */
+    std::vector<CompiledCategSplit>  cat_splits;
+    std::vector<uint64_t>            cat_bits;
+    std::vector<NumericColFormat>    col_format; /* empty unless quantized through 'quantize_compiled_model' */
+    MissingAction     missing_action;
+    double            exp_avg_depth;
+
+    #ifdef _ENABLE_CEREAL
+    template<class Archive>
+    void serialize(Archive &archive)
+    {
+        archive(
+            this->nodes,
+            this->tree_root,
+            this->range_low,
+            this->range_high,
+            this->cat_splits,
+            this->cat_bits,
+            this->col_format,
+            this->missing_action,
+            this->exp_avg_depth
+            );
+    }
+    #endif
+
+    CompiledIsoForest() = default;
+} CompiledIsoForest;
+
+/* Read-only version of an extended model, meant only for making predictions faster, laid out
+   in the same way as 'CompiledIsoForest'. The column indices and coefficients of each node are
+   contiguous in 'col_num' and 'coef', and the means of the columns are already accounted for in
+   the split points, range limits and imputation values, so that a node only needs a dot product.
+   Only supports models without categorical columns. Obtained through 'compile_ext_isoforest'. */
+typedef struct CompiledHPlane {
+    double    split_point; /* holds the score in terminal nodes */
+    uint32_t  col_st;      /* position of the first column in 'col_num' and 'coef', holds the terminal node number in terminal nodes */
+    uint32_t  ncols;
+    uint32_t  child_left;  /* right child is 'child_left + 1', zero for terminal nodes */
+
+    #ifdef _ENABLE_CEREAL
+    template<class Archive>
+    void serialize(Archive &archive)
+    {
+        archive(
+            this->split_point,
+            this->col_st,
+            this->ncols,
+            this->child_left
+            );
+    }
+    #endif
+
+    CompiledHPlane() = default;
+} CompiledHPlane;
+
+typedef struct CompiledExtIsoForest {
+    std::vector<CompiledHPlane>  hplanes;
+    std::vector<size_t>          tree_root;
+    std::vector<uint32_t>        col_num;
+    std::vector<double>          coef;
+    std::vector<double>          fill_val;   /* empty when the model doesn't impute missing values */
+    std::vector<double>          range_low;  /* empty when the model has no range penalties */
+    std::vector<double>          range_high; /* empty when the model has no range penalties */
+    MissingAction     missing_action;
+    double            exp_avg_depth;
+
+    #ifdef _ENABLE_CEREAL
+    template<class Archive>
+    void serialize(Archive &archive)
+    {
+        archive(
+            this->hplanes,
+            this->tree_root,
+            this->col_num,
+            this->coef,
+            this->fill_val,
+            this->range_low,
+            this->range_high,
+            this->missing_action,
+            this->exp_avg_depth
+            );
+    }
+    #endif
+
+    CompiledExtIsoForest() = default;
+} CompiledExtIsoForest;
+
+/* Mapping from the node indices in the trees of a model to the numbers of their terminal nodes, as output
+   in 'tree_num' by the prediction functions, stored contiguously for all the trees. Terminal node numbers
+   start at zero in each tree, while 'terminal_offset' contains the position at which the terminal nodes of
+   each tree start when numbering them across all the trees (e.g. as columns of a leaf embedding).
+   Obtained through 'build_terminal_mapping', and needs to be rebuilt if the model gets modified. */
+typedef struct TerminalNodeMapping {
+    std::vector<size_t>  terminal_num;    /* terminal number of node 'node' from tree 'tree' is at 'node_offset[tree] + node' */
+    std::vector<size_t>  node_offset;     /* has one entry per tree plus one, last one being the total number of nodes */
+    std::vector<size_t>  terminal_offset; /* has one entry per tree plus one, last one being the total number of terminal nodes */
+
+    #ifdef _ENABLE_CEREAL
+    template<class Archive>
+    void serialize(Archive &archive)
+    {
+        archive(
+            this->terminal_num,
+            this->node_offset,
+            this->terminal_offset
+            );
+    }
+    #endif
+
+    TerminalNodeMapping() = default;
+} TerminalNodeMapping;
+
+/* Object for making predictions repeatedly on small batches of dense data (e.g. one row at a time) with
+   as little overhead as possible. Holds a compiled version of the model when it can be compiled, and
+   otherwise a mapping from tree nodes to terminal node numbers, so that predictions on it do not need to
+   allocate any memory. Batches with fewer than 'min_rows_parallel' rows are scored in the calling thread
+   without starting a parallel region. Keeps a pointer to the model from which it was created, which must
+   outlive it and must not be modified while it is in use. Obtained through 'prepare_predictor'. */
+typedef struct IsoForestPredictor {
+    IsoForest                         *model_outputs;
+    ExtIsoForest                      *model_outputs_ext;
+    bool                              is_compiled;
+    CompiledIsoForest                 compiled_model;
+    CompiledExtIsoForest              compiled_model_ext;
+    TerminalNodeMapping               terminal_mapping; /* empty when the model is compiled */
+    int                               nthreads;
+    size_t                            min_rows_parallel;
+
+    IsoForestPredictor() = default;
+} IsoForestPredictor;
+
+/* Read-only memory mapping of a matrix stored in raw binary files, in either dense column-major format
+   (a single file) or CSC format (one file each for values, row indices and column pointers). The data is
+   shared with every other process that maps the same files, and the pointers can be passed as inputs to
+   the fitting and prediction functions (e.g. 'values' as 'numeric_data' or 'Xc', 'indices' as 'Xc_ind').
+   When fitting to memory-mapped dense data, the OS is told ahead of time which pages contain the rows
+   that were sampled for each tree. Obtained through 'map_dense_matrix' or 'map_csc_matrix', and must
+   be released through 'unmap_matrix'. */
+typedef struct MappedMatrix {
+    void    *values  = NULL;  /* dense data, or non-zero values for CSC matrices */
+    void    *indices = NULL;  /* only for CSC matrices */
+    void    *indptr  = NULL;  /* only for CSC matrices */
+    size_t  values_bytes  = 0;
+    size_t  indices_bytes = 0;
+    size_t  indptr_bytes  = 0;
+    size_t  nrows = 0;
+    size_t  ncols = 0;
+    size_t  nnz   = 0;        /* only for CSC matrices */
+
+    MappedMatrix() = default;
+} MappedMatrix;
+
+/* Function that receives the tiles of distances produced by 'calc_similarity_tiled', as a row-major matrix
+   of 'nrows_tile' query rows (starting at 'row_st') by 'ncols_tile' reference rows (starting at 'col_st') */
+typedef void (*SimilarityTileCallback)(const double *tile, size_t row_st, size_t col_st,
+                                       size_t nrows_tile, size_t ncols_tile, void *callback_data);
+
+/* Terminal node in which each row of the data to which a model was fit falls in each tree, from which the
+   distances between those rows can be calculated without passing them through the trees again. Terminal
+   nodes are numbered as in 'tree_num' in the prediction functions, and are bit-packed using 'bits_per_leaf'
+   bits for each, with the largest number that fits in those bits standing for rows that do not end up in a
+   single terminal node. Obtained through 'build_training_leaf_index', and needs to be rebuilt if the model
+   gets modified. */
+typedef struct TrainingLeafIndex {
+    size_t                nrows = 0;
+    size_t                ntrees = 0;
+    size_t                bits_per_leaf = 0;
+    size_t                words_per_tree = 0;
+    std::vector<uint64_t> leaves;  /* the rows of tree 'tree' start at 'leaves[tree * words_per_tree]' */
+
+    #ifdef _ENABLE_CEREAL
+    template<class Archive>
+    void serialize(Archive &archive)
+    {
+        archive(
+            this->nrows,
+            this->ntrees,
+            this->bits_per_leaf,
+            this->words_per_tree,
+            this->leaves
+            );
+    }
+    #endif
+
+    TrainingLeafIndex() = default;
+} TrainingLeafIndex;
+
 
 /* Structs that are only used internally */
 template <class real_t, class sparse_ix>
@@ -392,6 +667,8 @@ struct InputData {
     int         max_categ;
     size_t      ncols_categ;
     size_t      nrows;
+    size_t      ld_numeric;   /* distance between the starts of consecutive columns */
+    size_t      ld_categ;     /* distance between the starts of consecutive columns */
     size_t      ncols_tot;
     real_t*     sample_weights;
     bool        weight_as_sample;
@@ -404,6 +681,12 @@ struct InputData {
     std::vector<double> btree_weights_init;  /* only when using weights for sampling */
     std::vector<char>   has_missing;         /* only used when producing missing imputations on-the-fly */
     size_t              n_missing;           /* only used when producing missing imputations on-the-fly */
+    std::vector<uint8_t> binned_numeric;     /* only when using histograms for guided splits */
+    size_t               nbins;              /* only when using histograms for guided splits */
+    bool                 presort_numeric;    /* whether to keep the numeric columns sorted in each tree */
+    bool                 compact_nodes;      /* whether to copy the data of small nodes into contiguous buffers */
+    size_t*              tree_rows;          /* rows to take for each tree ('sample_size' per tree) instead of sampling them */
+    bool                 advise_rows;        /* whether to hint the OS about the pages with the rows of each tree (memory-mapped data) */
 };
 
 
@@ -415,6 +698,8 @@ struct PredictionData {
     bool        is_col_major;
     size_t      ncols_numeric; /* only required for row-major data */
     size_t      ncols_categ;   /* only required for row-major data */
+    size_t      ld_numeric;    /* distance between consecutive columns (col-major) or rows (row-major) */
+    size_t      ld_categ;      /* distance between consecutive columns (col-major) or rows (row-major) */
     real_t*     Xc;            /* only for sparse matrices */
     sparse_ix*  Xc_ind;        /* only for sparse matrices */
     sparse_ix*  Xc_indptr;     /* only for sparse matrices */
@@ -454,6 +739,8 @@ typedef struct {
     UseDepthImp   depth_imp;      /* only when building NA imputer */
     WeighImpRows  weigh_imp_rows; /* only when building NA imputer */
     size_t        min_imp_obs;    /* only when building NA imputer */
+
+    bool compensated_sums; /* only for extended model */
 } ModelParams;
 
 template <class sparse_ix=size_t>
@@ -519,6 +806,89 @@ public:
     ColumnSampler() = default;
 };
 
+/* Large subtrees are grown separately from the node where they hang, so that the same tree can be
+   split by multiple threads at once. Each one gets its own random seed and is joined back into the
+   tree once all threads are done, so the result does not depend on how many threads there are. */
+typedef struct DeferredSubtree {
+    size_t                 tree_num;
+    size_t                 parent;      /* deferred subtree from which it hangs, or SIZE_MAX if it's the tree itself */
+    size_t                 node;        /* node in the parent which is to be replaced by this subtree */
+    size_t                 depth;
+    uint64_t               seed;
+    std::vector<size_t>    ix_arr;
+    ColumnSampler          col_sampler;
+    std::vector<IsoTree>   trees;
+    std::vector<IsoHPlane> hplanes;
+} DeferredSubtree;
+
+/* Trees and deferred subtrees are handed to threads through one queue per thread. Each thread takes the
+   newest task from its own queue, and when it runs out, takes the oldest task from the queue of another
+   thread. Tasks are numbered with the trees first, followed by the subtrees in the order they were deferred. */
+class TreeScheduler {
+public:
+    std::deque<DeferredSubtree>      subtrees;
+    std::vector<std::deque<size_t>>  tasks;
+    std::unique_ptr<std::mutex[]>    tasks_lock;
+    std::mutex                       subtrees_lock;
+    std::atomic<size_t>              n_unfinished; /* tasks that have not yet been completed */
+    size_t                           ntrees;
+    size_t                           min_size;     /* minimum number of rows in order to grow a subtree separately */
+
+    TreeScheduler(size_t ntrees, size_t nthreads, size_t min_size);
+    DeferredSubtree* add_subtree(DeferredSubtree &subtree, size_t thread_num);
+    DeferredSubtree& get_subtree(size_t subtree_num);
+    bool get_task(size_t thread_num, size_t &task);
+    void finish_task();
+};
+
+/* Rows for each tree are sampled from a stream of data through weighted reservoirs, following algorithm
+   A-ExpJ from Efraimidis & Spirakis: each row gets a random key u^(1/w), a reservoir keeps the rows with the
+   largest keys, and the amount of weight to skip until the next row that enters it is drawn from the smallest
+   key in it, so most rows of a large stream are never looked at. Keys are kept as logarithms so that they do
+   not underflow with small weights. When sampling with replacement, each row of the sample is a reservoir of
+   size one. Rows are identified by their position in the stream. */
+class StreamReservoirs {
+public:
+    size_t     n_reservoirs;
+    size_t     res_size;
+    size_t     n_filled;
+    std::vector<std::pair<double, size_t>> keys;       /* (log-key, row), as min-heaps of 'res_size' per reservoir */
+    std::vector<std::pair<double, size_t>> next_take;  /* min-heap of (cumulative weight of next row to take, reservoir) */
+    std::vector<size_t> rows_taken;                    /* rows taken from the last chunk */
+    RNG_engine rnd_generator;
+
+    void initialize(size_t n_reservoirs, size_t res_size, uint64_t seed);
+    void take_rows(double weights[], double cum_weights[], size_t n, size_t row_st);
+};
+
+class RecursionState {
+public:
+    size_t  st;
+    size_t  st_NA;
+    size_t  end_NA;
+    size_t  split_ix;
+    size_t  end;
+    size_t  sampler_pos;
+    size_t  n_dropped;
+    bool    full_state;
+    std::vector<size_t> ix_arr;
+    std::vector<bool>   cols_possible;
+    std::vector<double> col_sampler_weights;
+    std::vector<double> weights_arr;
+
+    template <class WorkerMemory>
+    void save_state(WorkerMemory &workspace, bool full_state);
+    template <class WorkerMemory>
+    void restore_state(WorkerMemory &workspace);
+};
+
+/* node whose right branch is to be followed after finishing the left one */
+struct PendingBranch {
+    size_t node;
+    size_t depth;             /* the state to restore is 'recursion_states[depth]' */
+    DeferredSubtree *subtree; /* non-NULL if the branch is grown separately */
+};
+
 template <class ImputedData>
 struct WorkerMemory {
     std::vector<size_t>  ix_arr;
@@ -577,9 +947,26 @@ struct WorkerMemory {
     std::uniform_real_distribution<double> coef_unif;
     std::normal_distribution<double>       coef_norm;
     std::vector<double> sample_weights; /* when using weights and split criterion */
-
-    /* for similarity/distance calculations */
-    std::vector<double> tmat_sep;
+    std::vector<double> buffer_hist;    /* when using histograms for guided splits */
+    std::vector<size_t> presorted_ix;   /* when keeping the numeric columns sorted, one range per column */
+    std::vector<size_t> presorted_pos;  /* position of each numeric column in 'presorted_ix' */
+    std::vector<size_t> presorted_cols;
+    std::vector<char>   goes_left;
+    std::vector<size_t> buffer_presort;
+    bool                compact_active;  /* when inside a subtree whose data is in the buffers below */
+    size_t              compact_st;
+    size_t              compact_end;
+    std::vector<size_t> compact_rows;
+    std::vector<size_t> compact_col_pos;
+    std::vector<double> compact_numeric;
+    std::vector<float>  compact_numeric_flt;
+    std::vector<int>    compact_categ;
+    std::vector<bool>   col_is_taken;
+    std::unordered_set<size_t> col_is_taken_s;
+
+    /* for similarity/distance calculations, pointing to the output matrix shared by all threads */
+    double *tmat_sep = NULL;
+    bool    tmat_atomic = false;
 
     /* when calculating average depth on-the-fly */
     std::vector<double> row_depths;
@@ -588,42 +975,56 @@ struct WorkerMemory {
     std::vector<ImputedData> impute_vec;
     std::unordered_map<size_t, ImputedData> impute_map;
 
+    /* states saved before following the left branch, one per depth level */
+    std::deque<RecursionState> recursion_states;
+    std::vector<PendingBranch> pending_branches;
+
+    /* when growing subtrees in parallel */
+    TreeScheduler *scheduler = NULL;
+    size_t         thread_num;
+    size_t         curr_tree;
+    size_t         curr_subtree;  /* SIZE_MAX when growing the tree from its root */
+
 };
 
+/* Nodes of all the trees in a model, with the rows that fall into each terminal node stored contiguously
+   and the terminal nodes of each tree ordered as in a depth-first traversal, so that the rows under any
+   node form a single range. Used for finding nearest neighbors without calculating all pairwise distances. */
+typedef struct NodeRowIndex {
+    size_t              ntrees;
+    std::vector<size_t> node_offset;   /* node 'node' of tree 'tree' is at 'node_offset[tree] + node' */
+    std::vector<size_t> parent;
+    std::vector<size_t> depth;
+    std::vector<uint64_t> path;        /* branches taken from the root as bits from the highest one, up to depth 64 */
+    std::vector<double> terminal_sep;  /* separation depth of pairs in the same terminal node, negative if non-terminal */
+    std::vector<size_t> rows_st;       /* rows under each node are 'rows[rows_st[node]:rows_end[node]]' */
+    std::vector<size_t> rows_end;
+    std::vector<size_t> rows;
+    std::vector<size_t> row_nodes;     /* node of each row in each tree, at 'row_nodes[row * ntrees + tree]' */
+} NodeRowIndex;
+
+typedef struct WorkerForKNN {
+    std::vector<double> shared_depth;  /* depth of the nodes shared with the current row, summed across trees */
+    std::vector<size_t> candidates;
+    std::vector<std::pair<double, size_t>> sep_depth;
+} WorkerForKNN;
+
 typedef struct WorkerForSimilarity {
     std::vector<size_t> ix_arr;
     size_t              st;
     size_t              end;
     std::vector<double> weights_arr;
     std::vector<double> comb_val;
-    std::vector<double> tmat_sep;
-    std::vector<double> rmat;
+    double             *tmat;     /* output shared by all workers, each adding only into its own block */
+    double             *rmat;
+    size_t              row_st;   /* block of rows of 'tmat' or 'rmat' that this worker adds into */
+    size_t              row_end;
+    size_t              col_st;   /* block of columns of 'rmat', as indices of the rows in the data */
+    size_t              col_end;
     size_t              n_from;
     bool                assume_full_distr; /* doesn't need to have one copy per worker */
 } WorkerForSimilarity;
 
-class RecursionState {
-public:
-    size_t  st;
-    size_t  st_NA;
-    size_t  end_NA;
-    size_t  split_ix;
-    size_t  end;
-    size_t  sampler_pos;
-    size_t  n_dropped;
-    bool    full_state;
-    std::vector<size_t> ix_arr;
-    std::vector<bool>   cols_possible;
-    std::vector<double> col_sampler_weights;
-    std::unique_ptr<double[]> weights_arr;
-
-    RecursionState() = default;
-    template <class WorkerMemory>
-    RecursionState(WorkerMemory &workspace, bool full_state);
-    template <class WorkerMemory>
-    void restore_state(WorkerMemory &workspace);
-};
-
 /* Function prototypes */
 
 /* fit_model.cpp */
@@ -631,6 +1032,7 @@ template <class real_t, class sparse_ix>
 int fit_iforest(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
                 real_t numeric_data[],  size_t ncols_numeric,
                 int    categ_data[],    size_t ncols_categ,    int ncat[],
+                size_t ld_numeric,      size_t ld_categ,
                 real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
                 size_t ndim, size_t ntry, CoefType coef_type, bool coef_by_prop,
                 real_t sample_weights[], bool with_replacement, bool weight_as_sample,
@@ -642,12 +1044,37 @@ int fit_iforest(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
                 real_t col_weights[], bool weigh_by_kurt,
                 double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
                 double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
-                double min_gain, MissingAction missing_action,
+                double min_gain, size_t max_bins, bool compensated_sums, MissingAction missing_action,
                 CategSplit cat_split_type, NewCategAction new_cat_action,
                 bool   all_perm, Imputer *imputer, size_t min_imp_obs,
                 UseDepthImp depth_imp, WeighImpRows weigh_imp_rows, bool impute_at_fit,
                 uint64_t random_seed, int nthreads);
 template <class real_t, class sparse_ix>
+int fit_iforest_internal(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                         InputData<real_t, sparse_ix> &input_data, ModelParams &model_params,
+                         size_t max_bins, bool standardize_dist, double tmat[],
+                         double output_depths[], bool standardize_depth,
+                         Imputer *imputer, int nthreads);
+template <class real_t>
+int fit_iforest_stream(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                       size_t (*read_chunk)(void *reader_state, real_t numeric_data[], int categ_data[],
+                                            real_t sample_weights[], size_t max_rows),
+                       void *reader_state, size_t chunk_size,
+                       size_t ncols_numeric, size_t ncols_categ, int ncat[],
+                       size_t ndim, size_t ntry, CoefType coef_type, bool coef_by_prop,
+                       bool has_weights, bool with_replacement, bool weight_as_sample,
+                       size_t sample_size, size_t ntrees,
+                       size_t max_depth, size_t ncols_per_tree,
+                       bool   limit_depth, bool penalize_range,
+                       real_t col_weights[], bool weigh_by_kurt,
+                       double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
+                       double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
+                       double min_gain, size_t max_bins, bool compensated_sums, MissingAction missing_action,
+                       CategSplit cat_split_type, NewCategAction new_cat_action,
+                       bool   all_perm, Imputer *imputer, size_t min_imp_obs,
+                       UseDepthImp depth_imp, WeighImpRows weigh_imp_rows,
+                       uint64_t random_seed, int nthreads);
+template <class real_t, class sparse_ix>
 int add_tree(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
              real_t numeric_data[],  size_t ncols_numeric,
              int    categ_data[],    size_t ncols_categ,    int ncat[],
@@ -672,24 +1099,43 @@ void fit_itree(std::vector<IsoTree>    *tree_root,
                ModelParams              &model_params,
                std::vector<ImputeNode> *impute_nodes,
                size_t                   tree_num);
+template <class InputData, class WorkerMemory>
+void initialize_split_buffers(WorkerMemory &workspace, InputData &input_data, ModelParams &model_params, bool is_hplane);
+template <class InputData, class WorkerMemory>
+void grow_deferred_subtree(DeferredSubtree &subtree, size_t subtree_num, WorkerMemory &workspace,
+                           InputData &input_data, ModelParams &model_params, bool is_hplane);
 
 /* isoforest.cpp */
 template <class InputData, class WorkerMemory>
-void split_itree_recursive(std::vector<IsoTree>     &trees,
-                           WorkerMemory             &workspace,
-                           InputData                &input_data,
-                           ModelParams              &model_params,
-                           std::vector<ImputeNode> *impute_nodes,
-                           size_t                   curr_depth);
+void grow_itree(std::vector<IsoTree>     &trees,
+                WorkerMemory             &workspace,
+                InputData                &input_data,
+                ModelParams              &model_params,
+                std::vector<ImputeNode> *impute_nodes,
+                size_t                   curr_depth);
+template <class InputData, class WorkerMemory>
+bool split_itree_node(std::vector<IsoTree>     &trees,
+                      WorkerMemory             &workspace,
+                      InputData                &input_data,
+                      ModelParams              &model_params,
+                      std::vector<ImputeNode> *impute_nodes,
+                      size_t                   curr_depth);
 
 /* extended.cpp */
 template <class InputData, class WorkerMemory>
-void split_hplane_recursive(std::vector<IsoHPlane>   &hplanes,
-                            WorkerMemory             &workspace,
-                            InputData                &input_data,
-                            ModelParams              &model_params,
-                            std::vector<ImputeNode> *impute_nodes,
-                            size_t                   curr_depth);
+void grow_hplanes(std::vector<IsoHPlane>   &hplanes,
+                  WorkerMemory             &workspace,
+                  InputData                &input_data,
+                  ModelParams              &model_params,
+                  std::vector<ImputeNode> *impute_nodes,
+                  size_t                   curr_depth);
+template <class InputData, class WorkerMemory>
+bool split_hplane_node(std::vector<IsoHPlane>   &hplanes,
+                       WorkerMemory             &workspace,
+                       InputData                &input_data,
+                       ModelParams              &model_params,
+                       std::vector<ImputeNode> *impute_nodes,
+                       size_t                   curr_depth);
 template <class InputData, class WorkerMemory>
 void add_chosen_column(WorkerMemory &workspace, InputData &input_data, ModelParams &model_params,
                        std::vector<bool> &col_is_taken, std::unordered_set<size_t> &col_is_taken_s);
@@ -702,11 +1148,44 @@ void simplify_hplane(IsoHPlane &hplane, WorkerMemory &workspace, InputData &inpu
 template <class real_t, class sparse_ix>
 void predict_iforest(real_t numeric_data[], int categ_data[],
                      bool is_col_major, size_t ncols_numeric, size_t ncols_categ,
+                     size_t ld_numeric, size_t ld_categ,
                      real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
                      real_t Xr[], sparse_ix Xr_ind[], sparse_ix Xr_indptr[],
                      size_t nrows, int nthreads, bool standardize,
                      IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
-                     double output_depths[],   sparse_ix tree_num[]);
+                     double output_depths[],   sparse_ix tree_num[],
+                     TerminalNodeMapping *terminal_mapping);
+template <class real_t, class sparse_ix>
+void predict_iforest_threshold(real_t numeric_data[], int categ_data[],
+                               bool is_col_major, size_t ncols_numeric, size_t ncols_categ,
+                               size_t ld_numeric, size_t ld_categ,
+                               real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                               real_t Xr[], sparse_ix Xr_ind[], sparse_ix Xr_indptr[],
+                               size_t nrows, int nthreads, double threshold, bool standardize,
+                               IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                               bool output_is_outlier[], sparse_ix ntrees_used[]);
+template <class PredictionData>
+bool can_use_fast_traversal(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext, PredictionData &prediction_data);
+template <class PredictionData, class sparse_ix>
+void add_tree_depth(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                    PredictionData &prediction_data, bool use_fast_path,
+                    size_t tree, size_t row, double &output_depth, sparse_ix *restrict tree_num);
+template <class real_t, class sparse_ix>
+void predict_iforest_compiled(real_t numeric_data[], int categ_data[],
+                              bool is_col_major, size_t ncols_numeric, size_t ncols_categ,
+                              size_t ld_numeric, size_t ld_categ,
+                              size_t nrows, int nthreads, bool standardize,
+                              CompiledIsoForest *compiled_model, CompiledExtIsoForest *compiled_model_ext,
+                              double output_depths[], sparse_ix tree_num[]);
+template <class real_t, class sparse_ix>
+void predict_iforest_predictor(IsoForestPredictor &predictor,
+                               real_t numeric_data[], int categ_data[],
+                               bool is_col_major, size_t ncols_numeric, size_t ncols_categ,
+                               size_t nrows, bool standardize,
+                               double output_depths[], sparse_ix tree_num[]);
+template <class sparse_ix>
+void predict_iforest_mixed(void *numeric_cols[], int categ_data[], size_t nrows, int nthreads, bool standardize,
+                           CompiledIsoForest &compiled_model, double output_depths[], sparse_ix tree_num[]);
 template <class PredictionData, class sparse_ix>
 void traverse_itree_no_recurse(std::vector<IsoTree>  &tree,
                                IsoForest             &model_outputs,
@@ -714,6 +1193,62 @@ void traverse_itree_no_recurse(std::vector<IsoTree>  &tree,
                                double                &output_depth,
                                sparse_ix *restrict   tree_num,
                                size_t                row);
+template <class real_t>
+size_t get_compiled_rows_per_group(CompiledIsoForest *compiled_model, real_t *numeric_data, size_t col_stride);
+template <class real_t, class sparse_ix>
+void predict_compiled_rows(real_t *restrict numeric_data, int *restrict categ_data,
+                           bool is_col_major, size_t ld_numeric, size_t ld_categ, size_t nrows,
+                           size_t row_st, size_t row_end, size_t rows_per_group,
+                           CompiledIsoForest *compiled_model, CompiledExtIsoForest *compiled_model_ext,
+                           double *restrict output_depths, sparse_ix *restrict tree_num);
+template <class real_t>
+void traverse_compiled_itree(CompiledIsoForest     &compiled_model,
+                             size_t                tree,
+                             real_t *restrict      numeric_row,
+                             int    *restrict      categ_row,
+                             size_t                numeric_stride,
+                             size_t                categ_stride,
+                             double                &output_depth,
+                             size_t                &terminal_node);
+void traverse_compiled_itree_mixed(CompiledIsoForest     &compiled_model,
+                                   size_t                tree,
+                                   void                  *numeric_cols[],
+                                   int    *restrict      categ_data,
+                                   size_t                nrows,
+                                   size_t                row,
+                                   double                &output_depth,
+                                   size_t                &terminal_node);
+#ifdef HAS_AVX2_DISPATCH
+template <class real_t>
+__attribute__((target("avx2")))
+void traverse_compiled_itree_avx2(CompiledIsoForest     &compiled_model,
+                                  size_t                tree,
+                                  real_t *restrict      numeric_data,
+                                  size_t                row_st,
+                                  size_t                row_step,
+                                  size_t                col_stride,
+                                  double *restrict      output_depths,
+                                  size_t *restrict      terminal_nodes);
+#endif
+template <class real_t>
+void traverse_compiled_hplane(CompiledExtIsoForest  &compiled_model_ext,
+                              size_t                tree,
+                              real_t *restrict      numeric_row,
+                              size_t                col_stride,
+                              double                &output_depth,
+                              size_t                &terminal_node);
+#ifdef HAS_AVX2_DISPATCH
+template <class real_t>
+__attribute__((target("avx2")))
+void traverse_compiled_hplane_avx2(CompiledExtIsoForest  &compiled_model_ext,
+                                   size_t                tree,
+                                   real_t *restrict      numeric_data,
+                                   size_t                row_st,
+                                   size_t                row_step,
+                                   size_t                col_stride,
+                                   double *restrict      output_depths,
+                                   size_t *restrict      terminal_nodes);
+#endif
 template <class PredictionData, class sparse_ix, class ImputedData>
 double traverse_itree(std::vector<IsoTree>     &tree,
                       IsoForest                &model_outputs,
@@ -725,6 +1260,19 @@ double traverse_itree(std::vector<IsoTree>     &tree,
                       sparse_ix *restrict      tree_num,
                       size_t                   curr_lev);
 template <class PredictionData, class sparse_ix>
+void traverse_itree_csc(std::vector<IsoTree>     &tree,
+                        IsoForest                &model_outputs,
+                        PredictionData           &prediction_data,
+                        size_t *restrict         ix_arr,
+                        size_t *restrict         buffer,
+                        double *restrict         range_penalty,
+                        size_t                   row_offset,
+                        size_t                   st,
+                        size_t                   end,
+                        size_t                   curr_lev,
+                        double *restrict         output_depths,
+                        sparse_ix *restrict      tree_num);
+template <class PredictionData, class sparse_ix>
 void traverse_hplane_fast(std::vector<IsoHPlane>  &hplane,
                           ExtIsoForest            &model_outputs,
                           PredictionData          &prediction_data,
@@ -744,11 +1292,24 @@ template <class PredictionData>
 double extract_spC(PredictionData &prediction_data, size_t row, size_t col_num);
 template <class PredictionData, class sparse_ix>
 double extract_spR(PredictionData &prediction_data, sparse_ix *row_st, sparse_ix *row_end, size_t col_num);
+void get_tree_depth_bounds(std::vector<IsoTree> &tree, double &min_depth, double &max_depth, std::vector<double> &node_penalty);
+void get_tree_depth_bounds(std::vector<IsoHPlane> &hplanes, double &min_depth, double &max_depth, std::vector<double> &node_penalty);
+template <class sparse_ix>
+void get_leaf_embedding(sparse_ix tree_num[], size_t nrows, TerminalNodeMapping &terminal_mapping, int nthreads,
+                        sparse_ix indptr[], sparse_ix indices[]);
 template <class sparse_ix>
 void get_num_nodes(IsoForest &model_outputs, sparse_ix *restrict n_nodes, sparse_ix *restrict n_terminal, int nthreads);
 template <class sparse_ix>
 void get_num_nodes(ExtIsoForest &model_outputs, sparse_ix *restrict n_nodes, sparse_ix *restrict n_terminal, int nthreads);
 
+/* compile_model.hpp */
+void compile_isoforest(IsoForest &model_outputs, CompiledIsoForest &compiled_model);
+void compile_ext_isoforest(ExtIsoForest &model_outputs_ext, CompiledExtIsoForest &compiled_model_ext);
+void quantize_compiled_model(CompiledIsoForest &compiled_model, size_t ncols_numeric,
+                             NumericColFormat col_format[], double col_scale[], double col_offset[]);
+void prepare_predictor(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext, int nthreads,
+                       IsoForestPredictor &predictor);
+
 /* dist.cpp */
 template <class real_t, class sparse_ix>
 void calc_similarity(real_t numeric_data[], int categ_data[],
@@ -756,6 +1317,96 @@ void calc_similarity(real_t numeric_data[], int categ_data[],
                      size_t nrows, int nthreads, bool assume_full_distr, bool standardize_dist,
                      IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
                      double tmat[], double rmat[], size_t n_from);
+template <class real_t, class sparse_ix>
+void calc_similarity_knn(real_t numeric_data[], int categ_data[],
+                         real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                         size_t nrows, int nthreads, bool assume_full_distr, bool standardize_dist,
+                         IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                         size_t k, sparse_ix knn_indptr[], sparse_ix knn_indices[], double knn_dist[]);
+template <class sparse_ix>
+void find_knn_from_node_index(NodeRowIndex &node_index, int nthreads, bool standardize_dist, double div_trees,
+                              size_t k, sparse_ix knn_indptr[], sparse_ix knn_indices[], double knn_dist[]);
+double similarity_divisor(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext, size_t nrows, bool assume_full_distr);
+template <class real_t, class sparse_ix>
+void calc_similarity_tiled(real_t numeric_data[], int categ_data[],
+                           bool is_col_major, size_t ncols_numeric, size_t ncols_categ,
+                           real_t Xr[], sparse_ix Xr_ind[], sparse_ix Xr_indptr[],
+                           size_t nrows,
+                           real_t ref_numeric_data[], int ref_categ_data[],
+                           real_t ref_Xr[], sparse_ix ref_Xr_ind[], sparse_ix ref_Xr_indptr[],
+                           size_t nrows_ref,
+                           size_t tile_rows, size_t tile_cols,
+                           int nthreads, bool assume_full_distr, bool standardize_dist,
+                           IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                           SimilarityTileCallback callback, void *callback_data);
+template <class real_t, class sparse_ix>
+void get_leaf_signatures(real_t numeric_data[], int categ_data[],
+                         bool is_col_major, size_t ncols_numeric, size_t ncols_categ,
+                         real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                         real_t Xr[], sparse_ix Xr_ind[], sparse_ix Xr_indptr[],
+                         size_t nrows, int nthreads,
+                         IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                         uint64_t signatures[]);
+uint64_t make_signature(uint64_t path, size_t depth);
+size_t signature_depth(uint64_t signature);
+double signature_separation_depth(const uint64_t *restrict signature1, const uint64_t *restrict signature2, size_t ntrees);
+void calc_similarity_from_signatures(const uint64_t signatures[], size_t nrows, size_t ntrees, int nthreads,
+                                     bool standardize_dist, double tmat[], double rmat[], size_t n_from);
+void get_signature_buckets(const uint64_t signatures[], size_t nrows, size_t ntrees,
+                           size_t trees_per_band, size_t prefix_depth, int nthreads,
+                           uint64_t buckets[]);
+uint64_t hash_signature(uint64_t hash, uint64_t signature);
+template <class real_t, class sparse_ix>
+void build_training_leaf_index(real_t numeric_data[], int categ_data[],
+                               real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                               size_t nrows, int nthreads,
+                               IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                               TrainingLeafIndex &leaf_index);
+void set_packed_leaf(TrainingLeafIndex &leaf_index, size_t tree, size_t row, uint64_t leaf);
+uint64_t get_packed_leaf(const TrainingLeafIndex &leaf_index, size_t tree, size_t row);
+void get_leaf_index_nodes(TrainingLeafIndex &leaf_index, IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                          NodeRowIndex &node_index, size_t row_nodes[], bool tree_major, int nthreads);
+void calc_similarity_from_leaf_index(TrainingLeafIndex &leaf_index,
+                                     IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                                     int nthreads, bool assume_full_distr, bool standardize_dist,
+                                     double tmat[], double rmat[], size_t n_from);
+template <class sparse_ix>
+void calc_similarity_knn_from_leaf_index(TrainingLeafIndex &leaf_index,
+                                         IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                                         int nthreads, bool assume_full_distr, bool standardize_dist,
+                                         size_t k, sparse_ix knn_indptr[], sparse_ix knn_indices[], double knn_dist[]);
+template <class real_t, class sparse_ix>
+void build_node_row_index(real_t numeric_data[], int categ_data[],
+                          real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                          size_t nrows, int nthreads, bool assume_full_distr,
+                          IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                          NodeRowIndex &node_index);
+void index_node_rows(NodeRowIndex &node_index, int nthreads, bool assume_full_distr,
+                     IsoForest *model_outputs, ExtIsoForest *model_outputs_ext);
+void init_node_index(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext, NodeRowIndex &node_index);
+template <class real_t, class sparse_ix>
+void get_row_nodes(real_t numeric_data[], int categ_data[],
+                   bool is_col_major, size_t ncols_numeric, size_t ncols_categ,
+                   size_t ld_numeric, size_t ld_categ,
+                   real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                   real_t Xr[], sparse_ix Xr_ind[], sparse_ix Xr_indptr[],
+                   size_t nrows, int nthreads,
+                   IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                   NodeRowIndex &node_index, size_t row_nodes[], bool tree_major);
+void build_node_number_mapping(NodeRowIndex &node_index, TerminalNodeMapping &node_numbers);
+template <class Node>
+void add_tree_to_node_index(std::vector<Node> &nodes, size_t tree, bool assume_full_distr, NodeRowIndex &node_index,
+                            const size_t *extra_rows);
+size_t shared_path_depth(NodeRowIndex &node_index, size_t node1, size_t node2);
+double pair_separation_depth(NodeRowIndex &node_index, size_t row1, size_t row2);
+double nodes_separation_depth(NodeRowIndex &node_index, const size_t *restrict nodes1, const size_t *restrict nodes2);
+void add_tree_separation_depths(NodeRowIndex &node_index, size_t node, const size_t *restrict other_nodes, size_t n,
+                                double *restrict sep_depth);
+size_t find_nearest_rows(NodeRowIndex &node_index, WorkerForKNN &workspace, size_t row, size_t k);
+size_t node_left(IsoTree &node);
+size_t node_left(IsoHPlane &node);
+size_t node_right(IsoTree &node);
+size_t node_right(IsoHPlane &node);
 template <class PredictionData>
 void traverse_tree_sim(WorkerForSimilarity   &workspace,
                        PredictionData        &prediction_data,
@@ -768,10 +1419,11 @@ void traverse_hplane_sim(WorkerForSimilarity     &workspace,
                          ExtIsoForest            &model_outputs,
                          std::vector<IsoHPlane>  &hplanes,
                          size_t                  curr_tree);
-template <class PredictionData, class InputData, class WorkerMemory>
-void gather_sim_result(std::vector<WorkerForSimilarity> *worker_memory,
-                       std::vector<WorkerMemory> *worker_memory_m,
-                       PredictionData *prediction_data, InputData *input_data,
+bool node_has_pairs_in_block(WorkerForSimilarity &workspace);
+void assign_sim_blocks(std::vector<WorkerForSimilarity> &worker_memory, size_t nrows, size_t n_from,
+                       double tmat[], double rmat[]);
+template <class PredictionData, class InputData>
+void gather_sim_result(PredictionData *prediction_data, InputData *input_data,
                        IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
                        double *restrict tmat, double *restrict rmat, size_t n_from,
                        size_t ntrees, bool assume_full_distr,
@@ -870,9 +1522,52 @@ template <class InputData, class WorkerMemory>
 void add_separation_step(WorkerMemory &workspace, InputData &input_data, double remainder);
 template <class InputData, class WorkerMemory>
 void add_remainder_separation_steps(WorkerMemory &workspace, InputData &input_data, long double sum_weight);
+void build_terminal_mapping(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext, TerminalNodeMapping &terminal_mapping);
+template <class sparse_ix>
+void map_terminal_nodes(TerminalNodeMapping &terminal_mapping, size_t tree,
+                        sparse_ix *restrict tree_num, size_t row_st, size_t row_end);
 template <class PredictionData, class sparse_ix>
 void remap_terminal_trees(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
                           PredictionData &prediction_data, sparse_ix *restrict tree_num, int nthreads);
+template <class WorkerMemory>
+RecursionState& get_recursion_state(WorkerMemory &workspace, size_t curr_depth);
+template <class WorkerMemory>
+DeferredSubtree* defer_subtree(WorkerMemory &workspace, size_t st, size_t end, size_t curr_depth);
+template <class InputData, class WorkerMemory>
+void build_presorted_cols(WorkerMemory &workspace, InputData &input_data);
+template <class WorkerMemory>
+size_t* get_presorted_col(WorkerMemory &workspace, size_t col);
+template <class WorkerMemory>
+void partition_presorted_cols(WorkerMemory &workspace, size_t split_pos);
+template <class InputData, class WorkerMemory>
+void update_compact_rows(WorkerMemory &workspace, InputData &input_data);
+template <class WorkerMemory>
+void restore_compact_rows(WorkerMemory &workspace);
+template <class WorkerMemory>
+std::vector<double>& get_compact_buffer(WorkerMemory &workspace, double*);
+template <class WorkerMemory>
+std::vector<float>& get_compact_buffer(WorkerMemory &workspace, float*);
+template <class WorkerMemory>
+std::vector<int>& get_compact_buffer(WorkerMemory &workspace, int*);
+template <class real_t, class WorkerMemory>
+real_t* get_compact_col(WorkerMemory &workspace, real_t *restrict x, size_t col);
+template <class real_t, class sparse_ix, class WorkerMemory>
+real_t* get_numeric_col(WorkerMemory &workspace, InputData<real_t, sparse_ix> &input_data, size_t col);
+template <class real_t, class sparse_ix, class WorkerMemory>
+int* get_categ_col(WorkerMemory &workspace, InputData<real_t, sparse_ix> &input_data, size_t col);
+size_t& get_left_child(IsoTree &node);
+size_t& get_right_child(IsoTree &node);
+size_t& get_left_child(IsoHPlane &node);
+size_t& get_right_child(IsoHPlane &node);
+std::vector<IsoTree>& get_subtree_nodes(DeferredSubtree &subtree, std::vector<IsoTree> &tree);
+std::vector<IsoHPlane>& get_subtree_nodes(DeferredSubtree &subtree, std::vector<IsoHPlane> &hplane);
+template <class Node>
+void append_joined_nodes(std::vector<Node> &joined, std::vector<Node> &nodes, size_t node,
+                         std::unordered_map<size_t, size_t> &deferred_here,
+                         std::vector<std::unordered_map<size_t, size_t>> &deferred_in_subtree,
+                         std::deque<DeferredSubtree> &subtrees);
+template <class Node>
+void join_deferred_subtrees(std::vector<std::vector<Node>> &trees, TreeScheduler &scheduler, int nthreads);
 
 
 /* utils.cpp */
@@ -890,19 +1585,53 @@ void increase_comb_counter(size_t ix_arr[], size_t st, size_t end, size_t n,
                            double *restrict counter, double *restrict weights, double exp_remainder);
 void increase_comb_counter(size_t ix_arr[], size_t st, size_t end, size_t n,
                            double counter[], std::unordered_map<size_t, double> &weights, double exp_remainder);
+void increase_comb_counter_in_rows(size_t ix_arr[], size_t st, size_t end, size_t n,
+                                   size_t row_st, size_t row_end, double counter[], double exp_remainder);
+void increase_comb_counter_in_rows(size_t ix_arr[], size_t st, size_t end, size_t n,
+                                   size_t row_st, size_t row_end,
+                                   double *restrict counter, double *restrict weights, double exp_remainder);
 void increase_comb_counter_in_groups(size_t ix_arr[], size_t st, size_t end, size_t split_ix, size_t n,
+                                     size_t from_st, size_t from_end, size_t to_st, size_t to_end,
                                      double counter[], double exp_remainder);
 void increase_comb_counter_in_groups(size_t ix_arr[], size_t st, size_t end, size_t split_ix, size_t n,
+                                     size_t from_st, size_t from_end, size_t to_st, size_t to_end,
                                      double *restrict counter, double *restrict weights, double exp_remainder);
+void increase_comb_counter_atomic(size_t ix_arr[], size_t st, size_t end, size_t n,
+                                  double counter[], double exp_remainder);
+void increase_comb_counter_atomic(size_t ix_arr[], size_t st, size_t end, size_t n,
+                                  double *restrict counter, double *restrict weights, double exp_remainder);
+void increase_comb_counter_atomic(size_t ix_arr[], size_t st, size_t end, size_t n,
+                                  double counter[], std::unordered_map<size_t, double> &weights, double exp_remainder);
 void tmat_to_dense(double *restrict tmat, double *restrict dmat, size_t n, bool diag_to_one);
+size_t get_predict_block_size(size_t nrows, int nthreads);
+bool cpu_has_avx2();
+#ifdef HAS_AVX2_DISPATCH
+__attribute__((target("avx2")))
+__m256d gather_rows_avx2(double *restrict x, size_t *restrict ix);
+__attribute__((target("avx2")))
+__m256d gather_rows_avx2(float *restrict x, size_t *restrict ix);
+#endif
+float half_to_float(uint16_t half);
+float bfloat16_to_float(uint16_t bfloat);
 template <class real_t=double>
 void build_btree_sampler(std::vector<double> &btree_weights, real_t *restrict sample_weights,
                          size_t nrows, size_t &log2_n, size_t &btree_offset);
+template <class InputData>
+void bin_numeric_columns(InputData &input_data, size_t max_bins, int nthreads);
+template <class InputData>
+bool should_presort_numeric(InputData &input_data, ModelParams &model_params);
+template <class InputData>
+bool should_compact_nodes(InputData &input_data, ModelParams &model_params, bool has_impute_nodes);
 template <class real_t=double>
 void sample_random_rows(std::vector<size_t> &ix_arr, size_t nrows, bool with_replacement,
                         RNG_engine &rnd_generator, std::vector<size_t> &ix_all,
                         real_t sample_weights[], std::vector<double> &btree_weights,
                         size_t log2_n, size_t btree_offset, std::vector<bool> &is_repeated);
+template <class real_t>
+void drop_unused_stream_rows(std::vector<StreamReservoirs> &reservoirs, std::vector<size_t> &kept_rows,
+                             std::vector<real_t> &kept_numeric, std::vector<int> &kept_categ,
+                             std::vector<real_t> &kept_weights, size_t ncols_numeric, size_t ncols_categ,
+                             bool keep_weights);
 template <class real_t=double>
 void weighted_shuffle(size_t *restrict outp, size_t n, real_t *restrict weights, double *restrict buffer_arr, RNG_engine &rnd_generator);
 size_t divide_subset_split(size_t ix_arr[], double x[], size_t st, size_t end, double split_point);
@@ -926,6 +1655,11 @@ void divide_subset_split(size_t ix_arr[], int x[], size_t st, size_t end,
 template <class real_t=double>
 void get_range(size_t ix_arr[], real_t x[], size_t st, size_t end,
                MissingAction missing_action, double &xmin, double &xmax, bool &unsplittable);
+#ifdef HAS_AVX2_DISPATCH
+template <class real_t>
+__attribute__((target("avx2")))
+void get_range_avx2(size_t *restrict ix_arr, real_t *restrict x, size_t st, size_t end, double &xmin, double &xmax);
+#endif
 template <class real_t, class sparse_ix>
 void get_range(size_t ix_arr[], size_t st, size_t end, size_t col_num,
                real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
@@ -972,12 +1706,24 @@ template <class real_t, class sparse_ix>
 void sort_csc_indices(real_t *restrict Xc, sparse_ix *restrict Xc_ind, sparse_ix *restrict Xc_indptr, size_t ncols_numeric);
 
 /* mult.cpp */
+#ifdef HAS_AVX2_DISPATCH
+template <bool compensated, bool squared, class real_t_>
+__attribute__((target("avx2")))
+size_t accumulate_lanes_avx2(size_t *restrict ix_arr, size_t st, size_t end, real_t_ *restrict x,
+                             double center, bool skip_NA, double *restrict sum, double *restrict err, size_t &cnt);
+#endif
+template <bool compensated, bool squared, class real_t_>
+void accumulate_lanes(size_t *restrict ix_arr, size_t st, size_t end, real_t_ *restrict x,
+                      double center, bool skip_NA, double *restrict sum, double *restrict err, size_t &cnt);
 template <class real_t, class real_t_>
 void calc_mean_and_sd_t(size_t ix_arr[], size_t st, size_t end, real_t_ *restrict x,
                         MissingAction missing_action, double &x_sd, double &x_mean);
+template <bool compensated, class real_t_>
+void calc_mean_and_sd_lanes(size_t ix_arr[], size_t st, size_t end, real_t_ *restrict x,
+                            MissingAction missing_action, double &x_sd, double &x_mean);
 template <class real_t_>
 void calc_mean_and_sd(size_t ix_arr[], size_t st, size_t end, real_t_ *restrict x,
-                      MissingAction missing_action, double &x_sd, double &x_mean);
+                      MissingAction missing_action, bool compensated_sums, double &x_sd, double &x_mean);
 template <class real_t_, class mapping>
 void calc_mean_and_sd_weighted(size_t ix_arr[], size_t st, size_t end, real_t_ *restrict x, mapping w,
                                MissingAction missing_action, double &x_sd, double &x_mean);
@@ -1103,6 +1849,16 @@ double eval_guided_crit_weighted(size_t *restrict ix_arr, size_t st, size_t end,
                                  size_t &split_ix, double &split_point, double &xmin, double &xmax,
                                  GainCriterion criterion, double min_gain, MissingAction missing_action,
                                  mapping w);
+template <class real_t_>
+double eval_guided_crit_sorted(size_t *restrict ix_arr, size_t st, size_t end, real_t_ *restrict x,
+                               double *restrict buffer_sd, bool as_relative_gain,
+                               size_t &split_ix, double &split_point, double &xmin, double &xmax,
+                               GainCriterion criterion, double min_gain);
+template <class real_t_, class mapping>
+double eval_guided_crit_sorted_weighted(size_t *restrict ix_arr, size_t st, size_t end, real_t_ *restrict x,
+                                        double *restrict buffer_sd, bool as_relative_gain,
+                                        size_t &split_ix, double &split_point, double &xmin, double &xmax,
+                                        GainCriterion criterion, double min_gain, mapping &w);
 template <class real_t_, class sparse_ix>
 double eval_guided_crit(size_t ix_arr[], size_t st, size_t end,
                         size_t col_num, real_t_ Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
@@ -1116,6 +1872,26 @@ double eval_guided_crit_weighted(size_t ix_arr[], size_t st, size_t end,
                                  double &split_point, double &xmin, double &xmax,
                                  GainCriterion criterion, double min_gain, MissingAction missing_action,
                                  mapping w);
+template <class real_t_, class mapping>
+double eval_guided_crit_binned_t(size_t *restrict ix_arr, size_t st, size_t end, real_t_ *restrict x,
+                                 uint8_t *restrict x_bin, size_t nbins, double *restrict buffer_hist,
+                                 double *restrict buffer_sd, bool as_relative_gain,
+                                 size_t &split_ix, double &split_point, double &xmin, double &xmax,
+                                 GainCriterion criterion, double min_gain, MissingAction missing_action,
+                                 mapping &w, bool weighted);
+template <class real_t_>
+double eval_guided_crit_binned(size_t *restrict ix_arr, size_t st, size_t end, real_t_ *restrict x,
+                               uint8_t *restrict x_bin, size_t nbins, double *restrict buffer_hist,
+                               double *restrict buffer_sd, bool as_relative_gain,
+                               size_t &split_ix, double &split_point, double &xmin, double &xmax,
+                               GainCriterion criterion, double min_gain, MissingAction missing_action);
+template <class real_t_, class mapping>
+double eval_guided_crit_binned_weighted(size_t *restrict ix_arr, size_t st, size_t end, real_t_ *restrict x,
+                                        uint8_t *restrict x_bin, size_t nbins, double *restrict buffer_hist,
+                                        double *restrict buffer_sd, bool as_relative_gain,
+                                        size_t &split_ix, double &split_point, double &xmin, double &xmax,
+                                        GainCriterion criterion, double min_gain, MissingAction missing_action,
+                                        mapping &w);
 double eval_guided_crit(size_t *restrict ix_arr, size_t st, size_t end, int *restrict x, int ncat,
                         size_t *restrict buffer_cnt, size_t *restrict buffer_pos, double *restrict buffer_prob,
                         int &chosen_cat, char *restrict split_categ, char *restrict buffer_split,
@@ -1154,6 +1930,12 @@ std::string serialize_imputer(Imputer &imputer);
 void deserialize_imputer(Imputer &output_obj, std::istream &serialized);
 void deserialize_imputer(Imputer &output_obj, const char *input_file_path);
 void deserialize_imputer(Imputer &output_obj, std::string &serialized, bool move_str);
+void serialize_training_leaf_index(TrainingLeafIndex &leaf_index, std::ostream &output);
+void serialize_training_leaf_index(TrainingLeafIndex &leaf_index, const char *output_file_path);
+std::string serialize_training_leaf_index(TrainingLeafIndex &leaf_index);
+void deserialize_training_leaf_index(TrainingLeafIndex &output_obj, std::istream &serialized);
+void deserialize_training_leaf_index(TrainingLeafIndex &output_obj, const char *input_file_path);
+void deserialize_training_leaf_index(TrainingLeafIndex &output_obj, std::string &serialized, bool move_str);
 #ifdef _MSC_VER
 void serialize_isoforest(IsoForest &model, const wchar_t *output_file_path);
 void deserialize_isoforest(IsoForest &output_obj, const wchar_t *input_file_path);
@@ -1161,6 +1943,8 @@ void serialize_ext_isoforest(ExtIsoForest &model, const wchar_t *output_file_pat
 void deserialize_ext_isoforest(ExtIsoForest &output_obj, const wchar_t *input_file_path);
 void serialize_imputer(Imputer &imputer, const wchar_t *output_file_path);
 void deserialize_imputer(Imputer &output_obj, const wchar_t *input_file_path);
+void serialize_training_leaf_index(TrainingLeafIndex &leaf_index, const wchar_t *output_file_path);
+void deserialize_training_leaf_index(TrainingLeafIndex &output_obj, const wchar_t *input_file_path);
 #endif /* _MSC_VER */
 bool has_msvc();
 #ifdef _FOR_PYTHON
@@ -1198,6 +1982,17 @@ void extract_cond_ext_isotree(ExtIsoForest &model, IsoHPlane &hplane,
                               std::vector<std::string> &numeric_colnames, std::vector<std::string> &categ_colnames,
                               std::vector<std::vector<std::string>> &categ_levels);
 
+/* mapped_data.cpp */
+void map_dense_matrix(const char *file_path, size_t nrows, size_t ncols, size_t bytes_per_value,
+                      MappedAccess access, MappedMatrix &mapped);
+void map_csc_matrix(const char *values_path, const char *indices_path, const char *indptr_path,
+                    size_t nrows, size_t ncols, size_t bytes_per_value, size_t bytes_per_index,
+                    MappedAccess access, MappedMatrix &mapped);
+void unmap_matrix(MappedMatrix &mapped);
+bool is_mapped_memory(const void *ptr);
+void advise_mapped_rows(const void *data, size_t bytes_per_value, size_t ld, size_t ncols,
+                        const size_t *ix_arr, size_t n);
+
 /* dealloc.cpp */
 void dealloc_IsoForest(IsoForest &model_outputs);
 void dealloc_IsoExtForest(ExtIsoForest &model_outputs_ext);
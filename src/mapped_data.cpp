@@ -0,0 +1,270 @@
+/*    Isolation forests and variations thereof, with adjustments for incorporation
+*     of categorical variables and missing values.
+*     Writen for C++11 standard and aimed at being used in R and Python.
+*     
+*     This library is based on the following works:
+*     [1] Liu, Fei Tony, Kai Ming Ting, and Zhi-Hua Zhou.
+*         "Isolation forest."
+*         2008 Eighth IEEE International Conference on Data Mining. IEEE, 2008.
+*     [2] Liu, Fei Tony, Kai Ming Ting, and Zhi-Hua Zhou.
+*         "Isolation-based anomaly detection."
+*         ACM Transactions on Knowledge Discovery from Data (TKDD) 6.1 (2012): 3.
+*     [3] Hariri, Sahand, Matias Carrasco Kind, and Robert J. Brunner.
+*         "Extended Isolation Forest."
+*         arXiv preprint arXiv:1811.02141 (2018).
+*     [4] Liu, Fei Tony, Kai Ming Ting, and Zhi-Hua Zhou.
+*         "On detecting clustered anomalies using SCiForest."
+*         Joint European Conference on Machine Learning and Knowledge Discovery in Databases. Springer, Berlin, Heidelberg, 2010.
+*     [5] https://sourceforge.net/projects/iforest/
+*     [6] https://math.stackexchange.com/questions/3388518/expected-number-of-paths-required-to-separate-elements-in-a-binary-tree
+*     [7] Quinlan, J. Ross. C4. 5: programs for machine learning. Elsevier, 2014.
+*     [8] Cortes, David. "Distance approximation using Isolation Forests." arXiv preprint arXiv:1910.12362 (2019).
+*     [9] Cortes, David. "Imputing missing values with unsupervised random trees." arXiv preprint arXiv:1911.06646 (2019).
+* 
+*     BSD 2-Clause License
+*     Copyright (c) 2019-2021, David Cortes
+*     All rights reserved.
+*     Redistribution and use in source and binary forms, with or without
+*     modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this
+*       list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice,
+*       this list of conditions and the following disclaimer in the documentation
+*       and/or other materials provided with the distribution.
+*     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+*     AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+*     IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+*     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+*     FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+*     DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+*     SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*     CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+*     OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+*     OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "isotree.hpp"
+
+/* The Windows headers conflict with some of R's macros, so R builds on Windows do not support this */
+#if defined(_WIN32) && !defined(_FOR_R)
+    #define MAP_WITH_WINAPI
+#endif
+
+#if defined(MAP_WITH_WINAPI)
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+#elif !defined(_WIN32)
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+/* Address ranges of the files that are currently mapped, so that the fitting procedures can
+   tell whether the data they receive is memory-mapped without changing their signatures. */
+static std::vector<std::pair<uintptr_t, uintptr_t>> mapped_ranges;
+static std::mutex mapped_ranges_mutex;
+
+static void register_mapping(void *ptr, size_t nbytes)
+{
+    std::lock_guard<std::mutex> lock(mapped_ranges_mutex);
+    mapped_ranges.emplace_back((uintptr_t)ptr, (uintptr_t)ptr + nbytes);
+}
+
+static void unregister_mapping(void *ptr)
+{
+    std::lock_guard<std::mutex> lock(mapped_ranges_mutex);
+    for (size_t ix = 0; ix < mapped_ranges.size(); ix++)
+    {
+        if (mapped_ranges[ix].first == (uintptr_t)ptr)
+        {
+            mapped_ranges.erase(mapped_ranges.begin() + ix);
+            return;
+        }
+    }
+}
+
+bool is_mapped_memory(const void *ptr)
+{
+    if (ptr == NULL) return false;
+    std::lock_guard<std::mutex> lock(mapped_ranges_mutex);
+    for (const auto &range : mapped_ranges)
+        if ((uintptr_t)ptr >= range.first && (uintptr_t)ptr < range.second)
+            return true;
+    return false;
+}
+
+static void* map_file(const char *file_path, size_t expected_bytes, MappedAccess access)
+{
+    if (!expected_bytes) return NULL;
+    void *ptr;
+
+    #if defined(MAP_WITH_WINAPI)
+    HANDLE file = CreateFileA(file_path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("Could not open file '" + std::string(file_path) + "'.\n");
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || (uint64_t)file_size.QuadPart != (uint64_t)expected_bytes)
+    {
+        CloseHandle(file);
+        throw std::runtime_error("Size of file '" + std::string(file_path) + "' does not match with the matrix dimensions.\n");
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL)
+        throw std::runtime_error("Could not map file '" + std::string(file_path) + "'.\n");
+    ptr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping); /* the view keeps the mapping alive */
+    if (ptr == NULL)
+        throw std::runtime_error("Could not map file '" + std::string(file_path) + "'.\n");
+
+    #elif defined(_WIN32)
+    throw std::runtime_error("Memory-mapped files are not supported in this build.\n");
+
+    #else
+    int fd = open(file_path, O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Could not open file '" + std::string(file_path) + "'.\n");
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || (uint64_t)file_stat.st_size != (uint64_t)expected_bytes)
+    {
+        close(fd);
+        throw std::runtime_error("Size of file '" + std::string(file_path) + "' does not match with the matrix dimensions.\n");
+    }
+    ptr = mmap(NULL, expected_bytes, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); /* the mapping keeps the file open */
+    if (ptr == MAP_FAILED)
+        throw std::runtime_error("Could not map file '" + std::string(file_path) + "'.\n");
+    switch (access)
+    {
+        case SequentialAccess: {madvise(ptr, expected_bytes, MADV_SEQUENTIAL); break;}
+        case RandomAccess:     {madvise(ptr, expected_bytes, MADV_RANDOM);     break;}
+        default:               {break;}
+    }
+    #endif
+
+    register_mapping(ptr, expected_bytes);
+    return ptr;
+}
+
+static void unmap_file(void *ptr, size_t nbytes)
+{
+    if (ptr == NULL) return;
+    unregister_mapping(ptr);
+    #if defined(MAP_WITH_WINAPI)
+    UnmapViewOfFile(ptr);
+    #elif !defined(_WIN32)
+    munmap(ptr, nbytes);
+    #endif
+}
+
+static size_t read_index(const void *indices, size_t bytes_per_index, size_t ix)
+{
+    if (bytes_per_index == sizeof(int))
+        return (size_t) ((const int*)indices)[ix];
+    else
+        return (size_t) ((const int64_t*)indices)[ix];
+}
+
+void map_dense_matrix(const char *file_path, size_t nrows, size_t ncols, size_t bytes_per_value,
+                      MappedAccess access, MappedMatrix &mapped)
+{
+    if (bytes_per_value != sizeof(double) && bytes_per_value != sizeof(float))
+        throw std::runtime_error("'bytes_per_value' must be 4 or 8.\n");
+    if (ncols && nrows > SIZE_MAX / ncols / bytes_per_value)
+        throw std::runtime_error("Matrix dimensions are too large.\n");
+
+    unmap_matrix(mapped);
+    mapped.values = map_file(file_path, nrows * ncols * bytes_per_value, access);
+    mapped.values_bytes = nrows * ncols * bytes_per_value;
+    mapped.nrows = nrows;
+    mapped.ncols = ncols;
+}
+
+void map_csc_matrix(const char *values_path, const char *indices_path, const char *indptr_path,
+                    size_t nrows, size_t ncols, size_t bytes_per_value, size_t bytes_per_index,
+                    MappedAccess access, MappedMatrix &mapped)
+{
+    if (bytes_per_value != sizeof(double) && bytes_per_value != sizeof(float))
+        throw std::runtime_error("'bytes_per_value' must be 4 or 8.\n");
+    if (bytes_per_index != sizeof(int) && bytes_per_index != sizeof(int64_t))
+        throw std::runtime_error("'bytes_per_index' must be 4 or 8.\n");
+
+    if (ncols >= SIZE_MAX / bytes_per_index)
+        throw std::runtime_error("Matrix dimensions are too large.\n");
+
+    unmap_matrix(mapped);
+    mapped.indptr = map_file(indptr_path, (ncols + 1) * bytes_per_index, NormalAccess);
+    mapped.indptr_bytes = (ncols + 1) * bytes_per_index;
+
+    /* negative entries become very large when read as 'size_t', so they are caught by the same checks */
+    size_t nnz = read_index(mapped.indptr, bytes_per_index, ncols);
+    bool valid_indptr = read_index(mapped.indptr, bytes_per_index, 0) == 0 && nnz <= SIZE_MAX / sizeof(double);
+    for (size_t col = 0; col < ncols && valid_indptr; col++)
+        valid_indptr = read_index(mapped.indptr, bytes_per_index, col) <= read_index(mapped.indptr, bytes_per_index, col + 1);
+    if (!valid_indptr)
+    {
+        unmap_matrix(mapped);
+        throw std::runtime_error("Invalid column pointers in file '" + std::string(indptr_path) + "'.\n");
+    }
+
+    try
+    {
+        mapped.indices = map_file(indices_path, nnz * bytes_per_index, access);
+        mapped.indices_bytes = nnz * bytes_per_index;
+        for (size_t ix = 0; ix < nnz; ix++)
+            if (read_index(mapped.indices, bytes_per_index, ix) >= nrows)
+                throw std::runtime_error("Invalid row indices in file '" + std::string(indices_path) + "'.\n");
+        mapped.values = map_file(values_path, nnz * bytes_per_value, access);
+        mapped.values_bytes = nnz * bytes_per_value;
+    }
+    catch (...)
+    {
+        unmap_matrix(mapped);
+        throw;
+    }
+    mapped.nrows = nrows;
+    mapped.ncols = ncols;
+    mapped.nnz = nnz;
+}
+
+void unmap_matrix(MappedMatrix &mapped)
+{
+    unmap_file(mapped.values, mapped.values_bytes);
+    unmap_file(mapped.indices, mapped.indices_bytes);
+    unmap_file(mapped.indptr, mapped.indptr_bytes);
+    mapped = MappedMatrix();
+}
+
+/* Tells the OS to start reading the pages that contain the given rows of a column-major array, so that
+   the page faults for a sub-sample are served in parallel instead of one at a time as the tree touches
+   them. Consecutive pages are requested together. */
+void advise_mapped_rows(const void *data, size_t bytes_per_value, size_t ld, size_t ncols,
+                        const size_t *ix_arr, size_t n)
+{
+    #ifndef _WIN32
+    static const uintptr_t page_size = (uintptr_t)sysconf(_SC_PAGESIZE);
+    std::vector<uintptr_t> pages(n);
+    for (size_t col = 0; col < ncols; col++)
+    {
+        uintptr_t col_start = (uintptr_t)data + col * ld * bytes_per_value;
+        for (size_t row = 0; row < n; row++)
+            pages[row] = (col_start + ix_arr[row] * bytes_per_value) / page_size;
+        std::sort(pages.begin(), pages.end());
+
+        size_t st = 0;
+        while (st < n)
+        {
+            size_t end = st + 1;
+            while (end < n && pages[end] <= pages[end - 1] + 1) end++;
+            madvise((void*)(pages[st] * page_size), (pages[end - 1] - pages[st] + 1) * page_size, MADV_WILLNEED);
+            st = end;
+        }
+    }
+    #endif
+}
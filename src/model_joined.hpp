@@ -1,5 +1,6 @@
 #include "isotree.hpp"
 
+#include "compile_model.hpp"
 #include "crit.hpp"
 #include "dist.hpp"
 #include "extended.hpp"
@@ -47,6 +47,118 @@
 #define SD_MIN 1e-10
 /* https://www.johndcook.com/blog/standard_deviation/ */
 
+/* When passing 'compensated_sums', the sums for regular numerical columns are accumulated in 'N_SUM_LANES'
+   separate lanes (row 'st + i' goes to lane 'i % N_SUM_LANES') which are added up at the end in a fixed order,
+   so that they can be calculated with SIMD instructions and still produce the same results on every CPU. The
+   lanes use compensated (Neumaier) summation for large inputs, which does not depend on 'long double'. */
+#define N_SUM_LANES 8
+
+template <bool compensated>
+void add_to_lane(double &sum, double &err, double x)
+{
+    if (!compensated)
+    {
+        sum += x;
+        return;
+    }
+
+    double t = sum + x;
+    err += (std::fabs(sum) >= std::fabs(x))? ((sum - t) + x) : ((x - t) + sum);
+    sum = t;
+}
+
+double sum_lanes(double *restrict lanes)
+{
+    return ((lanes[0] + lanes[1]) + (lanes[2] + lanes[3])) + ((lanes[4] + lanes[5]) + (lanes[6] + lanes[7]));
+}
+
+#ifdef HAS_AVX2_DISPATCH
+template <bool compensated>
+__attribute__((target("avx2")))
+void add_to_lanes_avx2(__m256d &sum, __m256d &err, __m256d x)
+{
+    if (!compensated)
+    {
+        sum = _mm256_add_pd(sum, x);
+        return;
+    }
+
+    const __m256d sign_bit = _mm256_set1_pd(-0.);
+    __m256d t = _mm256_add_pd(sum, x);
+    __m256d sum_is_larger = _mm256_cmp_pd(_mm256_andnot_pd(sign_bit, sum), _mm256_andnot_pd(sign_bit, x), _CMP_GE_OQ);
+    err = _mm256_add_pd(err, _mm256_blendv_pd(_mm256_add_pd(_mm256_sub_pd(x, t), sum),
+                                              _mm256_add_pd(_mm256_sub_pd(sum, t), x),
+                                              sum_is_larger));
+    sum = t;
+}
+
+/* Same as 'accumulate_lanes' below, for as many full groups of 'N_SUM_LANES' rows as there are.
+   Returns the row at which it stopped. */
+template <bool compensated, bool squared, class real_t_>
+__attribute__((target("avx2")))
+size_t accumulate_lanes_avx2(size_t *restrict ix_arr, size_t st, size_t end, real_t_ *restrict x,
+                             double center, bool skip_NA, double *restrict sum, double *restrict err, size_t &cnt)
+{
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d vcenter = _mm256_set1_pd(center);
+    __m256d sum1 = _mm256_loadu_pd(sum), sum2 = _mm256_loadu_pd(sum + 4);
+    __m256d err1 = _mm256_loadu_pd(err), err2 = _mm256_loadu_pd(err + 4);
+    size_t row;
+    for (row = st; row + N_SUM_LANES - 1 <= end; row += N_SUM_LANES)
+    {
+        __m256d xval1 = gather_rows_avx2(x, ix_arr + row);
+        __m256d xval2 = gather_rows_avx2(x, ix_arr + row + 4);
+        /* 'x - x' is zero only for finite values */
+        __m256d is_finite1 = _mm256_cmp_pd(_mm256_sub_pd(xval1, xval1), zero, _CMP_EQ_OQ);
+        __m256d is_finite2 = _mm256_cmp_pd(_mm256_sub_pd(xval2, xval2), zero, _CMP_EQ_OQ);
+        if (squared)
+        {
+            xval1 = _mm256_sub_pd(xval1, vcenter);
+            xval2 = _mm256_sub_pd(xval2, vcenter);
+            xval1 = _mm256_mul_pd(xval1, xval1);
+            xval2 = _mm256_mul_pd(xval2, xval2);
+        }
+        if (skip_NA)
+        {
+            xval1 = _mm256_and_pd(xval1, is_finite1);
+            xval2 = _mm256_and_pd(xval2, is_finite2);
+            cnt  += __builtin_popcount(_mm256_movemask_pd(is_finite1))
+                     + __builtin_popcount(_mm256_movemask_pd(is_finite2));
+        }
+        add_to_lanes_avx2<compensated>(sum1, err1, xval1);
+        add_to_lanes_avx2<compensated>(sum2, err2, xval2);
+    }
+    if (!skip_NA) cnt += row - st;
+
+    _mm256_storeu_pd(sum, sum1); _mm256_storeu_pd(sum + 4, sum2);
+    _mm256_storeu_pd(err, err1); _mm256_storeu_pd(err + 4, err2);
+    return row;
+}
+#endif
+
+/* Adds the values 'x[ix_arr[st..end]]' (or their squared differences from 'center') into the lanes
+   of 'sum' and 'err', skipping missing and infinite values if passing 'skip_NA', and increasing
+   'cnt' by the number of values that were added. */
+template <bool compensated, bool squared, class real_t_>
+void accumulate_lanes(size_t *restrict ix_arr, size_t st, size_t end, real_t_ *restrict x,
+                      double center, bool skip_NA, double *restrict sum, double *restrict err, size_t &cnt)
+{
+    size_t row = st;
+    #ifdef HAS_AVX2_DISPATCH
+    if (end - st + 1 >= N_SUM_LANES && cpu_has_avx2())
+        row = accumulate_lanes_avx2<compensated, squared>(ix_arr, st, end, x, center, skip_NA, sum, err, cnt);
+    #endif
+
+    for (; row <= end; row++)
+    {
+        double xval = x[ix_arr[row]];
+        bool take = !skip_NA || !is_na_or_inf(xval);
+        cnt += take;
+        if (squared) xval = square(xval - center);
+        add_to_lane<compensated>(sum[(row - st) % N_SUM_LANES], err[(row - st) % N_SUM_LANES], take? xval : 0.);
+    }
+}
+
 /* for regular numerical */
 template <class real_t, class real_t_>
 void calc_mean_and_sd_t(size_t ix_arr[], size_t st, size_t end, real_t_ *restrict x,
@@ -94,14 +206,49 @@ void calc_mean_and_sd_t(size_t ix_arr[], size_t st, size_t end, real_t_ *restric
     }
 }
 
+/* for regular numerical, with compensated sums */
+template <bool compensated, class real_t_>
+void calc_mean_and_sd_lanes(size_t ix_arr[], size_t st, size_t end, real_t_ *restrict x,
+                            MissingAction missing_action, double &x_sd, double &x_mean)
+{
+    bool skip_NA = missing_action != Fail;
+    double sum[N_SUM_LANES] = {0}, err[N_SUM_LANES] = {0};
+    size_t cnt = 0;
+    accumulate_lanes<compensated, false>(ix_arr, st, end, x, 0., skip_NA, sum, err, cnt);
+    if (!cnt)
+    {
+        x_mean = 0;
+        x_sd   = 0;
+        return;
+    }
+    x_mean = (sum_lanes(sum) + sum_lanes(err)) / (double)cnt;
+
+    std::fill(sum, sum + N_SUM_LANES, 0.);
+    std::fill(err, err + N_SUM_LANES, 0.);
+    cnt = 0;
+    accumulate_lanes<compensated, true>(ix_arr, st, end, x, x_mean, skip_NA, sum, err, cnt);
+    x_sd = std::sqrt((sum_lanes(sum) + sum_lanes(err)) / (double)cnt);
+}
+
 template <class real_t_>
 void calc_mean_and_sd(size_t ix_arr[], size_t st, size_t end, real_t_ *restrict x,
-                      MissingAction missing_action, double &x_sd, double &x_mean)
+                      MissingAction missing_action, bool compensated_sums, double &x_sd, double &x_mean)
 {
-    if (end - st + 1 < THRESHOLD_LONG_DOUBLE)
-        calc_mean_and_sd_t<double, real_t_>(ix_arr, st, end, x, missing_action, x_sd, x_mean);
+    if (compensated_sums)
+    {
+        if (end - st + 1 < THRESHOLD_LONG_DOUBLE)
+            calc_mean_and_sd_lanes<false, real_t_>(ix_arr, st, end, x, missing_action, x_sd, x_mean);
+        else
+            calc_mean_and_sd_lanes<true, real_t_>(ix_arr, st, end, x, missing_action, x_sd, x_mean);
+    }
+
     else
-        calc_mean_and_sd_t<long double, real_t_>(ix_arr, st, end, x, missing_action, x_sd, x_mean);
+    {
+        if (end - st + 1 < THRESHOLD_LONG_DOUBLE)
+            calc_mean_and_sd_t<double, real_t_>(ix_arr, st, end, x, missing_action, x_sd, x_mean);
+        else
+            calc_mean_and_sd_t<long double, real_t_>(ix_arr, st, end, x, missing_action, x_sd, x_mean);
+    }
     x_sd = std::fmax(x_sd, SD_MIN);
 }
 
@@ -44,9 +44,6 @@
 */
 #include "isotree.hpp"
 
-/* TODO: implement a faster predict function for CSC matrices that would
-   take the observations down the tree with an array of row indices. */
-
 
 /* Predict outlier score, average depth, or terminal node numbers
 * 
@@ -87,6 +84,16 @@
 *       of columns to which the model was fit, and when using column-major order, must have
 *       the same number of columns as the data to which the model was fit (i.e. cannot have
 *       new columns).
+* - ld_numeric
+*       Leading dimension of 'numeric_data', i.e. the distance (in number of entries) between the start
+*       of one column and the start of the next one when using column-major order, or between the start
+*       of one row and the start of the next one when using row-major order. Passing a value larger than
+*       'nrows' (column-major) or 'ncols_numeric' (row-major) allows making predictions on a slice of a
+*       larger array without copying it. Pass zero to assume that the data is contiguous.
+*       Ignored when the data is sparse.
+* - ld_categ
+*       Leading dimension of 'categ_data', with the same meaning as 'ld_numeric'. Pass zero to assume
+*       that the data is contiguous.
 * - Xc[nnz]
 *       Pointer to numeric data in sparse numeric matrix in CSC format (column-compressed).
 *       Pass NULL if there are no sparse numeric columns.
@@ -140,66 +147,136 @@
 *       Note that the mapping between tree node and terminal tree node is not stored in
 *       the model object for efficiency reasons, so this mapping will be determined on-the-fly
 *       when passing this parameter, and as such, there will be some overhead regardless of
-*       the actual number of rows. Pass NULL if only average depths or outlier scores are desired.
+*       the actual number of rows, unless passing 'terminal_mapping'. Pass NULL if only average
+*       depths or outlier scores are desired.
+* - terminal_mapping
+*       Pointer to a mapping from tree nodes to terminal node numbers for this same model, as
+*       produced by function 'build_terminal_mapping'. If passed, the terminal node numbers will be
+*       mapped right after passing each block of rows through a tree, without the overhead of
+*       determining the mapping on-the-fly. Pass NULL if not available or if not passing 'tree_num'.
 */
 template <class real_t, class sparse_ix>
 void predict_iforest(real_t numeric_data[], int categ_data[],
                      bool is_col_major, size_t ncols_numeric, size_t ncols_categ,
+                     size_t ld_numeric, size_t ld_categ,
                      real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
                      real_t Xr[], sparse_ix Xr_ind[], sparse_ix Xr_indptr[],
                      size_t nrows, int nthreads, bool standardize,
                      IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
-                     double output_depths[],   sparse_ix tree_num[])
+                     double output_depths[],   sparse_ix tree_num[],
+                     TerminalNodeMapping *terminal_mapping)
 {
     /* put data in a struct for passing it in fewer lines */
     PredictionData<real_t, sparse_ix>
                    prediction_data = {numeric_data, categ_data, nrows,
                                       is_col_major, ncols_numeric, ncols_categ,
+                                      ld_numeric? ld_numeric : (is_col_major? nrows : ncols_numeric),
+                                      ld_categ?   ld_categ   : (is_col_major? nrows : ncols_categ),
                                       Xc, Xc_ind, Xc_indptr,
                                       Xr, Xr_ind, Xr_indptr};
 
     if ((size_t)nthreads > nrows)
         nthreads = nrows;
 
+    /* rows are taken in blocks which pass through one tree before moving on to
+       the next, so that each tree is read once per block instead of once per row */
+    size_t block_size = get_predict_block_size(nrows, nthreads);
+    size_t nblocks = (nrows + block_size - 1) / block_size;
+
     if (model_outputs != NULL)
     {
+        size_t ntrees = model_outputs->trees.size();
         if (
             model_outputs->missing_action == Fail &&
             (model_outputs->new_cat_action != Weighted || prediction_data.categ_data == NULL) &&
             prediction_data.Xc_indptr == NULL && prediction_data.Xr_indptr == NULL
             )
         {
-            #pragma omp parallel for schedule(static) num_threads(nthreads) shared(nrows, model_outputs, prediction_data, output_depths, tree_num)
-            for (size_t_for row = 0; row < nrows; row++)
+            #pragma omp parallel for schedule(static) num_threads(nthreads) shared(nrows, nblocks, block_size, ntrees, model_outputs, prediction_data, output_depths, tree_num, terminal_mapping)
+            for (size_t_for block = 0; block < nblocks; block++)
+            {
+                size_t row_end = std::min(nrows, (block + 1) * block_size);
+                for (size_t tree = 0; tree < ntrees; tree++)
+                {
+                    for (size_t row = block * block_size; row < row_end; row++)
+                    {
+                        traverse_itree_no_recurse(model_outputs->trees[tree],
+                                                  *model_outputs,
+                                                  prediction_data,
+                                                  output_depths[row],
+                                                  (tree_num == NULL)? NULL : tree_num + nrows * tree,
+                                                  row);
+                    }
+
+                    if (tree_num != NULL && terminal_mapping != NULL)
+                        map_terminal_nodes(*terminal_mapping, tree, tree_num + nrows * tree, block * block_size, row_end);
+                }
+            }
+        }
+
+        else if (
+            prediction_data.Xc_indptr != NULL &&
+            model_outputs->missing_action != Divide &&
+            (model_outputs->new_cat_action != Weighted || prediction_data.categ_data == NULL)
+            )
+        {
+            /* rows are taken down each tree together, so here the blocks are made as large as possible */
+            size_t csc_block_size = std::max((size_t)1, (nrows + (size_t)nthreads - 1) / (size_t)std::max(nthreads, 1));
+            size_t csc_nblocks = (nrows + csc_block_size - 1) / csc_block_size;
+            #pragma omp parallel for schedule(static) num_threads(nthreads) shared(nrows, csc_nblocks, csc_block_size, ntrees, model_outputs, prediction_data, output_depths, tree_num, terminal_mapping)
+            for (size_t_for block = 0; block < csc_nblocks; block++)
             {
-                for (std::vector<IsoTree> &tree : model_outputs->trees)
+                size_t row_st  = block * csc_block_size;
+                size_t row_end = std::min(nrows, (block + 1) * csc_block_size);
+                std::vector<size_t> ix_arr(row_end - row_st);
+                std::vector<size_t> buffer(row_end - row_st);
+                std::vector<double> range_penalty(row_end - row_st);
+                for (size_t tree = 0; tree < ntrees; tree++)
                 {
-                    traverse_itree_no_recurse(tree,
-                                              *model_outputs,
-                                              prediction_data,
-                                              output_depths[row],
-                                              (tree_num == NULL)? NULL : tree_num + nrows * (&tree - &(model_outputs->trees[0])),
-                                              (size_t) row);
+                    std::iota(ix_arr.begin(), ix_arr.end(), row_st);
+                    std::fill(range_penalty.begin(), range_penalty.end(), 0.);
+                    traverse_itree_csc(model_outputs->trees[tree],
+                                       *model_outputs,
+                                       prediction_data,
+                                       ix_arr.data(),
+                                       buffer.data(),
+                                       range_penalty.data(),
+                                       row_st,
+                                       (size_t)0,
+                                       ix_arr.size() - 1,
+                                       (size_t)0,
+                                       output_depths,
+                                       (tree_num == NULL)? NULL : tree_num + nrows * tree);
+
+                    if (tree_num != NULL && terminal_mapping != NULL)
+                        map_terminal_nodes(*terminal_mapping, tree, tree_num + nrows * tree, row_st, row_end);
                 }
             }
         }
 
         else
         {
-            #pragma omp parallel for schedule(static) num_threads(nthreads) shared(nrows, model_outputs, prediction_data, output_depths, tree_num)
-            for (size_t_for row = 0; row < nrows; row++)
+            #pragma omp parallel for schedule(static) num_threads(nthreads) shared(nrows, nblocks, block_size, ntrees, model_outputs, prediction_data, output_depths, tree_num, terminal_mapping)
+            for (size_t_for block = 0; block < nblocks; block++)
             {
-                for (std::vector<IsoTree> &tree : model_outputs->trees)
+                size_t row_end = std::min(nrows, (block + 1) * block_size);
+                for (size_t tree = 0; tree < ntrees; tree++)
                 {
-                    output_depths[row] += traverse_itree(tree,
-                                                         *model_outputs,
-                                                         prediction_data,
-                                                         (std::vector<ImputeNode>*)NULL,
-                                                         (ImputedData<sparse_ix>*)NULL,
-                                                         (double)0,
-                                                         (size_t) row,
-                                                         (tree_num == NULL)? NULL : tree_num + nrows * (&tree - &(model_outputs->trees[0])),
-                                                         (size_t) 0);
+                    for (size_t row = block * block_size; row < row_end; row++)
+                    {
+                        output_depths[row] += traverse_itree(model_outputs->trees[tree],
+                                                             *model_outputs,
+                                                             prediction_data,
+                                                             (std::vector<ImputeNode>*)NULL,
+                                                             (ImputedData<sparse_ix>*)NULL,
+                                                             (double)0,
+                                                             row,
+                                                             (tree_num == NULL)? NULL : tree_num + nrows * tree,
+                                                             (size_t) 0);
+                    }
+
+                    if (tree_num != NULL && terminal_mapping != NULL)
+                        map_terminal_nodes(*terminal_mapping, tree, tree_num + nrows * tree, block * block_size, row_end);
                 }
             }
         }
@@ -208,6 +285,7 @@ void predict_iforest(real_t numeric_data[], int categ_data[],
 
     else
     {
+        size_t ntrees = model_outputs_ext->hplanes.size();
         if (
             model_outputs_ext->missing_action == Fail &&
             prediction_data.categ_data == NULL &&
@@ -215,36 +293,50 @@ void predict_iforest(real_t numeric_data[], int categ_data[],
             prediction_data.Xr_indptr == NULL
             )
         {
-            #pragma omp parallel for schedule(static) num_threads(nthreads) shared(nrows, model_outputs_ext, prediction_data, output_depths, tree_num)
-            for (size_t_for row = 0; row < nrows; row++)
+            #pragma omp parallel for schedule(static) num_threads(nthreads) shared(nrows, nblocks, block_size, ntrees, model_outputs_ext, prediction_data, output_depths, tree_num, terminal_mapping)
+            for (size_t_for block = 0; block < nblocks; block++)
             {
-                for (std::vector<IsoHPlane> &hplane : model_outputs_ext->hplanes)
+                size_t row_end = std::min(nrows, (block + 1) * block_size);
+                for (size_t tree = 0; tree < ntrees; tree++)
                 {
-                    traverse_hplane_fast(hplane,
-                                         *model_outputs_ext,
-                                         prediction_data,
-                                         output_depths[row],
-                                         (tree_num == NULL)? NULL : tree_num + nrows * (&hplane - &(model_outputs_ext->hplanes[0])),
-                                         (size_t) row);
+                    for (size_t row = block * block_size; row < row_end; row++)
+                    {
+                        traverse_hplane_fast(model_outputs_ext->hplanes[tree],
+                                             *model_outputs_ext,
+                                             prediction_data,
+                                             output_depths[row],
+                                             (tree_num == NULL)? NULL : tree_num + nrows * tree,
+                                             row);
+                    }
+
+                    if (tree_num != NULL && terminal_mapping != NULL)
+                        map_terminal_nodes(*terminal_mapping, tree, tree_num + nrows * tree, block * block_size, row_end);
                 }
             }
         }
 
         else
         {
-            #pragma omp parallel for schedule(static) num_threads(nthreads) shared(nrows, model_outputs_ext, prediction_data, output_depths, tree_num)
-            for (size_t_for row = 0; row < nrows; row++)
+            #pragma omp parallel for schedule(static) num_threads(nthreads) shared(nrows, nblocks, block_size, ntrees, model_outputs_ext, prediction_data, output_depths, tree_num, terminal_mapping)
+            for (size_t_for block = 0; block < nblocks; block++)
             {
-                for (std::vector<IsoHPlane> &hplane : model_outputs_ext->hplanes)
+                size_t row_end = std::min(nrows, (block + 1) * block_size);
+                for (size_t tree = 0; tree < ntrees; tree++)
                 {
-                    traverse_hplane(hplane,
-                                    *model_outputs_ext,
-                                    prediction_data,
-                                    output_depths[row],
-                                    (std::vector<ImputeNode>*)NULL,
-                                    (ImputedData<sparse_ix>*)NULL,
-                                    (tree_num == NULL)? NULL : tree_num + nrows * (&hplane - &(model_outputs_ext->hplanes[0])),
-                                    (size_t) row);
+                    for (size_t row = block * block_size; row < row_end; row++)
+                    {
+                        traverse_hplane(model_outputs_ext->hplanes[tree],
+                                        *model_outputs_ext,
+                                        prediction_data,
+                                        output_depths[row],
+                                        (std::vector<ImputeNode>*)NULL,
+                                        (ImputedData<sparse_ix>*)NULL,
+                                        (tree_num == NULL)? NULL : tree_num + nrows * tree,
+                                        row);
+                    }
+
+                    if (tree_num != NULL && terminal_mapping != NULL)
+                        map_terminal_nodes(*terminal_mapping, tree, tree_num + nrows * tree, block * block_size, row_end);
                 }
             }
         }
@@ -277,13 +369,603 @@ void predict_iforest(real_t numeric_data[], int categ_data[],
     /* re-map tree numbers to start at zero (if predicting tree numbers) */
     /* Note: usually this type of 'prediction' is not required,
        thus this mapping is not stored in the model objects so as to
-       save memory */
-    if (tree_num != NULL)
+       save memory - it can however be passed in 'terminal_mapping' */
+    if (tree_num != NULL && terminal_mapping == NULL)
         remap_terminal_trees(model_outputs, model_outputs_ext,
                              prediction_data, tree_num, nthreads);
 }
 
 
+/* Determine which rows have an outlier score above a given threshold, stopping early for a row
+* 
+* Will pass the rows through the trees in the same order as 'predict_iforest', but once the depths
+* obtained so far for a given row plus the smallest and largest depths that the remaining trees could
+* possibly produce (which are determined from their terminal nodes, accounting for range penalties)
+* leave no doubt about which side of the threshold the row will end up in, the remaining trees are
+* not evaluated for that row. Rows that are undecided until the last tree get the same score as
+* in 'predict_iforest'. This is typically much faster when most rows are clearly inliers.
+* 
+* Parameters
+* ==========
+* - numeric_data[nrows * ncols_numeric]
+*       Pointer to numeric data for which to make predictions. See the documentation of
+*       'predict_iforest' for details.
+* - categ_data[nrows * ncols_categ]
+*       Pointer to categorical data for which to make predictions. See the documentation of
+*       'predict_iforest' for details.
+* - is_col_major
+*       Whether 'numeric_data' and 'categ_data' come in column-major order.
+* - ncols_numeric
+*       Number of columns in 'numeric_data'.
+* - ncols_categ
+*       Number of columns in 'categ_data'.
+* - ld_numeric
+*       Leading dimension of 'numeric_data'. See the documentation of 'predict_iforest' for details.
+*       Pass zero to assume that the data is contiguous.
+* - ld_categ
+*       Leading dimension of 'categ_data'. Pass zero to assume that the data is contiguous.
+* - Xc[nnz], Xc_ind[nnz], Xc_indptr[ncols_numeric + 1]
+*       Sparse numeric data in CSC format, if the data is sparse. Pass NULL otherwise.
+* - Xr[nnz], Xr_ind[nnz], Xr_indptr[nrows + 1]
+*       Sparse numeric data in CSR format, if the data is sparse. Pass NULL otherwise.
+* - nrows
+*       Number of rows in 'numeric_data', 'Xc', 'Xr, 'categ_data'.
+* - nthreads
+*       Number of parallel threads to use. Ignored when not building with OpenMP support.
+* - threshold
+*       Threshold against which to compare the rows. If 'standardize' is 'true', this is an outlier
+*       score (between zero and one), and rows will be flagged when their score is strictly higher
+*       than it. If 'standardize' is 'false', this is an average depth, and rows will be flagged when
+*       their average depth is strictly lower than it.
+* - standardize
+*       Whether 'threshold' refers to standardized outlier scores or to average depths.
+* - model_outputs
+*       Pointer to fitted single-variable model object from function 'fit_iforest'. Pass NULL
+*       if the predictions are to be made from an extended model. Can only pass one of
+*       'model_outputs' and 'model_outputs_ext'.
+* - model_outputs_ext
+*       Pointer to fitted extended model object from function 'fit_iforest'. Pass NULL
+*       if the predictions are to be made from a single-variable model. Can only pass one of
+*       'model_outputs' and 'model_outputs_ext'.
+* - output_is_outlier[nrows] (out)
+*       Pointer to array where it will be written whether each row lies beyond the threshold.
+* - ntrees_used[nrows] (out)
+*       Pointer to array where the number of trees that were evaluated for each row will be
+*       written into. Pass NULL if not desired.
+*/
+template <class real_t, class sparse_ix>
+void predict_iforest_threshold(real_t numeric_data[], int categ_data[],
+                               bool is_col_major, size_t ncols_numeric, size_t ncols_categ,
+                               size_t ld_numeric, size_t ld_categ,
+                               real_t Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                               real_t Xr[], sparse_ix Xr_ind[], sparse_ix Xr_indptr[],
+                               size_t nrows, int nthreads, double threshold, bool standardize,
+                               IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                               bool output_is_outlier[], sparse_ix ntrees_used[])
+{
+    PredictionData<real_t, sparse_ix>
+                   prediction_data = {numeric_data, categ_data, nrows,
+                                      is_col_major, ncols_numeric, ncols_categ,
+                                      ld_numeric? ld_numeric : (is_col_major? nrows : ncols_numeric),
+                                      ld_categ?   ld_categ   : (is_col_major? nrows : ncols_categ),
+                                      Xc, Xc_ind, Xc_indptr,
+                                      Xr, Xr_ind, Xr_indptr};
+
+    if ((size_t)nthreads > nrows)
+        nthreads = nrows;
+
+    bool use_fast_path = can_use_fast_traversal(model_outputs, model_outputs_ext, prediction_data);
+    size_t ntrees = (model_outputs != NULL)? model_outputs->trees.size() : model_outputs_ext->hplanes.size();
+    double exp_avg_depth = (model_outputs != NULL)? model_outputs->exp_avg_depth : model_outputs_ext->exp_avg_depth;
+
+    /* the threshold is compared against the sum of depths across trees */
+    double depth_threshold = standardize? (-std::log2(threshold) * exp_avg_depth * (double)ntrees)
+                                        : (threshold * (double)ntrees);
+
+    /* bounds for the sum of depths that the trees from a given one onwards can add */
+    std::vector<double> remaining_min(ntrees + 1);
+    std::vector<double> remaining_max(ntrees + 1);
+    std::vector<double> tree_min(ntrees), tree_max(ntrees);
+    #pragma omp parallel num_threads(nthreads) shared(ntrees, model_outputs, model_outputs_ext, tree_min, tree_max)
+    {
+        std::vector<double> node_penalty;
+        #pragma omp for schedule(static)
+        for (size_t_for tree = 0; tree < ntrees; tree++)
+        {
+            if (model_outputs != NULL)
+                get_tree_depth_bounds(model_outputs->trees[tree], tree_min[tree], tree_max[tree], node_penalty);
+            else
+                get_tree_depth_bounds(model_outputs_ext->hplanes[tree], tree_min[tree], tree_max[tree], node_penalty);
+        }
+    }
+    remaining_min[ntrees] = 0;
+    remaining_max[ntrees] = 0;
+    for (size_t tree = ntrees; tree > 0; tree--)
+    {
+        remaining_min[tree - 1] = remaining_min[tree] + tree_min[tree - 1];
+        remaining_max[tree - 1] = remaining_max[tree] + tree_max[tree - 1];
+    }
+
+    size_t block_size = get_predict_block_size(nrows, nthreads);
+    size_t nblocks = (nrows + block_size - 1) / block_size;
+    std::vector<double> depths(nrows, 0.);
+
+    #pragma omp parallel num_threads(nthreads) shared(nrows, nblocks, block_size, ntrees, model_outputs, model_outputs_ext, prediction_data, use_fast_path, depth_threshold, remaining_min, remaining_max, depths, output_is_outlier, ntrees_used)
+    {
+        /* rows in the block which haven't been decided yet */
+        std::vector<size_t> undecided;
+
+        #pragma omp for schedule(static)
+        for (size_t_for block = 0; block < nblocks; block++)
+        {
+            size_t row_end = std::min(nrows, (block + 1) * block_size);
+            undecided.resize(row_end - block * block_size);
+            std::iota(undecided.begin(), undecided.end(), (size_t)(block * block_size));
+
+            size_t tree;
+            for (tree = 0; tree < ntrees && undecided.size(); tree++)
+            {
+                for (size_t row : undecided)
+                    add_tree_depth(model_outputs, model_outputs_ext, prediction_data, use_fast_path,
+                                   tree, row, depths[row], (sparse_ix*)NULL);
+
+                /* the last tree is left for the exact comparison below */
+                if (tree == ntrees - 1)
+                    continue;
+
+                size_t n_undecided = 0;
+                for (size_t row : undecided)
+                {
+                    if (depths[row] + remaining_max[tree + 1] < depth_threshold)
+                        output_is_outlier[row] = true;
+                    else if (depths[row] + remaining_min[tree + 1] >= depth_threshold)
+                        output_is_outlier[row] = false;
+                    else
+                    {
+                        undecided[n_undecided++] = row;
+                        continue;
+                    }
+
+                    if (ntrees_used != NULL)
+                        ntrees_used[row] = tree + 1;
+                }
+                undecided.resize(n_undecided);
+            }
+
+            /* rows which went through all the trees get compared in the same way as in 'predict_iforest' */
+            for (size_t row : undecided)
+            {
+                if (standardize)
+                    output_is_outlier[row] = std::exp2( - depths[row] / ((double)ntrees * exp_avg_depth) ) > threshold;
+                else
+                    output_is_outlier[row] = (depths[row] / (double)ntrees) < threshold;
+                if (ntrees_used != NULL)
+                    ntrees_used[row] = ntrees;
+            }
+        }
+    }
+}
+
+
+/* Whether the rows can be passed through the trees with the functions that don't handle missing values,
+   sparse inputs or weighted categorical splits, under the same conditions as in 'predict_iforest' */
+template <class PredictionData>
+bool can_use_fast_traversal(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext, PredictionData &prediction_data)
+{
+    if (model_outputs != NULL)
+        return model_outputs->missing_action == Fail &&
+               (model_outputs->new_cat_action != Weighted || prediction_data.categ_data == NULL) &&
+               prediction_data.Xc_indptr == NULL && prediction_data.Xr_indptr == NULL;
+    else
+        return model_outputs_ext->missing_action == Fail &&
+               prediction_data.categ_data == NULL &&
+               prediction_data.Xc_indptr == NULL && prediction_data.Xr_indptr == NULL;
+}
+
+/* Adds the depth of a row in a single tree, for functions which don't pass all rows through the same trees */
+template <class PredictionData, class sparse_ix>
+void add_tree_depth(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                    PredictionData &prediction_data, bool use_fast_path,
+                    size_t tree, size_t row, double &output_depth, sparse_ix *restrict tree_num)
+{
+    if (model_outputs != NULL)
+    {
+        if (use_fast_path)
+            traverse_itree_no_recurse(model_outputs->trees[tree],
+                                      *model_outputs,
+                                      prediction_data,
+                                      output_depth,
+                                      tree_num,
+                                      row);
+        else
+            output_depth += traverse_itree(model_outputs->trees[tree],
+                                           *model_outputs,
+                                           prediction_data,
+                                           (std::vector<ImputeNode>*)NULL,
+                                           (ImputedData<sparse_ix>*)NULL,
+                                           (double)0,
+                                           row,
+                                           tree_num,
+                                           (size_t) 0);
+    }
+
+    else
+    {
+        if (use_fast_path)
+            traverse_hplane_fast(model_outputs_ext->hplanes[tree],
+                                 *model_outputs_ext,
+                                 prediction_data,
+                                 output_depth,
+                                 tree_num,
+                                 row);
+        else
+            traverse_hplane(model_outputs_ext->hplanes[tree],
+                            *model_outputs_ext,
+                            prediction_data,
+                            output_depth,
+                            (std::vector<ImputeNode>*)NULL,
+                            (ImputedData<sparse_ix>*)NULL,
+                            tree_num,
+                            row);
+    }
+}
+
+
+/* Predict outlier score, average depth, or terminal node numbers from a compiled model
+* 
+* Parameters
+* ==========
+* - numeric_data[nrows * ncols_numeric]
+*       Pointer to numeric data for which to make predictions. May be ordered by rows
+*       (i.e. entries 1..n contain row 0, n+1..2n row 1, etc.) - a.k.a. row-major - or by
+*       columns (i.e. entries 1..n contain column 0, n+1..2n column 1, etc.) - a.k.a. column-major
+*       (see parameter 'is_col_major'). Only dense data is supported.
+*       Pass NULL if there are no numeric columns.
+* - categ_data[nrows * ncols_categ]
+*       Pointer to categorical data for which to make predictions, in the same order as
+*       'numeric_data'. See the documentation of 'predict_iforest' for the encoding.
+*       Pass NULL if there are no categorical columns.
+* - is_col_major
+*       Whether 'numeric_data' and 'categ_data' come in column-major order. If passing 'false',
+*       will assume they are in row-major order, which is the preferred order here.
+* - ncols_numeric
+*       Number of columns in 'numeric_data'. Ignored when the data comes in column-major order.
+* - ncols_categ
+*       Number of columns in 'categ_data'. Ignored when the data comes in column-major order.
+* - ld_numeric
+*       Leading dimension of 'numeric_data'. See the documentation of 'predict_iforest' for details.
+*       Pass zero to assume that the data is contiguous.
+* - ld_categ
+*       Leading dimension of 'categ_data'. Pass zero to assume that the data is contiguous.
+* - nrows
+*       Number of rows in 'numeric_data' and 'categ_data'.
+* - nthreads
+*       Number of parallel threads to use. Ignored when not building with OpenMP support.
+* - standardize
+*       Whether to standardize the average depths for each row according to their relative magnitude
+*       compared to the expected average, in order to obtain an outlier score. If passing 'false',
+*       will output the average depth instead.
+* - compiled_model
+*       Pointer to compiled single-variable model object from function 'compile_isoforest'.
+*       Pass NULL if the predictions are to be made from an extended model. Can only pass one
+*       of 'compiled_model' and 'compiled_model_ext'.
+*       Models quantized through 'quantize_compiled_model' are not accepted here - these
+*       can only be used through 'predict_iforest_mixed'.
+* - compiled_model_ext
+*       Pointer to compiled extended model object from function 'compile_ext_isoforest'.
+*       Pass NULL if the predictions are to be made from a single-variable model. Can only pass
+*       one of 'compiled_model' and 'compiled_model_ext'.
+* - output_depths[nrows] (out)
+*       Pointer to array where the output average depths or outlier scores will be written into.
+*       Must already be initialized to zeros.
+* - tree_num[nrows * ntrees] (out)
+*       Pointer to array where the output terminal node numbers will be written into.
+*       Unlike in 'predict_iforest', the numbers are stored in the compiled model, so
+*       this output has no additional overhead. Pass NULL if not desired.
+*/
+template <class real_t, class sparse_ix>
+void predict_iforest_compiled(real_t numeric_data[], int categ_data[],
+                              bool is_col_major, size_t ncols_numeric, size_t ncols_categ,
+                              size_t ld_numeric, size_t ld_categ,
+                              size_t nrows, int nthreads, bool standardize,
+                              CompiledIsoForest *compiled_model, CompiledExtIsoForest *compiled_model_ext,
+                              double output_depths[], sparse_ix tree_num[])
+{
+    if (compiled_model != NULL && compiled_model->col_format.size())
+        throw std::runtime_error("Quantized compiled models can only be used through 'predict_iforest_mixed'.\n");
+
+    if ((size_t)nthreads > nrows)
+        nthreads = nrows;
+
+    if (!ld_numeric) ld_numeric = is_col_major? nrows : ncols_numeric;
+    if (!ld_categ)   ld_categ   = is_col_major? nrows : ncols_categ;
+
+    size_t block_size = get_predict_block_size(nrows, nthreads);
+    size_t nblocks = (nrows + block_size - 1) / block_size;
+    size_t rows_per_group = get_compiled_rows_per_group(compiled_model, numeric_data, is_col_major? ld_numeric : 1);
+
+    #pragma omp parallel for schedule(static) num_threads(nthreads) shared(numeric_data, categ_data, is_col_major, ld_numeric, ld_categ, nrows, nblocks, block_size, rows_per_group, compiled_model, compiled_model_ext, output_depths, tree_num)
+    for (size_t_for block = 0; block < nblocks; block++)
+        predict_compiled_rows(numeric_data, categ_data, is_col_major, ld_numeric, ld_categ, nrows,
+                              block * block_size, std::min(nrows, (block + 1) * block_size), rows_per_group,
+                              compiled_model, compiled_model_ext, output_depths, tree_num);
+
+    size_t ntrees = (compiled_model != NULL)? compiled_model->tree_root.size() : compiled_model_ext->tree_root.size();
+    double exp_avg_depth = (compiled_model != NULL)? compiled_model->exp_avg_depth : compiled_model_ext->exp_avg_depth;
+    double depth_divisor = (double)ntrees * exp_avg_depth;
+    if (standardize)
+        #pragma omp parallel for schedule(static) num_threads(nthreads) shared(nrows, output_depths, depth_divisor)
+        for (size_t_for row = 0; row < nrows; row++)
+            output_depths[row] = std::exp2( - output_depths[row] / depth_divisor );
+    else
+        #pragma omp parallel for schedule(static) num_threads(nthreads) shared(nrows, output_depths, ntrees)
+        for (size_t_for row = 0; row < nrows; row++)
+            output_depths[row] /= (double)ntrees;
+}
+
+/* When there are only numeric splits, rows can go down the trees in groups */
+template <class real_t>
+size_t get_compiled_rows_per_group(CompiledIsoForest *compiled_model, real_t *numeric_data, size_t col_stride)
+{
+    #ifdef HAS_AVX2_DISPATCH
+    if (
+        cpu_has_avx2() &&
+        (compiled_model == NULL || !compiled_model->cat_splits.size()) &&
+        numeric_data != NULL &&
+        col_stride <= (size_t)UINT32_MAX
+        )
+        return 8;
+    #endif
+    return 1;
+}
+
+/* Passes rows 'row_st' through 'row_end' (not inclusive) through all the trees of a compiled model, one tree
+   at a time, adding their depths to 'output_depths' and setting their terminal nodes in 'tree_num'.
+   'ld_numeric' and 'ld_categ' are the leading dimensions of the data, which must already be determined. */
+template <class real_t, class sparse_ix>
+void predict_compiled_rows(real_t *restrict numeric_data, int *restrict categ_data,
+                           bool is_col_major, size_t ld_numeric, size_t ld_categ, size_t nrows,
+                           size_t row_st, size_t row_end, size_t rows_per_group,
+                           CompiledIsoForest *compiled_model, CompiledExtIsoForest *compiled_model_ext,
+                           double *restrict output_depths, sparse_ix *restrict tree_num)
+{
+    size_t ntrees = (compiled_model != NULL)? compiled_model->tree_root.size() : compiled_model_ext->tree_root.size();
+    size_t numeric_stride = is_col_major? ld_numeric : 1;
+    size_t categ_stride = is_col_major? ld_categ : 1;
+    size_t row_end_groups = row_st;
+    if (rows_per_group > 1)
+        row_end_groups += rows_per_group * ((row_end - row_st) / rows_per_group);
+    size_t terminal_node;
+
+    for (size_t tree = 0; tree < ntrees; tree++)
+    {
+        #ifdef HAS_AVX2_DISPATCH
+        if (rows_per_group > 1)
+        {
+            size_t terminal_nodes[8];
+            for (size_t row = row_st; row < row_end_groups; row += rows_per_group)
+            {
+                if (compiled_model != NULL)
+                    traverse_compiled_itree_avx2(*compiled_model, tree, numeric_data,
+                                                 row, is_col_major? 1 : ld_numeric, numeric_stride,
+                                                 output_depths + row, terminal_nodes);
+                else
+                    traverse_compiled_hplane_avx2(*compiled_model_ext, tree, numeric_data,
+                                                  row, is_col_major? 1 : ld_numeric, numeric_stride,
+                                                  output_depths + row, terminal_nodes);
+                if (tree_num != NULL)
+                    for (size_t lane = 0; lane < rows_per_group; lane++)
+                        tree_num[row + lane + nrows * tree] = terminal_nodes[lane];
+            }
+        }
+        #endif
+
+        for (size_t row = row_end_groups; row < row_end; row++)
+        {
+            if (compiled_model != NULL)
+                traverse_compiled_itree(*compiled_model, tree,
+                                        (numeric_data == NULL)? (real_t*)NULL :
+                                            (numeric_data + (is_col_major? row : row * ld_numeric)),
+                                        (categ_data == NULL)? (int*)NULL :
+                                            (categ_data + (is_col_major? row : row * ld_categ)),
+                                        numeric_stride, categ_stride, output_depths[row], terminal_node);
+            else
+                traverse_compiled_hplane(*compiled_model_ext, tree,
+                                         numeric_data + (is_col_major? row : row * ld_numeric),
+                                         numeric_stride, output_depths[row], terminal_node);
+            if (tree_num != NULL)
+                tree_num[row + nrows * tree] = terminal_node;
+        }
+    }
+}
+
+/* Predict outlier score, average depth, or terminal node numbers with a prepared predictor object
+* 
+* Parameters
+* ==========
+* - predictor
+*       Object prepared from a fitted model through function 'prepare_predictor'.
+* - numeric_data[nrows * ncols_numeric]
+*       Pointer to numeric data for which to make predictions, in the same format as for
+*       'predict_iforest_compiled'. Only dense data is supported.
+*       Pass NULL if there are no numeric columns.
+* - categ_data[nrows * ncols_categ]
+*       Pointer to categorical data for which to make predictions, in the same format as for
+*       'predict_iforest_compiled'. Pass NULL if there are no categorical columns.
+* - is_col_major
+*       Whether 'numeric_data' and 'categ_data' come in column-major order.
+* - ncols_numeric
+*       Number of columns in 'numeric_data'. Ignored when the data comes in column-major order.
+* - ncols_categ
+*       Number of columns in 'categ_data'. Ignored when the data comes in column-major order.
+* - nrows
+*       Number of rows in 'numeric_data' and 'categ_data'. If this is lower than the predictor's
+*       'min_rows_parallel', the rows will be scored in the calling thread, without any memory
+*       allocations, otherwise this will call 'predict_iforest_compiled' or 'predict_iforest'.
+* - standardize
+*       Whether to standardize the average depths for each row according to their relative magnitude
+*       compared to the expected average, in order to obtain an outlier score. If passing 'false',
+*       will output the average depth instead.
+* - output_depths[nrows] (out)
+*       Pointer to array where the output average depths or outlier scores will be written into.
+*       Must already be initialized to zeros.
+* - tree_num[nrows * ntrees] (out)
+*       Pointer to array where the output terminal node numbers will be written into.
+*       Pass NULL if not desired.
+*/
+template <class real_t, class sparse_ix>
+void predict_iforest_predictor(IsoForestPredictor &predictor,
+                               real_t numeric_data[], int categ_data[],
+                               bool is_col_major, size_t ncols_numeric, size_t ncols_categ,
+                               size_t nrows, bool standardize,
+                               double output_depths[], sparse_ix tree_num[])
+{
+    IsoForest    *model_outputs     = predictor.model_outputs;
+    ExtIsoForest *model_outputs_ext = predictor.model_outputs_ext;
+    CompiledIsoForest    *compiled_model     = (model_outputs != NULL)? &predictor.compiled_model : NULL;
+    CompiledExtIsoForest *compiled_model_ext = (model_outputs != NULL)? NULL : &predictor.compiled_model_ext;
+
+    if (predictor.is_compiled && compiled_model != NULL && compiled_model->col_format.size())
+        throw std::runtime_error("Quantized compiled models can only be used through 'predict_iforest_mixed'.\n");
+
+    if (nrows >= predictor.min_rows_parallel && predictor.nthreads > 1)
+    {
+        if (predictor.is_compiled)
+            predict_iforest_compiled(numeric_data, categ_data,
+                                     is_col_major, ncols_numeric, ncols_categ,
+                                     (size_t)0, (size_t)0,
+                                     nrows, predictor.nthreads, standardize,
+                                     compiled_model, compiled_model_ext,
+                                     output_depths, tree_num);
+        else
+            predict_iforest(numeric_data, categ_data,
+                            is_col_major, ncols_numeric, ncols_categ,
+                            (size_t)0, (size_t)0,
+                            (real_t*)NULL, (sparse_ix*)NULL, (sparse_ix*)NULL,
+                            (real_t*)NULL, (sparse_ix*)NULL, (sparse_ix*)NULL,
+                            nrows, predictor.nthreads, standardize,
+                            model_outputs, model_outputs_ext,
+                            output_depths, tree_num, &predictor.terminal_mapping);
+        return;
+    }
+
+    size_t ntrees;
+    double exp_avg_depth;
+    if (predictor.is_compiled)
+    {
+        ntrees = (compiled_model != NULL)? compiled_model->tree_root.size() : compiled_model_ext->tree_root.size();
+        exp_avg_depth = (compiled_model != NULL)? compiled_model->exp_avg_depth : compiled_model_ext->exp_avg_depth;
+        predict_compiled_rows(numeric_data, categ_data, is_col_major,
+                              is_col_major? nrows : ncols_numeric, is_col_major? nrows : ncols_categ, nrows,
+                              (size_t)0, nrows,
+                              get_compiled_rows_per_group(compiled_model, numeric_data, is_col_major? nrows : 1),
+                              compiled_model, compiled_model_ext, output_depths, tree_num);
+    }
+
+    else
+    {
+        PredictionData<real_t, sparse_ix>
+                       prediction_data = {numeric_data, categ_data, nrows,
+                                          is_col_major, ncols_numeric, ncols_categ,
+                                          is_col_major? nrows : ncols_numeric,
+                                          is_col_major? nrows : ncols_categ,
+                                          NULL, NULL, NULL,
+                                          NULL, NULL, NULL};
+        bool use_fast_path = can_use_fast_traversal(model_outputs, model_outputs_ext, prediction_data);
+        ntrees = (model_outputs != NULL)? model_outputs->trees.size() : model_outputs_ext->hplanes.size();
+        exp_avg_depth = (model_outputs != NULL)? model_outputs->exp_avg_depth : model_outputs_ext->exp_avg_depth;
+        for (size_t tree = 0; tree < ntrees; tree++)
+        {
+            for (size_t row = 0; row < nrows; row++)
+                add_tree_depth(model_outputs, model_outputs_ext, prediction_data, use_fast_path,
+                               tree, row, output_depths[row],
+                               (tree_num == NULL)? (sparse_ix*)NULL : (tree_num + nrows * tree));
+
+            if (tree_num != NULL)
+                map_terminal_nodes(predictor.terminal_mapping, tree, tree_num + nrows * tree, (size_t)0, nrows);
+        }
+    }
+
+    if (standardize)
+        for (size_t row = 0; row < nrows; row++)
+            output_depths[row] = std::exp2( - output_depths[row] / ((double)ntrees * exp_avg_depth) );
+    else
+        for (size_t row = 0; row < nrows; row++)
+            output_depths[row] /= (double)ntrees;
+}
+
+/* Predict outlier score, average depth, or terminal node numbers from a quantized compiled model,
+   on data in which each numeric column can come in a different format
+* 
+* Parameters
+* ==========
+* - numeric_cols[ncols_numeric]
+*       Pointers to the numeric columns of the data, each of them being an array with 'nrows' entries
+*       in the format that was specified for that column in 'quantize_compiled_model' (e.g. 'uint16_t*'
+*       holding the bits of half-precision numbers for 'ColFloat16', 'int8_t*' for 'ColInt8'). The
+*       columns are read as they are, without converting them to double precision beforehand.
+*       Pass NULL if there are no numeric columns.
+* - categ_data[nrows * ncols_categ]
+*       Pointer to categorical data in column-major order. See the documentation of 'predict_iforest'
+*       for the encoding. Pass NULL if there are no categorical columns.
+* - nrows
+*       Number of rows in the data.
+* - nthreads
+*       Number of parallel threads to use. Ignored when not building with OpenMP support.
+* - standardize
+*       Whether to output standardized outlier scores or average depths.
+* - compiled_model
+*       Compiled single-variable model, quantized through function 'quantize_compiled_model'.
+* - output_depths[nrows] (out)
+*       Pointer to array where the output average depths or outlier scores will be written into.
+*       Must already be initialized to zeros.
+* - tree_num[nrows * ntrees] (out)
+*       Pointer to array where the output terminal node numbers will be written into.
+*       Pass NULL if not desired.
+*/
+template <class sparse_ix>
+void predict_iforest_mixed(void *numeric_cols[], int categ_data[], size_t nrows, int nthreads, bool standardize,
+                           CompiledIsoForest &compiled_model, double output_depths[], sparse_ix tree_num[])
+{
+    if (!compiled_model.col_format.size())
+        throw std::runtime_error("Compiled model must be quantized through 'quantize_compiled_model'.\n");
+
+    if ((size_t)nthreads > nrows)
+        nthreads = nrows;
+
+    size_t ntrees = compiled_model.tree_root.size();
+    size_t block_size = get_predict_block_size(nrows, nthreads);
+    size_t nblocks = (nrows + block_size - 1) / block_size;
+    size_t terminal_node;
+
+    #pragma omp parallel for schedule(static) num_threads(nthreads) private(terminal_node) shared(numeric_cols, categ_data, nrows, nblocks, block_size, ntrees, compiled_model, output_depths, tree_num)
+    for (size_t_for block = 0; block < nblocks; block++)
+    {
+        size_t row_end = std::min(nrows, (block + 1) * block_size);
+        for (size_t tree = 0; tree < ntrees; tree++)
+        {
+            for (size_t row = block * block_size; row < row_end; row++)
+            {
+                traverse_compiled_itree_mixed(compiled_model, tree, numeric_cols, categ_data, nrows, row,
+                                              output_depths[row], terminal_node);
+                if (tree_num != NULL)
+                    tree_num[row + nrows * tree] = terminal_node;
+            }
+        }
+    }
+
+    double depth_divisor = (double)ntrees * compiled_model.exp_avg_depth;
+    if (standardize)
+        #pragma omp parallel for schedule(static) num_threads(nthreads) shared(nrows, output_depths, depth_divisor)
+        for (size_t_for row = 0; row < nrows; row++)
+            output_depths[row] = std::exp2( - output_depths[row] / depth_divisor );
+    else
+        #pragma omp parallel for schedule(static) num_threads(nthreads) shared(nrows, output_depths, ntrees)
+        for (size_t_for row = 0; row < nrows; row++)
+            output_depths[row] /= (double)ntrees;
+}
+
+
 template <class PredictionData, class sparse_ix>
 void traverse_itree_no_recurse(std::vector<IsoTree>  &tree,
                                IsoForest             &model_outputs,
@@ -313,9 +995,9 @@ void traverse_itree_no_recurse(std::vector<IsoTree>  &tree,
                 {
                     xval =  prediction_data.numeric_data[
                                 prediction_data.is_col_major?
-                                (row +  tree[curr_lev].col_num * prediction_data.nrows)
+                                (row +  tree[curr_lev].col_num * prediction_data.ld_numeric)
                                     :
-                                (tree[curr_lev].col_num + row * prediction_data.ncols_numeric)
+                                (tree[curr_lev].col_num + row * prediction_data.ld_numeric)
                             ];
                     curr_lev = (xval <= tree[curr_lev].num_split)?
                                 tree[curr_lev].tree_left : tree[curr_lev].tree_right;
@@ -327,9 +1009,9 @@ void traverse_itree_no_recurse(std::vector<IsoTree>  &tree,
                 {
                     cval =  prediction_data.categ_data[
                                 prediction_data.is_col_major?
-                                (row +  tree[curr_lev].col_num * prediction_data.nrows)
+                                (row +  tree[curr_lev].col_num * prediction_data.ld_categ)
                                     :
-                                (tree[curr_lev].col_num + row * prediction_data.ncols_categ)
+                                (tree[curr_lev].col_num + row * prediction_data.ld_categ)
                             ];
                     switch(model_outputs.cat_split_type)
                     {
@@ -395,6 +1077,455 @@ void traverse_itree_no_recurse(std::vector<IsoTree>  &tree,
     }
 }
 
+/* The range penalties are added in the same order as in 'traverse_itree_no_recurse' or 'traverse_itree'
+   (according to the missing action), so that the results are exactly the same as in the original model */
+template <class real_t>
+void traverse_compiled_itree(CompiledIsoForest     &compiled_model,
+                             size_t                tree,
+                             real_t *restrict      numeric_row,
+                             int    *restrict      categ_row,
+                             size_t                numeric_stride,
+                             size_t                categ_stride,
+                             double                &output_depth,
+                             size_t                &terminal_node)
+{
+    const CompiledNode *restrict nodes = compiled_model.nodes.data();
+    const bool has_range_penalty = compiled_model.range_low.size() > 0;
+    const bool penalize_in_place = compiled_model.missing_action == Fail;
+    size_t curr_node = compiled_model.tree_root[tree];
+    double range_penalty = 0;
+    double xval;
+    int    cval;
+    bool   go_right;
+
+    while (nodes[curr_node].child_left)
+    {
+        const CompiledNode &node = nodes[curr_node];
+        if (!(node.col_num & COMPILED_CATEG_FLAG))
+        {
+            xval = numeric_row[(size_t)(node.col_num & COMPILED_COL_MASK) * numeric_stride];
+            go_right = !(xval <= node.split_point);
+            if (isnan(xval))
+                go_right = !(node.col_num & COMPILED_NA_LEFT_FLAG);
+            curr_node = (size_t)node.child_left + go_right;
+
+            if (has_range_penalty)
+            {
+                if (penalize_in_place)
+                    output_depth  -= (xval < compiled_model.range_low[curr_node]) || (xval > compiled_model.range_high[curr_node]);
+                else
+                    range_penalty += (xval < compiled_model.range_low[curr_node]) || (xval > compiled_model.range_high[curr_node]);
+            }
+        }
+
+        else
+        {
+            cval = categ_row[(size_t)(node.col_num & COMPILED_COL_MASK) * categ_stride];
+            const CompiledCategSplit &split = compiled_model.cat_splits[(size_t)node.split_point];
+            if (cval < 0)
+                go_right = !(node.col_num & COMPILED_NA_LEFT_FLAG);
+            else if (!split.ncat)
+                go_right = cval != split.chosen_cat;
+            else if (cval >= split.ncat)
+                go_right = !split.new_to_left;
+            else
+                go_right = !extract_bit(compiled_model.cat_bits[split.offset + cval / 64], cval % 64);
+            curr_node = (size_t)node.child_left + go_right;
+        }
+    }
+
+    output_depth += nodes[curr_node].split_point - range_penalty;
+    terminal_node = nodes[curr_node].col_num;
+}
+
+/* Reads entry 'row' of a numeric column passed in any of the formats from 'NumericColFormat' */
+double read_numeric_col(void *column, NumericColFormat format, size_t row)
+{
+    switch(format)
+    {
+        case ColFloat64:  return ((double*)column)[row];
+        case ColFloat32:  return ((float*)column)[row];
+        case ColFloat16:  return half_to_float(((uint16_t*)column)[row]);
+        case ColBFloat16: return bfloat16_to_float(((uint16_t*)column)[row]);
+        case ColInt8:     return ((int8_t*)column)[row];
+        case ColUInt8:    return ((uint8_t*)column)[row];
+        case ColInt16:    return ((int16_t*)column)[row];
+        case ColUInt16:   return ((uint16_t*)column)[row];
+    }
+    return NAN;
+}
+
+/* Same as 'traverse_compiled_itree', but for a quantized model on data with one array per numeric column,
+   in which integer columns get compared against the quantized split points as they are */
+void traverse_compiled_itree_mixed(CompiledIsoForest     &compiled_model,
+                                   size_t                tree,
+                                   void                  *numeric_cols[],
+                                   int    *restrict      categ_data,
+                                   size_t                nrows,
+                                   size_t                row,
+                                   double                &output_depth,
+                                   size_t                &terminal_node)
+{
+    const CompiledNode *restrict nodes = compiled_model.nodes.data();
+    const NumericColFormat *restrict col_format = compiled_model.col_format.data();
+    const bool has_range_penalty = compiled_model.range_low.size() > 0;
+    const bool penalize_in_place = compiled_model.missing_action == Fail;
+    size_t curr_node = compiled_model.tree_root[tree];
+    size_t col;
+    double range_penalty = 0;
+    double xval;
+    int    cval;
+    bool   go_right;
+
+    while (nodes[curr_node].child_left)
+    {
+        const CompiledNode &node = nodes[curr_node];
+        col = node.col_num & COMPILED_COL_MASK;
+        if (!(node.col_num & COMPILED_CATEG_FLAG))
+        {
+            xval = read_numeric_col(numeric_cols[col], col_format[col], row);
+            go_right = !(xval <= node.split_point);
+            if (isnan(xval))
+                go_right = !(node.col_num & COMPILED_NA_LEFT_FLAG);
+            curr_node = (size_t)node.child_left + go_right;
+
+            if (has_range_penalty)
+            {
+                if (penalize_in_place)
+                    output_depth  -= (xval < compiled_model.range_low[curr_node]) || (xval > compiled_model.range_high[curr_node]);
+                else
+                    range_penalty += (xval < compiled_model.range_low[curr_node]) || (xval > compiled_model.range_high[curr_node]);
+            }
+        }
+
+        else
+        {
+            cval = categ_data[row + col * nrows];
+            const CompiledCategSplit &split = compiled_model.cat_splits[(size_t)node.split_point];
+            if (cval < 0)
+                go_right = !(node.col_num & COMPILED_NA_LEFT_FLAG);
+            else if (!split.ncat)
+                go_right = cval != split.chosen_cat;
+            else if (cval >= split.ncat)
+                go_right = !split.new_to_left;
+            else
+                go_right = !extract_bit(compiled_model.cat_bits[split.offset + cval / 64], cval % 64);
+            curr_node = (size_t)node.child_left + go_right;
+        }
+    }
+
+    output_depth += nodes[curr_node].split_point - range_penalty;
+    terminal_node = nodes[curr_node].col_num;
+}
+
+#ifdef HAS_AVX2_DISPATCH
+/* Gathers the numeric values for 4 rows at once, leaving zeros in the lanes which are already at a terminal node */
+__attribute__((target("avx2")))
+__m256d gather_numeric_avx2(double *numeric_data, __m256i ix, __m256i active)
+{
+    return _mm256_mask_i64gather_pd(_mm256_setzero_pd(), numeric_data, ix, _mm256_castsi256_pd(active), 8);
+}
+
+__attribute__((target("avx2")))
+__m256d gather_numeric_avx2(float *numeric_data, __m256i ix, __m256i active)
+{
+    __m128i mask = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(active, _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6)));
+    return _mm256_cvtps_pd(_mm256_mask_i64gather_ps(_mm_setzero_ps(), numeric_data, ix, _mm_castsi128_ps(mask), 4));
+}
+
+/* Same as 'traverse_compiled_itree', but takes 8 rows down the tree at the same time (as two
+   independent groups of 4, so that the gathers from one can overlap with the other), for models
+   without categorical splits. Rows are at 'numeric_data + (row_st + lane) * row_step'. Lanes
+   that reach a terminal node stay there until all of them have finished. */
+template <class real_t>
+__attribute__((target("avx2")))
+void traverse_compiled_itree_avx2(CompiledIsoForest     &compiled_model,
+                                  size_t                tree,
+                                  real_t *restrict      numeric_data,
+                                  size_t                row_st,
+                                  size_t                row_step,
+                                  size_t                col_stride,
+                                  double *restrict      output_depths,
+                                  size_t *restrict      terminal_nodes)
+{
+    static_assert(sizeof(CompiledNode) == 16, "Unexpected padding in 'CompiledNode'.");
+    const double    *split_point = (const double*) compiled_model.nodes.data();
+    const long long *node_info   = (const long long*) ((const char*)compiled_model.nodes.data() + offsetof(CompiledNode, col_num));
+    const bool has_range_penalty = compiled_model.range_low.size() > 0;
+    const bool penalize_in_place = compiled_model.missing_action == Fail;
+    const bool has_na_left       = compiled_model.missing_action == Impute;
+
+    const __m256i ones     = _mm256_set1_epi64x(-1);
+    const __m256i one      = _mm256_set1_epi64x(1);
+    const __m256i col_mask = _mm256_set1_epi64x(COMPILED_COL_MASK);
+    const __m256i na_flag  = _mm256_set1_epi64x(COMPILED_NA_LEFT_FLAG);
+    const __m256i stride   = _mm256_set1_epi64x(col_stride);
+
+    __m256i row_offs[2], curr_node[2], node_pos[2], info[2], child_left[2], active[2], go_right[2];
+    __m256d xval[2], split[2], range_low, range_high, penalty, depth[2], range_penalty[2];
+    for (int group = 0; group < 2; group++)
+    {
+        size_t row = row_st + 4 * group;
+        row_offs[group]  = _mm256_setr_epi64x(row * row_step,       (row + 1) * row_step,
+                                              (row + 2) * row_step, (row + 3) * row_step);
+        curr_node[group] = _mm256_set1_epi64x(compiled_model.tree_root[tree]);
+        depth[group]     = _mm256_loadu_pd(output_depths + 4 * group);
+        range_penalty[group] = _mm256_setzero_pd();
+    }
+
+    while (true)
+    {
+        for (int group = 0; group < 2; group++)
+        {
+            node_pos[group]   = _mm256_add_epi64(curr_node[group], curr_node[group]);
+            info[group]       = _mm256_i64gather_epi64(node_info, node_pos[group], 8);
+            child_left[group] = _mm256_srli_epi64(info[group], 32);
+            active[group]     = _mm256_xor_si256(_mm256_cmpeq_epi64(child_left[group], _mm256_setzero_si256()), ones);
+        }
+        if (_mm256_testz_si256(active[0], active[0]) && _mm256_testz_si256(active[1], active[1]))
+            break;
+
+        for (int group = 0; group < 2; group++)
+        {
+            xval[group]  = gather_numeric_avx2(numeric_data,
+                                               _mm256_add_epi64(row_offs[group],
+                                                                _mm256_mul_epu32(_mm256_and_si256(info[group], col_mask), stride)),
+                                               active[group]);
+            split[group] = _mm256_i64gather_pd(split_point, node_pos[group], 8);
+        }
+
+        for (int group = 0; group < 2; group++)
+        {
+            go_right[group] = _mm256_castpd_si256(_mm256_cmp_pd(xval[group], split[group], _CMP_NLE_UQ));
+            if (has_na_left)
+            {
+                __m256i is_na   = _mm256_castpd_si256(_mm256_cmp_pd(xval[group], xval[group], _CMP_UNORD_Q));
+                __m256i na_left = _mm256_cmpeq_epi64(_mm256_and_si256(info[group], na_flag), na_flag);
+                go_right[group] = _mm256_blendv_epi8(go_right[group], _mm256_xor_si256(na_left, ones), is_na);
+            }
+            curr_node[group] = _mm256_blendv_epi8(curr_node[group],
+                                                  _mm256_add_epi64(child_left[group], _mm256_and_si256(go_right[group], one)),
+                                                  active[group]);
+
+            if (has_range_penalty)
+            {
+                range_low  = _mm256_mask_i64gather_pd(_mm256_setzero_pd(), compiled_model.range_low.data(),
+                                                      curr_node[group], _mm256_castsi256_pd(active[group]), 8);
+                range_high = _mm256_mask_i64gather_pd(_mm256_setzero_pd(), compiled_model.range_high.data(),
+                                                      curr_node[group], _mm256_castsi256_pd(active[group]), 8);
+                penalty = _mm256_or_pd(_mm256_cmp_pd(xval[group], range_low, _CMP_LT_OQ),
+                                       _mm256_cmp_pd(xval[group], range_high, _CMP_GT_OQ));
+                penalty = _mm256_and_pd(_mm256_and_pd(penalty, _mm256_castsi256_pd(active[group])), _mm256_set1_pd(1.));
+                if (penalize_in_place)
+                    depth[group] = _mm256_sub_pd(depth[group], penalty);
+                else
+                    range_penalty[group] = _mm256_add_pd(range_penalty[group], penalty);
+            }
+        }
+    }
+
+    alignas(32) long long terminal[4];
+    for (int group = 0; group < 2; group++)
+    {
+        depth[group] = _mm256_add_pd(depth[group],
+                                     _mm256_sub_pd(_mm256_i64gather_pd(split_point, node_pos[group], 8), range_penalty[group]));
+        _mm256_storeu_pd(output_depths + 4 * group, depth[group]);
+        _mm256_store_si256((__m256i*)terminal, info[group]);
+        for (size_t lane = 0; lane < 4; lane++)
+            terminal_nodes[4 * group + lane] = (uint32_t)terminal[lane];
+    }
+}
+#endif
+
+/* Same as 'traverse_hplane_fast' and 'traverse_hplane' for dense numeric data, but with
+   the column means already folded into the split points, ranges, and fill values. Note
+   that the results might differ from the original model in the last digits due to this. */
+template <class real_t>
+void traverse_compiled_hplane(CompiledExtIsoForest  &compiled_model_ext,
+                              size_t                tree,
+                              real_t *restrict      numeric_row,
+                              size_t                col_stride,
+                              double                &output_depth,
+                              size_t                &terminal_node)
+{
+    const CompiledHPlane *restrict hplanes = compiled_model_ext.hplanes.data();
+    const uint32_t *restrict col_num = compiled_model_ext.col_num.data();
+    const double   *restrict coef    = compiled_model_ext.coef.data();
+    const bool has_range_penalty = compiled_model_ext.range_low.size() > 0;
+    const bool impute_missing    = compiled_model_ext.fill_val.size() > 0;
+    size_t curr_node = compiled_model_ext.tree_root[tree];
+    size_t col_end;
+    double hval;
+    double xval;
+
+    while (hplanes[curr_node].child_left)
+    {
+        const CompiledHPlane &node = hplanes[curr_node];
+        col_end = (size_t)node.col_st + (size_t)node.ncols;
+        hval = 0;
+        if (!impute_missing)
+        {
+            for (size_t col = node.col_st; col < col_end; col++)
+                hval += numeric_row[(size_t)col_num[col] * col_stride] * coef[col];
+        }
+
+        else
+        {
+            for (size_t col = node.col_st; col < col_end; col++)
+            {
+                xval  = numeric_row[(size_t)col_num[col] * col_stride];
+                hval += is_na_or_inf(xval)? compiled_model_ext.fill_val[col] : (xval * coef[col]);
+            }
+        }
+
+        if (has_range_penalty)
+            output_depth -= (hval < compiled_model_ext.range_low[curr_node]) ||
+                            (hval > compiled_model_ext.range_high[curr_node]);
+        curr_node = (size_t)node.child_left + !(hval <= node.split_point);
+    }
+
+    output_depth += hplanes[curr_node].split_point;
+    terminal_node = hplanes[curr_node].col_st;
+}
+
+#ifdef HAS_AVX2_DISPATCH
+/* Packs a 64-bit lane mask into the 32-bit lane mask used by the 32-bit gathers */
+__attribute__((target("avx2")))
+__m128i mask_64_to_32_avx2(__m256i mask)
+{
+    return _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(mask, _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6)));
+}
+
+/* Same as 'traverse_compiled_hplane', but takes 8 rows down the tree at the same time in
+   the same way as 'traverse_compiled_itree_avx2'. Each lane only takes as many columns from
+   the hyperplanes as its current node has. */
+template <class real_t>
+__attribute__((target("avx2")))
+void traverse_compiled_hplane_avx2(CompiledExtIsoForest  &compiled_model_ext,
+                                   size_t                tree,
+                                   real_t *restrict      numeric_data,
+                                   size_t                row_st,
+                                   size_t                row_step,
+                                   size_t                col_stride,
+                                   double *restrict      output_depths,
+                                   size_t *restrict      terminal_nodes)
+{
+    static_assert(sizeof(CompiledHPlane) == 24, "Unexpected padding in 'CompiledHPlane'.");
+    const double    *split_point = (const double*) compiled_model_ext.hplanes.data();
+    const long long *node_info   = (const long long*) ((const char*)compiled_model_ext.hplanes.data() + offsetof(CompiledHPlane, col_st));
+    const int       *node_child  = (const int*) ((const char*)compiled_model_ext.hplanes.data() + offsetof(CompiledHPlane, child_left));
+    const int       *col_num     = (const int*) compiled_model_ext.col_num.data();
+    const double    *coef        = compiled_model_ext.coef.data();
+    const double    *fill_val    = compiled_model_ext.fill_val.data();
+    const bool has_range_penalty = compiled_model_ext.range_low.size() > 0;
+    const bool impute_missing    = compiled_model_ext.fill_val.size() > 0;
+
+    const __m256i ones      = _mm256_set1_epi64x(-1);
+    const __m256i one       = _mm256_set1_epi64x(1);
+    const __m256i low_mask  = _mm256_set1_epi64x(UINT32_MAX);
+    const __m256i stride    = _mm256_set1_epi64x(col_stride);
+    const __m256d inf       = _mm256_set1_pd(HUGE_VAL);
+    const __m256d sign_mask = _mm256_set1_pd(-0.);
+
+    __m256i row_offs[2], curr_node[2], node_pos[2], info[2], col_st[2], ncols[2], child_left[2], active[2];
+    __m256i take, pos, col;
+    __m256d hval[2], split[2], depth[2], xval, term, range_low, range_high, penalty;
+    alignas(32) long long ncols_lanes[8];
+    for (int group = 0; group < 2; group++)
+    {
+        size_t row = row_st + 4 * group;
+        row_offs[group]  = _mm256_setr_epi64x(row * row_step,       (row + 1) * row_step,
+                                              (row + 2) * row_step, (row + 3) * row_step);
+        curr_node[group] = _mm256_set1_epi64x(compiled_model_ext.tree_root[tree]);
+        depth[group]     = _mm256_loadu_pd(output_depths + 4 * group);
+    }
+
+    while (true)
+    {
+        for (int group = 0; group < 2; group++)
+        {
+            node_pos[group]   = _mm256_add_epi64(_mm256_add_epi64(curr_node[group], curr_node[group]), curr_node[group]);
+            child_left[group] = _mm256_cvtepu32_epi64(_mm256_i64gather_epi32(node_child,
+                                                                             _mm256_add_epi64(node_pos[group], node_pos[group]),
+                                                                             4));
+            active[group]     = _mm256_xor_si256(_mm256_cmpeq_epi64(child_left[group], _mm256_setzero_si256()), ones);
+        }
+        if (_mm256_testz_si256(active[0], active[0]) && _mm256_testz_si256(active[1], active[1]))
+            break;
+
+        long long max_ncols = 0;
+        for (int group = 0; group < 2; group++)
+        {
+            info[group]   = _mm256_mask_i64gather_epi64(_mm256_setzero_si256(), node_info, node_pos[group], active[group], 8);
+            col_st[group] = _mm256_and_si256(info[group], low_mask);
+            ncols[group]  = _mm256_srli_epi64(info[group], 32);
+            split[group]  = _mm256_mask_i64gather_pd(_mm256_setzero_pd(), split_point, node_pos[group],
+                                                     _mm256_castsi256_pd(active[group]), 8);
+            hval[group]   = _mm256_setzero_pd();
+            _mm256_store_si256((__m256i*)(ncols_lanes + 4 * group), ncols[group]);
+        }
+        for (int lane = 0; lane < 8; lane++)
+            max_ncols = std::max(max_ncols, ncols_lanes[lane]);
+
+        for (long long k = 0; k < max_ncols; k++)
+        {
+            for (int group = 0; group < 2; group++)
+            {
+                take = _mm256_and_si256(_mm256_cmpgt_epi64(ncols[group], _mm256_set1_epi64x(k)), active[group]);
+                pos  = _mm256_add_epi64(col_st[group], _mm256_set1_epi64x(k));
+                col  = _mm256_cvtepu32_epi64(_mm256_mask_i64gather_epi32(_mm_setzero_si128(), col_num, pos,
+                                                                         mask_64_to_32_avx2(take), 4));
+                xval = gather_numeric_avx2(numeric_data,
+                                           _mm256_add_epi64(row_offs[group], _mm256_mul_epu32(col, stride)),
+                                           take);
+                term = _mm256_mul_pd(xval, _mm256_mask_i64gather_pd(_mm256_setzero_pd(), coef, pos,
+                                                                     _mm256_castsi256_pd(take), 8));
+                if (impute_missing)
+                {
+                    __m256d is_na = _mm256_cmp_pd(_mm256_andnot_pd(sign_mask, xval), inf, _CMP_NLT_UQ);
+                    term = _mm256_blendv_pd(term,
+                                            _mm256_mask_i64gather_pd(_mm256_setzero_pd(), fill_val, pos,
+                                                                     _mm256_and_pd(is_na, _mm256_castsi256_pd(take)), 8),
+                                            is_na);
+                }
+                hval[group] = _mm256_add_pd(hval[group], term);
+            }
+        }
+
+        for (int group = 0; group < 2; group++)
+        {
+            if (has_range_penalty)
+            {
+                range_low  = _mm256_mask_i64gather_pd(_mm256_setzero_pd(), compiled_model_ext.range_low.data(),
+                                                      curr_node[group], _mm256_castsi256_pd(active[group]), 8);
+                range_high = _mm256_mask_i64gather_pd(_mm256_setzero_pd(), compiled_model_ext.range_high.data(),
+                                                      curr_node[group], _mm256_castsi256_pd(active[group]), 8);
+                penalty = _mm256_or_pd(_mm256_cmp_pd(hval[group], range_low, _CMP_LT_OQ),
+                                       _mm256_cmp_pd(hval[group], range_high, _CMP_GT_OQ));
+                penalty = _mm256_and_pd(_mm256_and_pd(penalty, _mm256_castsi256_pd(active[group])), _mm256_set1_pd(1.));
+                depth[group] = _mm256_sub_pd(depth[group], penalty);
+            }
+
+            curr_node[group] = _mm256_blendv_epi8(curr_node[group],
+                                                  _mm256_add_epi64(child_left[group],
+                                                                   _mm256_and_si256(_mm256_castpd_si256(_mm256_cmp_pd(hval[group], split[group], _CMP_NLE_UQ)),
+                                                                                    one)),
+                                                  active[group]);
+        }
+    }
+
+    alignas(32) long long terminal[4];
+    for (int group = 0; group < 2; group++)
+    {
+        depth[group] = _mm256_add_pd(depth[group], _mm256_i64gather_pd(split_point, node_pos[group], 8));
+        _mm256_storeu_pd(output_depths + 4 * group, depth[group]);
+        _mm256_store_si256((__m256i*)terminal, _mm256_i64gather_epi64(node_info, node_pos[group], 8));
+        for (size_t lane = 0; lane < 4; lane++)
+            terminal_nodes[4 * group + lane] = (uint32_t)terminal[lane];
+    }
+}
+#endif
+
 enum NumericConfig {DenseRowMajor, DenseColMajor, SparseCSR, SparseCSC};
 
 template <class PredictionData, class sparse_ix, class ImputedData>
@@ -451,13 +1582,13 @@ double traverse_itree(std::vector<IsoTree>     &tree,
                     {
                         case DenseRowMajor:
                         {
-                            xval = prediction_data.numeric_data[tree[curr_lev].col_num + row * prediction_data.ncols_numeric];
+                            xval = prediction_data.numeric_data[tree[curr_lev].col_num + row * prediction_data.ld_numeric];
                             break;
                         }
 
                         case DenseColMajor:
                         {
-                            xval = prediction_data.numeric_data[row +  tree[curr_lev].col_num * prediction_data.nrows];
+                            xval = prediction_data.numeric_data[row +  tree[curr_lev].col_num * prediction_data.ld_numeric];
                             break;
                         }
 
@@ -519,9 +1650,9 @@ double traverse_itree(std::vector<IsoTree>     &tree,
                 {
                     cval =  prediction_data.categ_data[
                                 prediction_data.is_col_major?
-                                (row +  tree[curr_lev].col_num * prediction_data.nrows)
+                                (row +  tree[curr_lev].col_num * prediction_data.ld_categ)
                                     :
-                                (tree[curr_lev].col_num * row * prediction_data.ncols_categ)
+                                (tree[curr_lev].col_num + row * prediction_data.ld_categ)
                             ];
                     if (cval < 0)
                     {
@@ -668,6 +1799,135 @@ double traverse_itree(std::vector<IsoTree>     &tree,
     }
 }
 
+/* Takes the rows at 'ix_arr[st..end]' (inclusive, sorted in ascending order) down a single-variable tree
+   all at once, for numeric data in CSC format. The rows are partitioned at each node while keeping them
+   sorted, so that the non-zero entries of the column used at a node can be matched to them with a single
+   pass over the column, instead of searching for each row separately as done by 'extract_spC'. Supports
+   the same cases as 'traverse_itree' except for those in which a row needs to follow both branches.
+   Range penalties are accumulated in 'range_penalty[row - row_offset]'. */
+template <class PredictionData, class sparse_ix>
+void traverse_itree_csc(std::vector<IsoTree>     &tree,
+                        IsoForest                &model_outputs,
+                        PredictionData           &prediction_data,
+                        size_t *restrict         ix_arr,
+                        size_t *restrict         buffer,
+                        double *restrict         range_penalty,
+                        size_t                   row_offset,
+                        size_t                   st,
+                        size_t                   end,
+                        size_t                   curr_lev,
+                        double *restrict         output_depths,
+                        sparse_ix *restrict      tree_num)
+{
+    if (tree[curr_lev].score >= 0.)
+    {
+        for (size_t row = st; row <= end; row++)
+            output_depths[ix_arr[row]] += tree[curr_lev].score - range_penalty[ix_arr[row] - row_offset];
+        if (tree_num != NULL)
+            for (size_t row = st; row <= end; row++)
+                tree_num[ix_arr[row]] = curr_lev;
+        return;
+    }
+
+    size_t tree_left  = tree[curr_lev].tree_left;
+    size_t tree_right = tree[curr_lev].tree_right;
+    bool   na_left    = tree[curr_lev].pct_tree_left >= .5;
+    size_t n_left = st;
+    size_t n_right = 0;
+    bool   go_right;
+
+    switch(tree[curr_lev].col_type)
+    {
+        case Numeric:
+        {
+            auto *ind_st  = prediction_data.Xc_ind + prediction_data.Xc_indptr[tree[curr_lev].col_num];
+            auto *ind_end = prediction_data.Xc_ind + prediction_data.Xc_indptr[tree[curr_lev].col_num + 1];
+            auto *curr_ind = ind_st;
+            /* when the column has many more entries than there are rows in the node, it is
+               cheaper to search for each row in what's left of the column than to scan it */
+            bool use_search = (size_t)(ind_end - ind_st) > 8 * (end - st + 1);
+            double xval;
+
+            for (size_t row = st; row <= end; row++)
+            {
+                if (use_search)
+                    curr_ind = std::lower_bound(curr_ind, ind_end, ix_arr[row]);
+                else
+                    while (curr_ind < ind_end && (size_t)*curr_ind < ix_arr[row]) curr_ind++;
+                xval = (curr_ind < ind_end && (size_t)*curr_ind == ix_arr[row])?
+                        prediction_data.Xc[curr_ind - prediction_data.Xc_ind] : 0.;
+
+                if (isnan(xval))
+                {
+                    go_right = !na_left;
+                    if (model_outputs.missing_action == Fail)
+                        range_penalty[ix_arr[row] - row_offset] = NAN;
+                }
+
+                else
+                {
+                    go_right = !(xval <= tree[curr_lev].num_split);
+                    size_t child = go_right? tree_right : tree_left;
+                    range_penalty[ix_arr[row] - row_offset] += (xval < tree[child].range_low) || (xval > tree[child].range_high);
+                }
+
+                if (go_right)
+                    buffer[n_right++] = ix_arr[row];
+                else
+                    ix_arr[n_left++] = ix_arr[row];
+            }
+            break;
+        }
+
+        default:
+        {
+            int cval;
+            for (size_t row = st; row <= end; row++)
+            {
+                cval = prediction_data.categ_data[
+                            prediction_data.is_col_major?
+                            (ix_arr[row] + tree[curr_lev].col_num * prediction_data.ld_categ)
+                                :
+                            (tree[curr_lev].col_num + ix_arr[row] * prediction_data.ld_categ)
+                        ];
+
+                if (cval < 0)
+                {
+                    go_right = !na_left;
+                    if (model_outputs.missing_action == Fail)
+                        range_penalty[ix_arr[row] - row_offset] = NAN;
+                }
+
+                else if (model_outputs.cat_split_type == SingleCateg)
+                    go_right = cval != tree[curr_lev].chosen_cat;
+
+                else if (!tree[curr_lev].cat_split.size())
+                    go_right = (cval <= 1)? (cval != 0) : (tree[curr_lev].pct_tree_left >= .5);
+
+                else if (cval >= (int)tree[curr_lev].cat_split.size())
+                    go_right = tree[curr_lev].pct_tree_left >= .5;
+
+                else
+                    go_right = !tree[curr_lev].cat_split[cval];
+
+                if (go_right)
+                    buffer[n_right++] = ix_arr[row];
+                else
+                    ix_arr[n_left++] = ix_arr[row];
+            }
+            break;
+        }
+    }
+
+    std::copy(buffer, buffer + n_right, ix_arr + n_left);
+    if (n_left > st)
+        traverse_itree_csc(tree, model_outputs, prediction_data, ix_arr, buffer, range_penalty, row_offset,
+                           st, n_left - 1, tree_left, output_depths, tree_num);
+    if (n_right)
+        traverse_itree_csc(tree, model_outputs, prediction_data, ix_arr, buffer, range_penalty, row_offset,
+                           n_left, end, tree_right, output_depths, tree_num);
+}
+
 /* this is a simpler version for situations in which there is
    only numeric data in dense arrays and no missing values */
 template <class PredictionData, class sparse_ix>
@@ -697,14 +1957,14 @@ void traverse_hplane_fast(std::vector<IsoHPlane>  &hplane,
             if (prediction_data.is_col_major)
             {
                 for (size_t col = 0; col < hplane[curr_lev].col_num.size(); col++)
-                    hval += (prediction_data.numeric_data[row +  hplane[curr_lev].col_num[col] * prediction_data.nrows] 
+                    hval += (prediction_data.numeric_data[row +  hplane[curr_lev].col_num[col] * prediction_data.ld_numeric] 
                              - hplane[curr_lev].mean[col]) * hplane[curr_lev].coef[col];
             }
 
             else
             {
                 for (size_t col = 0; col < hplane[curr_lev].col_num.size(); col++)
-                    hval += (prediction_data.numeric_data[hplane[curr_lev].col_num[col] + row * prediction_data.ncols_numeric] 
+                    hval += (prediction_data.numeric_data[hplane[curr_lev].col_num[col] + row * prediction_data.ld_numeric] 
                              - hplane[curr_lev].mean[col]) * hplane[curr_lev].coef[col];
             }
         }
@@ -779,13 +2039,13 @@ void traverse_hplane(std::vector<IsoHPlane>   &hplane,
                         {
                             case DenseRowMajor:
                             {
-                                xval = prediction_data.numeric_data[hplane[curr_lev].col_num[col] + row * prediction_data.ncols_numeric];
+                                xval = prediction_data.numeric_data[hplane[curr_lev].col_num[col] + row * prediction_data.ld_numeric];
                                 break;
                             }
 
                             case DenseColMajor:
                             {
-                                xval = prediction_data.numeric_data[row +  hplane[curr_lev].col_num[col] * prediction_data.nrows];
+                                xval = prediction_data.numeric_data[row +  hplane[curr_lev].col_num[col] * prediction_data.ld_numeric];
                                 break;
                             }
 
@@ -829,9 +2089,9 @@ void traverse_hplane(std::vector<IsoHPlane>   &hplane,
                     {
                         cval = prediction_data.categ_data[
                             prediction_data.is_col_major?
-                            (row +  hplane[curr_lev].col_num[col] * prediction_data.nrows)
+                            (row +  hplane[curr_lev].col_num[col] * prediction_data.ld_categ)
                                 :
-                            (hplane[curr_lev].col_num[col] + row * prediction_data.ncols_categ)
+                            (hplane[curr_lev].col_num[col] + row * prediction_data.ld_categ)
                         ];
                         if (cval < 0)
                         {
@@ -942,3 +2202,92 @@ void get_num_nodes(ExtIsoForest &model_outputs, sparse_ix *restrict n_nodes, spa
     }
 }
 
+/* Smallest and largest depth that a row can obtain from a given tree. Besides the scores of the terminal nodes,
+   the lower bound accounts for the range penalties that could be subtracted along the path to each of them
+   (single-variable trees check the range of the node to which they move, extended ones that of the node
+   from which they move). Both also hold when following more than one branch, as that takes a weighted
+   average of the terminal nodes. Assumes that children are always placed after their parents. */
+void get_tree_depth_bounds(std::vector<IsoTree> &tree, double &min_depth, double &max_depth, std::vector<double> &node_penalty)
+{
+    min_depth =  HUGE_VAL;
+    max_depth = -HUGE_VAL;
+    node_penalty.assign(tree.size(), 0.);
+    for (size_t node = 0; node < tree.size(); node++)
+    {
+        if (tree[node].score >= 0)
+        {
+            min_depth = std::fmin(min_depth, tree[node].score - node_penalty[node]);
+            max_depth = std::fmax(max_depth, tree[node].score);
+        }
+
+        else
+        {
+            for (size_t child : {tree[node].tree_left, tree[node].tree_right})
+                node_penalty[child] = node_penalty[node]
+                                        + (double)(!isinf(tree[child].range_low) || !isinf(tree[child].range_high));
+        }
+    }
+}
+
+void get_tree_depth_bounds(std::vector<IsoHPlane> &hplanes, double &min_depth, double &max_depth, std::vector<double> &node_penalty)
+{
+    min_depth =  HUGE_VAL;
+    max_depth = -HUGE_VAL;
+    node_penalty.assign(hplanes.size(), 0.);
+    for (size_t node = 0; node < hplanes.size(); node++)
+    {
+        if (hplanes[node].score > 0)
+        {
+            min_depth = std::fmin(min_depth, hplanes[node].score - node_penalty[node]);
+            max_depth = std::fmax(max_depth, hplanes[node].score);
+        }
+
+        else
+        {
+            double penalty = node_penalty[node]
+                              + (double)(!isinf(hplanes[node].range_low) || !isinf(hplanes[node].range_high));
+            node_penalty[hplanes[node].hplane_left]  = penalty;
+            node_penalty[hplanes[node].hplane_right] = penalty;
+        }
+    }
+}
+
+/* Convert terminal node numbers into a sparse one-hot encoded matrix in CSR format
+* 
+* Parameters
+* ==========
+* - tree_num[nrows * ntrees]
+*       Terminal node numbers as output by the prediction functions.
+* - nrows
+*       Number of rows in 'tree_num'.
+* - terminal_mapping
+*       Mapping for the same model that produced 'tree_num', obtained through function
+*       'build_terminal_mapping'. The output matrix will have a number of columns equal
+*       to the total number of terminal nodes across all trees, with the terminal nodes
+*       of each tree placed after those of the previous tree.
+* - nthreads
+*       Number of parallel threads to use.
+* - indptr[nrows + 1] (out)
+*       Array where the row index pointers of the CSR matrix will be written into.
+*       Each row has exactly one non-zero entry per tree, all of them being equal to one,
+*       so the values of the non-zero entries are not output.
+* - indices[nrows * ntrees] (out)
+*       Array where the column indices of the non-zero entries of the CSR matrix will be
+*       written into. These will be sorted within each row.
+*/
+template <class sparse_ix>
+void get_leaf_embedding(sparse_ix tree_num[], size_t nrows, TerminalNodeMapping &terminal_mapping, int nthreads,
+                        sparse_ix indptr[], sparse_ix indices[])
+{
+    size_t ntrees = terminal_mapping.node_offset.size() - 1;
+    const size_t *restrict terminal_offset = terminal_mapping.terminal_offset.data();
+
+    #pragma omp parallel for schedule(static) num_threads(nthreads) shared(tree_num, nrows, ntrees, terminal_offset, indptr, indices)
+    for (size_t_for row = 0; row < nrows; row++)
+    {
+        indptr[row] = row * ntrees;
+        for (size_t tree = 0; tree < ntrees; tree++)
+            indices[row * ntrees + tree] = terminal_offset[tree] + tree_num[row + nrows * tree];
+    }
+    indptr[nrows] = nrows * ntrees;
+}
@@ -97,6 +97,9 @@ void deserialize_obj(T &output, std::string &serialized, bool move_str)
 * - imputer (in)
 *       An imputer object to serialize, after being fitted through function 'fit_iforest'
 *       with 'build_imputer=true'.
+* - leaf_index (in)
+*       A training leaf index to serialize, after being built through function
+*       'build_training_leaf_index'.
 * - output_obj (out)
 *       An already-allocated object into which a serialized object of the same class will
 *       be de-serialized. The contents of this object will be overwritten. Should be initialized
@@ -215,6 +218,36 @@ void deserialize_imputer(Imputer &output_obj, std::string &serialized, bool move
 }
 
 
+
+
+void serialize_training_leaf_index(TrainingLeafIndex &leaf_index, std::ostream &output)
+{
+    serialize_obj(leaf_index, output);
+}
+void serialize_training_leaf_index(TrainingLeafIndex &leaf_index, const char *output_file_path)
+{
+    std::ofstream output(output_file_path, std::ios::binary);
+    serialize_obj(leaf_index, output);
+}
+std::string serialize_training_leaf_index(TrainingLeafIndex &leaf_index)
+{
+    return serialize_obj(leaf_index);
+}
+void deserialize_training_leaf_index(TrainingLeafIndex &output_obj, std::istream &serialized)
+{
+    deserialize_obj(output_obj, serialized);
+}
+void deserialize_training_leaf_index(TrainingLeafIndex &output_obj, const char *input_file_path)
+{
+    std::ifstream serialized(input_file_path, std::ios::binary);
+    deserialize_obj(output_obj, serialized);
+}
+void deserialize_training_leaf_index(TrainingLeafIndex &output_obj, std::string &serialized, bool move_str)
+{
+    deserialize_obj(output_obj, serialized, move_str);
+}
+
+
 #ifdef _MSC_VER
 void serialize_isoforest(IsoForest &model, const wchar_t *output_file_path)
 {
@@ -246,6 +279,16 @@ void deserialize_imputer(Imputer &output_obj, const wchar_t *input_file_path)
     std::ifstream serialized(input_file_path, std::ios::binary);
     deserialize_obj(output_obj, serialized);
 }
+void serialize_training_leaf_index(TrainingLeafIndex &leaf_index, const wchar_t *output_file_path)
+{
+    std::ofstream output(output_file_path, std::ios::binary);
+    serialize_obj(leaf_index, output);
+}
+void deserialize_training_leaf_index(TrainingLeafIndex &output_obj, const wchar_t *input_file_path)
+{
+    std::ifstream serialized(input_file_path, std::ios::binary);
+    deserialize_obj(output_obj, serialized);
+}
 bool has_msvc()
 {
     return true;
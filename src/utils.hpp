@@ -347,54 +347,153 @@ void increase_comb_counter(size_t ix_arr[], size_t st, size_t end, size_t n,
         }
 }
 
+/* Same as 'increase_comb_counter', but only for the pairs in which the smaller row index is within
+   [row_st, row_end), so that each thread can add into its own block of rows of a shared matrix.
+   Requires 'ix_arr' to be sorted. */
+void increase_comb_counter_in_rows(size_t ix_arr[], size_t st, size_t end, size_t n,
+                                   size_t row_st, size_t row_end, double counter[], double exp_remainder)
+{
+    size_t ncomb = (n * (n - 1)) / 2;
+    size_t el_st  = std::lower_bound(ix_arr + st, ix_arr + end + 1, row_st) - ix_arr;
+    size_t el_end = std::lower_bound(ix_arr + el_st, ix_arr + end + 1, row_end) - ix_arr;
+    if (exp_remainder <= 1)
+        for (size_t el1 = el_st; el1 < el_end; el1++)
+            for (size_t el2 = el1 + 1; el2 <= end; el2++)
+                counter[ix_comb(ix_arr[el1], ix_arr[el2], n, ncomb)]++;
+    else
+        for (size_t el1 = el_st; el1 < el_end; el1++)
+            for (size_t el2 = el1 + 1; el2 <= end; el2++)
+                counter[ix_comb(ix_arr[el1], ix_arr[el2], n, ncomb)] += exp_remainder;
+}
+
+void increase_comb_counter_in_rows(size_t ix_arr[], size_t st, size_t end, size_t n,
+                                   size_t row_st, size_t row_end,
+                                   double *restrict counter, double *restrict weights, double exp_remainder)
+{
+    size_t ncomb = (n * (n - 1)) / 2;
+    size_t el_st  = std::lower_bound(ix_arr + st, ix_arr + end + 1, row_st) - ix_arr;
+    size_t el_end = std::lower_bound(ix_arr + el_st, ix_arr + end + 1, row_end) - ix_arr;
+    if (exp_remainder <= 1)
+        for (size_t el1 = el_st; el1 < el_end; el1++)
+            for (size_t el2 = el1 + 1; el2 <= end; el2++)
+                counter[ix_comb(ix_arr[el1], ix_arr[el2], n, ncomb)]
+                    +=
+                weights[ix_arr[el1]] * weights[ix_arr[el2]];
+    else
+        for (size_t el1 = el_st; el1 < el_end; el1++)
+            for (size_t el2 = el1 + 1; el2 <= end; el2++)
+                counter[ix_comb(ix_arr[el1], ix_arr[el2], n, ncomb)]
+                    +=
+                weights[ix_arr[el1]] * weights[ix_arr[el2]] * exp_remainder;
+}
+
+/* Pairs between rows of the first group within [from_st, from_end) and rows of the second group
+   within [to_st, to_end), with the groups split at 'split_ix'. Requires 'ix_arr' to be sorted. */
 void increase_comb_counter_in_groups(size_t ix_arr[], size_t st, size_t end, size_t split_ix, size_t n,
+                                     size_t from_st, size_t from_end, size_t to_st, size_t to_end,
                                      double counter[], double exp_remainder)
 {
-    size_t n_group = 0;
-    for (size_t ix = st; ix <= end; ix++)
-        if (ix_arr[ix] < split_ix)
-            n_group++;
-        else
-            break;
+    size_t *ix_end = ix_arr + end + 1;
+    size_t el1_st  = std::lower_bound(ix_arr + st, ix_end, from_st) - ix_arr;
+    size_t el1_end = std::lower_bound(ix_arr + el1_st, ix_end, from_end) - ix_arr;
+    size_t el2_st  = std::lower_bound(ix_arr + el1_end, ix_end, to_st) - ix_arr;
+    size_t el2_end = std::lower_bound(ix_arr + el2_st, ix_end, to_end) - ix_arr;
 
     n = n - split_ix;
 
     if (exp_remainder <= 1)
-        for (size_t ix1 = st; ix1 < st + n_group; ix1++)
-            for (size_t ix2 = st + n_group; ix2 <= end; ix2++)
+        for (size_t ix1 = el1_st; ix1 < el1_end; ix1++)
+            for (size_t ix2 = el2_st; ix2 < el2_end; ix2++)
                 counter[ix_arr[ix1] * n + ix_arr[ix2] - split_ix]++;
     else
-        for (size_t ix1 = st; ix1 < st + n_group; ix1++)
-            for (size_t ix2 = st + n_group; ix2 <= end; ix2++)
+        for (size_t ix1 = el1_st; ix1 < el1_end; ix1++)
+            for (size_t ix2 = el2_st; ix2 < el2_end; ix2++)
                 counter[ix_arr[ix1] * n + ix_arr[ix2] - split_ix] += exp_remainder;
 }
 
 void increase_comb_counter_in_groups(size_t ix_arr[], size_t st, size_t end, size_t split_ix, size_t n,
+                                     size_t from_st, size_t from_end, size_t to_st, size_t to_end,
                                      double *restrict counter, double *restrict weights, double exp_remainder)
 {
-    size_t n_group = 0;
-    for (size_t ix = st; ix <= end; ix++)
-        if (ix_arr[ix] < split_ix)
-            n_group++;
-        else
-            break;
+    size_t *ix_end = ix_arr + end + 1;
+    size_t el1_st  = std::lower_bound(ix_arr + st, ix_end, from_st) - ix_arr;
+    size_t el1_end = std::lower_bound(ix_arr + el1_st, ix_end, from_end) - ix_arr;
+    size_t el2_st  = std::lower_bound(ix_arr + el1_end, ix_end, to_st) - ix_arr;
+    size_t el2_end = std::lower_bound(ix_arr + el2_st, ix_end, to_end) - ix_arr;
 
     n = n - split_ix;
 
     if (exp_remainder <= 1)
-        for (size_t ix1 = st; ix1 < st + n_group; ix1++)
-            for (size_t ix2 = st + n_group; ix2 <= end; ix2++)
+        for (size_t ix1 = el1_st; ix1 < el1_end; ix1++)
+            for (size_t ix2 = el2_st; ix2 < el2_end; ix2++)
                 counter[ix_arr[ix1] * n + ix_arr[ix2] - split_ix]
                     +=
                 weights[ix_arr[ix1]] * weights[ix_arr[ix2]];
     else
-        for (size_t ix1 = st; ix1 < st + n_group; ix1++)
-            for (size_t ix2 = st + n_group; ix2 <= end; ix2++)
+        for (size_t ix1 = el1_st; ix1 < el1_end; ix1++)
+            for (size_t ix2 = el2_st; ix2 < el2_end; ix2++)
                 counter[ix_arr[ix1] * n + ix_arr[ix2] - split_ix]
                     +=
                 weights[ix_arr[ix1]] * weights[ix_arr[ix2]] * exp_remainder;
 }
 
+/* Same as 'increase_comb_counter', but adding atomically, for when all threads add into the same matrix */
+void increase_comb_counter_atomic(size_t ix_arr[], size_t st, size_t end, size_t n,
+                                  double counter[], double exp_remainder)
+{
+    size_t i, j;
+    size_t ncomb = (n * (n - 1)) / 2;
+    double add = (exp_remainder <= 1)? 1. : exp_remainder;
+    for (size_t el1 = st; el1 < end; el1++)
+    {
+        for (size_t el2 = el1 + 1; el2 <= end; el2++)
+        {
+            i = std::min(ix_arr[el1], ix_arr[el2]);
+            j = std::max(ix_arr[el1], ix_arr[el2]);
+            #pragma omp atomic
+            counter[ix_comb(i, j, n, ncomb)] += add;
+        }
+    }
+}
+
+void increase_comb_counter_atomic(size_t ix_arr[], size_t st, size_t end, size_t n,
+                                  double *restrict counter, double *restrict weights, double exp_remainder)
+{
+    size_t i, j;
+    size_t ncomb = (n * (n - 1)) / 2;
+    double mult = (exp_remainder <= 1)? 1. : exp_remainder;
+    for (size_t el1 = st; el1 < end; el1++)
+    {
+        for (size_t el2 = el1 + 1; el2 <= end; el2++)
+        {
+            i = std::min(ix_arr[el1], ix_arr[el2]);
+            j = std::max(ix_arr[el1], ix_arr[el2]);
+            #pragma omp atomic
+            counter[ix_comb(i, j, n, ncomb)] += weights[i] * weights[j] * mult;
+        }
+    }
+}
+
+void increase_comb_counter_atomic(size_t ix_arr[], size_t st, size_t end, size_t n,
+                                  double counter[], std::unordered_map<size_t, double> &weights, double exp_remainder)
+{
+    size_t i, j;
+    size_t ncomb = (n * (n - 1)) / 2;
+    double mult = (exp_remainder <= 1)? 1. : exp_remainder;
+    double w;
+    for (size_t el1 = st; el1 < end; el1++)
+    {
+        for (size_t el2 = el1 + 1; el2 <= end; el2++)
+        {
+            i = std::min(ix_arr[el1], ix_arr[el2]);
+            j = std::max(ix_arr[el1], ix_arr[el2]);
+            w = weights[i] * weights[j] * mult;
+            #pragma omp atomic
+            counter[ix_comb(i, j, n, ncomb)] += w;
+        }
+    }
+}
+
 void tmat_to_dense(double *restrict tmat, double *restrict dmat, size_t n, bool diag_to_one)
 {
     size_t ncomb = (n * (n - 1)) / 2;
@@ -414,6 +513,73 @@ void tmat_to_dense(double *restrict tmat, double *restrict dmat, size_t n, bool
             dmat[i + i * n] = 0;
 }
 
+/* Number of rows that are passed together through each tree when making predictions.
+   Larger blocks mean each tree is read from memory fewer times, but there should be
+   enough blocks for all threads to get work. */
+size_t get_predict_block_size(size_t nrows, int nthreads)
+{
+    const size_t max_block_size = 256;
+    size_t rows_per_thread = (nthreads > 1)? ((nrows + (size_t)nthreads - 1) / (size_t)nthreads) : nrows;
+    return std::max((size_t)1, std::min(max_block_size, rows_per_thread));
+}
+
+bool cpu_has_avx2()
+{
+    #ifdef HAS_AVX2_DISPATCH
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    return has_avx2;
+    #else
+    return false;
+    #endif
+}
+
+#ifdef HAS_AVX2_DISPATCH
+/* Loads 'x[ix[0]], ..., x[ix[3]]' as doubles */
+__attribute__((target("avx2")))
+__m256d gather_rows_avx2(double *restrict x, size_t *restrict ix)
+{
+    return _mm256_i64gather_pd(x, _mm256_loadu_si256((const __m256i*)ix), 8);
+}
+
+__attribute__((target("avx2")))
+__m256d gather_rows_avx2(float *restrict x, size_t *restrict ix)
+{
+    return _mm256_cvtps_pd(_mm256_i64gather_ps(x, _mm256_loadu_si256((const __m256i*)ix), 4));
+}
+#endif
+
+/* Conversions from 16-bit floating point formats, exact for all values (including subnormals) */
+float half_to_float(uint16_t half)
+{
+    uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+    uint32_t expo = (half >> 10) & 0x1f;
+    uint32_t mant = half & 0x3ff;
+    uint32_t bits;
+    if (expo == 0x1f)
+        bits = sign | 0x7f800000 | (mant << 13);
+    else if (expo)
+        bits = sign | ((expo + 112) << 23) | (mant << 13);
+    else if (!mant)
+        bits = sign;
+    else
+    {
+        expo = 113;
+        while (!(mant & 0x400)) { mant <<= 1; expo--; }
+        bits = sign | (expo << 23) | ((mant & 0x3ff) << 13);
+    }
+    float out;
+    memcpy(&out, &bits, sizeof(float));
+    return out;
+}
+
+float bfloat16_to_float(uint16_t bfloat)
+{
+    uint32_t bits = (uint32_t)bfloat << 16;
+    float out;
+    memcpy(&out, &bits, sizeof(float));
+    return out;
+}
+
 template <class real_t>
 void build_btree_sampler(std::vector<double> &btree_weights, real_t *restrict sample_weights,
                          size_t nrows, size_t &log2_n, size_t &btree_offset)
@@ -441,6 +607,91 @@ void build_btree_sampler(std::vector<double> &btree_weights, real_t *restrict sa
     }
 }
 
+/* Discretizes the dense numeric columns into at most 'max_bins' bins with roughly the same number
+   of observations each, which are then used for evaluating guided splits from bin statistics. Missing
+   values are assigned to 'HIST_NA_BIN'. */
+template <class InputData>
+void bin_numeric_columns(InputData &input_data, size_t max_bins, int nthreads)
+{
+    max_bins = std::min(max_bins, HIST_MAX_BINS);
+    input_data.binned_numeric.resize(input_data.nrows * input_data.ncols_numeric);
+    std::vector<size_t> nbins(input_data.ncols_numeric);
+
+    #pragma omp parallel for schedule(dynamic) num_threads(nthreads) shared(input_data, max_bins, nbins)
+    for (size_t_for col = 0; col < input_data.ncols_numeric; col++)
+    {
+        auto x = input_data.numeric_data + col * input_data.ld_numeric;
+        uint8_t *restrict x_bin = input_data.binned_numeric.data() + col * input_data.nrows;
+
+        std::vector<double> sorted_x;
+        sorted_x.reserve(input_data.nrows);
+        for (size_t row = 0; row < input_data.nrows; row++)
+            if (!isnan(x[row])) sorted_x.push_back(x[row]);
+        std::sort(sorted_x.begin(), sorted_x.end());
+
+        /* a value equal to a bin edge goes to the bin to its right */
+        std::vector<double> edges;
+        for (size_t bin = 1; bin < max_bins; bin++)
+        {
+            size_t pos = (bin * sorted_x.size()) / max_bins;
+            if (pos > 0 && pos < sorted_x.size())
+                edges.push_back(sorted_x[pos]);
+        }
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+        nbins[col] = edges.size() + 1;
+
+        for (size_t row = 0; row < input_data.nrows; row++)
+            x_bin[row] = isnan(x[row])?
+                         HIST_NA_BIN : (uint8_t)(std::upper_bound(edges.begin(), edges.end(), (double)x[row]) - edges.begin());
+    }
+
+    input_data.nbins = nbins.size()? *std::max_element(nbins.begin(), nbins.end()) : 0;
+}
+
+/* Determines whether guided splits should take the numeric columns from orders sorted once per tree,
+   which is exact only when the nodes never send observations to both branches (i.e. there are no
+   missing values to impute or divide). Keeping them sorted requires passing through every column at
+   each split, so it is only done when the columns would otherwise be sorted frequently enough. */
+template <class InputData>
+bool should_presort_numeric(InputData &input_data, ModelParams &model_params)
+{
+    double prob_pick  = model_params.prob_pick_by_gain_avg  + model_params.prob_pick_by_gain_pl;
+    double prob_split = model_params.prob_split_by_gain_avg + model_params.prob_split_by_gain_pl;
+    double cols_sorted_per_node = prob_pick * (double)input_data.ncols_numeric + std::fmin(prob_split, 1. - prob_pick);
+    if (cols_sorted_per_node * std::log2((double)model_params.sample_size) < (double)input_data.ncols_numeric)
+        return false;
+
+    if (model_params.missing_action == Fail)
+        return true;
+
+    for (size_t col = 0; col < input_data.ncols_numeric; col++)
+        for (size_t row = 0; row < input_data.nrows; row++)
+            if (is_na_or_inf(input_data.numeric_data[row + col * input_data.ld_numeric]))
+                return false;
+    for (size_t col = 0; col < input_data.ncols_categ; col++)
+        for (size_t row = 0; row < input_data.nrows; row++)
+            if (input_data.categ_data[row + col * input_data.ld_categ] < 0)
+                return false;
+    return true;
+}
+
+/* Determines whether small nodes should copy their data into contiguous buffers (see 'update_compact_rows').
+   This is only possible when nothing else (weights, sorted orders, imputations, distances) refers to the
+   rows of a node while it is being split, and it only pays off when the data does not fit in the CPU caches. */
+template <class InputData>
+bool should_compact_nodes(InputData &input_data, ModelParams &model_params, bool has_impute_nodes)
+{
+    if (input_data.Xc_indptr != NULL || input_data.binned_numeric.size() || input_data.presort_numeric)
+        return false;
+    if (model_params.missing_action == Divide || model_params.calc_dist || has_impute_nodes)
+        return false;
+    if (input_data.sample_weights != NULL && !input_data.weight_as_sample)
+        return false;
+
+    double bytes_per_row = (double)(input_data.ncols_numeric * sizeof(*input_data.numeric_data) + input_data.ncols_categ * sizeof(int));
+    return (double)input_data.nrows * bytes_per_row >= (double)MIN_BYTES_COMPACT;
+}
+
 template <class real_t>
 void sample_random_rows(std::vector<size_t> &ix_arr, size_t nrows, bool with_replacement,
                         RNG_engine &rnd_generator, std::vector<size_t> &ix_all,
@@ -611,6 +862,115 @@ void sample_random_rows(std::vector<size_t> &ix_arr, size_t nrows, bool with_rep
     }
 }
 
+void StreamReservoirs::initialize(size_t n_reservoirs, size_t res_size, uint64_t seed)
+{
+    this->n_reservoirs = n_reservoirs;
+    this->res_size = res_size;
+    this->n_filled = 0;
+    this->keys.resize(n_reservoirs * res_size);
+    this->next_take.clear();
+    this->next_take.reserve(n_reservoirs);
+    this->rows_taken.clear();
+    this->rnd_generator.seed(seed);
+}
+
+/* Passes a chunk of rows from the stream through the reservoirs. 'cum_weights' holds the cumulative
+   weight of the stream up to and including each row, and 'row_st' is the position of the first row
+   of the chunk in the stream. Rows with zero weight are never taken. */
+void StreamReservoirs::take_rows(double weights[], double cum_weights[], size_t n, size_t row_st)
+{
+    std::uniform_real_distribution<double> runif(std::numeric_limits<double>::min(), 1.);
+    std::greater<std::pair<double, size_t>> is_greater;
+    this->rows_taken.clear();
+
+    /* the amount of weight to skip is such that the next row taken has a key larger than the smallest one */
+    auto add_next_take = [&](size_t reservoir, size_t row)
+    {
+        double log_smallest = this->keys[reservoir * this->res_size].first;
+        double cum_w_next = cum_weights[row] + std::log(runif(this->rnd_generator)) / log_smallest;
+        this->next_take.emplace_back(std::fmax(cum_w_next, std::nextafter(cum_weights[row], HUGE_VAL)), reservoir);
+        std::push_heap(this->next_take.begin(), this->next_take.end(), is_greater);
+    };
+
+    /* the first rows with non-zero weight go into all reservoirs */
+    size_t row = 0;
+    for (; row < n && this->n_filled < this->res_size; row++)
+    {
+        if (weights[row] <= 0) continue;
+        for (size_t reservoir = 0; reservoir < this->n_reservoirs; reservoir++)
+            this->keys[reservoir * this->res_size + this->n_filled] = {std::log(runif(this->rnd_generator)) / weights[row],
+                                                                        row_st + row};
+        this->rows_taken.push_back(row_st + row);
+        this->n_filled++;
+
+        if (this->n_filled == this->res_size)
+        {
+            for (size_t reservoir = 0; reservoir < this->n_reservoirs; reservoir++)
+            {
+                std::make_heap(this->keys.begin() + reservoir * this->res_size,
+                               this->keys.begin() + (reservoir + 1) * this->res_size,
+                               is_greater);
+                add_next_take(reservoir, row);
+            }
+        }
+    }
+
+    /* after that, each row taken replaces the one with the smallest key in its reservoir */
+    while (this->next_take.size() && this->next_take.front().first <= cum_weights[n-1])
+    {
+        std::pop_heap(this->next_take.begin(), this->next_take.end(), is_greater);
+        size_t reservoir = this->next_take.back().second;
+        row = std::lower_bound(cum_weights, cum_weights + n, this->next_take.back().first) - cum_weights;
+        this->next_take.pop_back();
+
+        auto res_st = this->keys.begin() + reservoir * this->res_size;
+        auto res_end = res_st + this->res_size;
+        double min_key_w = std::exp(weights[row] * res_st->first);
+        std::pop_heap(res_st, res_end, is_greater);
+        *(res_end - 1) = {std::log(min_key_w + runif(this->rnd_generator) * (1. - min_key_w)) / weights[row],
+                          row_st + row};
+        std::push_heap(res_st, res_end, is_greater);
+        this->rows_taken.push_back(row_st + row);
+        add_next_take(reservoir, row);
+    }
+}
+
+/* Drops the rows kept from a stream that are no longer in the reservoir of any tree */
+template <class real_t>
+void drop_unused_stream_rows(std::vector<StreamReservoirs> &reservoirs, std::vector<size_t> &kept_rows,
+                             std::vector<real_t> &kept_numeric, std::vector<int> &kept_categ,
+                             std::vector<real_t> &kept_weights, size_t ncols_numeric, size_t ncols_categ,
+                             bool keep_weights)
+{
+    std::vector<size_t> used_rows;
+    for (StreamReservoirs &res : reservoirs)
+        for (size_t reservoir = 0; reservoir < res.n_reservoirs; reservoir++)
+            for (size_t ix = 0; ix < res.n_filled; ix++)
+                used_rows.push_back(res.keys[reservoir * res.res_size + ix].second);
+    std::sort(used_rows.begin(), used_rows.end());
+    used_rows.erase(std::unique(used_rows.begin(), used_rows.end()), used_rows.end());
+
+    /* both are sorted, and all the used rows are among the kept ones */
+    size_t n_used = 0;
+    for (size_t row = 0; row < kept_rows.size() && n_used < used_rows.size(); row++)
+    {
+        if (kept_rows[row] != used_rows[n_used]) continue;
+        kept_rows[n_used] = kept_rows[row];
+        std::copy(kept_numeric.begin() + row * ncols_numeric, kept_numeric.begin() + (row + 1) * ncols_numeric,
+                  kept_numeric.begin() + n_used * ncols_numeric);
+        std::copy(kept_categ.begin() + row * ncols_categ, kept_categ.begin() + (row + 1) * ncols_categ,
+                  kept_categ.begin() + n_used * ncols_categ);
+        if (keep_weights)
+            kept_weights[n_used] = kept_weights[row];
+        n_used++;
+    }
+    kept_rows.resize(n_used);
+    kept_numeric.resize(n_used * ncols_numeric);
+    kept_categ.resize(n_used * ncols_categ);
+    if (keep_weights)
+        kept_weights.resize(n_used);
+}
+
 /* https://stackoverflow.com/questions/57599509/c-random-non-repeated-integers-with-weights */
 template <class real_t>
 void weighted_shuffle(size_t *restrict outp, size_t n, real_t *restrict weights, double *restrict buffer_arr, RNG_engine &rnd_generator)
@@ -1612,6 +1972,11 @@ void get_range(size_t ix_arr[], real_t x[], size_t st, size_t end,
     xmin =  HUGE_VAL;
     xmax = -HUGE_VAL;
 
+    #ifdef HAS_AVX2_DISPATCH
+    if (end - st + 1 >= 16 && cpu_has_avx2())
+        get_range_avx2(ix_arr, x, st, end, xmin, xmax);
+    else
+    #endif
     if (missing_action == Fail)
     {
         for (size_t row = st; row <= end; row++)
@@ -1634,6 +1999,43 @@ void get_range(size_t ix_arr[], real_t x[], size_t st, size_t end,
     unsplittable = (xmin == xmax) || (xmin == HUGE_VAL && xmax == -HUGE_VAL) || isnan(xmin) || isnan(xmax);
 }
 
+#ifdef HAS_AVX2_DISPATCH
+/* Same as above, taking 8 rows at a time. Missing values are skipped regardless of 'missing_action'
+   ('_mm256_min_pd' returns its second argument when the first one is NaN), so the result is the same. */
+template <class real_t>
+__attribute__((target("avx2")))
+void get_range_avx2(size_t *restrict ix_arr, real_t *restrict x, size_t st, size_t end, double &xmin, double &xmax)
+{
+    __m256d min1 = _mm256_set1_pd(xmin), min2 = min1;
+    __m256d max1 = _mm256_set1_pd(xmax), max2 = max1;
+    size_t row;
+    for (row = st; row + 7 <= end; row += 8)
+    {
+        __m256d xval1 = gather_rows_avx2(x, ix_arr + row);
+        __m256d xval2 = gather_rows_avx2(x, ix_arr + row + 4);
+        min1 = _mm256_min_pd(xval1, min1);
+        min2 = _mm256_min_pd(xval2, min2);
+        max1 = _mm256_max_pd(xval1, max1);
+        max2 = _mm256_max_pd(xval2, max2);
+    }
+
+    double lanes_min[4], lanes_max[4];
+    _mm256_storeu_pd(lanes_min, _mm256_min_pd(min1, min2));
+    _mm256_storeu_pd(lanes_max, _mm256_max_pd(max1, max2));
+    for (int lane = 0; lane < 4; lane++)
+    {
+        xmin = std::fmin(xmin, lanes_min[lane]);
+        xmax = std::fmax(xmax, lanes_max[lane]);
+    }
+
+    for (; row <= end; row++)
+    {
+        xmin = std::fmin(xmin, x[ix_arr[row]]);
+        xmax = std::fmax(xmax, x[ix_arr[row]]);
+    }
+}
+#endif
+
 /* for sparse inputs */
 template <class real_t, class sparse_ix>
 void get_range(size_t ix_arr[], size_t st, size_t end, size_t col_num,
@@ -0,0 +1,124 @@
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <iostream>
+#include <cmath>
+#include <string>
+#include <stdexcept>
+#include <cstdlib>
+#include "isotree.hpp"
+
+/*  Checks that the functions which calculate isolation-based distances without going
+    through 'calc_similarity' produce the same distances as it does.
+
+    The models are fit to data with missing values under missing_action=Impute, in
+    which rows with missing values are sent to one branch or the other according to
+    where most of the training rows went at each node.
+
+    Built and run by 'ctest' along with the library. */
+
+static const size_t nrows  = 300;
+static const size_t ncols  = 4;
+static const size_t ntrees = 50;
+static const double tol    = 1e-8;
+
+static size_t tmat_ix(size_t i, size_t j)
+{
+    if (i > j) std::swap(i, j);
+    return i * (2 * nrows - i - 1) / 2 + j - i - 1;
+}
+
+static bool check(bool ok, const std::string &what)
+{
+    if (!ok) std::cerr << "FAILED: " << what << std::endl;
+    return ok;
+}
+
+static bool check_knn(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                      std::vector<double> &X, bool assume_full_distr, const std::string &label)
+{
+    std::vector<double> tmat(nrows * (nrows - 1) / 2, 0);
+    calc_similarity(X.data(), NULL, NULL, NULL, NULL, nrows, 1, assume_full_distr, true,
+                    model_outputs, model_outputs_ext, tmat.data(), NULL, 0);
+
+    size_t k = 5;
+    std::vector<size_t> knn_indptr(nrows + 1), knn_indices(nrows * k);
+    std::vector<double> knn_dist(nrows * k);
+    calc_similarity_knn(X.data(), NULL, NULL, NULL, NULL, nrows, 1, assume_full_distr, true,
+                        model_outputs, model_outputs_ext,
+                        k, knn_indptr.data(), knn_indices.data(), knn_dist.data());
+
+    bool ok = knn_indptr[nrows] > 0;
+    for (size_t row = 0; row < nrows; row++)
+        for (size_t ix = knn_indptr[row]; ix < knn_indptr[row + 1]; ix++)
+            ok &= std::fabs(knn_dist[ix] - tmat[tmat_ix(row, knn_indices[ix])]) <= tol;
+    return check(ok, "calc_similarity_knn vs. calc_similarity (" + label + ")");
+}
+
+static double max_abs_diff(const std::vector<double> &a, const std::vector<double> &b)
+{
+    double diff = 0;
+    for (size_t ix = 0; ix < a.size(); ix++)
+        diff = std::max(diff, std::fabs(a[ix] - b[ix]));
+    return diff;
+}
+
+static bool check_leaf_index(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                             std::vector<double> &X, bool assume_full_distr, const std::string &label)
+{
+    size_t n_from = 40;
+    std::vector<double> tmat(nrows * (nrows - 1) / 2, 0), rmat(n_from * (nrows - n_from), 0);
+    calc_similarity(X.data(), NULL, NULL, NULL, NULL, nrows, 1, assume_full_distr, true,
+                    model_outputs, model_outputs_ext, tmat.data(), NULL, 0);
+    calc_similarity(X.data(), NULL, NULL, NULL, NULL, nrows, 1, assume_full_distr, true,
+                    model_outputs, model_outputs_ext, NULL, rmat.data(), n_from);
+
+    TrainingLeafIndex leaf_index;
+    build_training_leaf_index(X.data(), NULL, NULL, NULL, NULL, nrows, 1,
+                              model_outputs, model_outputs_ext, leaf_index);
+    std::vector<double> tmat_leaf(tmat.size(), 0), rmat_leaf(rmat.size(), 0);
+    calc_similarity_from_leaf_index(leaf_index, model_outputs, model_outputs_ext, 1, assume_full_distr, true,
+                                    tmat_leaf.data(), NULL, 0);
+    calc_similarity_from_leaf_index(leaf_index, model_outputs, model_outputs_ext, 1, assume_full_distr, true,
+                                    NULL, rmat_leaf.data(), n_from);
+
+    return check(max_abs_diff(tmat_leaf, tmat) <= tol, "leaf index 'tmat' vs. calc_similarity (" + label + ")") &
+           check(max_abs_diff(rmat_leaf, rmat) <= tol, "leaf index 'rmat' vs. calc_similarity (" + label + ")");
+}
+
+int main()
+{
+    std::mt19937 rng(1);
+    std::normal_distribution<double> rnorm(0, 1);
+    std::vector<double> X(nrows * ncols);
+    for (size_t ix = 0; ix < X.size(); ix++)
+        X[ix] = (ix % 25)? rnorm(rng) : NAN;
+
+    bool ok = true;
+    for (size_t ndim = 1; ndim <= 2; ndim++)
+    {
+        IsoForest iso;
+        ExtIsoForest iso_ext;
+        IsoForest    *model_outputs     = (ndim == 1)? &iso : NULL;
+        ExtIsoForest *model_outputs_ext = (ndim == 1)? NULL : &iso_ext;
+        fit_iforest(model_outputs, model_outputs_ext, X.data(), ncols,
+                    NULL, 0, NULL, 0, 0, NULL, NULL, NULL,
+                    ndim, 3, Normal, false, NULL, false, false,
+                    nrows, nrows, ntrees, 0, 0, true, false,
+                    false, NULL, NULL, false, NULL, false,
+                    0., 0., 0., 0., 0., 0, false, Impute,
+                    SubSet, Smallest, false, NULL, 0, Higher, Inverse, false,
+                    123, 1);
+
+        for (int assume_full_distr = 0; assume_full_distr <= 1; assume_full_distr++)
+        {
+            std::string label = "ndim=" + std::to_string(ndim) +
+                                (assume_full_distr? ", full distr" : ", not full distr");
+            ok &= check_knn(model_outputs, model_outputs_ext, X, (bool)assume_full_distr, label);
+            ok &= check_leaf_index(model_outputs, model_outputs_ext, X, (bool)assume_full_distr, label);
+        }
+    }
+
+    if (ok) std::cout << "All distance checks passed." << std::endl;
+    return ok? EXIT_SUCCESS : EXIT_FAILURE;
+}